@@ -16,6 +16,7 @@
 #include "Raycaster.h"
 #include "ImGuiRenderer.h"
 #include "LinAlgOps.h"
+#include "Mesh.h"
 
 #include <imgui.h>
 #include <imgui_internal.h>
@@ -46,6 +47,21 @@ namespace
     GLFWwindow* window;
   };
 
+  uint32_t colors[] = {
+    0xffcc0000,0xff9e91cc,0xff5ea5f4,0xff8c8c51,
+    0xffff7547,0xff2b2bcc,0xffe0eded,0xff2d4f2d,
+    0xff707ff9,0xff00a5ff,0xff2175ed,0xff0000ff,
+    0xff8c668c,0xff238e23,0xffaae8ed,0xff445bcc,
+    0xff660033,0xff937c68,0xff33c9ed,0xffd1eded,
+    0xffe5e0af,0xffbfbfbf,0xff00cccc,0xff14448c,
+    0xff8911ed,0xff990066,0xffdd00dd,0xff4763ff,
+    0xff4f2d2d,0xff0099ed,0xff33cc99,0xffc6ed75,
+    0xff4f4f2d,0xff0000cc,0xff5e9e9e,0xffb2ddf4,
+    0xffeded00,0xffccbf00,0xff7fff00,0xffa8a8a8,
+    0xff00cc00,0xffdbf4f4,0xff007fff,0xff7093db,
+    0xfff4f4f4,0xff6b238e,0xff7f0000,0xffed82ed
+  };
+
 }
 
 App::App(Logger l, GLFWwindow* window, uint32_t w, uint32_t h) :
@@ -94,6 +110,34 @@ void App::startFrame()
   imGuiRenderer->startFrame();
 }
 
+TriangleColorRule App::getTriangleColorRule(const Mesh* mesh) const
+{
+  TriangleColorRule rule;
+  rule.color = 0xff888888;
+  rule.selectedColor = 0xffddffff;
+  switch (triangleColor) {
+  case TriangleColor::ModelColor:
+    rule.colors = mesh->triColor;
+    break;
+  case TriangleColor::ObjectId:
+    rule.indices = mesh->TriObjIx;
+    break;
+  case TriangleColor::SmoothingGroup:
+    rule.indices = mesh->triSmoothGroupIx;
+    break;
+  case TriangleColor::TriangleOrder:
+    rule.shift = 8;
+    break;
+  default:
+    break;
+  }
+  if (rule.indices || triangleColor == TriangleColor::TriangleOrder) {
+    rule.palette = colors;
+    rule.paletteSize = ARRAYSIZE(colors);
+  }
+  return rule;
+}
+
 void App::resize(uint32_t w, uint32_t h)
 {
   auto depthFormat = VK_FORMAT_D32_SFLOAT;
@@ -3,6 +3,11 @@
 #include "Common.h"
 #include "RenderSolid.h"
 #include "Tasks.h"
+#include "IndexOptimizer.h"
+#include "MeshIndexing.h"
+#include "HandlePicking.h"
+#include "MeshDerived.h"
+#include "Selection.h"
 
 #if 0
 
@@ -65,7 +70,11 @@ public:
 
   void present();
 
+  // Rule for the triangle colors of a mesh under the current triangleColor choice.
+  TriangleColorRule getTriangleColorRule(const Mesh* mesh) const;
+
   Viewer* viewer;
+  MeshDerivedCache meshDerived;   // Shared by the renderers, declared before tasks to outlive running jobs.
   Tasks tasks;
   bool wasResized = false;
   int width, height;
@@ -82,12 +91,26 @@ public:
   bool viewNormals = false;
   bool viewTangents = false;
 
+  bool useLods = true;
+  float lodPixelError = 1.f;      // Largest screen-space error in pixels when picking a level of detail.
+  IndexOptimizer indexOptimizer = IndexOptimizer::ForsythPartitioned;
+  uint32_t outlineClasses = EdgeAll & ~EdgeInterior;  // EdgeClass bits of the edges drawn as outlines.
+  float outlineCreaseAngle = 30.f;                      // Dihedral angle in degrees above which an edge is a crease.
+
   bool updateColor = true;
   bool selectAll = false;
   bool selectNone = false;
+  bool selectInvert = false;
+  bool selectMatching = false;    // Add the objects whose names match selectPattern.
+  char selectPattern[64] = { '\0' };
   bool viewAll = false;
   bool moveToSelection = false;
   bool picking = false;
+  bool marqueeActive = false;   // Shift-drag in progress, started at marqueeStart.
+  bool marqueeSelect = false;   // Select the objects in the rectangle from marqueeStart to marqueeStop.
+  Vec2f marqueeStart;
+  Vec2f marqueeStop;
+  HitTmp hitTmp;              // Picking BVHs and object bounds, kept between picks.
   unsigned scrollToItem = ~0u;
 
   char fpsString[64] = { '\0' };
@@ -1,8 +1,10 @@
 #include <cassert>
+#include <algorithm>
 #include "Common.h"
 #include "App.h"
 #include "RenderNormals.h"
 #include "Mesh.h"
+#include "MeshLod.h"
 #include "MeshIndexing.h"
 #include "VulkanContext.h"
 #include "RenderTextureManager.h"
@@ -27,13 +29,6 @@ namespace {
 #include "flatPS.glsl.h"
     ;
 
-  struct Vertex {
-    Vec3f p;
-    Vec3f n;
-    uint32_t color;
-    uint32_t dummy;
-  };
-
   struct Vec3fRGBA8
   {
     Vec3f p;
@@ -67,6 +62,24 @@ RenderNormals::~RenderNormals()
 {
 }
 
+void RenderNormals::prepareVertices(Logger logger, Tasks* tasks, MeshDerivedCache* cache, Vector<Vertex>& vertices, const Mesh* mesh, const Selection& selection, IndexOptimizer optimizer)
+{
+  // One normal per unique vertex, using the indexing the solid renderer shares at full detail.
+  auto lod = getLodLevel(mesh, 0);
+  auto indexing = getVertexIndexing(*cache, logger, tasks, mesh, 0, optimizer);
+  const auto & corners = indexing->corners;
+
+  vertices.resize(corners.size());
+  for (uint32_t i = 0; i < corners.size32(); i++) {
+    auto k = corners[i];
+    auto t = lod.sourceTriangle(k / 3);
+    bool selected = selection.get(mesh->TriObjIx ? mesh->TriObjIx[t] : 0);
+    vertices[i].p = mesh->vtx[lod.triVtxIx[k]];
+    vertices[i].n = mesh->nrm[lod.triNrmIx[k]];
+    vertices[i].color = selected ? 0xffff88 : 0xff4444;
+  }
+}
+
 void RenderNormals::update(Vector<Mesh*>& meshes)
 {
   auto * vCtx = app->vCtx;
@@ -90,34 +103,35 @@ void RenderNormals::update(Vector<Mesh*>& meshes)
       logger(0, "Created new RenderNormals.MeshData item.");
     }
     auto & meshData = newMeshData.back();
-    if (meshData.geometryGeneration != mesh->geometryGeneration || meshData.colorGeneration != mesh->colorGeneration) {
-      meshData.geometryGeneration = mesh->geometryGeneration;
-      meshData.colorGeneration = mesh->colorGeneration;
 
-      meshData.vertexCount = 3*mesh->triCount;
-      meshData.vtxNrm = resources->createVertexDeviceBuffer(sizeof(Vertex) * meshData.vertexCount);
-
-      auto vtxNrmStaging = resources->createStagingBuffer(meshData.vtxNrm.resource->requestedSize);
-      {
-        auto * mem = (Vertex*)vtxNrmStaging.resource->hostPtr;
-        for (unsigned t = 0; t < mesh->triCount; t++) {
-          bool selected = mesh->selected[mesh->TriObjIx[t]];
-          for (unsigned i = 0; i < 3; i++) {
-            auto k = 3 * t + i;
-            mem[k].p = mesh->vtx[mesh->triVtxIx[k]];
-            mem[k].n = mesh->nrm[mesh->triNrmIx[k]];
-            mem[k].color = selected ? 0xffff88 : 0xff4444;
-          }
-        }
+    // Vertices are made by a task and uploaded once ready, the previous buffer is drawn meanwhile.
+    GeometryKey ready;
+    Vector<Vertex> vertices;
+    if (meshData.pending.take(ready, vertices) && ready.geometryGeneration == mesh->geometryGeneration) {
+      meshData.key = ready;
+      meshData.vertexCount = vertices.size32();
+      meshData.vtxNrm = resources->createVertexDeviceBuffer(std::max(size_t(1), vertices.byteSize()));
+      if (vertices.any()) {
+        vCtx->frameManager->stageAndCopyBuffer(meshData.vtxNrm, vertices.data(), vertices.byteSize());
       }
-      vCtx->frameManager->copyBuffer(meshData.vtxNrm, vtxNrmStaging, meshData.vtxNrm.resource->requestedSize);
       logger(0, "Updated RenderNormals.MeshData item.");
     }
+
+    GeometryKey wanted;
+    wanted.geometryGeneration = mesh->geometryGeneration;
+    wanted.colorGeneration = mesh->colorGeneration;
+    if (meshData.key != wanted && !meshData.pending.pending()) {
+      // The selection is changed by the frame thread, so the task gets a copy.
+      meshData.pending.start(&app->tasks, wanted, [logger = logger, tasks = &app->tasks, cache = &app->meshDerived, mesh, selection = Selection(mesh->selection), optimizer = app->indexOptimizer](Vector<Vertex>& vertices, const GeometryKey&)
+      {
+        prepareVertices(logger, tasks, cache, vertices, mesh, selection, optimizer);
+      });
+    }
   }
   meshData.swap(newMeshData);
   for (auto & item : newMeshData) {
     if (item.src == nullptr) continue;
-    // just handles and those will destroy themselves.
+    // just handles and those will destroy themselves, a pending package is released when its task ends.
     logger(0, "Destroyed RenderNormals.MeshData item.");
   }
 }
@@ -212,7 +226,8 @@ void RenderNormals::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const Ve
   }
 
   for (auto & item : meshData) {
-    
+    if (!item.vtxNrm) continue;
+
     VkDescriptorBufferInfo objectBufferInfo;
     auto* objectBuffer = (ObjectBuffer*)vCtx->frameManager->allocUniformStore(objectBufferInfo, sizeof(ObjectBuffer));
     objectBuffer->MVP = MVP;
@@ -1,6 +1,10 @@
 #pragma once
 #include <vulkan/vulkan.h>
 #include "Common.h"
+#include "LinAlg.h"
+#include "AsyncPackage.h"
+#include "MeshDerived.h"
+#include "Selection.h"
 #include "VulkanContext.h"
 #include "ResourceManager.h"
 #include "RenderTextureManager.h"
@@ -28,11 +32,27 @@ private:
   Logger logger;
   App* app = nullptr;
 
-  struct MeshData
+  struct Vertex {
+    Vec3f p;
+    Vec3f n;
+    uint32_t color;
+    uint32_t dummy;
+  };
+
+  struct GeometryKey
   {
-    Mesh* src = nullptr;
     uint32_t geometryGeneration = 0;
     uint32_t colorGeneration = 0;
+
+    bool operator==(const GeometryKey& other) const { return geometryGeneration == other.geometryGeneration && colorGeneration == other.colorGeneration; }
+    bool operator!=(const GeometryKey& other) const { return !(*this == other); }
+  };
+
+  struct MeshData
+  {
+    Mesh* src = nullptr;
+    GeometryKey key;                                  // Input of the uploaded buffer, zero generations until the first upload.
+    AsyncPackage<GeometryKey, Vector<Vertex>> pending;
     RenderBufferHandle vtxNrm;
     uint32_t vertexCount = 0;
   };
@@ -44,5 +64,6 @@ private:
   uint32_t viewport[4];
 
   void buildPipelines(RenderPassHandle pass);
+  static void prepareVertices(Logger logger, Tasks* tasks, MeshDerivedCache* cache, Vector<Vertex>& vertices, const Mesh* mesh, const Selection& selection, IndexOptimizer optimizer);
 
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <algorithm>
 #include "Common.h"
 #include "App.h"
 #include "RenderOutlines.h"
@@ -68,12 +69,51 @@ RenderOutlines::~RenderOutlines()
 {
 }
 
-void RenderOutlines::update(Vector<Mesh*>& meshes)
+void RenderOutlines::prepareGeometry(Logger logger, Tasks* tasks, MeshDerivedCache* cache, GeometryPackage& package, const Mesh* mesh, const GeometryKey& key)
+{
+  package.edges = getClassifiedEdges(*cache, logger, tasks, mesh, key.edgeClasses, (3.14159265f / 180.f) * key.creaseAngle);
+
+  package.lineOffset = mesh->vtxCount;
+  package.lineCount = mesh->lineCount;
+  package.vertices.resize(mesh->vtxCount + 2 * size_t(mesh->lineCount));
+  std::memcpy(package.vertices.data(), mesh->vtx, sizeof(Vec3f)*mesh->vtxCount);
+  for (uint32_t e = 0; e < 2 * package.lineCount; e++) {
+    package.vertices[package.lineOffset + e] = mesh->vtx[mesh->lineVtxIx[e]];
+  }
+}
+
+void RenderOutlines::uploadGeometry(MeshData& meshData, GeometryPackage& package)
 {
   auto * vCtx = app->vCtx;
   auto * resources = vCtx->resources;
   auto * frameManager = vCtx->frameManager;
 
+  meshData.outlineCount = package.edges->size32() / 2;
+  meshData.lineOffset = package.lineOffset;
+  meshData.lineCount = package.lineCount;
+  meshData.vertexCount = package.vertices.size32();
+  meshData.vtx = resources->createVertexDeviceBuffer(sizeof(Vec3f) * std::max(1u, meshData.vertexCount));
+  meshData.col = resources->createVertexDeviceBuffer(sizeof(uint32_t) * std::max(1u, meshData.vertexCount));
+  if (package.vertices.any()) {
+    frameManager->stageAndCopyBuffer(meshData.vtx, package.vertices.data(), package.vertices.byteSize());
+  }
+
+  // The class mask may select no edges at all, e.g. a closed smooth mesh with interior edges excluded.
+  if (meshData.outlineCount) {
+    meshData.indices = resources->createIndexDeviceBuffer(sizeof(uint32_t) * 2 * meshData.outlineCount);
+    frameManager->stageAndCopyBuffer(meshData.indices, package.edges->data(), sizeof(uint32_t) * 2 * meshData.outlineCount);
+  }
+  else {
+    meshData.indices = RenderBufferHandle();
+  }
+  meshData.colorGeneration = 0; // trigger update
+  logger(0, "RenderOutlines: Updated geometry.");
+}
+
+void RenderOutlines::update(Vector<Mesh*>& meshes)
+{
+  auto * vCtx = app->vCtx;
+
   newMeshData.clear();
   for (auto & mesh : meshes) {
     bool found = false;
@@ -90,36 +130,27 @@ void RenderOutlines::update(Vector<Mesh*>& meshes)
       logger(0, "Created new RenderOutlines.MeshData item.");
     }
     auto & meshData = newMeshData.back();
-    if (meshData.geometryGeneration != mesh->geometryGeneration) {
-      meshData.geometryGeneration = mesh->geometryGeneration;
-      meshData.colorGeneration = 0; // trigger update
-
-      Vector<uint32_t> indices;
-      getEdges(logger, indices, mesh->triVtxIx, mesh->triCount);
 
-      meshData.outlineCount = indices.size32() / 2;
-      meshData.lineOffset = mesh->vtxCount;
-      meshData.lineCount = mesh->lineCount;
-      meshData.vertexCount = mesh->vtxCount + 2 * meshData.lineCount;
-      meshData.vtx = resources->createVertexDeviceBuffer(sizeof(Vec3f) * meshData.vertexCount);
-      meshData.col = resources->createVertexDeviceBuffer(sizeof(uint32_t) * meshData.vertexCount);
+    // Edges are classified by a task and uploaded once ready, the previous buffers are drawn meanwhile.
+    GeometryKey ready;
+    GeometryPackage package;
+    if (meshData.pending.take(ready, package) && ready.geometryGeneration == mesh->geometryGeneration) {
+      meshData.key = ready;
+      uploadGeometry(meshData, package);
+    }
 
-      auto vtxStaging = resources->createStagingBuffer(meshData.vtx.resource->requestedSize);
+    GeometryKey wanted;
+    wanted.geometryGeneration = mesh->geometryGeneration;
+    wanted.edgeClasses = app->outlineClasses;
+    wanted.creaseAngle = app->outlineCreaseAngle;
+    if (meshData.key != wanted && !meshData.pending.pending()) {
+      meshData.pending.start(&app->tasks, wanted, [logger = logger, tasks = &app->tasks, cache = &app->meshDerived, mesh](GeometryPackage& package, const GeometryKey& key)
       {
-        auto * mem = (Vec3f*)vtxStaging.resource->hostPtr;
-        std::memcpy(mem, mesh->vtx, sizeof(Vec3f)*mesh->vtxCount);
-        for (uint32_t e = 0; e < 2 * meshData.lineCount; e++) {
-          mem[meshData.lineOffset + e] = mesh->vtx[mesh->lineVtxIx[e]];
-        }
-      }
-      frameManager->copyBuffer(meshData.vtx, vtxStaging, meshData.vtx.resource->requestedSize);
-
-      meshData.indices = resources->createIndexDeviceBuffer(sizeof(uint32_t) * 2 * meshData.outlineCount);
-      frameManager->stageAndCopyBuffer(meshData.indices, indices.data(), sizeof(uint32_t) * 2 * meshData.outlineCount);
-      logger(0, "RenderOutlines: Updated geometry.");
+        prepareGeometry(logger, tasks, cache, package, mesh, key);
+      });
     }
 
-    if (meshData.colorGeneration != mesh->colorGeneration) {
+    if (meshData.colorGeneration != mesh->colorGeneration && meshData.vtx) {
       meshData.colorGeneration = mesh->colorGeneration;
 
       auto stagingBuf = vCtx->resources->createStagingBuffer(meshData.col.resource->requestedSize);
@@ -149,7 +180,7 @@ void RenderOutlines::update(Vector<Mesh*>& meshes)
   meshData.swap(newMeshData);
   for (auto & item : newMeshData) {
     if (item.src == nullptr) continue;
-    // just handles and those will destroy themselves.
+    // just handles and those will destroy themselves, a pending package is released when its task ends.
     logger(0, "RenderOutlines: Destroyed meshdata item.");
   }
 }
@@ -240,6 +271,7 @@ void RenderOutlines::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const V
   }
 
   for (auto & item : meshData) {
+    if (!item.vtx) continue;
 
     VkBuffer buffers[2] = { item.vtx.resource->buffer, item.col.resource->buffer };
     VkDeviceSize offsets[ARRAYSIZE(buffers)] = { 0, 0 };
@@ -265,7 +297,7 @@ void RenderOutlines::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const V
     
     vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, linePipeline.resource->pipeLayout, 0, 1, &set, 0, nullptr);
 
-    if (outlines) {
+    if (outlines && item.outlineCount) {
       vkCmdBindIndexBuffer(cmdBuf, item.indices.resource->buffer, 0, VK_INDEX_TYPE_UINT32);
       vkCmdDrawIndexed(cmdBuf, 2 * item.outlineCount, 1, 0, 0, 0);
     }
@@ -1,6 +1,9 @@
 #pragma once
 #include <vulkan/vulkan.h>
 #include "Common.h"
+#include "LinAlg.h"
+#include "AsyncPackage.h"
+#include "MeshDerived.h"
 #include "VulkanContext.h"
 #include "ResourceManager.h"
 #include "RenderTextureManager.h"
@@ -28,11 +31,31 @@ private:
   Logger logger;
   App* app = nullptr;
 
+  struct GeometryKey
+  {
+    uint32_t geometryGeneration = 0;
+    uint32_t edgeClasses = 0;
+    float creaseAngle = 0.f;
+
+    bool operator==(const GeometryKey& other) const { return geometryGeneration == other.geometryGeneration && edgeClasses == other.edgeClasses && creaseAngle == other.creaseAngle; }
+    bool operator!=(const GeometryKey& other) const { return !(*this == other); }
+  };
+
+  // Contents of the vertex and index buffers, prepared off the frame thread.
+  struct GeometryPackage
+  {
+    Vector<Vec3f> vertices;     // Mesh vertices followed by the line endpoints.
+    std::shared_ptr<const Vector<uint32_t>> edges;  // Outline edges as pairs of mesh vertices.
+    uint32_t lineOffset = 0;
+    uint32_t lineCount = 0;
+  };
+
   struct MeshData
   {
     Mesh* src = nullptr;
-    uint32_t geometryGeneration = 0;
+    GeometryKey key;            // Input of the uploaded buffers, zero generation until the first upload.
     uint32_t colorGeneration = 0;
+    AsyncPackage<GeometryKey, GeometryPackage> pending;
 
     RenderBufferHandle vtx;
     RenderBufferHandle col;
@@ -54,5 +77,7 @@ private:
   uint32_t viewport[4];
 
   void buildPipelines(RenderPassHandle pass);
+  static void prepareGeometry(Logger logger, Tasks* tasks, MeshDerivedCache* cache, GeometryPackage& package, const Mesh* mesh, const GeometryKey& key);
+  void uploadGeometry(MeshData& meshData, GeometryPackage& package);
 
 };
\ No newline at end of file
@@ -1,21 +1,18 @@
 #include <cassert>
+#include <algorithm>
 #include "Common.h"
+#include "Tasks.h"
 #include "App.h"
 #include "RenderSolid.h"
 #include "Mesh.h"
-#include "MeshIndexing.h"
+#include "MeshLod.h"
+#include "Viewer.h"
 #include "VulkanContext.h"
 #include "RenderTextureManager.h"
 #include "LinAlgOps.h"
 #include "Half.h"
-#include "VertexCache.h"
 #include "ShaderStructs.h"
 
-//#define TRASH_INDICES
-#ifdef TRASH_INDICES
-#include <algorithm>
-#include <random>
-#endif
 
 
 namespace {
@@ -24,12 +21,20 @@ namespace {
 #include "vanilla.vert.h"
   };
 
-  uint32_t vanilla_frag[] = {
-#include "vanilla.frag.h"
+  uint32_t triangleColor_frag[] = {
+#include "triangleColor.frag.h"
   };
 
-  uint32_t textured_frag[] = {
-#include "textured.frag.h"
+  uint32_t triangleColorTextured_frag[] = {
+#include "triangleColorTextured.frag.h"
+  };
+
+  uint32_t triangleColorById_frag[] = {
+#include "triangleColorById.frag.h"
+  };
+
+  uint32_t triangleColorTexturedById_frag[] = {
+#include "triangleColorTexturedById.frag.h"
   };
 
   struct RGBA8
@@ -67,8 +72,14 @@ void RenderSolid::init()
   auto * resources = vCtx->resources;
 
   vertexShader = resources->createShader(vanilla_vert, sizeof(vanilla_vert));
-  solidShader = resources->createShader(vanilla_frag, sizeof(vanilla_frag));
-  texturedShader = resources->createShader(textured_frag, sizeof(textured_frag));
+  if (vCtx->geometryShader) {
+    solidShader = resources->createShader(triangleColor_frag, sizeof(triangleColor_frag));
+    texturedShader = resources->createShader(triangleColorTextured_frag, sizeof(triangleColorTextured_frag));
+  }
+  else {
+    solidShader = resources->createShader(triangleColorById_frag, sizeof(triangleColorById_frag));
+    texturedShader = resources->createShader(triangleColorTexturedById_frag, sizeof(triangleColorTexturedById_frag));
+  }
   
   checkerTex = textureManager->loadTexture(TextureSource::Checker);
   colorGradientTex = textureManager->loadTexture(TextureSource::ColorGradient);
@@ -93,11 +104,113 @@ RenderSolid::~RenderSolid()
 {
 }
 
-void RenderSolid::update(Vector<Mesh*>& meshes)
+void RenderSolid::prepareGeometry(Logger logger, Tasks* tasks, MeshDerivedCache* cache, GeometryPackage& package, const Mesh* mesh, const GeometryKey& key, bool primitiveId)
+{
+  auto lod = getLodLevel(mesh, key.lodLevel);
+
+  auto & vertices = package.vertices;
+  auto triangleSource = std::make_shared<Vector<uint32_t>>(lod.triCount);
+  package.triangleSource = triangleSource;
+
+  if (mesh->nrmCount) {
+    // Corners are unique on position, normal and texture coordinate, colors are per triangle.
+    package.indexing = getVertexIndexing(*cache, logger, tasks, mesh, key.lodLevel, key.indexOptimizer);
+    const auto & corners = package.indexing->corners;
+    for (uint32_t i = 0; i < lod.triCount; i++) (*triangleSource)[i] = lod.sourceTriangle(package.indexing->triangles[i]);
+
+    Vector<Vec2f> texCoords(corners.size());
+    for (uint32_t i = 0; i < corners.size32(); i++) {
+      texCoords[i] = mesh->texCount ? 10.f*mesh->tex[lod.triTexIx[corners[i]]] : Vec2f(0.5f);
+    }
+    Vector<uint16_t> texHalves(2 * texCoords.size());
+    halvesFromFloats(texHalves.data(), (const float*)texCoords.data(), texHalves.size());
+
+    vertices.resize(corners.size());
+    for (uint32_t i = 0; i < corners.size32(); i++) {
+      auto ix = corners[i];
+      vertices[i] = Vertex(mesh->vtx[lod.triVtxIx[ix]],
+                           mesh->nrm[lod.triNrmIx[ix]],
+                           texHalves[2 * i + 0],
+                           texHalves[2 * i + 1],
+                           0xffffff);
+    }
+
+    if (!primitiveId) {
+      // The shaders find the triangle from the vertex index, so each triangle gets three vertices of its own.
+      const auto & indices = package.indexing->indices;
+      Vector<Vertex> expanded(indices.size());
+      for (uint32_t i = 0; i < indices.size32(); i++) expanded[i] = vertices[indices[i]];
+      vertices.swap(expanded);
+      package.indexing.reset();
+    }
+  }
+  else {
+    for (uint32_t i = 0; i < lod.triCount; i++) (*triangleSource)[i] = lod.sourceTriangle(i);
+    auto normals = getFaceNormals(*cache, logger, tasks, mesh, key.lodLevel);
+    vertices.resize(3 * size_t(lod.triCount));
+    if (mesh->texCount) {
+      Vector<Vec2f> texCoords(3 * lod.triCount);
+      for (unsigned i = 0; i < 3 * lod.triCount; i++) texCoords[i] = 10.f*mesh->tex[lod.triTexIx[i]];
+      Vector<uint16_t> texHalves(2 * texCoords.size());
+      halvesFromFloats(texHalves.data(), (const float*)texCoords.data(), texHalves.size());
+
+      for (unsigned i = 0; i < lod.triCount; i++) {
+        for (unsigned k = 0; k < 3; k++) {
+          vertices[3 * i + k] = Vertex(mesh->vtx[lod.triVtxIx[3 * i + k]],
+                                       (*normals)[i],
+                                       texHalves[2 * (3 * i + k) + 0],
+                                       texHalves[2 * (3 * i + k) + 1],
+                                       0xffffff);
+        }
+      }
+    }
+    else {
+      const auto half = halfFromFloat(0.5f);
+      for (unsigned i = 0; i < lod.triCount; i++) {
+        for (unsigned k = 0; k < 3; k++) {
+          vertices[3 * i + k] = Vertex(mesh->vtx[lod.triVtxIx[3 * i + k]],
+                                       (*normals)[i],
+                                       half,
+                                       half,
+                                       0xffffff);
+        }
+      }
+    }
+  }
+  logger(0, "RenderSolid: Prepared %u triangles at level %u", lod.triCount, key.lodLevel);
+}
+
+void RenderSolid::uploadGeometry(MeshData& meshData, GeometryPackage& package)
 {
   auto * vCtx = app->vCtx;
   auto * resources = vCtx->resources;
 
+  meshData.triangleCount = package.triangleSource->size32();
+  meshData.vtx = resources->createStorageBuffer(std::max(size_t(1), package.vertices.byteSize()));
+  if (package.vertices.any()) {
+    vCtx->frameManager->stageAndCopyBuffer(meshData.vtx, package.vertices.data(), package.vertices.byteSize());
+  }
+
+  if (package.indexing && package.indexing->indices.any()) {
+    const auto & indices = package.indexing->indices;
+    meshData.indices = resources->createIndexDeviceBuffer(indices.byteSize());
+    vCtx->frameManager->stageAndCopyBuffer(meshData.indices, indices.data(), indices.byteSize());
+  }
+  else {
+    meshData.indices = RenderBufferHandle();
+  }
+
+  meshData.colors = resources->createStorageBuffer(sizeof(uint32_t) * std::max(1u, meshData.triangleCount));
+  meshData.triangleSource = package.triangleSource;
+  meshData.triangleColors.reset();
+  meshData.colorGeneration = package.colorGeneration;
+  uploadColors(meshData, package.colors);
+
+  logger(0, "RenderSolid: Updated MeshData item");
+}
+
+void RenderSolid::update(Vector<Mesh*>& meshes)
+{
   newMeshData.clear();
   for (auto & mesh : meshes) {
     bool found = false;
@@ -114,105 +227,53 @@ void RenderSolid::update(Vector<Mesh*>& meshes)
       logger(0, "Created new Renderer.MeshData item.");
     }
     auto & meshData = newMeshData.back();
-    if (meshData.geometryGeneration != mesh->geometryGeneration || meshData.colorGeneration != mesh->colorGeneration) {
-      meshData.geometryGeneration = mesh->geometryGeneration;
-      meshData.colorGeneration = mesh->colorGeneration;
 
-      meshData.triangleCount = mesh->triCount;
-      meshData.vtx = resources->createStorageBuffer(sizeof(Vertex) * 3 * meshData.triangleCount);
-
-      Vector<uint32_t> indices;
-      auto vtxStaging = resources->createStagingBuffer(meshData.vtx.resource->requestedSize);
+    // Geometry is prepared by a task and uploaded once ready, the previous buffers are drawn meanwhile.
+    GeometryKey ready;
+    GeometryPackage package;
+    if (meshData.pending.take(ready, package) && ready.geometryGeneration == mesh->geometryGeneration) {
+      meshData.key = ready;
+      uploadGeometry(meshData, package);
+    }
 
+    GeometryKey wanted;
+    wanted.geometryGeneration = mesh->geometryGeneration;
+    wanted.lodLevel = app->useLods ? selectLodLevel(mesh, app->viewer->getProjectionMatrix(), app->viewer->getViewMatrix(), float(app->height), app->lodPixelError) : 0;
+    wanted.indexOptimizer = app->indexOptimizer;
+    if (meshData.key != wanted && !meshData.pending.pending()) {
+      // The selection is changed by the frame thread, so the task gets a copy.
+      meshData.pending.start(&app->tasks, wanted, [logger = logger, tasks = &app->tasks, cache = &app->meshDerived, mesh, primitiveId = app->vCtx->geometryShader,
+                                                   rule = app->getTriangleColorRule(mesh), selection = Selection(mesh->selection),
+                                                   colorGeneration = mesh->colorGeneration](GeometryPackage& package, const GeometryKey& key)
       {
-        auto * mem = (Vertex*)vtxStaging.resource->hostPtr;
-        if (mesh->nrmCount) {
-          if (false && mesh->texCount) {
-            for (unsigned i = 0; i < 3 * mesh->triCount; i++) {
-              mem[i] = Vertex(mesh->vtx[mesh->triVtxIx[i]],
-                              mesh->nrm[mesh->triNrmIx[i]],
-                              10.f*mesh->tex[mesh->triTexIx[i]],
-                              mesh->currentColor[i / 3]);
-            }
-          }
-          else {
-
-            Vector<uint32_t> newVertices;
-
-            uniqueIndices(logger, indices, newVertices, mesh->triVtxIx, mesh->triNrmIx, 3 * mesh->triCount);
-
-            for (uint32_t i = 0; i < newVertices.size32(); i++) {
-              auto ix = newVertices[i];
-              mem[i] = Vertex(mesh->vtx[mesh->triVtxIx[ix]],
-                              mesh->nrm[mesh->triNrmIx[ix]],
-                              Vec2f(0.5f),
-                              0xdddddd);
-            }
-          }
-        }
-        else {
-          if (mesh->texCount) {
-            for (unsigned i = 0; i < mesh->triCount; i++) {
-              Vec3f p[3];
-              for (unsigned k = 0; k < 3; k++) p[k] = mesh->vtx[mesh->triVtxIx[3 * i + k]];
-              auto n = cross(p[1] - p[0], p[2] - p[0]);
-              for (unsigned k = 0; k < 3; k++) {
-                mem[3 * i + k] = Vertex(p[k],
-                                        n,
-                                        10.f*mesh->tex[mesh->triTexIx[3 * i + k]],
-                                        mesh->currentColor[i]);
-              }
-            }
-          }
-          else {
-            for (unsigned i = 0; i < mesh->triCount; i++) {
-              Vec3f p[3];
-              for (unsigned k = 0; k < 3; k++) p[k] = mesh->vtx[mesh->triVtxIx[3 * i + k]];
-              auto n = cross(p[1] - p[0], p[2] - p[0]);
-              for (unsigned k = 0; k < 3; k++) {
-                mem[3 * i + k] = Vertex(p[k],
-                                        n,
-                                        Vec2f(0.5f),
-                                        mesh->currentColor[i]);
-              }
-            }
-          }
-        }
-        vCtx->frameManager->copyBuffer(meshData.vtx, vtxStaging, meshData.vtx.resource->requestedSize);
-      }
+        prepareGeometry(logger, tasks, cache, package, mesh, key, primitiveId);
+        prepareColors(tasks, package.colors, mesh, rule, selection, package.triangleSource, nullptr);
+        package.colorGeneration = colorGeneration;
+      });
+    }
 
-      if (indices.any()) {
-#ifdef TRASH_INDICES
-        std::random_device rd;
-        std::mt19937 g(rd());
-        std::shuffle((Vec3f*)indices.begin(), (Vec3f*)indices.end(), g);
-#endif
-        Vector<uint32_t> reindices(indices.size());
-
-        float fifo4, fifo8, fifo16, fifo32;
-        getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, indices.data(), indices.size32());
-        logger(0, "IN  AMCR FIFO4=%.2f, FIFO8=%.2f, FIFO16=%.2f, FIFO32=%.2f", fifo4, fifo8, fifo16, fifo32);
-        linearSpeedVertexCacheOptimisation(logger, reindices.data(), indices.data(), indices.size32());
-        getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, reindices.data(), indices.size32());
-        logger(0, "OPT AMCR FIFO4=%.2f, FIFO8=%.2f, FIFO16=%.2f, FIFO32=%.2f", fifo4, fifo8, fifo16, fifo32);
-        indices.swap(reindices);
-
-        meshData.indices = resources->createIndexDeviceBuffer(sizeof(uint32_t)*indices.size());
-        auto stage = resources->createStagingBuffer(sizeof(uint32_t)*indices.size());
-        std::memcpy(stage.resource->hostPtr, indices.data(), sizeof(uint32_t)*indices.size());
-        vCtx->frameManager->copyBuffer(meshData.indices, stage, sizeof(uint32_t)*indices.size());
-      }
-      else {
-        meshData.indices = RenderBufferHandle();
-      }
+    // Colors are evaluated and compared with the uploaded ones by a task, and only the runs that
+    // changed are uploaded. Colors made for drawn triangles that have since been replaced are dropped.
+    uint32_t readyColors = 0;
+    ColorPackage colorPackage;
+    if (meshData.pendingColors.take(readyColors, colorPackage) && colorPackage.triangleSource == meshData.triangleSource) {
+      meshData.colorGeneration = readyColors;
+      uploadColors(meshData, colorPackage);
+    }
 
-      logger(0, "RenderSolid: Updated MeshData item");
+    if (meshData.colorGeneration != mesh->colorGeneration && meshData.vtx && !meshData.pendingColors.pending()) {
+      meshData.pendingColors.start(&app->tasks, mesh->colorGeneration, [tasks = &app->tasks, mesh,
+                                                                         rule = app->getTriangleColorRule(mesh), selection = Selection(mesh->selection),
+                                                                         triangleSource = meshData.triangleSource, previous = meshData.triangleColors](ColorPackage& package, const uint32_t&)
+      {
+        prepareColors(tasks, package, mesh, rule, selection, triangleSource, previous);
+      });
     }
   }
   meshData.swap(newMeshData);
   for (auto & item : newMeshData) {
     if (item.src == nullptr) continue;
-    // just handles and those will destroy themselves.
+    // just handles and those will destroy themselves, a pending package is released when its task ends.
     logger(0, "Destroyed Renderer.MeshData item.");
   }
 
@@ -220,12 +281,74 @@ void RenderSolid::update(Vector<Mesh*>& meshes)
 }
 
 
+void RenderSolid::prepareColors(Tasks* tasks, ColorPackage& package, const Mesh* mesh, const TriangleColorRule& rule, const Selection& selection,
+                                std::shared_ptr<const Vector<uint32_t>> triangleSource, std::shared_ptr<const Vector<uint32_t>> previous)
+{
+  Vector<uint32_t> meshColors(mesh->triCount);
+  evaluateTriangleColors(tasks, meshColors.data(), rule, mesh->TriObjIx, selection, mesh->triCount);
+
+  const auto & source = *triangleSource;
+  auto triangleCount = source.size32();
+  auto colors = std::make_shared<Vector<uint32_t>>(triangleCount);
+  parallelFor(tasks, triangleCount, 1 << 16, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t i = begin; i < end; i++) (*colors)[i] = meshColors[source[i]];
+  });
+
+  // Changes closer than runGap triangles share a run, so colors scattered by the index
+  // optimizer do not turn into one tiny copy per triangle.
+  const uint32_t runGap = 256;
+  auto & runs = package.runs;
+  runs.clear();
+  if (previous && previous->size32() == triangleCount) {
+    const auto & prev = *previous;
+    uint32_t i = 0;
+    while (i < triangleCount) {
+      if ((*colors)[i] == prev[i]) {
+        i++;
+        continue;
+      }
+      uint32_t begin = i;
+      uint32_t end = i + 1;
+      for (i = end; i < triangleCount && i < end + runGap; i++) {
+        if ((*colors)[i] != prev[i]) end = i + 1;
+      }
+      runs.pushBack(begin);
+      runs.pushBack(end);
+    }
+  }
+  else if (triangleCount) {
+    runs.pushBack(0);
+    runs.pushBack(triangleCount);
+  }
+
+  package.triangleSource = std::move(triangleSource);
+  package.colors = std::move(colors);
+}
+
+void RenderSolid::uploadColors(MeshData& meshData, ColorPackage& package)
+{
+  const auto & runs = package.runs;
+  uint32_t changed = 0;
+  Vector<VkBufferCopy> regions(runs.size() / 2);
+  for (uint32_t i = 0; i < regions.size32(); i++) {
+    regions[i].srcOffset = sizeof(uint32_t) * runs[2 * i + 0];
+    regions[i].dstOffset = sizeof(uint32_t) * runs[2 * i + 0];
+    regions[i].size = sizeof(uint32_t) * (runs[2 * i + 1] - runs[2 * i + 0]);
+    changed += runs[2 * i + 1] - runs[2 * i + 0];
+  }
+  app->vCtx->frameManager->stageAndCopyBufferRegions(meshData.colors, package.colors->data(), regions.data(), regions.size32());
+  meshData.triangleColors = package.colors;
+  logger(0, "RenderSolid: Updated %u of %u triangle colors in %u runs", changed, package.colors->size32(), regions.size32());
+}
+
+
 void RenderSolid::buildPipelines(RenderPassHandle pass)
 {
   auto * vCtx = app->vCtx;
   auto * resources = vCtx->resources;
 
-  VkDescriptorSetLayoutBinding objBufLayoutBinding[2];
+  VkDescriptorSetLayoutBinding objBufLayoutBinding[3];
   objBufLayoutBinding[0] = {};
   objBufLayoutBinding[0].binding = 0;
   objBufLayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -236,14 +359,20 @@ void RenderSolid::buildPipelines(RenderPassHandle pass)
   objBufLayoutBinding[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
   objBufLayoutBinding[1].descriptorCount = 1;
   objBufLayoutBinding[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  objBufLayoutBinding[2] = {};
+  objBufLayoutBinding[2].binding = 3;
+  objBufLayoutBinding[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  objBufLayoutBinding[2].descriptorCount = 1;
+  objBufLayoutBinding[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
   VkDescriptorSetLayoutCreateInfo objBufLayoutInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
   objBufLayoutInfo.bindingCount = ARRAYSIZE(objBufLayoutBinding);
   objBufLayoutInfo.pBindings = objBufLayoutBinding;
 
-  VkDescriptorSetLayoutBinding objBufSamplerLayoutBinding[3];
+  VkDescriptorSetLayoutBinding objBufSamplerLayoutBinding[4];
   objBufSamplerLayoutBinding[0] = objBufLayoutBinding[0];
   objBufSamplerLayoutBinding[1] = objBufLayoutBinding[1];
+  objBufSamplerLayoutBinding[3] = objBufLayoutBinding[2];
   objBufSamplerLayoutBinding[2] = {};
   objBufSamplerLayoutBinding[2].binding = 2;
   objBufSamplerLayoutBinding[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -310,6 +439,7 @@ void RenderSolid::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const Vec4
   vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
 
   for (auto & item : meshData) {
+    if (!item.vtx) continue;
 
     VkDescriptorBufferInfo objectBufferInfo;
     auto* objectBuffer = (ObjectBuffer*)vCtx->frameManager->allocUniformStore(objectBufferInfo, sizeof(ObjectBuffer));
@@ -325,7 +455,7 @@ void RenderSolid::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const Vec4
 
       VkDescriptorSet set = frameManager->allocDescriptorSet(vanillaPipeline);
 
-      VkWriteDescriptorSet writes[2];
+      VkWriteDescriptorSet writes[3];
       for (size_t i = 0; i < ARRAYSIZE(writes); i++) {
         writes[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
         writes[i].dstSet = set;
@@ -336,6 +466,9 @@ void RenderSolid::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const Vec4
       writes[0].pBufferInfo = &objectBufferInfo;
       writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
       writes[1].pBufferInfo = &item.vtx.resource->descInfo;
+      writes[2].dstBinding = 3;
+      writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[2].pBufferInfo = &item.colors.resource->descInfo;
       vkUpdateDescriptorSets(device, ARRAYSIZE(writes), writes, 0, nullptr);
 
       vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, vanillaPipeline.resource->pipeLayout, 0, 1, &set, 0, NULL);
@@ -351,7 +484,7 @@ void RenderSolid::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const Vec4
       imageInfo.imageView = inDescSet == Texturing::Checker ? checkerTex.resource->view.resource->view : colorGradientTex.resource->view.resource->view;
       imageInfo.sampler = texSampler.resource->sampler;
 
-      VkWriteDescriptorSet writes[3];
+      VkWriteDescriptorSet writes[4];
       for (size_t i = 0; i < ARRAYSIZE(writes); i++) {
         writes[i] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
         writes[i].dstSet = set;
@@ -364,6 +497,8 @@ void RenderSolid::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const Vec4
       writes[1].pBufferInfo = &item.vtx.resource->descInfo;
       writes[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
       writes[2].pImageInfo = &imageInfo;
+      writes[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[3].pBufferInfo = &item.colors.resource->descInfo;
       vkUpdateDescriptorSets(device, ARRAYSIZE(writes), writes, 0, nullptr);
 
       vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, texturedPipeline.resource->pipeLayout, 0, 1, &set, 0, NULL);
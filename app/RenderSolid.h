@@ -1,6 +1,11 @@
 #pragma once
 #include <vulkan/vulkan.h>
 #include "Common.h"
+#include "AsyncPackage.h"
+#include "IndexOptimizer.h"
+#include "MeshDerived.h"
+#include "Selection.h"
+#include "ShaderStructs.h"
 #include "VulkanContext.h"
 #include "ResourceManager.h"
 #include "RenderTextureManager.h"
@@ -40,16 +45,50 @@ private:
   App* app = nullptr;
   Texturing inDescSet = Texturing::None;
 
+  struct GeometryKey
+  {
+    uint32_t geometryGeneration = 0;
+    uint32_t lodLevel = 0;
+    IndexOptimizer indexOptimizer = IndexOptimizer::None;
+
+    bool operator==(const GeometryKey& other) const { return geometryGeneration == other.geometryGeneration && lodLevel == other.lodLevel && indexOptimizer == other.indexOptimizer; }
+    bool operator!=(const GeometryKey& other) const { return !(*this == other); }
+  };
+
+  // Color of each drawn triangle and the runs of it to upload, prepared off the frame thread.
+  struct ColorPackage
+  {
+    std::shared_ptr<const Vector<uint32_t>> triangleSource;  // Drawn triangles the colors are for.
+    std::shared_ptr<const Vector<uint32_t>> colors;
+    Vector<uint32_t> runs;              // Begin and end of each run of triangles whose color changed.
+  };
+
+  // Contents of the vertex, index and color buffers, prepared off the frame thread.
+  struct GeometryPackage
+  {
+    Vector<Vertex> vertices;
+    std::shared_ptr<const MeshVertexIndexing> indexing;  // Null if the vertices are drawn in order.
+    std::shared_ptr<const Vector<uint32_t>> triangleSource;  // Mesh triangle of each drawn triangle.
+    ColorPackage colors;
+    uint32_t colorGeneration = 0;       // Mesh color generation the colors were evaluated for.
+  };
+
   struct MeshData
   {
     Mesh* src = nullptr;
-    uint32_t geometryGeneration = 0;
+    GeometryKey key;                    // Input of the uploaded buffers, zero generation until the first upload.
     uint32_t colorGeneration = 0;
+    AsyncPackage<GeometryKey, GeometryPackage> pending;
 
     RenderBufferHandle vtx;
 
     RenderBufferHandle indices;
     uint32_t triangleCount = 0;
+
+    RenderBufferHandle colors;          // Color of each drawn triangle, updated without touching the vertices.
+    AsyncPackage<uint32_t, ColorPackage> pendingColors;      // Keyed by mesh color generation.
+    std::shared_ptr<const Vector<uint32_t>> triangleSource;  // Mesh triangle of each drawn triangle.
+    std::shared_ptr<const Vector<uint32_t>> triangleColors;  // Contents of colors.
   };
   Vector<MeshData> meshData;
   Vector<MeshData> newMeshData;
@@ -68,5 +107,11 @@ private:
   SamplerHandle texSampler;
 
   void buildPipelines(RenderPassHandle pass);
+  // Without primitiveId, triangles are drawn without indices so shaders can find them from the vertex index.
+  static void prepareGeometry(Logger logger, Tasks* tasks, MeshDerivedCache* cache, GeometryPackage& package, const Mesh* mesh, const GeometryKey& key, bool primitiveId);
+  void uploadGeometry(MeshData& meshData, GeometryPackage& package);
+  static void prepareColors(Tasks* tasks, ColorPackage& package, const Mesh* mesh, const TriangleColorRule& rule, const Selection& selection,
+                            std::shared_ptr<const Vector<uint32_t>> triangleSource, std::shared_ptr<const Vector<uint32_t>> previous);
+  void uploadColors(MeshData& meshData, ColorPackage& package);
 
 };
\ No newline at end of file
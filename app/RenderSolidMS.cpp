@@ -1,22 +1,18 @@
 #include <cassert>
+#include <algorithm>
 #include "Common.h"
 #include "App.h"
 #include "RenderSolidMS.h"
 #include "Mesh.h"
-#include "MeshIndexing.h"
+#include "MeshLod.h"
+#include "Viewer.h"
 #include "VulkanContext.h"
 #include "RenderTextureManager.h"
 #include "LinAlgOps.h"
 #include "Half.h"
-#include "VertexCache.h"
 #include "ShaderStructs.h"
 #include "Bounds.h"
 
-//#define TRASH_INDICES
-#ifdef TRASH_INDICES
-#include <algorithm>
-#include <random>
-#endif
 
 
 namespace {
@@ -170,12 +166,79 @@ RenderSolidMS::~RenderSolidMS()
 {
 }
 
-void RenderSolidMS::update(Vector<Mesh*>& meshes)
+void RenderSolidMS::prepareGeometry(Logger logger, Tasks* tasks, MeshDerivedCache* cache, GeometryPackage& package, const Mesh* mesh, const GeometryKey& key)
+{
+  auto lod = getLodLevel(mesh, key.lodLevel);
+
+  // Corners are unique on position, normal and texture coordinate, or all unique without normals.
+  auto indexing = getVertexIndexing(*cache, logger, tasks, mesh, key.lodLevel, key.indexOptimizer);
+  const auto & corners = indexing->corners;
+  const auto & indices = indexing->indices;
+
+  std::shared_ptr<const Vector<Vec3f>> faceNormals;
+  if (mesh->nrmCount == 0) faceNormals = getFaceNormals(*cache, logger, tasks, mesh, key.lodLevel);
+
+  Vector<Vec2f> texCoords(corners.size());
+  for (uint32_t i = 0; i < corners.size32(); i++) {
+    texCoords[i] = mesh->texCount ? 10.f*mesh->tex[lod.triTexIx[corners[i]]] : Vec2f(0.5f);
+  }
+  Vector<uint16_t> texHalves(2 * texCoords.size());
+  halvesFromFloats(texHalves.data(), (const float*)texCoords.data(), texHalves.size());
+
+  package.vertices.resize(corners.size());
+  for (uint32_t i = 0; i < corners.size32(); i++) {
+    auto ix = corners[i];
+    package.vertices[i] = Vertex(mesh->vtx[lod.triVtxIx[ix]],
+                                 faceNormals ? (*faceNormals)[ix / 3] : mesh->nrm[lod.triNrmIx[ix]],
+                                 texHalves[2 * i + 0],
+                                 texHalves[2 * i + 1],
+                                 0xffffff);
+  }
+
+  auto & meshletData = package.meshletData;
+  auto & meshlets = package.meshlets;
+  Vector<Vec3f> P;
+
+  // Ritter is within a few percent of the minimal sphere for meshlet-sized
+  // clouds at a fraction of the cost of boundingSphereExact.
+  bool avx2 = cpuSupportsAVX2();
+  buildMeshlets(meshletData, meshlets, indices);
+  for (auto & meshlet : meshlets) {
+    if (meshlet.vertexCount) {
+      P.resize(meshlet.vertexCount);
+      for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        auto & v = package.vertices[meshletData[meshlet.offset + i]];
+        P[i] = Vec3f(v.px, v.py, v.pz);
+      }
+      if (avx2) boundingSphereAVX2(meshlet.center, meshlet.radius, P.data(), P.size());
+      else boundingSphere(meshlet.center, meshlet.radius, P.data(), P.size());
+    }
+  }
+
+  logger(0, "%d meshlets (%d tris per meshlet), %.1f uints per meshlet",
+         meshlets.size(), indices.size() / (3 * std::max(size_t(1), meshlets.size())), float(meshletData.size()) / std::max(size_t(1), meshlets.size()));
+}
+
+void RenderSolidMS::uploadGeometry(MeshData& meshData, GeometryPackage& package)
 {
   auto * vCtx = app->vCtx;
   auto * frameManager = vCtx->frameManager;
   auto * resources = vCtx->resources;
 
+  meshData.vtx = resources->createStorageBuffer(std::max(size_t(1), package.vertices.byteSize()));
+  meshData.meshletData = resources->createStorageBuffer(std::max(size_t(1), package.meshletData.byteSize()));
+  meshData.meshlets = resources->createStorageBuffer(std::max(size_t(1), package.meshlets.byteSize()));
+  meshData.meshletCount = package.meshlets.size32();
+
+  if (package.vertices.any()) frameManager->stageAndCopyBuffer(meshData.vtx, package.vertices.data(), package.vertices.byteSize());
+  if (package.meshletData.any()) frameManager->stageAndCopyBuffer(meshData.meshletData, package.meshletData.data(), package.meshletData.byteSize());
+  if (package.meshlets.any()) frameManager->stageAndCopyBuffer(meshData.meshlets, package.meshlets.data(), package.meshlets.byteSize());
+
+  logger(0, "RenderSolidMS: Updated MeshData item");
+}
+
+void RenderSolidMS::update(Vector<Mesh*>& meshes)
+{
   newMeshData.clear();
   for (auto & mesh : meshes) {
     bool found = false;
@@ -192,120 +255,31 @@ void RenderSolidMS::update(Vector<Mesh*>& meshes)
       logger(0, "Created new Renderer.MeshData item.");
     }
     auto & meshData = newMeshData.back();
-    if (meshData.geometryGeneration != mesh->geometryGeneration || meshData.colorGeneration != mesh->colorGeneration) {
-      meshData.geometryGeneration = mesh->geometryGeneration;
-      meshData.colorGeneration = mesh->colorGeneration;
-
-      auto triangleCount = mesh->triCount;
-      meshData.vtx = resources->createStorageBuffer(sizeof(Vertex) * 3 * triangleCount);
-
-      Vector<uint32_t> indices;
-      Vector<Vertex> vtx(3 * triangleCount);
-
-      if (mesh->nrmCount) {
-        if (false && mesh->texCount) {
-          for (unsigned i = 0; i < 3 * mesh->triCount; i++) {
-            vtx[i] = Vertex(mesh->vtx[mesh->triVtxIx[i]],
-                            mesh->nrm[mesh->triNrmIx[i]],
-                            10.f*mesh->tex[mesh->triTexIx[i]],
-                            mesh->currentColor[i / 3]);
-          }
-        }
-        else {
-
-          Vector<uint32_t> newVertices;
-
-          uniqueIndices(logger, indices, newVertices, mesh->triVtxIx, mesh->triNrmIx, 3 * mesh->triCount);
 
-          for (uint32_t i = 0; i < newVertices.size32(); i++) {
-            auto ix = newVertices[i];
-            vtx[i] = Vertex(mesh->vtx[mesh->triVtxIx[ix]],
-                            mesh->nrm[mesh->triNrmIx[ix]],
-                            Vec2f(0.5f),
-                            0xdddddd);
-          }
-        }
-      }
-      else {
-        if (mesh->texCount) {
-          for (unsigned i = 0; i < mesh->triCount; i++) {
-            Vec3f p[3];
-            for (unsigned k = 0; k < 3; k++) p[k] = mesh->vtx[mesh->triVtxIx[3 * i + k]];
-            auto n = cross(p[1] - p[0], p[2] - p[0]);
-            for (unsigned k = 0; k < 3; k++) {
-              vtx[3 * i + k] = Vertex(p[k],
-                                      n,
-                                      10.f*mesh->tex[mesh->triTexIx[3 * i + k]],
-                                      mesh->currentColor[i]);
-            }
-          }
-        }
-        else {
-          for (unsigned i = 0; i < mesh->triCount; i++) {
-            Vec3f p[3];
-            for (unsigned k = 0; k < 3; k++) p[k] = mesh->vtx[mesh->triVtxIx[3 * i + k]];
-            auto n = cross(p[1] - p[0], p[2] - p[0]);
-            for (unsigned k = 0; k < 3; k++) {
-              vtx[3 * i + k] = Vertex(p[k],
-                                      n,
-                                      Vec2f(0.5f),
-                                      mesh->currentColor[i]);
-            }
-          }
-        }
-      }
-
-      if (indices.empty()) {
-        indices.resize(3 * triangleCount);
-        for (uint32_t i = 0; i < indices.size32(); i++) indices[i] = i;
-      }
+    // Geometry is prepared by a task and uploaded once ready, the previous buffers are drawn meanwhile.
+    GeometryKey ready;
+    GeometryPackage package;
+    if (meshData.pending.take(ready, package) && ready.geometryGeneration == mesh->geometryGeneration) {
+      meshData.key = ready;
+      uploadGeometry(meshData, package);
+    }
 
+    // vanilla.mesh colors by meshlet, so triangle colors are not used and color changes need no rebuild.
+    GeometryKey wanted;
+    wanted.geometryGeneration = mesh->geometryGeneration;
+    wanted.lodLevel = app->useLods ? selectLodLevel(mesh, app->viewer->getProjectionMatrix(), app->viewer->getViewMatrix(), float(app->height), app->lodPixelError) : 0;
+    wanted.indexOptimizer = app->indexOptimizer;
+    if (meshData.key != wanted && !meshData.pending.pending()) {
+      meshData.pending.start(&app->tasks, wanted, [logger = logger, tasks = &app->tasks, cache = &app->meshDerived, mesh](GeometryPackage& package, const GeometryKey& key)
       {
-        Vector<uint32_t> reindices(indices.size());
-        float fifo4, fifo8, fifo16, fifo32;
-        getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, indices.data(), indices.size32());
-        logger(0, "IN  AMCR FIFO4=%.2f, FIFO8=%.2f, FIFO16=%.2f, FIFO32=%.2f", fifo4, fifo8, fifo16, fifo32);
-        linearSpeedVertexCacheOptimisation(logger, reindices.data(), indices.data(), indices.size32());
-        getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, reindices.data(), indices.size32());
-        logger(0, "OPT AMCR FIFO4=%.2f, FIFO8=%.2f, FIFO16=%.2f, FIFO32=%.2f", fifo4, fifo8, fifo16, fifo32);
-        indices.swap(reindices);
-      }
-
-      Vector<uint32_t> meshletData;
-      Vector<Meshlet> meshlets;
-      Vector<Vec3f> P;
-
-      buildMeshlets(meshletData, meshlets, indices);
-      for (auto & meshlet : meshlets) {
-        if (meshlet.vertexCount) {
-          P.resize(meshlet.vertexCount);
-          for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
-            auto k = meshletData[meshlet.offset + i];
-            P[i] = Vec3f(vtx[k].px, vtx[k].py, vtx[k].pz);
-          }
-          boundingSphere(meshlet.center, meshlet.radius, P.data(), P.size());
-        }
-      }
-
-      meshData.meshletData = resources->createStorageBuffer(meshletData.byteSize());
-      meshData.meshlets = resources->createStorageBuffer(meshlets.byteSize());
-      meshData.meshletCount = meshlets.size32();
-
-      frameManager->stageAndCopyBuffer(meshData.vtx, vtx.data(), vtx.byteSize());
-      frameManager->stageAndCopyBuffer(meshData.meshletData, meshletData.data(), meshletData.byteSize());
-      frameManager->stageAndCopyBuffer(meshData.meshlets, meshlets.data(), meshlets.byteSize());
-
-      logger(0, "%d meshlets (%d tris per meshlet), %.1f uints per meshlet",
-             meshlets.size(), indices.size() / (3 * meshlets.size()), float(meshletData.size()) / meshlets.size());
-
-
-      logger(0, "RenderSolidMS: Updated MeshData item");
+        prepareGeometry(logger, tasks, cache, package, mesh, key);
+      });
     }
   }
   meshData.swap(newMeshData);
   for (auto & item : newMeshData) {
     if (item.src == nullptr) continue;
-    // just handles and those will destroy themselves.
+    // just handles and those will destroy themselves, a pending package is released when its task ends.
     logger(0, "Destroyed Renderer.MeshData item.");
   }
 
@@ -411,6 +385,7 @@ void RenderSolidMS::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const Ve
   vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
 
   for (auto & item : meshData) {
+    if (!item.vtx) continue;
 
     VkDescriptorBufferInfo objectBufferInfo;
     auto* objectBuffer = (ObjectBuffer*)vCtx->frameManager->allocUniformStore(objectBufferInfo, sizeof(ObjectBuffer));
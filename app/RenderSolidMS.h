@@ -1,6 +1,10 @@
 #pragma once
 #include <vulkan/vulkan.h>
 #include "Common.h"
+#include "AsyncPackage.h"
+#include "IndexOptimizer.h"
+#include "MeshDerived.h"
+#include "ShaderStructs.h"
 #include "VulkanContext.h"
 #include "ResourceManager.h"
 #include "RenderTextureManager.h"
@@ -40,11 +44,29 @@ private:
   App* app = nullptr;
   Texturing inDescSet = Texturing::None;
 
+  struct GeometryKey
+  {
+    uint32_t geometryGeneration = 0;
+    uint32_t lodLevel = 0;
+    IndexOptimizer indexOptimizer = IndexOptimizer::None;
+
+    bool operator==(const GeometryKey& other) const { return geometryGeneration == other.geometryGeneration && lodLevel == other.lodLevel && indexOptimizer == other.indexOptimizer; }
+    bool operator!=(const GeometryKey& other) const { return !(*this == other); }
+  };
+
+  // Contents of the vertex and meshlet buffers, prepared off the frame thread.
+  struct GeometryPackage
+  {
+    Vector<Vertex> vertices;
+    Vector<uint32_t> meshletData;
+    Vector<Meshlet> meshlets;
+  };
+
   struct MeshData
   {
     Mesh* src = nullptr;
-    uint32_t geometryGeneration = 0;
-    uint32_t colorGeneration = 0;
+    GeometryKey key;                    // Input of the uploaded buffers, zero generation until the first upload.
+    AsyncPackage<GeometryKey, GeometryPackage> pending;
 
     RenderBufferHandle vtx;
 
@@ -70,5 +92,7 @@ private:
   SamplerHandle texSampler;
 
   void buildPipelines(RenderPassHandle pass);
+  static void prepareGeometry(Logger logger, Tasks* tasks, MeshDerivedCache* cache, GeometryPackage& package, const Mesh* mesh, const GeometryKey& key);
+  void uploadGeometry(MeshData& meshData, GeometryPackage& package);
 
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <algorithm>
 #include "Common.h"
 #include "App.h"
 #include "RenderTangents.h"
@@ -71,6 +72,16 @@ RenderTangents::~RenderTangents()
 {
 }
 
+void RenderTangents::prepareGeometry(Logger logger, Tasks* tasks, MeshDerivedCache* cache, GeometryPackage& package, const Mesh* mesh)
+{
+  // FIXME: Should get unique triplets and average. And do a de-duplication wrt positions
+  package.frames = getTangents(*cache, logger, tasks, mesh);
+  package.vertices.resize(3 * size_t(mesh->triCount));
+  for (uint32_t i = 0; i < 3 * mesh->triCount; i++) {
+    package.vertices[i] = mesh->vtx[mesh->triVtxIx[i]];
+  }
+}
+
 void RenderTangents::update(Vector<Mesh*>& meshes)
 {
   auto * vCtx = app->vCtx;
@@ -94,75 +105,37 @@ void RenderTangents::update(Vector<Mesh*>& meshes)
       logger(0, "Created new RenderTangents.MeshData item.");
     }
     auto & meshData = newMeshData.back();
-    if (meshData.geometryGeneration != mesh->geometryGeneration) {
-      meshData.geometryGeneration = mesh->geometryGeneration;
-
-      meshData.triangleCount = mesh->triCount;
-      meshData.vtx = resources->createVertexDeviceBuffer(sizeof(Vec3f) * 3 * meshData.triangleCount);
-      meshData.tan = resources->createVertexDeviceBuffer(sizeof(Vec3f) * 3 * meshData.triangleCount);
-      meshData.bnm = resources->createVertexDeviceBuffer(sizeof(Vec3f) * 3 * meshData.triangleCount);
 
-      // FIXME: Should get unique triplets and average. And do a de-duplication wrt positions
-
-      auto vtxStaging = resources->createStagingBuffer(meshData.vtx.resource->requestedSize);
-      auto tanStaging = resources->createStagingBuffer(meshData.tan.resource->requestedSize);
-      auto bnmStaging = resources->createStagingBuffer(meshData.bnm.resource->requestedSize);
-      {
-        auto * vtxMap = (Vec3f*)vtxStaging.resource->hostPtr;
-        auto * tanMap = (Vec3f*)tanStaging.resource->hostPtr;
-        auto * bnmMap = (Vec3f*)bnmStaging.resource->hostPtr;
-
-        if (mesh->nrm) {
-          for (unsigned i = 0; i < mesh->triCount; i++) {
-            Vec3f p[3];
-            Vec2f t[3];
-            for (unsigned k = 0; k < 3; k++) {
-              p[k] = mesh->vtx[mesh->triVtxIx[3 * i + k]];
-              t[k] = mesh->tex[mesh->triTexIx[3 * i + k]];
-            }
-            Vec3f u, v;
-            tangentSpaceBasis(u, v, p[0], p[1], p[2], t[0], t[1], t[2]);
-            for (unsigned k = 0; k < 3; k++) {
-              auto n = normalize(mesh->nrm[mesh->triNrmIx[3 * i + k]]);
-              auto uu = normalize(u - dot(u, n)*n);
-              auto vv = normalize(v - dot(v, n)*n);
-              vtxMap[3 * i + k] = p[k];
-              tanMap[3 * i + k] = uu;
-              bnmMap[3 * i + k] = vv;
-            }
-          }
-        }
-        else {
-          for (unsigned i = 0; i < mesh->triCount; i++) {
-            Vec3f p[3];
-            Vec2f t[3];
-            for (unsigned k = 0; k < 3; k++) {
-              p[k] = mesh->vtx[mesh->triVtxIx[3 * i + k]];
-              t[k] = mesh->tex[mesh->triTexIx[3 * i + k]];
-            }
-            Vec3f u, v;
-            tangentSpaceBasis(u, v, p[0], p[1], p[2], t[0], t[1], t[2]);
-            auto n = normalize(cross(p[1] - p[0], p[2] - p[0]));
-            auto uu = normalize(u - dot(u, n)*n);
-            auto vv = normalize(v - dot(v, n)*n);
-            for (unsigned k = 0; k < 3; k++) {
-              vtxMap[3 * i + k] = p[k];
-              tanMap[3 * i + k] = uu;
-              bnmMap[3 * i + k] = vv;
-            }
-          }
-        }
+    // Tangent frames are computed by a task and uploaded once ready.
+    uint32_t ready = 0;
+    GeometryPackage package;
+    if (meshData.pending.take(ready, package) && ready == mesh->geometryGeneration) {
+      meshData.geometryGeneration = ready;
+      meshData.triangleCount = package.vertices.size32() / 3;
+      meshData.vtx = resources->createVertexDeviceBuffer(std::max(size_t(1), package.vertices.byteSize()));
+      const auto & tangents = package.frames->tangents;
+      const auto & binormals = package.frames->binormals;
+      meshData.tan = resources->createVertexDeviceBuffer(std::max(size_t(1), tangents.byteSize()));
+      meshData.bnm = resources->createVertexDeviceBuffer(std::max(size_t(1), binormals.byteSize()));
+      if (meshData.triangleCount) {
+        vCtx->frameManager->stageAndCopyBuffer(meshData.vtx, package.vertices.data(), package.vertices.byteSize());
+        vCtx->frameManager->stageAndCopyBuffer(meshData.tan, tangents.data(), tangents.byteSize());
+        vCtx->frameManager->stageAndCopyBuffer(meshData.bnm, binormals.data(), binormals.byteSize());
       }
-      vCtx->frameManager->copyBuffer(meshData.vtx, vtxStaging, meshData.vtx.resource->requestedSize);
-      vCtx->frameManager->copyBuffer(meshData.tan, tanStaging, meshData.tan.resource->requestedSize);
-      vCtx->frameManager->copyBuffer(meshData.bnm, bnmStaging, meshData.bnm.resource->requestedSize);
       logger(0, "Updated RenderTangents.MeshData item.");
     }
+
+    if (meshData.geometryGeneration != mesh->geometryGeneration && !meshData.pending.pending()) {
+      meshData.pending.start(&app->tasks, mesh->geometryGeneration, [logger = logger, tasks = &app->tasks, cache = &app->meshDerived, mesh](GeometryPackage& package, const uint32_t&)
+      {
+        prepareGeometry(logger, tasks, cache, package, mesh);
+      });
+    }
   }
   meshData.swap(newMeshData);
   for (auto & item : newMeshData) {
     if (item.src == nullptr) continue;
-    // just handles and those will destroy themselves.
+    // just handles and those will destroy themselves, a pending package is released when its task ends.
     logger(0, "Destroyed RenderTangents.MeshData item.");
   }
 }
@@ -262,6 +235,7 @@ void RenderTangents::draw(VkCommandBuffer cmdBuf, RenderPassHandle pass, const V
   }
 
   for (auto & item : meshData) {
+    if (!item.vtx) continue;
     VkDescriptorBufferInfo objectBufferInfo;
     auto* objectBuffer = (ObjectBuffer*)vCtx->frameManager->allocUniformStore(objectBufferInfo, sizeof(ObjectBuffer));
     objectBuffer->MVP = MVP;
@@ -1,6 +1,9 @@
 #pragma once
 #include <vulkan/vulkan.h>
 #include "Common.h"
+#include "LinAlg.h"
+#include "AsyncPackage.h"
+#include "MeshDerived.h"
 #include "VulkanContext.h"
 #include "ResourceManager.h"
 #include "RenderTextureManager.h"
@@ -28,10 +31,18 @@ private:
   Logger logger;
   App* app = nullptr;
 
+  // Contents of the vertex buffers, three corners per triangle, prepared off the frame thread.
+  struct GeometryPackage
+  {
+    Vector<Vec3f> vertices;
+    std::shared_ptr<const MeshTangents> frames;
+  };
+
   struct MeshData
   {
     Mesh* src = nullptr;
     uint32_t geometryGeneration = 0;
+    AsyncPackage<uint32_t, GeometryPackage> pending;  // Keyed by geometry generation.
     RenderBufferHandle vtx;
     RenderBufferHandle tan;
     RenderBufferHandle bnm;
@@ -46,4 +57,5 @@ private:
   uint32_t viewport[4];
 
   void buildPipelines(RenderPassHandle pass);
+  static void prepareGeometry(Logger logger, Tasks* tasks, MeshDerivedCache* cache, GeometryPackage& package, const Mesh* mesh);
 };
\ No newline at end of file
@@ -15,6 +15,15 @@ struct Vertex
   Vertex(const Vec3f& p,
          const Vec3f& n,
          const Vec2f& t,
+         const uint32_t c) :
+    Vertex(p, n, halfFromFloat(t.x), halfFromFloat(t.y), c)
+  {}
+
+  // Texture coordinate already converted to halves, see halvesFromFloats.
+  Vertex(const Vec3f& p,
+         const Vec3f& n,
+         const uint16_t u,
+         const uint16_t v,
          const uint32_t c)
   {
     px = p.x;
@@ -24,8 +33,8 @@ struct Vertex
     nx = uint8_t(127.f*nn.x + 127.f);
     ny = uint8_t(127.f*nn.y + 127.f);
     nz = uint8_t(127.f*nn.z + 127.f);
-    tu = halfFromFloat(t.x);
-    tv = halfFromFloat(t.y);
+    tu = u;
+    tv = v;
     r = (c >> 16) & 0xff;
     g = (c >> 8) & 0xff;
     b = (c) & 0xff;
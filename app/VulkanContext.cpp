@@ -195,6 +195,11 @@ VulkanContext::VulkanContext(Logger logger,
 
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
     vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+    VkPhysicalDeviceFeatures supportedFeatures{};
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    geometryShader = supportedFeatures.geometryShader == VK_TRUE;
+    logger(0, "Device %d: geometryShader=%d", chosenDevice, geometryShader ? 1 : 0);
   }
   // create device and queue
   { 
@@ -245,6 +250,7 @@ VulkanContext::VulkanContext(Logger logger,
     VkPhysicalDeviceFeatures enabledFeatures{};
     enabledFeatures.fillModeNonSolid = 1;
     enabledFeatures.samplerAnisotropy = 1;
+    enabledFeatures.geometryShader = geometryShader ? 1 : 0;   // For gl_PrimitiveID in fragment shaders.
 
     VkPhysicalDevice16BitStorageFeatures features16 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES };
     features16.storageBuffer16BitAccess = true;
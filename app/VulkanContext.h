@@ -75,6 +75,7 @@ public:
 
   bool nvRayTracing = false;
   bool nvMeshShader = false;
+  bool geometryShader = false;    // gl_PrimitiveID is available in fragment shaders.
 private:
 #ifdef _DEBUG
   bool debugLayer = true;
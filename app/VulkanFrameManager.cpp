@@ -292,7 +292,7 @@ VkCommandBuffer VulkanFrameManager::createPrimaryCommandBuffer()
   return cmdBuf;
 }
 
-void  VulkanFrameManager::stageAndCopyBuffer(RenderBufferHandle dst, const void* src, VkDeviceSize size)
+void  VulkanFrameManager::stageAndCopyBuffer(RenderBufferHandle dst, const void* src, VkDeviceSize size, VkDeviceSize dstOffset)
 {
   auto device = vCtx->device;
 
@@ -300,11 +300,43 @@ void  VulkanFrameManager::stageAndCopyBuffer(RenderBufferHandle dst, const void*
   assert(staging.resource->hostPtr);
 
   std::memcpy(staging.resource->hostPtr, src, size);
-  copyBuffer(dst, staging, size);
+  copyBuffer(dst, staging, size, dstOffset);
 }
 
 
-void VulkanFrameManager::copyBuffer(RenderBufferHandle dst, RenderBufferHandle src, VkDeviceSize size)
+void VulkanFrameManager::stageAndCopyBufferRegions(RenderBufferHandle dst, const void* src, const VkBufferCopy* regions, uint32_t regionCount)
+{
+  if (regionCount == 0) return;
+
+  VkDeviceSize size = 0;
+  for (uint32_t i = 0; i < regionCount; i++) size += regions[i].size;
+
+  auto staging = vCtx->resources->createStagingBuffer(size);
+  assert(staging.resource->hostPtr);
+
+  // Regions are packed back to back in the staging buffer.
+  Vector<VkBufferCopy> copyRegions(regionCount);
+  VkDeviceSize offset = 0;
+  for (uint32_t i = 0; i < regionCount; i++) {
+    std::memcpy((char*)staging.resource->hostPtr + offset, (const char*)src + regions[i].srcOffset, regions[i].size);
+    copyRegions[i].srcOffset = offset;
+    copyRegions[i].dstOffset = regions[i].dstOffset;
+    copyRegions[i].size = regions[i].size;
+    offset += regions[i].size;
+  }
+
+  auto cmdBuf = createPrimaryCommandBuffer();
+
+  VkCommandBufferBeginInfo beginInfo{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(cmdBuf, &beginInfo);
+  vkCmdCopyBuffer(cmdBuf, staging.resource->buffer, dst.resource->buffer, regionCount, copyRegions.data());
+  vkEndCommandBuffer(cmdBuf);
+  submitGraphics(cmdBuf, true);
+}
+
+
+void VulkanFrameManager::copyBuffer(RenderBufferHandle dst, RenderBufferHandle src, VkDeviceSize size, VkDeviceSize dstOffset)
 {
   auto cmdBuf = createPrimaryCommandBuffer();
 
@@ -313,6 +345,7 @@ void VulkanFrameManager::copyBuffer(RenderBufferHandle dst, RenderBufferHandle s
   vkBeginCommandBuffer(cmdBuf, &beginInfo);
 
   VkBufferCopy copyRegion{};
+  copyRegion.dstOffset = dstOffset;
   copyRegion.size = size;
   vkCmdCopyBuffer(cmdBuf, src.resource->buffer, dst.resource->buffer, 1, &copyRegion);
   vkEndCommandBuffer(cmdBuf);
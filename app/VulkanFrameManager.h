@@ -20,8 +20,10 @@ public:
   void resize(uint32_t w, uint32_t h);
 
   VkCommandBuffer createPrimaryCommandBuffer();
-  void stageAndCopyBuffer(RenderBufferHandle dst, const void* src, VkDeviceSize size);
-  void copyBuffer(RenderBufferHandle dst, RenderBufferHandle src, VkDeviceSize size);
+  void stageAndCopyBuffer(RenderBufferHandle dst, const void* src, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+  void copyBuffer(RenderBufferHandle dst, RenderBufferHandle src, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+  // Copies several regions of src, with offsets in bytes into src and dst, through one staging buffer and one submit.
+  void stageAndCopyBufferRegions(RenderBufferHandle dst, const void* src, const VkBufferCopy* regions, uint32_t regionCount);
   void transitionImageLayout(ImageHandle image, VkImageLayout layout);
   void copyBufferToImage(ImageHandle dst, RenderBufferHandle src, uint32_t w, uint32_t h);
   void submitGraphics(VkCommandBuffer cmdBuf, bool wait = false);
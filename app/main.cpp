@@ -15,10 +15,12 @@
 #include "Viewer.h"
 #include "Common.h"
 #include "Mesh.h"
+#include "MeshLod.h"
 #include "LinAlgOps.h"
 #include "RenderSolid.h"
 #include "Raycaster.h"
 #include "HandlePicking.h"
+#include "Bounds.h"
 #include "App.h"
 
 
@@ -101,6 +103,10 @@ namespace {
         if (mods == GLFW_MOD_CONTROL) {
           app->picking = true;
         }
+        else if (mods == GLFW_MOD_SHIFT) {
+          app->marqueeActive = true;
+          app->marqueeStart = Vec2f(float(x), float(y));
+        }
         else {
           app->viewer->startRotation(float(x), float(y));
         }
@@ -110,6 +116,11 @@ namespace {
       }
       break;
     case GLFW_RELEASE:
+      if (button == 0 && app->marqueeActive) {
+        app->marqueeActive = false;
+        app->marqueeSelect = true;
+        app->marqueeStop = Vec2f(float(x), float(y));
+      }
       app->viewer->stopAction();
       break;
     }
@@ -215,7 +226,6 @@ namespace {
       CloseHandle(h);
     }
     if (mesh) {
-
       auto * name = path.c_str();
       for (auto * t = name; *t != '\0'; t++) {
         if (*t == '\\' || *t == '//') name = t + 1;
@@ -227,6 +237,14 @@ namespace {
       std::lock_guard<std::mutex> guard(app->incomingMeshLock);
       app->incomingMeshes.pushBack(mesh);
       logger(0, "Read %s in %lldms", path.c_str(), e);
+
+      // Levels of detail are built by a job of their own and picked up by the renderers once published.
+      TaskFunc lodFunc = [mesh](bool&)
+      {
+        float lodRatios[] = { 0.5f, 0.25f, 0.125f };
+        buildMeshLods(logger, mesh, lodRatios, ARRAYSIZE(lodRatios));
+      };
+      app->tasks.enqueue(lodFunc);
     }
     else {
       logger(0, "Failed to read %s", path.c_str());
@@ -248,6 +266,13 @@ namespace {
         if (ImGui::MenuItem("None", "CTRL+ ")) {
           app->selectNone = true;
         }
+        if (ImGui::MenuItem("Invert")) {
+          app->selectInvert = true;
+        }
+        ImGui::Separator();
+        if (ImGui::InputText("By name", app->selectPattern, sizeof(app->selectPattern), ImGuiInputTextFlags_EnterReturnsTrue)) {
+          app->selectMatching = true;
+        }
         ImGui::EndMenu();
       }
 
@@ -258,8 +283,25 @@ namespace {
         if (ImGui::MenuItem("Solid", "S", &app->viewSolid)) {}
         if (ImGui::MenuItem("Lines", "L", &app->viewLines)) {}
         if (ImGui::MenuItem("Outlines", "W", &app->viewOutlines)) {}
+        if (ImGui::BeginMenu("Outline edges", app->viewOutlines)) {
+          struct { const char* name; uint32_t bit; } classes[] = {
+            { "Interior", EdgeInterior },
+            { "Boundary", EdgeBoundary },
+            { "Non-manifold", EdgeNonManifold },
+            { "Crease", EdgeCrease },
+            { "Object boundary", EdgeObjectBoundary },
+            { "Smoothing group boundary", EdgeSmoothingBoundary }
+          };
+          for (auto & c : classes) {
+            bool sel = (app->outlineClasses & c.bit) != 0;
+            if (ImGui::MenuItem(c.name, nullptr, &sel)) app->outlineClasses ^= c.bit;
+          }
+          ImGui::SliderFloat("Crease angle", &app->outlineCreaseAngle, 0.f, 180.f, "%.0f deg");
+          ImGui::EndMenu();
+        }
         if (ImGui::MenuItem("Tangent coordsys", "C", &app->viewTangents)) {}
         if (ImGui::MenuItem("Normal vectors", "N", &app->viewNormals)) {}
+        if (ImGui::MenuItem("Level of detail", nullptr, &app->useLods)) {}
         if (ImGui::BeginMenu("RenderMode", app->viewSolid)) {
           bool sel[3] = {
             app->renderMode == RenderMode::Normal,
@@ -286,6 +328,20 @@ namespace {
           if (ImGui::MenuItem("Triangle order", nullptr, &sel[3])) { app->triangleColor = TriangleColor::TriangleOrder; app->updateColor = true; }
           ImGui::EndMenu();
         }
+        if (ImGui::BeginMenu("Index order")) {
+          IndexOptimizer strategies[] = {
+            IndexOptimizer::None,
+            IndexOptimizer::Forsyth,
+            IndexOptimizer::ForsythPartitioned,
+            IndexOptimizer::Tipsify,
+            IndexOptimizer::TipsifyOverdraw
+          };
+          for (auto strategy : strategies) {
+            bool sel = app->indexOptimizer == strategy;
+            if (ImGui::MenuItem(getIndexOptimizerName(strategy), nullptr, &sel)) app->indexOptimizer = strategy;
+          }
+          ImGui::EndMenu();
+        }
         if (ImGui::BeginMenu("Texturing")) {
           if (app->renderSolid) {
             bool sel[3] = {
@@ -337,7 +393,8 @@ namespace {
       for(auto * m : app->items.meshes) {
         if (ImGui::TreeNodeEx(m, ImGuiTreeNodeFlags_DefaultOpen, "%s Vn=%d Tn=%d", m->name ? m->name : "unnamed", m->vtxCount, m->triCount)) {
           for (unsigned o = 0; o < m->obj_n; o++) {
-            if (ImGui::Selectable(m->obj[o], &m->selected[o], ImGuiSelectableFlags_PressedOnClick)) {
+            if (ImGui::Selectable(m->obj[o], m->selection.get(o), ImGuiSelectableFlags_PressedOnClick)) {
+              m->selection.toggle(o);
               app->updateColor = true;
               //moveToSelection = true;
             }
@@ -373,9 +430,7 @@ namespace {
         auto obj_n = m->obj_n;
         if (obj_n == 0) obj_n = 1;
 
-        m->currentColor = (uint32_t*)m->arena.alloc(sizeof(uint32_t) * m->triCount);
-        m->selected = (bool*)m->arena.alloc(sizeof(bool)*(obj_n));
-        std::memset(m->selected, 0, sizeof(bool)*obj_n);
+        m->selection.resize(obj_n);
         app->updateColor = true;
 
         app->items.meshes.pushBack(m);
@@ -396,24 +451,6 @@ namespace {
 
 }
 
-namespace {
-
-  uint32_t colors[] = {
-    0xffcc0000,0xff9e91cc,0xff5ea5f4,0xff8c8c51,
-    0xffff7547,0xff2b2bcc,0xffe0eded,0xff2d4f2d,
-    0xff707ff9,0xff00a5ff,0xff2175ed,0xff0000ff,
-    0xff8c668c,0xff238e23,0xffaae8ed,0xff445bcc,
-    0xff660033,0xff937c68,0xff33c9ed,0xffd1eded,
-    0xffe5e0af,0xffbfbfbf,0xff00cccc,0xff14448c,
-    0xff8911ed,0xff990066,0xffdd00dd,0xff4763ff,
-    0xff4f2d2d,0xff0099ed,0xff33cc99,0xffc6ed75,
-    0xff4f4f2d,0xff0000cc,0xff5e9e9e,0xffb2ddf4,
-    0xffeded00,0xffccbf00,0xff7fff00,0xffa8a8a8,
-    0xff00cc00,0xffdbf4f4,0xff007fff,0xff7093db,
-    0xfff4f4f4,0xff6b238e,0xff7f0000,0xffed82ed
-  };
-}
-
 int main(int argc, char** argv)
 {
   GLFWwindow* window;
@@ -516,36 +553,73 @@ int main(int argc, char** argv)
       glfwGetCursorPos(window, &x, &y);
 
       Hit hit;
-      HitTmp tmp;
+      auto start = std::chrono::high_resolution_clock::now();
       Vec2f viewerPos(app->leftSplit, app->menuHeight);
       Vec2f viewerSize(app->width - viewerPos.x, app->height - viewerPos.y);
 
-      if(nearestHit(hit, tmp, logger,
+      if(nearestHit(hit, app->hitTmp, logger, &app->tasks,
                     app->items.meshes,
                     app->viewer->getProjectionViewMatrix(),
                     app->viewer->getProjectionViewInverseMatrix(),
                     viewerPos, viewerSize, Vec2f(float(x), float(y))))
       {
         auto * m = app->items.meshes[hit.mesh];
-        auto o = m->TriObjIx[hit.triangle];
-        m->selected[o] = !m->selected[o];
+        auto o = m->TriObjIx ? m->TriObjIx[hit.triangle] : 0;
+        m->selection.toggle(o);
         app->scrollToItem = o;
         app->updateColor = true;
-        logger(0, "Hit mesh %d triangle %d at %f", hit.mesh, hit.triangle, hit.depth);
+        auto stop = std::chrono::high_resolution_clock::now();
+        logger(0, "Hit mesh %d triangle %d at %f in %.0fus", hit.mesh, hit.triangle, hit.depth,
+               std::chrono::duration<double, std::micro>(stop - start).count());
       }
       else {
         logger(0, "Miss");
       }
     }
 
+    if (app->marqueeSelect) {
+      app->marqueeSelect = false;
+
+      auto start = std::chrono::high_resolution_clock::now();
+      Vec2f viewerPos(app->leftSplit, app->menuHeight);
+      Vec2f viewerSize(app->width - viewerPos.x, app->height - viewerPos.y);
+
+      Vector<ObjectHit> hits;
+      objectsInRectangle(hits, app->hitTmp, logger, &app->tasks,
+                         app->items.meshes,
+                         app->viewer->getProjectionViewMatrix(),
+                         viewerPos, viewerSize, app->marqueeStart, app->marqueeStop);
+      for (auto & hit : hits) {
+        auto * m = app->items.meshes[hit.mesh];
+        if (hit.object < m->selection.count) m->selection.set(hit.object, true);
+      }
+      app->updateColor = true;
+      auto stop = std::chrono::high_resolution_clock::now();
+      logger(0, "Selected %u objects in %.1fms", hits.size32(),
+             std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+
     if (app->selectAll | app->selectNone) {
+      bool all = app->selectAll;
       app->selectAll = app->selectNone = false;
+      for (auto * m : app->items.meshes) m->selection.setAll(all);
+      app->updateColor = true;
+    }
+
+    if (app->selectInvert) {
+      app->selectInvert = false;
+      for (auto * m : app->items.meshes) m->selection.invert();
+      app->updateColor = true;
+    }
+
+    if (app->selectMatching) {
+      app->selectMatching = false;
+      uint32_t matches = 0;
       for (auto * m : app->items.meshes) {
-        for (uint32_t i = 0; i < m->obj_n; i++) {
-          m->selected[i] = app->selectAll;
-          app->updateColor = true;
-        }
+        if (m->obj_n) matches += selectByName(m->selection, m->obj, m->obj_n, app->selectPattern);
       }
+      logger(0, "%u objects match '%s'", matches, app->selectPattern);
+      app->updateColor = true;
     }
 
     if (app->viewAll) {
@@ -557,87 +631,17 @@ int main(int argc, char** argv)
       app->moveToSelection = false;
       BBox3f bbox = createEmptyBBox3f();
       for (auto * m : app->items.meshes) {
-        for (uint32_t i = 0; i < m->triCount; i++) {
-          if (m->selected[m->TriObjIx[i]]) {
-            for (unsigned k = 0; k < 3; k++) {
-              engulf(bbox, m->vtx[m->triVtxIx[3 * i + k]]);
-            }
-          }
-        }
+        if (m->TriObjIx == nullptr) continue;
+        engulf(bbox, selectedBounds(getMeshObjects(app->hitTmp, logger, &app->tasks, m), m->selection));
       }
       if (isNotEmpty(bbox)) {
         app->viewer->view(bbox);
       }
     }
 
+    // Renderers evaluate the colors of the triangles they draw with App::getTriangleColorRule.
     if (app->updateColor) {
-      for (auto * m : app->items.meshes) {
-        m->touchColor();
-
-        auto color = app->triangleColor;
-        switch (color) {
-        case TriangleColor::ObjectId:
-          if (!m->TriObjIx) color = TriangleColor::Single;
-          break;
-        case TriangleColor::SmoothingGroup:
-          if (!m->triSmoothGroupIx) color = TriangleColor::Single;
-          break;
-        }
-
-        switch (color) {
-        case TriangleColor::Single:
-          for (uint32_t i = 0; i < m->triCount; i++) {
-            if (m->selected[m->TriObjIx[i]]) {
-              m->currentColor[i] = 0xffddffff;
-            }
-            else {
-              m->currentColor[i] = 0xff888888;
-            }
-          }
-          break;
-        case TriangleColor::ModelColor:
-          for (uint32_t i = 0; i < m->triCount; i++) {
-            if (m->selected[m->TriObjIx[i]]) {
-              m->currentColor[i] = 0xffddffff;
-            }
-            else {
-              m->currentColor[i] = m->triColor[i];
-            }
-          }
-          break;
-          break;
-        case TriangleColor::ObjectId:
-          for (uint32_t i = 0; i < m->triCount; i++) {
-            if (m->selected[m->TriObjIx[i]]) {
-              m->currentColor[i] = 0xffddffff;
-            }
-            else {
-              m->currentColor[i] = colors[m->TriObjIx[i] % (sizeof(colors) / sizeof(uint32_t))];
-            }
-          }
-          break;
-        case TriangleColor::SmoothingGroup:
-          for (uint32_t i = 0; i < m->triCount; i++) {
-            if (m->selected[m->TriObjIx[i]]) {
-              m->currentColor[i] = 0xffddffff;
-            }
-            else {
-              m->currentColor[i] = colors[m->triSmoothGroupIx[i] % (sizeof(colors) / sizeof(uint32_t))];
-            }
-          }
-          break;
-        case TriangleColor::TriangleOrder:
-          for (uint32_t i = 0; i < m->triCount; i++) {
-            if (m->selected[m->TriObjIx[i]]) {
-              m->currentColor[i] = 0xffddffff;
-            }
-            else {
-              m->currentColor[i] = colors[(i >> 8) % ARRAYSIZE(colors)];
-            }
-          }
-          break;
-        }
-      }
+      for (auto * m : app->items.meshes) m->touchColor();
     }
     app->updateColor = false;
 
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include "Common.h"
+#include "Tasks.h"
+
+// Data made in a task from the input identified by Key, for the frame thread to pick up once
+// finished so that preparing a large mesh never stalls a frame. The job is shared with its task,
+// so an unfinished package can be dropped at any time and is released when the task ends. The
+// prepare function must only read input that stays unchanged while it runs.
+template<typename Key, typename Package>
+class AsyncPackage
+{
+public:
+  typedef std::function<void(Package& package, const Key& key)> PrepareFunc;
+
+  // True from start until the finished package has been taken.
+  bool pending() const { return job != nullptr; }
+
+  // Key of the pending job.
+  const Key& pendingKey() const { assert(job); return job->key; }
+
+  // Runs prepare as a task, replacing any pending job.
+  void start(Tasks* tasks, const Key& key, PrepareFunc prepare)
+  {
+    job = std::make_shared<Job>();
+    job->key = key;
+    TaskFunc func = [j = job, prepare = std::move(prepare)](bool&)
+    {
+      prepare(j->package, j->key);
+      j->done.store(true);
+    };
+    tasks->enqueue(func);
+  }
+
+  // Moves out the package and its key and returns true if the pending job has finished.
+  bool take(Key& key, Package& package)
+  {
+    if (!job || !job->done.load()) return false;
+    key = job->key;
+    package = std::move(job->package);
+    job.reset();
+    return true;
+  }
+
+private:
+  struct Job
+  {
+    Key key;
+    Package package;
+    std::atomic<bool> done = false;
+  };
+  std::shared_ptr<Job> job;
+};
@@ -0,0 +1,1070 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <immintrin.h>
+#include <mutex>
+#include "Common.h"
+#include "LinAlgOps.h"
+#include "Tasks.h"
+#include "BVH.h"
+
+#if defined(__GNUC__) && !defined(__AVX__)
+#define AVX_TARGET __attribute__((target("avx")))
+#else
+#define AVX_TARGET
+#endif
+
+namespace {
+
+  constexpr uint32_t binCount = 16;
+  constexpr uint32_t maxLeafSize = 8;
+  constexpr uint32_t medianLeafSize = 4;
+  constexpr uint32_t binChunkSize = 1 << 14;    // Primitives per task when binning in parallel.
+  constexpr uint32_t minSubtreeSize = 1 << 12;  // Smallest range handed to a task as a whole subtree.
+  constexpr uint32_t maxDepth = 64;
+
+  // Slab exits are scaled by 1 + 2 gamma(3) so rounding never drops a box the ray just grazes,
+  // as in T. Ize, Robust BVH Ray Traversal. Hits on shared edges rely on this as much as on the
+  // watertight triangle test.
+  constexpr float robustExit = 1.f + 2.f * (3.f * 0.5f * FLT_EPSILON) / (1.f - 3.f * 0.5f * FLT_EPSILON);
+
+  float halfArea(const BBox3f& b)
+  {
+    if (isEmpty(b)) return 0.f;
+    auto e = b.max - b.min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+  }
+
+  // Half area of a non-empty box held in SSE registers.
+  float halfArea(__m128 min, __m128 max)
+  {
+    __m128 e = _mm_sub_ps(max, min);
+    __m128 f = _mm_shuffle_ps(e, e, _MM_SHUFFLE(3, 0, 2, 1));
+    alignas(16) float p[4];
+    _mm_store_ps(p, _mm_mul_ps(e, f));
+    return p[0] + p[1] + p[2];
+  }
+
+  // Primitive box moved along with its index, so binning reads memory in order.
+  struct PrimRef
+  {
+    Vec3f min;
+    uint32_t index;
+    Vec3f max;
+    uint32_t padding;
+
+    float center(unsigned axis) const { return 0.5f * (min[axis] + max[axis]); }
+  };
+
+  struct Range
+  {
+    uint32_t node;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t depth;
+    BBox3f bbox;
+    BBox3f centerBox;
+  };
+
+  // Bounds kept in SSE registers, the fourth lane is ignored.
+  struct Bin
+  {
+    __m128 min;
+    __m128 max;
+    __m128 centerMin;
+    __m128 centerMax;
+    uint32_t count;
+
+    BBox3f bbox() const { return toBBox(min, max); }
+    BBox3f centerBox() const { return toBBox(centerMin, centerMax); }
+
+    static BBox3f toBBox(__m128 lo, __m128 hi)
+    {
+      float a[4], b[4];
+      _mm_storeu_ps(a, lo);
+      _mm_storeu_ps(b, hi);
+      return BBox3f(Vec3f(a[0], a[1], a[2]), Vec3f(b[0], b[1], b[2]));
+    }
+  };
+
+  struct Bins
+  {
+    Bin bins[3][binCount];
+
+    void clear()
+    {
+      for (auto & axis : bins) {
+        for (auto & bin : axis) {
+          bin.min = bin.centerMin = _mm_set1_ps(FLT_MAX);
+          bin.max = bin.centerMax = _mm_set1_ps(-FLT_MAX);
+          bin.count = 0;
+        }
+      }
+    }
+
+    void merge(const Bins& other)
+    {
+      for (unsigned a = 0; a < 3; a++) {
+        for (unsigned k = 0; k < binCount; k++) {
+          auto & b = bins[a][k];
+          auto & o = other.bins[a][k];
+          b.min = _mm_min_ps(b.min, o.min);
+          b.max = _mm_max_ps(b.max, o.max);
+          b.centerMin = _mm_min_ps(b.centerMin, o.centerMin);
+          b.centerMax = _mm_max_ps(b.centerMax, o.centerMax);
+          b.count += o.count;
+        }
+      }
+    }
+  };
+
+  struct Builder
+  {
+    Tasks* tasks;
+    PrimRef* P;
+    BVHBuild method;
+
+    uint32_t binOf(const Range& r, unsigned axis, float scale, const PrimRef& ref) const
+    {
+      auto k = uint32_t(scale * (ref.center(axis) - r.centerBox.min[axis]));
+      return k < binCount ? k : binCount - 1;
+    }
+
+    // Same bins as binOf for all three axes at once.
+    void bin(Bins& bins, const Range& r, const Vec3f& scale, uint32_t begin, uint32_t end) const
+    {
+      bins.clear();
+      const __m128 half = _mm_set1_ps(0.5f);
+      const __m128 origin = _mm_setr_ps(r.centerBox.min.x, r.centerBox.min.y, r.centerBox.min.z, 0.f);
+      const __m128 scale4 = _mm_setr_ps(scale.x, scale.y, scale.z, 0.f);
+      const __m128 last = _mm_set1_ps(float(binCount - 1));
+      const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+      for (uint32_t i = begin; i < end; i++) {
+        // Clear the index in the fourth lane, as a float it is a denormal and very slow to add.
+        __m128 lo = _mm_and_ps(xyz, _mm_loadu_ps(&P[i].min.x));
+        __m128 hi = _mm_loadu_ps(&P[i].max.x);
+        __m128 c = _mm_mul_ps(half, _mm_add_ps(lo, hi));
+        __m128 k = _mm_min_ps(_mm_max_ps(_mm_mul_ps(scale4, _mm_sub_ps(c, origin)), _mm_setzero_ps()), last);
+        alignas(16) int32_t kk[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(kk), _mm_cvttps_epi32(k));
+        for (unsigned a = 0; a < 3; a++) {
+          auto & b = bins.bins[a][kk[a]];
+          b.min = _mm_min_ps(b.min, lo);
+          b.max = _mm_max_ps(b.max, hi);
+          b.centerMin = _mm_min_ps(b.centerMin, c);
+          b.centerMax = _mm_max_ps(b.centerMax, c);
+          b.count++;
+        }
+      }
+    }
+
+    void bounds(Range& r) const
+    {
+      r.bbox = createEmptyBBox3f();
+      r.centerBox = createEmptyBBox3f();
+      for (uint32_t i = r.begin; i < r.end; i++) {
+        engulf(r.bbox, P[i].min);
+        engulf(r.bbox, P[i].max);
+        engulf(r.centerBox, 0.5f * (P[i].min + P[i].max));
+      }
+    }
+
+    // Splits r into left and right, returns false if r should be a leaf.
+    bool split(Range& left, Range& right, const Range& r, bool parallel) const
+    {
+      // A leaf of any size beats overflowing the traversal stacks.
+      if (maxDepth <= r.depth + 1) return false;
+      left.depth = right.depth = r.depth + 1;
+
+      uint32_t n = r.end - r.begin;
+      auto extent = r.centerBox.max - r.centerBox.min;
+      unsigned widest = extent.x < extent.y ? (extent.y < extent.z ? 2 : 1) : (extent.x < extent.z ? 2 : 0);
+
+      uint32_t mid = 0;
+      if (method == BVHBuild::Median || extent[widest] <= 0.f) {
+        if (n <= (method == BVHBuild::Median ? medianLeafSize : maxLeafSize)) return false;
+        mid = r.begin + n / 2;
+        std::nth_element(P + r.begin, P + mid, P + r.end, [widest](const PrimRef& a, const PrimRef& b) { return a.center(widest) < b.center(widest); });
+        left.begin = r.begin;
+        left.end = mid;
+        right.begin = mid;
+        right.end = r.end;
+        bounds(left);
+        bounds(right);
+        return true;
+      }
+
+      if (n <= 2) return false;
+
+      Vec3f scale;
+      for (unsigned a = 0; a < 3; a++) scale[a] = 0.f < extent[a] ? binCount / extent[a] : 0.f;
+
+      // Bins are merged on the stack since Vector storage is not 16-byte aligned.
+      Bins bins;
+      if (parallel) {
+        bins.clear();
+        std::mutex binsLock;
+        uint32_t chunks = (n + binChunkSize - 1) / binChunkSize;
+        parallelFor(tasks, chunks, 1, [&](uint32_t begin, uint32_t end)
+        {
+          Bins partial;
+          for (uint32_t c = begin; c < end; c++) {
+            bin(partial, r, scale, r.begin + c * binChunkSize, std::min(r.end, r.begin + (c + 1) * binChunkSize));
+            std::lock_guard<std::mutex> guard(binsLock);
+            bins.merge(partial);
+          }
+        });
+      }
+      else {
+        bin(bins, r, scale, r.begin, r.end);
+      }
+
+      // Sweep the split planes between bins from both sides.
+      float bestCost = FLT_MAX;
+      unsigned bestAxis = 0;
+      uint32_t bestBin = 0;
+      for (unsigned a = 0; a < 3; a++) {
+        if (scale[a] == 0.f) continue;
+        float rightCost[binCount];
+        __m128 lo = _mm_set1_ps(FLT_MAX);
+        __m128 hi = _mm_set1_ps(-FLT_MAX);
+        uint32_t count = 0;
+        for (uint32_t k = binCount - 1; 0 < k; k--) {
+          lo = _mm_min_ps(lo, bins.bins[a][k].min);
+          hi = _mm_max_ps(hi, bins.bins[a][k].max);
+          count += bins.bins[a][k].count;
+          rightCost[k] = count ? count * halfArea(lo, hi) : 0.f;
+        }
+        lo = _mm_set1_ps(FLT_MAX);
+        hi = _mm_set1_ps(-FLT_MAX);
+        count = 0;
+        for (uint32_t k = 0; k + 1 < binCount; k++) {
+          lo = _mm_min_ps(lo, bins.bins[a][k].min);
+          hi = _mm_max_ps(hi, bins.bins[a][k].max);
+          count += bins.bins[a][k].count;
+          if (count == 0 || count == n) continue;
+          float cost = count * halfArea(lo, hi) + rightCost[k + 1];
+          if (cost < bestCost) {
+            bestCost = cost;
+            bestAxis = a;
+            bestBin = k;
+          }
+        }
+      }
+      assert(bestCost < FLT_MAX);
+
+      // Leaf if intersecting everything is cheaper than traversing one more level.
+      float area = halfArea(r.bbox);
+      if (n <= maxLeafSize && (area <= 0.f || float(n) <= 1.f + bestCost / area)) return false;
+
+      float s = scale[bestAxis];
+      mid = uint32_t(std::partition(P + r.begin, P + r.end, [&](const PrimRef& ref) { return binOf(r, bestAxis, s, ref) <= bestBin; }) - P);
+      left.begin = r.begin;
+      left.end = mid;
+      right.begin = mid;
+      right.end = r.end;
+      left.bbox = left.centerBox = right.bbox = right.centerBox = createEmptyBBox3f();
+      for (uint32_t k = 0; k < binCount; k++) {
+        auto & b = bins.bins[bestAxis][k];
+        auto & side = k <= bestBin ? left : right;
+        engulf(side.bbox, b.bbox());
+        engulf(side.centerBox, b.centerBox());
+      }
+      assert(left.begin < left.end && right.begin < right.end);
+      return true;
+    }
+
+    // Builds the subtree of r into nodes, with r.node already allocated.
+    void build(Vector<BVHNode>& nodes, const Range& root) const
+    {
+      Vector<Range> stack;
+      stack.pushBack(root);
+      while (!stack.empty()) {
+        auto r = stack.popBack();
+        nodes[r.node].bbox = r.bbox;
+
+        Range left, right;
+        if (!split(left, right, r, false)) {
+          nodes[r.node].first = r.begin;
+          nodes[r.node].count = r.end - r.begin;
+          continue;
+        }
+        left.node = nodes.size32();
+        right.node = left.node + 1;
+        nodes.pushBack(BVHNode());
+        nodes.pushBack(BVHNode());
+        nodes[r.node].first = left.node;
+        nodes[r.node].count = 0;
+        stack.pushBack(left);
+        stack.pushBack(right);
+      }
+    }
+  };
+
+  // Slab test, tNear is the entry distance when the box is hit before tFar.
+  bool intersectBox(float& tNear, const BBox3f& bbox, const Vec3f& origin, const Vec3f& invDirection, float tFar)
+  {
+    float t0 = 0.f;
+    float t1 = tFar;
+    for (unsigned k = 0; k < 3; k++) {
+      float a = (bbox.min[k] - origin[k]) * invDirection[k];
+      float b = (bbox.max[k] - origin[k]) * invDirection[k];
+      t0 = std::max(t0, std::min(a, b));
+      t1 = std::min(t1, std::max(a, b));
+    }
+    tNear = t0;
+    return t0 <= robustExit * t1;
+  }
+
+  // Ray set up for the watertight test of S. Woop, C. Benthin and I. Wald, Watertight
+  // Ray/Triangle Intersection. Coordinates are permuted so that z is the dominant direction
+  // axis, and the shear (Sx, Sy, Sz) maps the direction to +z.
+  struct WatertightRay
+  {
+    double o[3];    // Origin in permuted order.
+    unsigned k[3];  // Permutation, kx, ky, kz.
+    float Sx, Sy, Sz;
+
+    WatertightRay(const Vec3f& origin, const Vec3f& direction)
+    {
+      unsigned kz = 0;
+      if (std::abs(direction[kz]) < std::abs(direction.y)) kz = 1;
+      if (std::abs(direction[kz]) < std::abs(direction.z)) kz = 2;
+      unsigned kx = kz == 2 ? 0 : kz + 1;
+      unsigned ky = kx == 2 ? 0 : kx + 1;
+      if (direction[kz] < 0.f) std::swap(kx, ky);   // Keep the winding.
+      k[0] = kx;
+      k[1] = ky;
+      k[2] = kz;
+      for (unsigned i = 0; i < 3; i++) o[i] = double(origin[k[i]]);
+      Sx = direction[kx] / direction[kz];
+      Sy = direction[ky] / direction[kz];
+      Sz = 1.f / direction[kz];
+    }
+
+    // Vertex relative to the origin in permuted order. The difference is taken in double,
+    // so small triangles far from the world origin keep their precision.
+    void translate(float* r, const Vec3f& p) const
+    {
+      for (unsigned i = 0; i < 3; i++) r[i] = float(double(p[k[i]]) - o[i]);
+    }
+  };
+
+  // Edge functions recomputed in double when one is zero, so a ray through an edge or
+  // a vertex is decided consistently for all triangles sharing it.
+  void edgeFunctionsDouble(float& U, float& V, float& W, float ax, float ay, float bx, float by, float cx, float cy)
+  {
+    U = float(double(cx) * double(by) - double(cy) * double(bx));
+    V = float(double(ax) * double(cy) - double(ay) * double(cx));
+    W = float(double(bx) * double(ay) - double(by) * double(ax));
+  }
+
+  bool intersectWatertight(float& t, float& u, float& v, const WatertightRay& ray,
+                           const Vec3f& p0, const Vec3f& p1, const Vec3f& p2)
+  {
+    float a[3], b[3], c[3];
+    ray.translate(a, p0);
+    ray.translate(b, p1);
+    ray.translate(c, p2);
+    float ax = a[0] - ray.Sx * a[2];
+    float ay = a[1] - ray.Sy * a[2];
+    float bx = b[0] - ray.Sx * b[2];
+    float by = b[1] - ray.Sy * b[2];
+    float cx = c[0] - ray.Sx * c[2];
+    float cy = c[1] - ray.Sy * c[2];
+
+    float U = cx * by - cy * bx;
+    float V = ax * cy - ay * cx;
+    float W = bx * ay - by * ax;
+    if (U == 0.f || V == 0.f || W == 0.f) edgeFunctionsDouble(U, V, W, ax, ay, bx, by, cx, cy);
+
+    // Both sides are hit, so only mixed signs are a miss.
+    if ((U < 0.f || V < 0.f || W < 0.f) && (0.f < U || 0.f < V || 0.f < W)) return false;
+    float det = U + V + W;
+    if (det == 0.f) return false;
+
+    float T = U * (ray.Sz * a[2]) + V * (ray.Sz * b[2]) + W * (ray.Sz * c[2]);
+    float rcpDet = 1.f / det;
+    t = T * rcpDet;
+    u = V * rcpDet;
+    v = W * rcpDet;
+    return true;
+  }
+
+  // Vertex relative to the origin with the same rounding as WatertightRay::translate, the
+  // lanes hold the permuted x, y, z and zero.
+  AVX_TARGET __m128 translateAVX(const Vec3f& p, __m256d origin, __m128i permutation)
+  {
+    __m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(&p.x)));
+    __m128 xyz = _mm_movelh_ps(xy, _mm_load_ss(&p.z));
+    __m128 d = _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_cvtps_pd(xyz), origin));
+    return _mm_permutevar_ps(d, permutation);
+  }
+
+  // Eight rows of x, y, z, w to x, y and z registers of eight lanes.
+  AVX_TARGET void transposeAVX(__m256* soa, __m128* rows)
+  {
+    _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+    _MM_TRANSPOSE4_PS(rows[4], rows[5], rows[6], rows[7]);
+    for (unsigned j = 0; j < 3; j++) soa[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(rows[j]), rows[4 + j], 1);
+  }
+
+  // Same arithmetic as intersectWatertight on up to eight triangles at a time.
+  AVX_TARGET bool intersectLeafAVX(RayHit& hit, float& tMax, const uint32_t* primitives, uint32_t count,
+                                   const Vec3f* vtx, const uint32_t* triVtxIx, const WatertightRay& ray)
+  {
+    double o[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (unsigned i = 0; i < 3; i++) o[ray.k[i]] = ray.o[i];
+    __m256d origin = _mm256_loadu_pd(o);
+    __m128i permutation = _mm_setr_epi32(int(ray.k[0]), int(ray.k[1]), int(ray.k[2]), 3);
+
+    bool found = false;
+    for (uint32_t first = 0; first < count; first += 8) {
+      uint32_t n = std::min(8u, count - first);
+
+      __m128 ra[8], rb[8], rc[8];
+      for (unsigned i = 0; i < 8; i++) {
+        if (i < n) {
+          auto tri = primitives[first + i];
+          ra[i] = translateAVX(vtx[triVtxIx[3 * tri + 0]], origin, permutation);
+          rb[i] = translateAVX(vtx[triVtxIx[3 * tri + 1]], origin, permutation);
+          rc[i] = translateAVX(vtx[triVtxIx[3 * tri + 2]], origin, permutation);
+        }
+        else {
+          ra[i] = rb[i] = rc[i] = _mm_setzero_ps();
+        }
+      }
+      __m256 a[3], b[3], c[3];
+      transposeAVX(a, ra);
+      transposeAVX(b, rb);
+      transposeAVX(c, rc);
+
+      __m256 Sx = _mm256_set1_ps(ray.Sx);
+      __m256 Sy = _mm256_set1_ps(ray.Sy);
+      __m256 Sz = _mm256_set1_ps(ray.Sz);
+      __m256 az = a[2];
+      __m256 bz = b[2];
+      __m256 cz = c[2];
+      __m256 ax = _mm256_sub_ps(a[0], _mm256_mul_ps(Sx, az));
+      __m256 ay = _mm256_sub_ps(a[1], _mm256_mul_ps(Sy, az));
+      __m256 bx = _mm256_sub_ps(b[0], _mm256_mul_ps(Sx, bz));
+      __m256 by = _mm256_sub_ps(b[1], _mm256_mul_ps(Sy, bz));
+      __m256 cx = _mm256_sub_ps(c[0], _mm256_mul_ps(Sx, cz));
+      __m256 cy = _mm256_sub_ps(c[1], _mm256_mul_ps(Sy, cz));
+
+      __m256 U = _mm256_sub_ps(_mm256_mul_ps(cx, by), _mm256_mul_ps(cy, bx));
+      __m256 V = _mm256_sub_ps(_mm256_mul_ps(ax, cy), _mm256_mul_ps(ay, cx));
+      __m256 W = _mm256_sub_ps(_mm256_mul_ps(bx, ay), _mm256_mul_ps(by, ax));
+
+      __m256 zero = _mm256_setzero_ps();
+      __m256 valid = _mm256_cmp_ps(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps(float(n)), _CMP_LT_OQ);
+      __m256 onEdge = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(U, zero, _CMP_EQ_OQ), _mm256_cmp_ps(V, zero, _CMP_EQ_OQ)),
+                                   _mm256_cmp_ps(W, zero, _CMP_EQ_OQ));
+      if (int edgeMask = _mm256_movemask_ps(_mm256_and_ps(valid, onEdge))) {
+        alignas(32) float Ux[8], Vx[8], Wx[8], X[3][8], Y[3][8];
+        _mm256_store_ps(Ux, U);
+        _mm256_store_ps(Vx, V);
+        _mm256_store_ps(Wx, W);
+        _mm256_store_ps(X[0], ax); _mm256_store_ps(Y[0], ay);
+        _mm256_store_ps(X[1], bx); _mm256_store_ps(Y[1], by);
+        _mm256_store_ps(X[2], cx); _mm256_store_ps(Y[2], cy);
+        for (unsigned i = 0; i < 8; i++) {
+          if (edgeMask & (1 << i)) edgeFunctionsDouble(Ux[i], Vx[i], Wx[i], X[0][i], Y[0][i], X[1][i], Y[1][i], X[2][i], Y[2][i]);
+        }
+        U = _mm256_load_ps(Ux);
+        V = _mm256_load_ps(Vx);
+        W = _mm256_load_ps(Wx);
+      }
+
+      __m256 neg = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(U, zero, _CMP_LT_OQ), _mm256_cmp_ps(V, zero, _CMP_LT_OQ)),
+                                _mm256_cmp_ps(W, zero, _CMP_LT_OQ));
+      __m256 pos = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(zero, U, _CMP_LT_OQ), _mm256_cmp_ps(zero, V, _CMP_LT_OQ)),
+                                _mm256_cmp_ps(zero, W, _CMP_LT_OQ));
+      __m256 det = _mm256_add_ps(_mm256_add_ps(U, V), W);
+      __m256 ok = _mm256_andnot_ps(_mm256_and_ps(neg, pos), valid);
+      ok = _mm256_and_ps(ok, _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+      if (!_mm256_movemask_ps(ok)) continue;
+
+      __m256 T = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(U, _mm256_mul_ps(Sz, az)),
+                                             _mm256_mul_ps(V, _mm256_mul_ps(Sz, bz))),
+                               _mm256_mul_ps(W, _mm256_mul_ps(Sz, cz)));
+      __m256 rcpDet = _mm256_div_ps(_mm256_set1_ps(1.f), det);
+      __m256 t = _mm256_mul_ps(T, rcpDet);
+      ok = _mm256_and_ps(ok, _mm256_cmp_ps(zero, t, _CMP_LE_OQ));
+      int mask = _mm256_movemask_ps(ok);
+      if (!mask) continue;
+
+      alignas(32) float tx[8], ux[8], vx[8];
+      _mm256_store_ps(tx, t);
+      _mm256_store_ps(ux, _mm256_mul_ps(V, rcpDet));
+      _mm256_store_ps(vx, _mm256_mul_ps(W, rcpDet));
+      for (unsigned i = 0; i < 8; i++) {
+        if ((mask & (1 << i)) && tx[i] <= tMax) {
+          tMax = tx[i];
+          hit.triangle = primitives[first + i];
+          hit.t = tx[i];
+          hit.u = ux[i];
+          hit.v = vx[i];
+          found = true;
+        }
+      }
+    }
+    return found;
+  }
+
+  bool intersectLeaf(RayHit& hit, float& tMax, const Vector<uint32_t>& primitives, uint32_t first, uint32_t count,
+                     const Vec3f* vtx, const uint32_t* triVtxIx, const WatertightRay& ray)
+  {
+    if (cpuSupportsAVX()) return intersectLeafAVX(hit, tMax, primitives.data() + first, count, vtx, triVtxIx, ray);
+
+    bool found = false;
+    for (uint32_t i = first; i < first + count; i++) {
+      auto tri = primitives[i];
+      float t, u, v;
+      if (intersectWatertight(t, u, v, ray, vtx[triVtxIx[3 * tri + 0]], vtx[triVtxIx[3 * tri + 1]], vtx[triVtxIx[3 * tri + 2]]) &&
+          0.f <= t && t <= tMax)
+      {
+        tMax = t;
+        hit.triangle = tri;
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  template<unsigned W>
+  void collapse(WideBVH<W>& wide, const BVH& bvh)
+  {
+    wide.nodes.resize(0);
+    wide.primitives.resize(bvh.primitives.size());
+    if (bvh.primitives.any()) std::memcpy(wide.primitives.data(), bvh.primitives.data(), bvh.primitives.byteSize());
+    if (bvh.nodes.empty()) return;
+
+    struct Item
+    {
+      uint32_t wideNode;
+      uint32_t node;
+    };
+    Vector<Item> stack;
+    stack.pushBack(Item{ 0, 0 });
+    wide.nodes.pushBack(WideBVHNode<W>());
+    while (!stack.empty()) {
+      auto item = stack.popBack();
+
+      // Open the inner child with the largest area until all slots are used.
+      uint32_t slots[W];
+      uint32_t n = 0;
+      const auto & root = bvh.nodes[item.node];
+      if (root.count) {
+        slots[n++] = item.node;
+      }
+      else {
+        slots[n++] = root.first + 0;
+        slots[n++] = root.first + 1;
+        while (n < W) {
+          uint32_t best = ~0u;
+          float bestArea = -1.f;
+          for (uint32_t i = 0; i < n; i++) {
+            const auto & c = bvh.nodes[slots[i]];
+            float area = halfArea(c.bbox);
+            if (c.count == 0 && bestArea < area) {
+              bestArea = area;
+              best = i;
+            }
+          }
+          if (best == ~0u) break;
+          auto first = bvh.nodes[slots[best]].first;
+          slots[best] = first + 0;
+          slots[n++] = first + 1;
+        }
+      }
+
+      WideBVHNode<W> node;
+      for (uint32_t i = 0; i < W; i++) {
+        node.minX[i] = node.minY[i] = node.minZ[i] = FLT_MAX;
+        node.maxX[i] = node.maxY[i] = node.maxZ[i] = -FLT_MAX;
+        node.first[i] = ~0u;
+        node.count[i] = 0;
+      }
+      for (uint32_t i = 0; i < n; i++) {
+        const auto & c = bvh.nodes[slots[i]];
+        node.minX[i] = c.bbox.min.x; node.minY[i] = c.bbox.min.y; node.minZ[i] = c.bbox.min.z;
+        node.maxX[i] = c.bbox.max.x; node.maxY[i] = c.bbox.max.y; node.maxZ[i] = c.bbox.max.z;
+        if (c.count) {
+          node.first[i] = c.first;
+          node.count[i] = c.count;
+        }
+        else {
+          node.first[i] = wide.nodes.size32();
+          wide.nodes.pushBack(WideBVHNode<W>());
+          stack.pushBack(Item{ node.first[i], slots[i] });
+        }
+      }
+      wide.nodes[item.wideNode] = node;
+    }
+  }
+
+  template<unsigned W>
+  bool intersectWide(RayHit& hit, const WideBVH<W>& bvh,
+                     const Vec3f* vtx, const uint32_t* triVtxIx,
+                     const Vec3f& origin, const Vec3f& direction, float tMax)
+  {
+    if (bvh.nodes.empty()) return false;
+
+    // Near and far planes picked by direction sign, so empty boxes never hit.
+    WatertightRay ray(origin, direction);
+    Vec3f inv(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+    bool negX = inv.x < 0.f;
+    bool negY = inv.y < 0.f;
+    bool negZ = inv.z < 0.f;
+
+    struct Entry
+    {
+      uint32_t node;
+      float tNear;
+    };
+    Entry stack[maxDepth * W + 1];
+    uint32_t sp = 0;
+    stack[sp++] = Entry{ 0, 0.f };
+
+    bool found = false;
+    while (sp) {
+      auto entry = stack[--sp];
+      if (tMax < entry.tNear) continue;
+
+      const auto & node = bvh.nodes[entry.node];
+      const float* nearX = negX ? node.maxX : node.minX;
+      const float* farX = negX ? node.minX : node.maxX;
+      const float* nearY = negY ? node.maxY : node.minY;
+      const float* farY = negY ? node.minY : node.maxY;
+      const float* nearZ = negZ ? node.maxZ : node.minZ;
+      const float* farZ = negZ ? node.minZ : node.maxZ;
+
+      float t0[W], t1[W];
+      for (unsigned i = 0; i < W; i++) {
+        float ax = (nearX[i] - origin.x) * inv.x;
+        float bx = (farX[i] - origin.x) * inv.x;
+        float ay = (nearY[i] - origin.y) * inv.y;
+        float by = (farY[i] - origin.y) * inv.y;
+        float az = (nearZ[i] - origin.z) * inv.z;
+        float bz = (farZ[i] - origin.z) * inv.z;
+        float a = ax > 0.f ? ax : 0.f;
+        a = ay > a ? ay : a;
+        a = az > a ? az : a;
+        float b = bx < tMax ? bx : tMax;
+        b = by < b ? by : b;
+        b = bz < b ? bz : b;
+        t0[i] = a;
+        t1[i] = robustExit * b;
+      }
+
+      // Leaves right away, inner children pushed far to near.
+      Entry children[W];
+      uint32_t childCount = 0;
+      for (unsigned i = 0; i < W; i++) {
+        if (t1[i] < t0[i] || tMax < t0[i]) continue;
+        if (node.count[i]) {
+          found = intersectLeaf(hit, tMax, bvh.primitives, node.first[i], node.count[i], vtx, triVtxIx, ray) || found;
+        }
+        else if (node.first[i] != ~0u) {
+          uint32_t j = childCount++;
+          for (; 0 < j && children[j - 1].tNear < t0[i]; j--) children[j] = children[j - 1];
+          children[j] = Entry{ node.first[i], t0[i] };
+        }
+      }
+      assert(sp + childCount <= maxDepth * W + 1);
+      for (uint32_t i = 0; i < childCount; i++) stack[sp++] = children[i];
+    }
+    return found;
+  }
+
+  // Four rays in SSE registers, one lane per ray.
+  struct RayPacket
+  {
+    __m128 ox, oy, oz;
+    __m128 dx, dy, dz;
+    __m128 ix, iy, iz;
+    __m128 tMax;
+    __m128 active;
+  };
+
+  // Lanes of the packet that hit the box before their tMax, tNear is the smallest entry distance among them.
+  int intersectBox4(float& tNear, const BBox3f& bbox, const RayPacket& r)
+  {
+    __m128 ax = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.min.x), r.ox), r.ix);
+    __m128 bx = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.max.x), r.ox), r.ix);
+    __m128 ay = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.min.y), r.oy), r.iy);
+    __m128 by = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.max.y), r.oy), r.iy);
+    __m128 az = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.min.z), r.oz), r.iz);
+    __m128 bz = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bbox.max.z), r.oz), r.iz);
+    __m128 t0 = _mm_max_ps(_mm_setzero_ps(), _mm_min_ps(ax, bx));
+    t0 = _mm_max_ps(t0, _mm_min_ps(ay, by));
+    t0 = _mm_max_ps(t0, _mm_min_ps(az, bz));
+    __m128 t1 = _mm_min_ps(r.tMax, _mm_max_ps(ax, bx));
+    t1 = _mm_min_ps(t1, _mm_max_ps(ay, by));
+    t1 = _mm_min_ps(t1, _mm_max_ps(az, bz));
+    __m128 hit = _mm_and_ps(r.active, _mm_cmple_ps(t0, _mm_mul_ps(_mm_set1_ps(robustExit), t1)));
+
+    __m128 t = _mm_or_ps(_mm_and_ps(hit, t0), _mm_andnot_ps(hit, _mm_set1_ps(FLT_MAX)));
+    t = _mm_min_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 3, 0, 1)));
+    t = _mm_min_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+    tNear = _mm_cvtss_f32(t);
+    return _mm_movemask_ps(hit);
+  }
+
+  // Moller-Trumbore, one triangle against four rays. The watertight test needs a per-ray axis
+  // permutation, which does not fit lanes. Primary rays can live with an edge pixel missed now and then.
+  void intersectTriangle4(__m128& found, __m128i& hitTri, __m128& hitU, __m128& hitV, RayPacket& r, uint32_t tri,
+                          const Vec3f& p0, const Vec3f& p1, const Vec3f& p2)
+  {
+    auto e1 = p1 - p0;
+    auto e2 = p2 - p0;
+    __m128 e1x = _mm_set1_ps(e1.x), e1y = _mm_set1_ps(e1.y), e1z = _mm_set1_ps(e1.z);
+    __m128 e2x = _mm_set1_ps(e2.x), e2y = _mm_set1_ps(e2.y), e2z = _mm_set1_ps(e2.z);
+
+    __m128 pvx = _mm_sub_ps(_mm_mul_ps(r.dy, e2z), _mm_mul_ps(r.dz, e2y));
+    __m128 pvy = _mm_sub_ps(_mm_mul_ps(r.dz, e2x), _mm_mul_ps(r.dx, e2z));
+    __m128 pvz = _mm_sub_ps(_mm_mul_ps(r.dx, e2y), _mm_mul_ps(r.dy, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, pvx), _mm_mul_ps(e1y, pvy)), _mm_mul_ps(e1z, pvz));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+    __m128 tvx = _mm_sub_ps(r.ox, _mm_set1_ps(p0.x));
+    __m128 tvy = _mm_sub_ps(r.oy, _mm_set1_ps(p0.y));
+    __m128 tvz = _mm_sub_ps(r.oz, _mm_set1_ps(p0.z));
+    __m128 u = _mm_mul_ps(invDet, _mm_add_ps(_mm_add_ps(_mm_mul_ps(tvx, pvx), _mm_mul_ps(tvy, pvy)), _mm_mul_ps(tvz, pvz)));
+
+    __m128 qvx = _mm_sub_ps(_mm_mul_ps(tvy, e1z), _mm_mul_ps(tvz, e1y));
+    __m128 qvy = _mm_sub_ps(_mm_mul_ps(tvz, e1x), _mm_mul_ps(tvx, e1z));
+    __m128 qvz = _mm_sub_ps(_mm_mul_ps(tvx, e1y), _mm_mul_ps(tvy, e1x));
+    __m128 v = _mm_mul_ps(invDet, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r.dx, qvx), _mm_mul_ps(r.dy, qvy)), _mm_mul_ps(r.dz, qvz)));
+    __m128 t = _mm_mul_ps(invDet, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qvx), _mm_mul_ps(e2y, qvy)), _mm_mul_ps(e2z, qvz)));
+
+    // Written as negated rejections so that nans pass the same way they do in the scalar test.
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.f);
+    __m128 m = _mm_and_ps(r.active, _mm_cmpneq_ps(det, zero));
+    m = _mm_and_ps(m, _mm_cmpnlt_ps(u, zero));
+    m = _mm_and_ps(m, _mm_cmpnlt_ps(one, u));
+    m = _mm_and_ps(m, _mm_cmpnlt_ps(v, zero));
+    m = _mm_and_ps(m, _mm_cmpnlt_ps(one, _mm_add_ps(u, v)));
+    m = _mm_and_ps(m, _mm_cmple_ps(zero, t));
+    m = _mm_and_ps(m, _mm_cmple_ps(t, r.tMax));
+
+    found = _mm_or_ps(found, m);
+    r.tMax = _mm_or_ps(_mm_and_ps(m, t), _mm_andnot_ps(m, r.tMax));
+    hitU = _mm_or_ps(_mm_and_ps(m, u), _mm_andnot_ps(m, hitU));
+    hitV = _mm_or_ps(_mm_and_ps(m, v), _mm_andnot_ps(m, hitV));
+    __m128i mi = _mm_castps_si128(m);
+    hitTri = _mm_or_si128(_mm_and_si128(mi, _mm_set1_epi32(int(tri))), _mm_andnot_si128(mi, hitTri));
+  }
+
+}
+
+
+void buildBVH(Logger logger, Tasks* tasks, BVH& bvh, const BBox3f* boxes, uint32_t count, BVHBuild method)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+
+  bvh.nodes.resize(0);
+  bvh.primitives.resize(count);
+  if (count == 0) return;
+
+  Vector<PrimRef> refs(count);
+  parallelFor(tasks, count, 1 << 14, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t i = begin; i < end; i++) {
+      refs[i].min = boxes[i].min;
+      refs[i].index = i;
+      refs[i].max = boxes[i].max;
+      refs[i].padding = 0;
+    }
+  });
+
+  Builder builder{ tasks, refs.data(), method };
+
+  Range root;
+  root.node = 0;
+  root.begin = 0;
+  root.end = count;
+  root.depth = 0;
+  builder.bounds(root);
+  bvh.nodes.pushBack(BVHNode());
+
+  if (tasks == nullptr) {
+    builder.build(bvh.nodes, root);
+  }
+  else {
+    // Split the top levels with parallel binning until the ranges are small enough
+    // to balance over the workers, then build those subtrees in parallel.
+    uint32_t subtreeSize = std::max(minSubtreeSize, count / (8 * (tasks->getWorkerCount() + 1)));
+    Vector<Range> stack;
+    Vector<Range> subtrees;
+    stack.pushBack(root);
+    while (!stack.empty()) {
+      auto r = stack.popBack();
+      bvh.nodes[r.node].bbox = r.bbox;
+      if (r.end - r.begin <= subtreeSize) {
+        subtrees.pushBack(r);
+        continue;
+      }
+      Range left, right;
+      if (!builder.split(left, right, r, true)) {
+        bvh.nodes[r.node].first = r.begin;
+        bvh.nodes[r.node].count = r.end - r.begin;
+        continue;
+      }
+      left.node = bvh.nodes.size32();
+      right.node = left.node + 1;
+      bvh.nodes.pushBack(BVHNode());
+      bvh.nodes.pushBack(BVHNode());
+      bvh.nodes[r.node].first = left.node;
+      bvh.nodes[r.node].count = 0;
+      stack.pushBack(left);
+      stack.pushBack(right);
+    }
+
+    Vector<Vector<BVHNode>> subtreeNodes(subtrees.size());
+    parallelFor(tasks, subtrees.size32(), 1, [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t i = begin; i < end; i++) {
+        auto r = subtrees[i];
+        r.node = 0;
+        subtreeNodes[i].pushBack(BVHNode());
+        builder.build(subtreeNodes[i], r);
+      }
+    });
+
+    // Subtree roots replace their placeholders, the rest is appended after the top levels.
+    for (uint32_t i = 0; i < subtrees.size32(); i++) {
+      const auto & nodes = subtreeNodes[i];
+      uint32_t offset = bvh.nodes.size32() - 1;
+      for (uint32_t k = 0; k < nodes.size32(); k++) {
+        auto node = nodes[k];
+        if (node.count == 0) node.first += offset;
+        if (k == 0) bvh.nodes[subtrees[i].node] = node;
+        else bvh.nodes.pushBack(node);
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++) bvh.primitives[i] = refs[i].index;
+
+  auto stop = std::chrono::high_resolution_clock::now();
+  logger(0, "Built %s BVH with %u nodes over %u primitives in %.1fms, SAH cost %.1f",
+         method == BVHBuild::Median ? "median" : "SAH", bvh.nodes.size32(), count,
+         std::chrono::duration<double, std::milli>(stop - start).count(), getSAHCost(bvh));
+}
+
+
+void buildTriangleBVH(Logger logger, Tasks* tasks, BVH& bvh, const Vec3f* vtx, const uint32_t* triVtxIx, uint32_t triCount, BVHBuild method)
+{
+  Vector<BBox3f> boxes(triCount);
+  parallelFor(tasks, triCount, 1 << 14, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t i = begin; i < end; i++) {
+      auto & b = boxes[i];
+      b.min = b.max = vtx[triVtxIx[3 * i + 0]];
+      engulf(b, vtx[triVtxIx[3 * i + 1]]);
+      engulf(b, vtx[triVtxIx[3 * i + 2]]);
+    }
+  });
+  buildBVH(logger, tasks, bvh, boxes.data(), triCount, method);
+}
+
+
+float getSAHCost(const BVH& bvh)
+{
+  if (bvh.nodes.empty()) return 0.f;
+  double cost = 0.0;
+  for (auto & node : bvh.nodes) {
+    cost += double(halfArea(node.bbox)) * (node.count ? node.count : 1);
+  }
+  float rootArea = halfArea(bvh.nodes[0].bbox);
+  return 0.f < rootArea ? float(cost / rootArea) : 0.f;
+}
+
+
+void collapseBVH(BVH4& wide, const BVH& bvh)
+{
+  collapse(wide, bvh);
+}
+
+
+void collapseBVH(BVH8& wide, const BVH& bvh)
+{
+  collapse(wide, bvh);
+}
+
+
+bool intersectTriangle(float& t, float& u, float& v,
+                       const Vec3f& origin, const Vec3f& direction,
+                       const Vec3f& p0, const Vec3f& p1, const Vec3f& p2)
+{
+  return intersectWatertight(t, u, v, WatertightRay(origin, direction), p0, p1, p2);
+}
+
+
+bool intersectTriangles(RayHit& hit, const BVH& bvh,
+                        const Vec3f* vtx, const uint32_t* triVtxIx,
+                        const Vec3f& origin, const Vec3f& direction, float tMax)
+{
+  if (bvh.nodes.empty()) return false;
+
+  WatertightRay ray(origin, direction);
+  Vec3f invDirection(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+  float tNear;
+  if (!intersectBox(tNear, bvh.nodes[0].bbox, origin, invDirection, tMax)) return false;
+
+  struct Entry
+  {
+    uint32_t node;
+    float tNear;
+  };
+  Entry stack[maxDepth + 1];
+  uint32_t sp = 0;
+  stack[sp++] = Entry{ 0, tNear };
+
+  bool found = false;
+  while (sp) {
+    auto entry = stack[--sp];
+    if (tMax < entry.tNear) continue;
+
+    const auto & node = bvh.nodes[entry.node];
+    if (node.count) {
+      found = intersectLeaf(hit, tMax, bvh.primitives, node.first, node.count, vtx, triVtxIx, ray) || found;
+    }
+    else {
+      // Push the farther child first so the nearer one is visited first.
+      float ta, tb;
+      bool a = intersectBox(ta, bvh.nodes[node.first + 0].bbox, origin, invDirection, tMax);
+      bool b = intersectBox(tb, bvh.nodes[node.first + 1].bbox, origin, invDirection, tMax);
+      assert(sp + 2 <= maxDepth + 1);
+      if (a && b) {
+        if (ta < tb) {
+          stack[sp++] = Entry{ node.first + 1, tb };
+          stack[sp++] = Entry{ node.first + 0, ta };
+        }
+        else {
+          stack[sp++] = Entry{ node.first + 0, ta };
+          stack[sp++] = Entry{ node.first + 1, tb };
+        }
+      }
+      else if (a) stack[sp++] = Entry{ node.first + 0, ta };
+      else if (b) stack[sp++] = Entry{ node.first + 1, tb };
+    }
+  }
+  return found;
+}
+
+
+unsigned intersectTriangles4(RayHit* hits, const BVH& bvh,
+                             const Vec3f* vtx, const uint32_t* triVtxIx,
+                             const Vec3f* origins, const Vec3f* directions, const float* tMax)
+{
+  if (bvh.nodes.empty()) return 0;
+
+  RayPacket r;
+  r.ox = _mm_setr_ps(origins[0].x, origins[1].x, origins[2].x, origins[3].x);
+  r.oy = _mm_setr_ps(origins[0].y, origins[1].y, origins[2].y, origins[3].y);
+  r.oz = _mm_setr_ps(origins[0].z, origins[1].z, origins[2].z, origins[3].z);
+  r.dx = _mm_setr_ps(directions[0].x, directions[1].x, directions[2].x, directions[3].x);
+  r.dy = _mm_setr_ps(directions[0].y, directions[1].y, directions[2].y, directions[3].y);
+  r.dz = _mm_setr_ps(directions[0].z, directions[1].z, directions[2].z, directions[3].z);
+  r.ix = _mm_div_ps(_mm_set1_ps(1.f), r.dx);
+  r.iy = _mm_div_ps(_mm_set1_ps(1.f), r.dy);
+  r.iz = _mm_div_ps(_mm_set1_ps(1.f), r.dz);
+  r.tMax = _mm_loadu_ps(tMax);
+  r.active = _mm_cmple_ps(_mm_setzero_ps(), r.tMax);
+
+  __m128i hitTri = _mm_setzero_si128();
+  __m128 hitU = _mm_setzero_ps();
+  __m128 hitV = _mm_setzero_ps();
+  __m128 found = _mm_setzero_ps();
+
+  // Entries are skipped once every lane has a hit nearer than where the packet entered the node.
+  auto packetTMax = [](const RayPacket& r)
+  {
+    __m128 t = _mm_or_ps(_mm_and_ps(r.active, r.tMax), _mm_andnot_ps(r.active, _mm_set1_ps(-FLT_MAX)));
+    t = _mm_max_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 3, 0, 1)));
+    t = _mm_max_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(t);
+  };
+
+  struct Entry
+  {
+    uint32_t node;
+    float tNear;
+  };
+  Entry stack[maxDepth + 1];
+  uint32_t sp = 0;
+
+  float tNear;
+  if (!intersectBox4(tNear, bvh.nodes[0].bbox, r)) return 0;
+  stack[sp++] = Entry{ 0, tNear };
+
+  while (sp) {
+    auto entry = stack[--sp];
+    if (packetTMax(r) < entry.tNear) continue;
+
+    const auto & node = bvh.nodes[entry.node];
+    if (node.count) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        auto tri = bvh.primitives[i];
+        intersectTriangle4(found, hitTri, hitU, hitV, r, tri,
+                           vtx[triVtxIx[3 * tri + 0]], vtx[triVtxIx[3 * tri + 1]], vtx[triVtxIx[3 * tri + 2]]);
+      }
+    }
+    else {
+      // Push the child the packet enters last first.
+      float ta, tb;
+      bool a = intersectBox4(ta, bvh.nodes[node.first + 0].bbox, r) != 0;
+      bool b = intersectBox4(tb, bvh.nodes[node.first + 1].bbox, r) != 0;
+      assert(sp + 2 <= maxDepth + 1);
+      if (a && b) {
+        if (ta < tb) {
+          stack[sp++] = Entry{ node.first + 1, tb };
+          stack[sp++] = Entry{ node.first + 0, ta };
+        }
+        else {
+          stack[sp++] = Entry{ node.first + 0, ta };
+          stack[sp++] = Entry{ node.first + 1, tb };
+        }
+      }
+      else if (a) stack[sp++] = Entry{ node.first + 0, ta };
+      else if (b) stack[sp++] = Entry{ node.first + 1, tb };
+    }
+  }
+
+  alignas(16) float t[4], u[4], v[4];
+  alignas(16) uint32_t tri[4];
+  _mm_store_ps(t, r.tMax);
+  _mm_store_ps(u, hitU);
+  _mm_store_ps(v, hitV);
+  _mm_store_si128(reinterpret_cast<__m128i*>(tri), hitTri);
+  unsigned mask = unsigned(_mm_movemask_ps(found));
+  for (unsigned i = 0; i < 4; i++) {
+    if (mask & (1 << i)) hits[i] = RayHit{ tri[i], t[i], u[i], v[i] };
+  }
+  return mask;
+}
+
+
+bool intersectTriangles(RayHit& hit, const BVH4& bvh,
+                        const Vec3f* vtx, const uint32_t* triVtxIx,
+                        const Vec3f& origin, const Vec3f& direction, float tMax)
+{
+  return intersectWide(hit, bvh, vtx, triVtxIx, origin, direction, tMax);
+}
+
+
+bool intersectTriangles(RayHit& hit, const BVH8& bvh,
+                        const Vec3f* vtx, const uint32_t* triVtxIx,
+                        const Vec3f& origin, const Vec3f& direction, float tMax)
+{
+  return intersectWide(hit, bvh, vtx, triVtxIx, origin, direction, tMax);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <cfloat>
+#include "Common.h"
+#include "LinAlg.h"
+
+class Tasks;
+
+// 32 bytes, children of an inner node are adjacent.
+struct BVHNode
+{
+  BBox3f bbox;
+  uint32_t first;   // First child for inner nodes, first entry in BVH::primitives for leaves.
+  uint32_t count;   // Number of primitives in a leaf, zero for inner nodes.
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode should be 32 bytes");
+
+struct BVH
+{
+  Vector<BVHNode> nodes;        // Root is nodes[0], empty if there are no primitives.
+  Vector<uint32_t> primitives;  // Primitive indices referenced by the leaves.
+};
+
+// Node with W children for SIMD traversal, child bounds stored per axis.
+template<unsigned W>
+struct WideBVHNode
+{
+  float minX[W], minY[W], minZ[W];
+  float maxX[W], maxY[W], maxZ[W];  // Unused slots have an empty box.
+  uint32_t first[W];  // Wide node for inner children, first entry in primitives for leaves.
+  uint32_t count[W];  // Number of primitives for leaves, zero for inner children and unused slots.
+};
+
+template<unsigned W>
+struct WideBVH
+{
+  Vector<WideBVHNode<W>> nodes;   // Root is nodes[0], empty if there are no primitives.
+  Vector<uint32_t> primitives;
+};
+typedef WideBVH<4> BVH4;
+typedef WideBVH<8> BVH8;
+
+enum struct BVHBuild
+{
+  Median,     // Split at the median centroid along the widest axis.
+  BinnedSAH   // Surface area heuristic evaluated over 16 bins per axis.
+};
+
+// Builds a BVH over primitive boxes. With tasks, large ranges are binned in parallel
+// near the root and the subtrees below are built in parallel.
+void buildBVH(Logger logger, Tasks* tasks, BVH& bvh, const BBox3f* boxes, uint32_t count, BVHBuild method = BVHBuild::BinnedSAH);
+
+void buildTriangleBVH(Logger logger, Tasks* tasks, BVH& bvh, const Vec3f* vtx, const uint32_t* triVtxIx, uint32_t triCount, BVHBuild method = BVHBuild::BinnedSAH);
+
+// Expected cost of a random ray that hits the root, with node traversal and primitive tests at unit cost.
+float getSAHCost(const BVH& bvh);
+
+// Pulls up the children of the largest inner nodes until each wide node has up to W children.
+void collapseBVH(BVH4& wide, const BVH& bvh);
+void collapseBVH(BVH8& wide, const BVH& bvh);
+
+// Watertight test of Woop, Benthin and Wald, rays through a shared edge or vertex never slip
+// between triangles. Both sides are hit, t is the ray parameter and u, v the barycentric
+// weights of p1 and p2. Vertices are taken relative to the origin in double precision.
+bool intersectTriangle(float& t, float& u, float& v,
+                       const Vec3f& origin, const Vec3f& direction,
+                       const Vec3f& p0, const Vec3f& p1, const Vec3f& p2);
+
+struct RayHit
+{
+  uint32_t triangle;
+  float t;
+  float u;  // Barycentric weight of the triangle's second vertex.
+  float v;  // Barycentric weight of the triangle's third vertex.
+};
+
+// Nearest triangle hit by origin + t * direction with t in [0, tMax], using the test of
+// intersectTriangle on eight triangles of a leaf at a time when AVX is available.
+bool intersectTriangles(RayHit& hit, const BVH& bvh,
+                        const Vec3f* vtx, const uint32_t* triVtxIx,
+                        const Vec3f& origin, const Vec3f& direction, float tMax = FLT_MAX);
+
+// Four rays traversed together, meant for coherent rays like the primary rays of a 2x2 pixel block.
+// Lanes with a negative tMax are inactive. Returns a mask of the lanes that found a hit, and only
+// the hits of those lanes are written.
+unsigned intersectTriangles4(RayHit* hits, const BVH& bvh,
+                             const Vec3f* vtx, const uint32_t* triVtxIx,
+                             const Vec3f* origins, const Vec3f* directions, const float* tMax);
+
+bool intersectTriangles(RayHit& hit, const BVH4& bvh,
+                        const Vec3f* vtx, const uint32_t* triVtxIx,
+                        const Vec3f& origin, const Vec3f& direction, float tMax = FLT_MAX);
+
+bool intersectTriangles(RayHit& hit, const BVH8& bvh,
+                        const Vec3f* vtx, const uint32_t* triVtxIx,
+                        const Vec3f& origin, const Vec3f& direction, float tMax = FLT_MAX);
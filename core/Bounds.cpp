@@ -1,5 +1,229 @@
+#include <algorithm>
 #include <cassert>
+#include <cfloat>
+#include <immintrin.h>
+#include "Common.h"
 #include "LinAlgOps.h"
+#include "Tasks.h"
+#include "Bounds.h"
+
+//#define VALIDATE_BOUNDS
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+namespace {
+
+  void validateSphere(const Vec3f& center, float radius, const Vec3f* P, size_t N)
+  {
+#ifdef VALIDATE_BOUNDS
+    for (size_t i = 0; i < N; i++) {
+      assert(distance(center, P[i]) <= 1.001f*radius + 1e-6f);
+    }
+#else
+    (void)center; (void)radius; (void)P; (void)N;
+#endif
+  }
+
+  void validateBox(const OBB3f& box, const Vec3f* P, size_t N)
+  {
+#ifdef VALIDATE_BOUNDS
+    float tol = 1e-4f * (1.f + length(box.halfSize));
+    for (size_t i = 0; i < N; i++) {
+      auto d = P[i] - box.center;
+      assert(std::abs(dot(d, box.axis[0])) <= box.halfSize.x + tol);
+      assert(std::abs(dot(d, box.axis[1])) <= box.halfSize.y + tol);
+      assert(std::abs(dot(d, box.axis[2])) <= box.halfSize.z + tol);
+    }
+#else
+    (void)box; (void)P; (void)N;
+#endif
+  }
+
+  // Loads x,y,z into the lower three lanes without touching memory past z.
+  inline __m128 load3(const Vec3f& p)
+  {
+    return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(&p.x)), _mm_load_ss(&p.z));
+  }
+
+  template<typename Fetch>
+  BBox3f boundingBoxSSE(size_t N, Fetch fetch)
+  {
+    if (N == 0) return createEmptyBBox3f();
+
+    // Two independent accumulator pairs to hide min/max latency.
+    __m128 lo0 = load3(fetch(0));
+    __m128 hi0 = lo0;
+    __m128 lo1 = lo0;
+    __m128 hi1 = lo0;
+    size_t i = 1;
+    for (; i + 1 < N; i += 2) {
+      __m128 a = load3(fetch(i));
+      __m128 b = load3(fetch(i + 1));
+      lo0 = _mm_min_ps(lo0, a);
+      hi0 = _mm_max_ps(hi0, a);
+      lo1 = _mm_min_ps(lo1, b);
+      hi1 = _mm_max_ps(hi1, b);
+    }
+    if (i < N) {
+      __m128 a = load3(fetch(i));
+      lo0 = _mm_min_ps(lo0, a);
+      hi0 = _mm_max_ps(hi0, a);
+    }
+    float lo[4], hi[4];
+    _mm_storeu_ps(lo, _mm_min_ps(lo0, lo1));
+    _mm_storeu_ps(hi, _mm_max_ps(hi0, hi1));
+    return BBox3f(Vec3f(lo[0], lo[1], lo[2]), Vec3f(hi[0], hi[1], hi[2]));
+  }
+
+  float halfArea(const Vec3f& extent)
+  {
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+  }
+
+  // Fits center and half sizes of box along its axes.
+  void fitToAxes(OBB3f& box, const Vec3f* P, size_t N)
+  {
+    Vec3f lo(FLT_MAX);
+    Vec3f hi(-FLT_MAX);
+    for (size_t i = 0; i < N; i++) {
+      Vec3f d(dot(box.axis[0], P[i]), dot(box.axis[1], P[i]), dot(box.axis[2], P[i]));
+      lo = min(lo, d);
+      hi = max(hi, d);
+    }
+    Vec3f mid = 0.5f * (lo + hi);
+    box.center = mid.x * box.axis[0] + mid.y * box.axis[1] + mid.z * box.axis[2];
+    box.halfSize = 0.5f * (hi - lo);
+  }
+
+  // Any unit vector orthogonal to the unit vector a.
+  Vec3f orthogonal(const Vec3f& a)
+  {
+    Vec3f t = std::abs(a.x) < 0.6f ? Vec3f(1.f, 0.f, 0.f) : Vec3f(0.f, 1.f, 0.f);
+    return normalize(cross(a, t));
+  }
+
+  struct Vec3d
+  {
+    double x, y, z;
+    Vec3d() = default;
+    Vec3d(double x, double y, double z) : x(x), y(y), z(z) {}
+    Vec3d(const Vec3f& p) : x(p.x), y(p.y), z(p.z) {}
+  };
+
+  inline Vec3d operator+(const Vec3d& a, const Vec3d& b) { return Vec3d(a.x + b.x, a.y + b.y, a.z + b.z); }
+  inline Vec3d operator-(const Vec3d& a, const Vec3d& b) { return Vec3d(a.x - b.x, a.y - b.y, a.z - b.z); }
+  inline Vec3d operator*(double s, const Vec3d& a) { return Vec3d(s * a.x, s * a.y, s * a.z); }
+  inline double dot(const Vec3d& a, const Vec3d& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+  inline Vec3d cross(const Vec3d& a, const Vec3d& b) { return Vec3d(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+
+  struct Sphere
+  {
+    Vec3d c = Vec3d(0, 0, 0);
+    double r2 = -1.0;   // Empty sphere.
+
+    bool contains(const Vec3d& p) const
+    {
+      auto d = p - c;
+      return dot(d, d) <= r2 * (1.0 + 1e-9) + 1e-18;
+    }
+  };
+
+  Sphere sphereFrom(const Vec3d& a)
+  {
+    Sphere s;
+    s.c = a;
+    s.r2 = 0.0;
+    return s;
+  }
+
+  Sphere sphereFrom(const Vec3d& a, const Vec3d& b)
+  {
+    Sphere s;
+    s.c = 0.5 * (a + b);
+    auto d = b - s.c;
+    s.r2 = dot(d, d);
+    return s;
+  }
+
+  // Smallest candidate containing all of P. If rounding leaves no candidate
+  // containing all the points, fall back to the sphere through the two
+  // farthest points of P, grown to contain the rest, so the result is never
+  // empty.
+  Sphere smallestOfCandidates(const Sphere* candidates, uint32_t n, const Vec3d* P, uint32_t m)
+  {
+    Sphere best;
+    for (uint32_t i = 0; i < n; i++) {
+      bool ok = 0.0 <= candidates[i].r2;
+      for (uint32_t k = 0; ok && k < m; k++) ok = candidates[i].contains(P[k]);
+      if (ok && (best.r2 < 0.0 || candidates[i].r2 < best.r2)) best = candidates[i];
+    }
+    if (best.r2 < 0.0) {
+      double d2 = -1.0;
+      for (uint32_t j = 0; j < m; j++) {
+        for (uint32_t i = 0; i < j; i++) {
+          auto d = P[j] - P[i];
+          if (d2 < dot(d, d)) {
+            d2 = dot(d, d);
+            best = sphereFrom(P[i], P[j]);
+          }
+        }
+      }
+      for (uint32_t k = 0; k < m; k++) {
+        auto d = P[k] - best.c;
+        best.r2 = std::max(best.r2, dot(d, d));
+      }
+    }
+    return best;
+  }
+
+  // Smallest sphere with a, b and c on its boundary, which is the circumcircle
+  // of the triangle. Falls back to the smallest sphere containing the points
+  // when they are (nearly) collinear.
+  Sphere sphereFrom(const Vec3d& a, const Vec3d& b, const Vec3d& c)
+  {
+    auto u = b - a;
+    auto v = c - a;
+    auto w = cross(u, v);
+    auto w2 = dot(w, w);
+    if (w2 <= 1e-24 * dot(u, u) * dot(v, v)) {
+      Vec3d P[3] = { a, b, c };
+      Sphere candidates[3] = { sphereFrom(a, b), sphereFrom(a, c), sphereFrom(b, c) };
+      return smallestOfCandidates(candidates, 3, P, 3);
+    }
+    Sphere s;
+    auto o = (1.0 / (2.0 * w2)) * (dot(u, u) * cross(v, w) + dot(v, v) * cross(w, u));
+    s.c = a + o;
+    s.r2 = dot(o, o);
+    return s;
+  }
+
+  // Sphere with a, b, c and d on its boundary, the circumsphere of the
+  // tetrahedron. Falls back to the smallest sphere through three of the
+  // points containing the fourth when they are (nearly) coplanar.
+  Sphere sphereFrom(const Vec3d& a, const Vec3d& b, const Vec3d& c, const Vec3d& d)
+  {
+    auto u = b - a;
+    auto v = c - a;
+    auto t = d - a;
+    auto det = 2.0 * dot(u, cross(v, t));
+    auto scale = std::sqrt(dot(u, u) * dot(v, v) * dot(t, t));
+    if (std::abs(det) <= 1e-12 * scale) {
+      Vec3d P[4] = { a, b, c, d };
+      Sphere candidates[4] = { sphereFrom(a, b, c), sphereFrom(a, b, d), sphereFrom(a, c, d), sphereFrom(b, c, d) };
+      return smallestOfCandidates(candidates, 4, P, 4);
+    }
+    Sphere s;
+    auto o = (1.0 / det) * (dot(u, u) * cross(v, t) + dot(v, v) * cross(t, u) + dot(t, t) * cross(u, v));
+    s.c = a + o;
+    s.r2 = dot(o, o);
+    return s;
+  }
+
+}
 
 void boundingSphereNaive(Vec3f& center, float& radius, const Vec3f* P, size_t N)
 {
@@ -14,18 +238,7 @@ void boundingSphereNaive(Vec3f& center, float& radius, const Vec3f* P, size_t N)
   center = 0.5f*(bbmin + bbmax);
   radius = 0.5f*distance(bbmin, bbmax);
 
-  for (size_t i = 0; i < N; i++) {
-    assert(bbmin.x <= P[i].x);
-    assert(bbmin.y <= P[i].y);
-    assert(bbmin.z <= P[i].z);
-    assert(P[i].x <= bbmax.x);
-    assert(P[i].y <= bbmax.y);
-    assert(P[i].z <= bbmax.z);
-
-    auto r2 = distance(center, P[i]);
-    assert(r2 <= 1.001f*radius);
-  }
-
+  validateSphere(center, radius, P, N);
 }
 
 
@@ -80,12 +293,362 @@ void boundingSphere(Vec3f& center, float& radius, const Vec3f* P, size_t N)
     r = 0.5f*(r + g);
   }
 
-  for (size_t i = 0; i < N; i++) {
-    auto r2_i2 = distanceSquared(c, P[i]);
-    assert(r2_i2 <= r * r * 1.001f);
+  center = c;
+  radius = r;
+
+  validateSphere(center, radius, P, N);
+}
+
+
+AVX2_TARGET void boundingSphereAVX2(Vec3f& center, float& radius, const Vec3f* P, size_t N)
+{
+  assert(N);
+  assert(N < 0x80000000);
+  const float* F = &P[0].x;
+
+  // Eight points per iteration, gathered from the packed xyz triplets. Each
+  // lane tracks the extreme values along the axes and where they were found.
+  const auto stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+  auto lo = _mm256_set1_ps(FLT_MAX);
+  __m256 mn[3] = { lo, lo, lo };
+  __m256 mx[3] = { _mm256_set1_ps(-FLT_MAX), _mm256_set1_ps(-FLT_MAX), _mm256_set1_ps(-FLT_MAX) };
+  __m256i mnIx[3] = { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+  __m256i mxIx[3] = { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+  size_t i = 0;
+  auto ix = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const auto eight = _mm256_set1_epi32(8);
+  for (; i + 8 <= N; i += 8) {
+    for (uint32_t a = 0; a < 3; a++) {
+      auto v = _mm256_i32gather_ps(F + 3 * i + a, stride, 4);
+      auto lt = _mm256_cmp_ps(v, mn[a], _CMP_LT_OQ);
+      auto gt = _mm256_cmp_ps(mx[a], v, _CMP_LT_OQ);
+      mn[a] = _mm256_blendv_ps(mn[a], v, lt);
+      mx[a] = _mm256_blendv_ps(mx[a], v, gt);
+      mnIx[a] = _mm256_blendv_epi8(mnIx[a], ix, _mm256_castps_si256(lt));
+      mxIx[a] = _mm256_blendv_epi8(mxIx[a], ix, _mm256_castps_si256(gt));
+    }
+    ix = _mm256_add_epi32(ix, eight);
+  }
+
+  // Reduce lanes, preferring the first point on ties like the scalar version.
+  uint32_t E[6] = { 0, 0, 0, 0, 0, 0 };
+  if (8 <= N) {
+    for (uint32_t a = 0; a < 3; a++) {
+      alignas(32) float mnV[8], mxV[8];
+      alignas(32) uint32_t mnI[8], mxI[8];
+      _mm256_store_ps(mnV, mn[a]);
+      _mm256_store_ps(mxV, mx[a]);
+      _mm256_store_si256((__m256i*)mnI, mnIx[a]);
+      _mm256_store_si256((__m256i*)mxI, mxIx[a]);
+      uint32_t bmn = 0, bmx = 0;
+      for (uint32_t l = 1; l < 8; l++) {
+        if (mnV[l] < mnV[bmn] || (mnV[l] == mnV[bmn] && mnI[l] < mnI[bmn])) bmn = l;
+        if (mxV[bmx] < mxV[l] || (mxV[l] == mxV[bmx] && mxI[l] < mxI[bmx])) bmx = l;
+      }
+      E[2 * a + 0] = mnI[bmn];
+      E[2 * a + 1] = mxI[bmx];
+    }
   }
+  for (; i < N; i++) {
+    for (uint32_t a = 0; a < 3; a++) {
+      if (P[i][a] < P[E[2 * a]][a]) E[2 * a] = uint32_t(i);
+      if (P[E[2 * a + 1]][a] < P[i][a]) E[2 * a + 1] = uint32_t(i);
+    }
+  }
+
+  // Find most separated pair
+  auto c = 0.5f*(P[E[0]] + P[E[1]]);
+  float d2 = distanceSquared(P[E[0]], P[E[1]]);
+  for (size_t a = 1; a < 3; a++) {
+    auto d2_ = distanceSquared(P[E[2 * a]], P[E[2 * a + 1]]);
+    if (d2 < d2_) {
+      d2 = d2_;
+      c = 0.5f*(P[E[2 * a]] + P[E[2 * a + 1]]);
+    }
+  }
+  auto r = 0.5f*std::sqrt(d2);
 
+  // Growing the sphere is sequential, but most points are inside, so test
+  // eight at a time and only step through the ones that fall outside.
+  auto grow = [&](size_t k)
+  {
+    auto g2 = distanceSquared(c, P[k]);
+    if (g2 <= r * r) return;
+    auto g = std::sqrt(g2);
+    auto wc = 0.5f*(1.f + r / g);
+    auto wq = 0.5f*(1.f - r / g);
+    c = wc * c + wq * P[k];
+    r = 0.5f*(r + g);
+  };
+  for (i = 0; i + 8 <= N; i += 8) {
+    auto dx = _mm256_sub_ps(_mm256_i32gather_ps(F + 3 * i + 0, stride, 4), _mm256_set1_ps(c.x));
+    auto dy = _mm256_sub_ps(_mm256_i32gather_ps(F + 3 * i + 1, stride, 4), _mm256_set1_ps(c.y));
+    auto dz = _mm256_sub_ps(_mm256_i32gather_ps(F + 3 * i + 2, stride, 4), _mm256_set1_ps(c.z));
+    auto g2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    auto outside = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_set1_ps(r * r), g2, _CMP_LT_OQ));
+    if (outside) {
+      for (size_t k = i; k < i + 8; k++) grow(k);
+    }
+  }
+  for (; i < N; i++) grow(i);
 
   center = c;
   radius = r;
-}
\ No newline at end of file
+
+  validateSphere(center, radius, P, N);
+}
+
+
+void boundingSphereExact(Vec3f& center, float& radius, const Vec3f* P, size_t N)
+{
+  assert(N);
+
+  // Randomized incremental form of Welzl's algorithm: process the points in
+  // random order, and when a point falls outside, recompute the sphere with
+  // that point on the boundary from the points before it. Expected linear
+  // time. Points that forced a recomputation move to the front, so later
+  // recomputations meet the likely support points first.
+  Vector<Vec3d> Q(N);
+  for (size_t i = 0; i < N; i++) Q[i] = Vec3d(P[i]);
+  uint64_t seed = 0x9E3779B97F4A7C15ull ^ N;
+  for (size_t i = N - 1; 0 < i; i--) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    auto j = size_t((seed >> 33) % (i + 1));
+    auto t = Q[i]; Q[i] = Q[j]; Q[j] = t;
+  }
+  auto moveToFront = [&Q](size_t i)
+  {
+    auto t = Q[i];
+    for (size_t k = i; 0 < k; k--) Q[k] = Q[k - 1];
+    Q[0] = t;
+  };
+
+  auto s = sphereFrom(Q[0]);
+  for (size_t i = 1; i < N; i++) {
+    if (s.contains(Q[i])) continue;
+    s = sphereFrom(Q[i]);
+    for (size_t j = 0; j < i; j++) {
+      if (s.contains(Q[j])) continue;
+      s = sphereFrom(Q[i], Q[j]);
+      for (size_t k = 0; k < j; k++) {
+        if (s.contains(Q[k])) continue;
+        s = sphereFrom(Q[i], Q[j], Q[k]);
+        for (size_t l = 0; l < k; l++) {
+          if (s.contains(Q[l])) continue;
+          s = sphereFrom(Q[i], Q[j], Q[k], Q[l]);
+        }
+      }
+    }
+    moveToFront(i);
+  }
+
+  center = Vec3f(float(s.c.x), float(s.c.y), float(s.c.z));
+  radius = float(std::sqrt(s.r2));
+
+  // Absorb rounding from converting the center to float.
+  for (size_t i = 0; i < N; i++) {
+    auto d2 = distanceSquared(center, P[i]);
+    if (radius * radius < d2) radius = std::sqrt(d2);
+  }
+
+  validateSphere(center, radius, P, N);
+}
+
+
+BBox3f boundingBox(const Vec3f* P, const uint32_t* indices, size_t N)
+{
+  if (indices) {
+    return boundingBoxSSE(N, [P, indices](size_t i) -> const Vec3f& { return P[indices[i]]; });
+  }
+  else {
+    return boundingBoxSSE(N, [P](size_t i) -> const Vec3f& { return P[i]; });
+  }
+}
+
+
+void boundingBoxes(Tasks* tasks, BBox3f* boxes, const Vec3f* P, const uint32_t* indices, const uint32_t* offsets, uint32_t subsetCount)
+{
+  parallelFor(tasks, subsetCount, 64, [boxes, P, indices, offsets](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t i = begin; i < end; i++) {
+      uint32_t count = offsets[i + 1] - offsets[i];
+      boxes[i] = indices ? boundingBox(P, indices + offsets[i], count) : boundingBox(P + offsets[i], nullptr, count);
+    }
+  });
+}
+
+
+void orientedBoundingBox(OBB3f& box, const Vec3f* P, size_t N)
+{
+  box = OBB3f();
+  if (N == 0) return;
+
+  // Extremal points along 7 directions, the three axes first.
+  constexpr unsigned K = 7;
+  float lo[K], hi[K];
+  uint32_t loIx[K] = {}, hiIx[K] = {};
+  for (unsigned k = 0; k < K; k++) {
+    lo[k] = FLT_MAX;
+    hi[k] = -FLT_MAX;
+  }
+  for (size_t i = 0; i < N; i++) {
+    const auto& p = P[i];
+    float d[K] = { p.x, p.y, p.z, p.x + p.y + p.z, p.x + p.y - p.z, p.x - p.y + p.z, p.x - p.y - p.z };
+    for (unsigned k = 0; k < K; k++) {
+      if (d[k] < lo[k]) { lo[k] = d[k]; loIx[k] = uint32_t(i); }
+      if (hi[k] < d[k]) { hi[k] = d[k]; hiIx[k] = uint32_t(i); }
+    }
+  }
+  Vec3f E[2 * K];
+  for (unsigned k = 0; k < K; k++) {
+    E[2 * k + 0] = P[loIx[k]];
+    E[2 * k + 1] = P[hiIx[k]];
+  }
+
+  // The axis-aligned box is exact from the first three directions.
+  Vec3f aabbExtent(hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]);
+  float aabbArea = halfArea(aabbExtent);
+
+  float bestArea = aabbArea;
+  Vec3f bestAxes[3] = { Vec3f(1.f, 0.f, 0.f), Vec3f(0.f, 1.f, 0.f), Vec3f(0.f, 0.f, 1.f) };
+  auto candidate = [&](const Vec3f& u, const Vec3f& m)
+  {
+    Vec3f w = cross(u, m);
+    Vec3f a(FLT_MAX), b(-FLT_MAX);
+    for (unsigned i = 0; i < 2 * K; i++) {
+      Vec3f d(dot(u, E[i]), dot(m, E[i]), dot(w, E[i]));
+      a = min(a, d);
+      b = max(b, d);
+    }
+    float area = halfArea(b - a);
+    if (area < bestArea) {
+      bestArea = area;
+      bestAxes[0] = u;
+      bestAxes[1] = m;
+      bestAxes[2] = w;
+    }
+  };
+  auto triangle = [&](const Vec3f& a, const Vec3f& b, const Vec3f& c)
+  {
+    Vec3f m = cross(b - a, c - a);
+    float mm = lengthSquared(m);
+    if (mm <= FLT_MIN) return;
+    m = (1.f / std::sqrt(mm)) * m;
+    const Vec3f edges[3] = { b - a, c - b, a - c };
+    for (const auto& e : edges) {
+      float ee = lengthSquared(e);
+      if (ee <= FLT_MIN) continue;
+      candidate((1.f / std::sqrt(ee)) * e, m);
+    }
+  };
+
+  // Base triangle from the most distant extremal pair and the point farthest from that line.
+  float scale = std::max(FLT_MIN, lengthSquared(aabbExtent));
+  unsigned pair = 0;
+  float pairDist = -1.f;
+  for (unsigned k = 0; k < K; k++) {
+    float d = distanceSquared(E[2 * k], E[2 * k + 1]);
+    if (pairDist < d) { pairDist = d; pair = k; }
+  }
+  if (1e-12f * scale < pairDist) {
+    Vec3f p0 = E[2 * pair];
+    Vec3f p1 = E[2 * pair + 1];
+    Vec3f e0 = normalize(p1 - p0);
+
+    Vec3f p2 = p0;
+    float lineDist = -1.f;
+    for (unsigned i = 0; i < 2 * K; i++) {
+      auto u = E[i] - p0;
+      float d = lengthSquared(u - dot(u, e0) * e0);
+      if (lineDist < d) { lineDist = d; p2 = E[i]; }
+    }
+
+    if (lineDist <= 1e-12f * scale) {
+      // Collinear points, any frame around the line.
+      candidate(e0, orthogonal(e0));
+    }
+    else {
+      triangle(p0, p1, p2);
+
+      // Ditetrahedron apexes on either side of the base plane.
+      Vec3f n = normalize(cross(p1 - p0, p2 - p0));
+      float qlo = 0.f, qhi = 0.f;
+      Vec3f q0 = p0, q1 = p0;
+      for (unsigned i = 0; i < 2 * K; i++) {
+        float d = dot(n, E[i] - p0);
+        if (d < qlo) { qlo = d; q0 = E[i]; }
+        if (qhi < d) { qhi = d; q1 = E[i]; }
+      }
+      float planeEps = 1e-6f * std::sqrt(scale);
+      if (qlo < -planeEps) {
+        triangle(p0, p1, q0);
+        triangle(p1, p2, q0);
+        triangle(p2, p0, q0);
+      }
+      if (planeEps < qhi) {
+        triangle(p0, p1, q1);
+        triangle(p1, p2, q1);
+        triangle(p2, p0, q1);
+      }
+    }
+  }
+
+  box.axis[0] = bestAxes[0];
+  box.axis[1] = bestAxes[1];
+  box.axis[2] = bestAxes[2];
+  fitToAxes(box, P, N);
+
+  // Candidates were ranked on the extremal points only, the full fit may lose to the AABB.
+  if (aabbArea <= halfArea(2.f * box.halfSize)) {
+    box.axis[0] = Vec3f(1.f, 0.f, 0.f);
+    box.axis[1] = Vec3f(0.f, 1.f, 0.f);
+    box.axis[2] = Vec3f(0.f, 0.f, 1.f);
+    box.center = Vec3f(0.5f * (lo[0] + hi[0]), 0.5f * (lo[1] + hi[1]), 0.5f * (lo[2] + hi[2]));
+    box.halfSize = 0.5f * aabbExtent;
+  }
+  validateBox(box, P, N);
+}
+
+uint8_t insideFrustumPlaneMask(const Vec4f& h)
+{
+  return
+    ( h.x <= h.w ? 32 : 0) |
+    (-h.w <= h.x ? 16 : 0) |
+    ( h.y <= h.w ?  8 : 0) |
+    (-h.w <= h.y ?  4 : 0) |
+    ( h.z <= h.w ?  2 : 0) |
+    (-h.w <= h.z ?  1 : 0);
+}
+
+Mat4f rectangleClipMatrix(const Mat4f& PM, float x0, float y0, float x1, float y1)
+{
+  // Scale and translate normalized device coordinates so the rectangle becomes [-1,1]^2.
+  auto w = std::max(1e-6f, x1 - x0);
+  auto h = std::max(1e-6f, y1 - y0);
+  Mat4f rectMatrix(2.f / w, 0.f, 0.f, -(x0 + x1) / w,
+                   0.f, 2.f / h, 0.f, -(y0 + y1) / h,
+                   0.f, 0.f, 1.f, 0.f,
+                   0.f, 0.f, 0.f, 1.f);
+  return mul(rectMatrix, PM);
+}
+
+bool insideFrustumPlaneMask(uint32_t& mask, const BBox3f& box, const Mat4f& M)
+{
+  // Each plane is linear in the world position, so the box is outside a plane
+  // when all corners are, and inside it when all corners are.
+  uint32_t insideAll = 63;
+  uint32_t insideAny = 0;
+  for (unsigned i = 0; i < 8; i++) {
+    auto h = mul(M, Vec4f(i & 1 ? box.max.x : box.min.x,
+                          i & 2 ? box.max.y : box.min.y,
+                          i & 4 ? box.max.z : box.min.z,
+                          1.f));
+    auto m = insideFrustumPlaneMask(h);
+    insideAll &= m;
+    insideAny |= m;
+  }
+  if ((insideAny & mask) != mask) return false;
+  mask &= ~insideAll;
+  return true;
+}
@@ -1,9 +1,46 @@
 #pragma once
 #include "LinAlg.h"
 
+class Tasks;
+
 
 // Find bounding sphere that contains the bounding box.
 void boundingSphereNaive(Vec3f& center, float& radius, const Vec3f* P, size_t N);
 
 // Implementation of J. Ritter, An Efficient Bounding Sphere.
-void boundingSphere(Vec3f& center, float& radius, const Vec3f* P, size_t N);
\ No newline at end of file
+void boundingSphere(Vec3f& center, float& radius, const Vec3f* P, size_t N);
+
+// Same result as boundingSphere, testing eight points at a time with AVX2.
+// Only call when cpuSupportsAVX2() is true.
+void boundingSphereAVX2(Vec3f& center, float& radius, const Vec3f* P, size_t N);
+
+// Minimal bounding sphere, randomized move-to-front variant of E. Welzl,
+// Smallest Enclosing Disks (Balls and Ellipsoids), in expected linear time.
+void boundingSphereExact(Vec3f& center, float& radius, const Vec3f* P, size_t N);
+
+// Axis-aligned box of P, or of P[indices[i]] when indices is not null. Empty if N=0.
+BBox3f boundingBox(const Vec3f* P, const uint32_t* indices, size_t N);
+
+// Axis-aligned boxes of subsets, where subset i is indices[offsets[i]..offsets[i+1]),
+// or the P range offsets[i]..offsets[i+1] when indices is null.
+void boundingBoxes(Tasks* tasks, BBox3f* boxes, const Vec3f* P, const uint32_t* indices, const uint32_t* offsets, uint32_t subsetCount);
+
+// Oriented box using the 14-point DiTO heuristic of T. Larsson and L. Kallberg,
+// Fast Computation of Tight-Fitting Oriented Bounding Boxes. Candidate frames are
+// built from a ditetrahedron spanned by extremal points along 7 directions, the
+// one with the smallest surface area wins, and the AABB is kept if it is better.
+void orientedBoundingBox(OBB3f& box, const Vec3f* P, size_t N);
+
+// Bits of the clip-space planes the homogeneous point h is inside of: 32 for x <= w, 16 for -w <= x,
+// 8 for y <= w, 4 for -w <= y, 2 for z <= w and 1 for -w <= z. 63 is inside the view volume.
+uint8_t insideFrustumPlaneMask(const Vec4f& h);
+
+// Clip space of the part of the view volume of the projection-view matrix PM that lands in the
+// normalized device rectangle [x0,x1] x [y0,y1].
+Mat4f rectangleClipMatrix(const Mat4f& PM, float x0, float y0, float x1, float y1);
+
+// Tests the box, in the clip space of M, against the planes whose bits are set in mask. Returns
+// false when the box is outside one of them, otherwise clears the bits of the planes that contain
+// the whole box, so a box nested inside only needs to test the remaining ones. A mask of zero
+// means fully inside.
+bool insideFrustumPlaneMask(uint32_t& mask, const BBox3f& box, const Mat4f& M);
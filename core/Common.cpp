@@ -2,6 +2,11 @@
 #include <cstdlib>
 #include <algorithm>
 #include <cassert>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
 
 namespace {
 
@@ -21,6 +26,68 @@ namespace {
 
 }
 
+bool cpuSupportsAVX2()
+{
+  static const bool supported = []()
+  {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const int osxsave = 1 << 27;
+    const int avx = 1 << 28;
+    if ((info[2] & (osxsave | avx)) != (osxsave | avx)) return false;
+    if ((_xgetbv(0) & 6) != 6) return false;  // OS saves xmm and ymm state.
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+  }();
+  return supported;
+}
+
+bool cpuSupportsAVX()
+{
+  static const bool supported = []()
+  {
+    const unsigned osxsave = 1 << 27;
+    const unsigned avx = 1 << 28;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    if ((unsigned(info[2]) & (osxsave | avx)) != (osxsave | avx)) return false;
+    return (_xgetbv(0) & 6) == 6;  // OS saves xmm and ymm state.
+#else
+    return __builtin_cpu_supports("avx") != 0;
+#endif
+  }();
+  return supported;
+}
+
+bool cpuSupportsF16C()
+{
+  static const bool supported = []()
+  {
+    const unsigned osxsave = 1 << 27;
+    const unsigned avx = 1 << 28;
+    const unsigned f16c = 1 << 29;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    if ((unsigned(info[2]) & (osxsave | avx | f16c)) != (osxsave | avx | f16c)) return false;
+    return (_xgetbv(0) & 6) == 6;  // OS saves xmm and ymm state.
+#else
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return false;
+    if ((c & (osxsave | avx | f16c)) != (osxsave | avx | f16c)) return false;
+    return __builtin_cpu_supports("avx") != 0;
+#endif
+  }();
+  return supported;
+}
+
 uint64_t fnv_1a(const char* bytes, size_t l)
 {
   uint64_t hash = 0xcbf29ce484222325;
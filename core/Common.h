@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <functional>
 #include <initializer_list>
+#include <utility>
 #include "mem/Allocators.h"
 
 #ifndef ARRAYSIZE
@@ -191,7 +192,7 @@ public:
   void pushBack(T && t)
   {
     reserve(fill + 1);
-    new(data() + (fill++)) T(t);
+    new(data() + (fill++)) T(std::move(t));
   }
 
   T& back() { assert(fill); return (*this)[fill - 1]; }
@@ -199,7 +200,7 @@ public:
   T popBack()
   {
     assert(fill);
-    auto t = data()[--fill];
+    auto t = std::move(data()[--fill]);
     (*this)[fill].~T();
     return t;
   }
@@ -252,4 +253,13 @@ struct StringInterning
 
 uint64_t fnv_1a(const char* bytes, size_t l);
 
+// True if the CPU and OS support AVX, checked once.
+bool cpuSupportsAVX();
+
+// True if the CPU and OS support AVX2, checked once.
+bool cpuSupportsAVX2();
+
+// True if the CPU and OS support AVX and F16C half conversion, checked once.
+bool cpuSupportsF16C();
+
 Mesh* readObj(Logger logger, const void * ptr, size_t size);
\ No newline at end of file
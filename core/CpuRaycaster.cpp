@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "Common.h"
+#include "Tasks.h"
+#include "LinAlgOps.h"
+#include "Mesh.h"
+#include "CpuRaycaster.h"
+
+namespace {
+
+  constexpr uint32_t tileSize = 16;         // Pixels per tile side, a tile is the unit of work for tasks.
+  constexpr uint32_t maxPathLength = 10;    // Rays per path, matches maxRecursionDepth of the Raycaster pipeline.
+  constexpr float tMin = 0.001f;
+  constexpr float tMax = 1000.f;
+
+  // Random numbers as in raytrace.common.glsl.
+  uint32_t wangHash(uint32_t state)
+  {
+    state = (state ^ 61) ^ (state >> 16);
+    state *= 9;
+    state = state ^ (state >> 4);
+    state *= 0x27d4eb2d;
+    state = state ^ (state >> 15);
+    return state;
+  }
+
+  float rand(uint32_t& state)
+  {
+    state = 1664525 * state + 1013904223;
+    return float(1.0 / 4294967296.0) * state;
+  }
+
+  // The shader passes the state by value, which reuses the same numbers on every bounce,
+  // here the state is advanced.
+  Vec3f randomCosineDir(uint32_t& state)
+  {
+    const float twoPi = float(2.0 * 3.14159265358979323846264338327950288);
+    float r1 = std::min(1.f, rand(state));
+    float r2 = std::min(1.f, rand(state));
+    float z = std::sqrt(1.f - r2);
+    float phi = twoPi * r1;
+    float sqrtR2 = std::sqrt(r2);
+    return Vec3f(sqrtR2 * std::cos(phi), sqrtR2 * std::sin(phi), z);
+  }
+
+  void orthonormal(Vec3f& u, Vec3f& v, Vec3f& w, const Vec3f& d)
+  {
+    w = normalize(d);
+    auto a = 0.9f < std::abs(w.x) ? Vec3f(0, 1, 0) : Vec3f(1, 0, 0);
+    v = normalize(cross(w, a));
+    u = cross(w, v);
+  }
+
+  // Sky, ground glow and light as in raytrace.rmiss.glsl.
+  Vec3f irradiance(const Vec3f& l, const Vec3f& u, const Vec3f& d)
+  {
+    auto sky = std::min(1.f, std::max(0.f, 0.5f + dot(u, d))) * 0.2f;
+    auto low = std::pow(std::max(0.f, -dot(u, d)), 5.f);
+    auto light = 15.f * std::pow(std::max(0.f, dot(l, d)), 20.f);
+    return Vec3f(light + low,
+                 0.5f * sky + 0.4f * low + 0.9f * light,
+                 sky + 0.1f * low + 0.8f * light);
+  }
+
+  uint32_t packColor(const Vec3f& c, float alpha)
+  {
+    uint32_t rv = 0;
+    for (unsigned k = 0; k < 4; k++) {
+      auto x = k < 3 ? c[k] : alpha;
+      x = std::min(1.f, std::max(0.f, x));
+      rv |= uint32_t(255.f * x + 0.5f) << (8 * k);
+    }
+    return rv;
+  }
+
+}
+
+
+CpuRaycaster::CpuRaycaster(Logger logger, Tasks* tasks) :
+  logger(logger),
+  tasks(tasks)
+{
+}
+
+CpuRaycaster::~CpuRaycaster()
+{
+  for (auto * data : meshData) delete data;
+}
+
+void CpuRaycaster::updateMeshData(MeshData& data, const Mesh* mesh)
+{
+  if (data.geometryGeneration == mesh->geometryGeneration && data.colorGeneration == mesh->colorGeneration) return;
+
+  if (data.geometryGeneration != mesh->geometryGeneration) {
+    buildTriangleBVH(logger, tasks, data.bvh, mesh->vtx, mesh->triVtxIx, mesh->triCount);
+  }
+  data.geometryGeneration = mesh->geometryGeneration;
+  data.colorGeneration = mesh->colorGeneration;
+
+  // Same contents as the TriangleData buffer of Raycaster.
+  data.triangleData.resize(mesh->triCount);
+  parallelFor(tasks, mesh->triCount, 1 << 14, [&data, mesh](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t t = begin; t < end; t++) {
+      Vec3f n[3];
+      if (mesh->nrmCount) {
+        for (unsigned k = 0; k < 3; k++) n[k] = normalize(mesh->nrm[mesh->triNrmIx[3 * t + k]]);
+      }
+      else {
+        Vec3f p[3];
+        for (unsigned k = 0; k < 3; k++) p[k] = mesh->vtx[mesh->triVtxIx[3 * t + k]];
+        n[0] = n[1] = n[2] = normalize(cross(p[1] - p[0], p[2] - p[0]));
+      }
+      auto & d = data.triangleData[t];
+      d.n0x = n[0].x; d.n0y = n[0].y; d.n0z = n[0].z;
+      d.n1x = n[1].x; d.n1y = n[1].y; d.n1z = n[1].z;
+      d.n2x = n[2].x; d.n2y = n[2].y; d.n2z = n[2].z;
+      auto color = t;
+      d.r = (1.f / 255.f)*((color >> 16) & 0xff);
+      d.g = (1.f / 255.f)*((color >> 8) & 0xff);
+      d.b = (1.f / 255.f)*(color & 0xff);
+    }
+  });
+}
+
+void CpuRaycaster::update(Vector<Mesh*>& meshes)
+{
+  Vector<MeshData*> newMeshData;
+  for (auto * mesh : meshes) {
+    MeshData* data = nullptr;
+    for (auto *& d : meshData) {
+      if (d && d->src == mesh) {
+        data = d;
+        d = nullptr;
+        break;
+      }
+    }
+    if (data == nullptr) {
+      data = new MeshData();
+      data->src = mesh;
+    }
+    updateMeshData(*data, mesh);
+    newMeshData.pushBack(data);
+  }
+  for (auto * d : meshData) delete d;
+  meshData.swap(newMeshData);
+}
+
+bool CpuRaycaster::intersect(RayHit& hit, uint32_t& mesh, const Vec3f& origin, const Vec3f& direction, float tFar) const
+{
+  bool found = false;
+  for (uint32_t j = 0; j < meshData.size32(); j++) {
+    auto * data = meshData[j];
+    if (intersectTriangles(hit, data->bvh, data->src->vtx, data->src->triVtxIx, origin, direction, tFar)) {
+      tFar = hit.t;
+      mesh = j;
+      found = true;
+    }
+  }
+  return found;
+}
+
+Vec3f CpuRaycaster::trace(uint32_t state, const Vec3f& l, const Vec3f& u, const Vec3f& origin, const Vec3f& direction, const RayHit& hit, uint32_t mesh) const
+{
+  auto o = origin;
+  auto d = direction;
+  auto h = hit;
+  float weight = 1.f;
+  for (uint32_t length = 1; length < maxPathLength; length++) {
+    const auto & data = meshData[mesh]->triangleData[h.triangle];
+    float w0 = h.u;
+    float w1 = h.v;
+    float w2 = 1.f - w0 - w1;
+    auto n = w2 * Vec3f(data.n0x, data.n0y, data.n0z) +
+             w0 * Vec3f(data.n1x, data.n1y, data.n1z) +
+             w1 * Vec3f(data.n2x, data.n2y, data.n2z);
+
+    // The shader culls back faces, here both sides are hit, so bounce off the side the ray came from.
+    if (0.f < dot(n, d)) n = -1.f * n;
+
+    Vec3f a, b, c;
+    orthonormal(a, b, c, n);
+    auto dl = randomCosineDir(state);
+    auto p = o + h.t * d;
+    d = normalize(dl.x * a + dl.y * b + dl.z * c);
+    o = p + tMin * d;
+    weight *= 0.7f;
+    if (!intersect(h, mesh, o, d, tMax - tMin)) return weight * irradiance(l, u, d);
+  }
+  return Vec3f(0.f);
+}
+
+void CpuRaycaster::drawTile(uint32_t* rgba, uint32_t w, uint32_t h, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+                            const Vec3f& l, const Vec3f& u, const Mat4f& Pinv) const
+{
+  // 2x2 pixel packets for the primary rays, paths continue one ray at a time.
+  for (uint32_t y = y0; y < y1; y += 2) {
+    for (uint32_t x = x0; x < x1; x += 2) {
+      Vec3f origins[4];
+      Vec3f directions[4];
+      float tFar[4];
+      for (unsigned k = 0; k < 4; k++) {
+        auto px = x + (k & 1);
+        auto py = y + (k >> 1);
+        if (x1 <= px || y1 <= py) {
+          origins[k] = Vec3f(0.f);
+          directions[k] = Vec3f(1.f);
+          tFar[k] = -1.f;
+          continue;
+        }
+        float cx = 2.f * float(px) / float(w) - 1.f;
+        float cy = 1.f - 2.f * float(py) / float(h);
+        auto oh = mul(Pinv, Vec4f(cx, cy, -1.f, 1.f));
+        auto fh = mul(Pinv, Vec4f(cx, cy, 1.f, 1.f));
+        auto o = (1.f / oh.w) * Vec3f(oh.x, oh.y, oh.z);
+        auto f = (1.f / fh.w) * Vec3f(fh.x, fh.y, fh.z);
+        directions[k] = normalize(f - o);
+        origins[k] = o + tMin * directions[k];
+        tFar[k] = tMax - tMin;
+      }
+
+      RayHit hits[4];
+      uint32_t hitMesh[4] = { 0, 0, 0, 0 };
+      unsigned hitMask = 0;
+      for (uint32_t j = 0; j < meshData.size32(); j++) {
+        auto * data = meshData[j];
+        RayHit meshHits[4];
+        unsigned mask = intersectTriangles4(meshHits, data->bvh, data->src->vtx, data->src->triVtxIx, origins, directions, tFar);
+        for (unsigned k = 0; k < 4; k++) {
+          if (mask & (1 << k)) {
+            hits[k] = meshHits[k];
+            hitMesh[k] = j;
+            tFar[k] = meshHits[k].t;
+          }
+        }
+        hitMask |= mask;
+      }
+
+      for (unsigned k = 0; k < 4; k++) {
+        auto px = x + (k & 1);
+        auto py = y + (k >> 1);
+        if (x1 <= px || y1 <= py) continue;
+
+        bool hit = (hitMask & (1 << k)) != 0;
+        auto & pixel = rgba[size_t(w) * py + px];
+        if (shading == Shading::TriangleIndex) {
+          if (hit) {
+            const auto & data = meshData[hitMesh[k]]->triangleData[hits[k].triangle];
+            pixel = packColor(Vec3f(data.r, data.g, data.b), 1.f);
+          }
+          else {
+            pixel = 0;
+          }
+          continue;
+        }
+
+        uint32_t state = w * py + px + rndState;
+        Vec3f color(0.f);
+        for (uint32_t s = 0; s < samples; s++) {
+          state = wangHash(state);
+          auto c = hit ? trace(state, l, u, origins[k], directions[k], hits[k], hitMesh[k]) : irradiance(l, u, directions[k]);
+          color = color + (1.f / samples) * c;
+        }
+        pixel = packColor(color, 1.f);
+      }
+    }
+  }
+}
+
+void CpuRaycaster::draw(uint32_t* rgba, uint32_t w, uint32_t h, const Mat3f& Ninv, const Mat4f& Pinv)
+{
+  if (w == 0 || h == 0) return;
+
+  // Light at the top right behind the camera and camera up, as Raycaster sets up the scene buffer.
+  auto l = normalize(mul(Ninv, Vec3f(1, 1, 0.2f)));
+  auto u = normalize(mul(Ninv, Vec3f(0, 1, 0)));
+
+  uint32_t tilesX = (w + tileSize - 1) / tileSize;
+  uint32_t tilesY = (h + tileSize - 1) / tileSize;
+  parallelFor(tasks, tilesX * tilesY, 1, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t i = begin; i < end; i++) {
+      uint32_t x0 = tileSize * (i % tilesX);
+      uint32_t y0 = tileSize * (i / tilesX);
+      drawTile(rgba, w, h, x0, y0, std::min(w, x0 + tileSize), std::min(h, y0 + tileSize), l, u, Pinv);
+    }
+  });
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "Common.h"
+#include "LinAlg.h"
+#include "BVH.h"
+
+class Tasks;
+struct Mesh;
+
+// CPU counterpart of Raycaster for machines without ray tracing hardware. Uses the same
+// camera, per-triangle data and shading as raytrace.rgen/rchit/rmiss, and renders into
+// memory so it can produce thumbnails and regression images headless.
+class CpuRaycaster
+{
+public:
+  enum struct Shading
+  {
+    PathTraced,     // Cosine-weighted bounces until the sky is hit, as raytrace.rchit does.
+    TriangleIndex   // Unlit triangle-order color, the triangle index in rgb and zero alpha on misses.
+  };
+
+  CpuRaycaster(Logger logger, Tasks* tasks);
+  ~CpuRaycaster();
+
+  // Rebuilds BVHs and triangle data of meshes whose generations changed, drops meshes that are gone.
+  void update(Vector<Mesh*>& meshes);
+
+  // Renders w x h pixels as RGBA8, red in the lowest byte and the top row first. Ninv and Pinv
+  // are the inverse view rotation and inverse projection-view matrix, as passed to Raycaster::draw.
+  void draw(uint32_t* rgba, uint32_t w, uint32_t h, const Mat3f& Ninv, const Mat4f& Pinv);
+
+  Shading shading = Shading::PathTraced;
+  uint32_t samples = 1;     // Paths per pixel.
+  uint32_t rndState = 42;   // Seed, the same seed gives the same image.
+
+private:
+  struct TriangleData
+  {
+    float n0x, n0y, n0z;
+    float n1x, n1y, n1z;
+    float n2x, n2y, n2z;
+    float r, g, b;
+  };
+
+  struct MeshData
+  {
+    const Mesh* src = nullptr;
+    uint32_t geometryGeneration = 0;
+    uint32_t colorGeneration = 0;
+
+    BVH bvh;
+    Vector<TriangleData> triangleData;
+  };
+
+  Logger logger;
+  Tasks* tasks = nullptr;
+
+  Vector<MeshData*> meshData;
+
+  void updateMeshData(MeshData& data, const Mesh* mesh);
+
+  bool intersect(RayHit& hit, uint32_t& mesh, const Vec3f& origin, const Vec3f& direction, float tFar) const;
+  Vec3f trace(uint32_t state, const Vec3f& l, const Vec3f& u, const Vec3f& origin, const Vec3f& direction, const RayHit& hit, uint32_t mesh) const;
+  void drawTile(uint32_t* rgba, uint32_t w, uint32_t h, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+                const Vec3f& l, const Vec3f& u, const Mat4f& Pinv) const;
+
+  CpuRaycaster(const CpuRaycaster&) = delete;
+  CpuRaycaster& operator=(const CpuRaycaster&) = delete;
+};
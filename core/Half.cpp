@@ -0,0 +1,121 @@
+#include <immintrin.h>
+#include "Common.h"
+#include "Half.h"
+
+#if defined(__GNUC__) && !defined(__F16C__)
+#define F16C_TARGET __attribute__((target("avx,f16c")))
+#else
+#define F16C_TARGET
+#endif
+
+namespace {
+
+  // Four floats to halves in the lower 16 bits of each lane, same rules as halfFromFloat.
+  __m128i halvesFromFloatsSSE2(__m128 x)
+  {
+    __m128i u = _mm_castps_si128(x);
+    __m128i sign = _mm_and_si128(_mm_srli_epi32(u, 16), _mm_set1_epi32(0x8000));
+    __m128i a = _mm_and_si128(u, _mm_set1_epi32(0x7FFFFFFF));
+
+    // Below 2^-14, the subnormal mantissa is |x| * 2^24 truncated, which is zero below 2^-24.
+    __m128i sub = _mm_cvttps_epi32(_mm_mul_ps(_mm_castsi128_ps(a), _mm_set1_ps(float(1 << 24))));
+    __m128i normal = _mm_srli_epi32(_mm_sub_epi32(a, _mm_set1_epi32((127 - 15) << 23)), 23 - 10);
+    __m128i isNan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7F800000));
+    __m128i special = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(isNan, _mm_set1_epi32(1)));
+
+    __m128i isSub = _mm_cmplt_epi32(a, _mm_set1_epi32((127 - 14) << 23));
+    __m128i isNormal = _mm_cmplt_epi32(a, _mm_set1_epi32((127 + 16) << 23));
+    __m128i r = _mm_or_si128(_mm_and_si128(isNormal, normal), _mm_andnot_si128(isNormal, special));
+    r = _mm_or_si128(_mm_and_si128(isSub, sub), _mm_andnot_si128(isSub, r));
+    r = _mm_or_si128(r, sign);
+
+    // Sign-extend so the saturating pack keeps the bit pattern.
+    return _mm_srai_epi32(_mm_slli_epi32(r, 16), 16);
+  }
+
+  // Four halves in the lower 16 bits of each lane to floats, same rules as floatFromHalf.
+  __m128 floatsFromHalvesSSE2(__m128i h)
+  {
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    __m128i exp = _mm_and_si128(h, _mm_set1_epi32(0x7C00));
+    __m128i mantissa = _mm_and_si128(h, _mm_set1_epi32(0x3FF));
+    __m128i o = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7FFF)), 23 - 10);
+
+    __m128i normal = _mm_add_epi32(o, _mm_set1_epi32((127 - 15) << 23));
+    __m128i quiet = _mm_andnot_si128(_mm_cmpeq_epi32(mantissa, _mm_setzero_si128()), _mm_set1_epi32(0x400000));
+    __m128i special = _mm_or_si128(_mm_add_epi32(o, _mm_set1_epi32((255 - 31) << 23)), quiet);
+    __m128i sub = _mm_castps_si128(_mm_mul_ps(_mm_cvtepi32_ps(mantissa), _mm_set1_ps(1.f / (1 << 24))));
+
+    __m128i isSub = _mm_cmpeq_epi32(exp, _mm_setzero_si128());
+    __m128i isSpecial = _mm_cmpeq_epi32(exp, _mm_set1_epi32(0x7C00));
+    __m128i r = _mm_or_si128(_mm_and_si128(isSpecial, special), _mm_andnot_si128(isSpecial, normal));
+    r = _mm_or_si128(_mm_and_si128(isSub, sub), _mm_andnot_si128(isSub, r));
+    return _mm_castsi128_ps(_mm_or_si128(r, sign));
+  }
+
+  // Truncating conversion matches halfFromFloat except for overflow, which saturates
+  // to 65504 instead of infinity, and nan payloads. Such blocks take the scalar path.
+  F16C_TARGET size_t halvesFromFloatsF16C(uint16_t* dst, const float* src, size_t N)
+  {
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    size_t i = 0;
+    for (; i + 8 <= N; i += 8) {
+      __m256 x = _mm256_loadu_ps(src + i);
+      __m256 over = _mm256_cmp_ps(_mm256_and_ps(x, absMask), _mm256_set1_ps(65536.f), _CMP_GE_OQ);
+      __m256 nan = _mm256_cmp_ps(x, x, _CMP_UNORD_Q);
+      if (_mm256_movemask_ps(_mm256_or_ps(over, nan))) {
+        for (size_t k = 0; k < 8; k++) dst[i + k] = halfFromFloat(src[i + k]);
+      }
+      else {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(x, _MM_FROUND_TO_ZERO));
+      }
+    }
+    return i;
+  }
+
+  // Exact conversion, except that signaling nans are quieted here as in floatFromHalf.
+  F16C_TARGET size_t floatsFromHalvesF16C(float* dst, const uint16_t* src, size_t N)
+  {
+    const __m256 quiet = _mm256_castsi256_ps(_mm256_set1_epi32(0x400000));
+    size_t i = 0;
+    for (; i + 8 <= N; i += 8) {
+      __m256 x = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+      x = _mm256_or_ps(x, _mm256_and_ps(_mm256_cmp_ps(x, x, _CMP_UNORD_Q), quiet));
+      _mm256_storeu_ps(dst + i, x);
+    }
+    return i;
+  }
+
+}
+
+void halvesFromFloats(uint16_t* dst, const float* src, size_t N)
+{
+  size_t i = 0;
+  if (cpuSupportsF16C()) {
+    i = halvesFromFloatsF16C(dst, src, N);
+  }
+  else {
+    for (; i + 8 <= N; i += 8) {
+      __m128i lo = halvesFromFloatsSSE2(_mm_loadu_ps(src + i));
+      __m128i hi = halvesFromFloatsSSE2(_mm_loadu_ps(src + i + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+    }
+  }
+  for (; i < N; i++) dst[i] = halfFromFloat(src[i]);
+}
+
+void floatsFromHalves(float* dst, const uint16_t* src, size_t N)
+{
+  size_t i = 0;
+  if (cpuSupportsF16C()) {
+    i = floatsFromHalvesF16C(dst, src, N);
+  }
+  else {
+    for (; i + 8 <= N; i += 8) {
+      __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_storeu_ps(dst + i, floatsFromHalvesSSE2(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+      _mm_storeu_ps(dst + i + 4, floatsFromHalvesSSE2(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+    }
+  }
+  for (; i < N; i++) dst[i] = floatFromHalf(src[i]);
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <cinttypes>
+#include <cstddef>
 
 
 inline uint16_t buildHalf(unsigned sign, unsigned exp, unsigned mantissa)
@@ -37,3 +38,32 @@ inline uint16_t halfFromFloat(float f)
     return buildHalf(sign, 0x1F, 1);  // nan
   }
 }
+
+inline float floatFromHalf(uint16_t h)
+{
+  union {
+    float f;
+    unsigned u;
+  } v;
+  unsigned sign = unsigned(h >> 15) << 31;
+  unsigned exp = (h >> 10) & 0x1F;
+  unsigned mantissa = h & 0x3FF;
+
+  if (exp == 0) {
+    v.f = float(mantissa) * (1.f / (1 << 24));  // zero or subnormal, exact.
+    v.u |= sign;
+  }
+  else if (exp < 0x1F) {
+    v.u = sign | ((exp + 127 - 15) << 23) | (mantissa << (23 - 10));
+  }
+  else {
+    v.u = sign | 0x7F800000 | (mantissa << (23 - 10)) | (mantissa ? 0x400000 : 0);  // infinity or quiet nan
+  }
+  return v.f;
+}
+
+// Same results as halfFromFloat, converting with F16C when available and SSE2 otherwise.
+void halvesFromFloats(uint16_t* dst, const float* src, size_t N);
+
+// Same results as floatFromHalf, converting with F16C when available and SSE2 otherwise.
+void floatsFromHalves(float* dst, const uint16_t* src, size_t N);
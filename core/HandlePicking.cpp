@@ -1,30 +1,140 @@
+#include <algorithm>
+#include <cmath>
 #include "HandlePicking.h"
+#include "Bounds.h"
+#include "Tasks.h"
 #include "LinAlgOps.h"
 //#include "App.h"  // MeshItem
 #include "Mesh.h"
 
 namespace {
 
-  uint8_t insideFrustumPlaneMask(Vec4f& h)
+  // Ray against the oriented box in the box frame, so meshes the ray misses never get a BVH.
+  bool rayHitsBox(const OBB3f& box, const Vec3f& origin, const Vec3f& direction, float tMax)
   {
-    return
-      ( h.x <= h.w ? 32 : 0) |
-      (-h.w <= h.x ? 16 : 0) |
-      ( h.y <= h.w ?  8 : 0) |
-      (-h.w <= h.y ?  4 : 0) |
-      ( h.z <= h.w ?  2 : 0) |
-      (-h.w <= h.z ?  1 : 0);
+    float t0 = 0.f;
+    float t1 = tMax;
+    auto o = origin - box.center;
+    for (unsigned k = 0; k < 3; k++) {
+      auto p = dot(box.axis[k], o);
+      auto d = dot(box.axis[k], direction);
+      auto h = box.halfSize[k];
+      if (d == 0.f) {
+        if (h < std::abs(p)) return false;
+        continue;
+      }
+      auto a = (-h - p) / d;
+      auto b = (h - p) / d;
+      t0 = std::max(t0, std::min(a, b));
+      t1 = std::min(t1, std::max(a, b));
+    }
+    return t0 <= t1;
+  }
+
+  constexpr uint32_t chunkTriangles = 4096;  // Triangles per task when testing objects that straddle the frustum.
+
+  // Drops data of meshes that are gone, so a recycled Mesh pointer never matches a stale entry.
+  void pruneMeshData(HitTmp& tmp, const Vector<Mesh*>& meshes)
+  {
+    for (uint32_t i = 0; i < tmp.meshData.size32(); ) {
+      auto * e = tmp.meshData[i];
+      if (std::find(meshes.begin(), meshes.end(), e->mesh) == meshes.end()) {
+        delete e;
+        tmp.meshData[i] = tmp.meshData.back();
+        tmp.meshData.popBack();
+      }
+      else {
+        i++;
+      }
+    }
+  }
+
+  HitTmp::MeshData& getMeshData(HitTmp& tmp, const Mesh* m)
+  {
+    for (auto * e : tmp.meshData) {
+      if (e->mesh == m) return *e;
+    }
+    auto * entry = new HitTmp::MeshData();
+    entry->mesh = m;
+    tmp.meshData.pushBack(entry);
+    return *entry;
+  }
+
+  const BVH& getMeshBVH(HitTmp& tmp, Logger logger, Tasks* tasks, const Mesh* m)
+  {
+    auto & entry = getMeshData(tmp, m);
+    if (entry.geometryGeneration != m->geometryGeneration) {
+      entry.geometryGeneration = m->geometryGeneration;
+      buildTriangleBVH(logger, tasks, entry.bvh, m->vtx, m->triVtxIx, m->triCount);
+    }
+    return entry.bvh;
+  }
+
+  // Clips the clip-space triangle against the planes in mask, using the bits
+  // of insideFrustumPlaneMask, true if anything is left.
+  bool triangleInsideFrustum(const Vec4f& h0, const Vec4f& h1, const Vec4f& h2, uint32_t mask)
+  {
+    auto m0 = insideFrustumPlaneMask(h0);
+    auto m1 = insideFrustumPlaneMask(h1);
+    auto m2 = insideFrustumPlaneMask(h2);
+    if (((m0 | m1 | m2) & mask) != mask) return false;
+    mask &= ~(m0 & m1 & m2);
+
+    // Each plane adds at most one vertex to the convex polygon.
+    Vec4f buffers[2][3 + 6];
+    Vec4f* poly = buffers[0];
+    Vec4f* next = buffers[1];
+    poly[0] = h0;
+    poly[1] = h1;
+    poly[2] = h2;
+    unsigned n = 3;
+    for (unsigned i = 0; i < 6; i++) {
+      if ((mask & (32 >> i)) == 0) continue;
+
+      // Signed distances in the order of the mask bits, x <= w first.
+      float d[3 + 6];
+      for (unsigned j = 0; j < n; j++) {
+        const auto & h = poly[j];
+        float c = i < 2 ? h.x : i < 4 ? h.y : h.z;
+        d[j] = (i & 1) ? h.w + c : h.w - c;
+      }
+
+      unsigned m = 0;
+      for (unsigned j = 0; j < n; j++) {
+        unsigned k = j + 1 < n ? j + 1 : 0;
+        if (0.f <= d[j]) next[m++] = poly[j];
+        if ((0.f <= d[j]) != (0.f <= d[k])) {
+          next[m++] = poly[j] + (d[j] / (d[j] - d[k])) * (poly[k] - poly[j]);
+        }
+      }
+      if (m == 0) return false;
+      std::swap(poly, next);
+      n = m;
+    }
+    return true;
   }
 
+}
+
 
+HitTmp::~HitTmp()
+{
+  for (auto * e : meshData) delete e;
+}
 
 
+const MeshObjects& getMeshObjects(HitTmp& tmp, Logger logger, Tasks* tasks, const Mesh* mesh)
+{
+  auto & entry = getMeshData(tmp, mesh);
+  updateMeshObjects(logger, tasks, entry.objects, mesh);
+  return entry.objects;
 }
 
 
 bool nearestHit(Hit& hit,
                 HitTmp& tmp,
                 Logger logger,
+                Tasks* tasks,
                 const Vector<Mesh*>& meshes,
                 const Mat4f& PM,
                 const Mat4f& PMinv,
@@ -32,105 +142,151 @@ bool nearestHit(Hit& hit,
                 const Vec2f& viewPortSize,
                 const Vec2f& screenPos)
 {
-  float nearestZ = FLT_MAX;
-  auto & vmasks = tmp.vertexMasks;
-
-  Vec2f pickExtent(5.f, 5.f);
-
-  auto sx = (1.f / pickExtent.x) * viewPortSize.x;
-  auto sy = (1.f / pickExtent.y) * viewPortSize.y;
-  auto tx = (1.f / pickExtent.x) * (viewPortSize.x - 2.f*(screenPos.x - viewPortPos.x));
-  auto ty = -(1.f / pickExtent.y) * (viewPortSize.y - 2.f*(screenPos.y - viewPortPos.y));
-
-  Mat4f pickMatrix(sx, 0.f, 0.f, tx,
-                   0.f, sy, 0.f, ty,
-                   0.f, 0.f, 1.f, 0.f,
-                   0.f, 0.f, 0.f, 1.f);
+  // World-space ray through the pixel from the near to the far plane, t in [0,1].
+  auto nx = 2.f * (screenPos.x - viewPortPos.x) / viewPortSize.x - 1.f;
+  auto ny = 1.f - 2.f * (screenPos.y - viewPortPos.y) / viewPortSize.y;
+  auto h0 = mul(PMinv, Vec4f(nx, ny, -1.f, 1.f));
+  auto h1 = mul(PMinv, Vec4f(nx, ny, 1.f, 1.f));
+  auto origin = (1.f / h0.w) * Vec3f(h0.x, h0.y, h0.z);
+  auto direction = (1.f / h1.w) * Vec3f(h1.x, h1.y, h1.z) - origin;
 
-  Mat4f pickSpaceFromWorld = mul(pickMatrix, PM);
+  pruneMeshData(tmp, meshes);
 
+  float nearestT = 1.f;
+  bool found = false;
   for (unsigned j = 0; j < meshes.size32(); j++) {
     auto * m = meshes[j];
+    if (!isEmpty(m->obb) && !rayHitsBox(m->obb, origin, direction, nearestT)) continue;
 
-    auto mask = 0;
-    for (unsigned i = 0; i < 8; i++) {
-      auto h = mul(pickSpaceFromWorld, Vec4f(i & 1 ? m->bbox.min.x : m->bbox.max.x,
-                                             i & 2 ? m->bbox.min.y : m->bbox.max.y,
-                                             i & 4 ? m->bbox.min.z : m->bbox.max.z,
-                                             1.f));
-      mask = mask | insideFrustumPlaneMask(h);
-    }
-    if (mask != 63) {
-      logger(0, "BBOX skip");
-      continue;
+    RayHit rayHit;
+    if (intersectTriangles(rayHit, getMeshBVH(tmp, logger, tasks, m), m->vtx, m->triVtxIx, origin, direction, nearestT)) {
+      nearestT = rayHit.t;
+      found = true;
+      hit.mesh = j;
+      hit.triangle = rayHit.triangle;
+      hit.u = rayHit.u;
+      hit.v = rayHit.v;
     }
+  }
 
-    vmasks.accommodate(m->vtxCount);
-    for (unsigned i = 0; i < m->vtxCount; i++) {
-      auto & p = m->vtx[i];
-      auto h = mul(pickSpaceFromWorld, Vec4f(p.x, p.y, p.z, 1.f));
-      vmasks[i] = insideFrustumPlaneMask(h);
-    }
+  if (found) {
+    auto h = mul(PM, Vec4f(origin + nearestT * direction, 1.f));
+    hit.depth = h.z / h.w;
+  }
+  return found;
+}
 
-    for (unsigned i = 0; i < m->triCount; i++) {
-      auto ix0 = m->triVtxIx[3 * i + 0];
-      auto ix1 = m->triVtxIx[3 * i + 1];
-      auto ix2 = m->triVtxIx[3 * i + 2];
 
-      if ((vmasks[ix0] | vmasks[ix1] | vmasks[ix2]) != 63) {
-        continue; // vertices are comletely outside at least one plane
-      }
+void objectsInRectangle(Vector<ObjectHit>& hits,
+                        HitTmp& tmp,
+                        Logger logger,
+                        Tasks* tasks,
+                        const Vector<Mesh*>& meshes,
+                        const Mat4f& PM,
+                        const Vec2f& viewPortPos,
+                        const Vec2f& viewPortSize,
+                        const Vec2f& a,
+                        const Vec2f& b)
+{
+  hits.resize(0);
 
-      auto h0 = mul(pickSpaceFromWorld, Vec4f(m->vtx[ix0], 1.f));
-      auto h1 = mul(pickSpaceFromWorld, Vec4f(m->vtx[ix1], 1.f));
-      auto h2 = mul(pickSpaceFromWorld, Vec4f(m->vtx[ix2], 1.f));
-      if ((vmasks[ix0] & vmasks[ix1] & vmasks[ix2] & 1) == 1) {
-        // all vertices in front of near plane
-
-        auto p0 = (1.f / h0.w)*Vec2f(h0.data);
-        auto p1 = (1.f / h1.w)*Vec2f(h1.data);
-        auto p2 = (1.f / h2.w)*Vec2f(h2.data);
-        auto v01 = p1 - p0;
-        auto v12 = p2 - p1;
-        auto v20 = p0 - p2;
-
-        auto area12o = v12.x*p1.y - p1.x*v12.y;
-        auto area20o = v20.x*p2.y - p2.x*v20.y;
-        auto area01o = v01.x*p0.y - p0.x*v01.y;
-        auto area012 = v01.x*v20.y - v20.x*v01.y;
-
-        if (1e-5f < std::abs(area012)) {
-          if ((signbit(area12o) == signbit(area20o)) &&
-              (signbit(area01o) == signbit(area012)) &&
-              (signbit(area20o) == signbit(area01o)))
-          {
-            auto s = 1.f / (area012);
-            auto b0 = (1.f / h0.w) * s * area12o;
-            auto b1 = (1.f / h1.w) * s * area20o;
-            auto b2 = (1.f / h2.w) * s * area01o;
-
-            auto z = b0 * h0.z + b1 * h1.z + b2 * h2.z;
-            if (z < nearestZ) {
-              nearestZ = z;
-              hit.mesh = j;
-              hit.triangle = i;
-              hit.depth = nearestZ;
-            }
-          }
-        }
+  auto ax = 2.f * (a.x - viewPortPos.x) / viewPortSize.x - 1.f;
+  auto ay = 1.f - 2.f * (a.y - viewPortPos.y) / viewPortSize.y;
+  auto bx = 2.f * (b.x - viewPortPos.x) / viewPortSize.x - 1.f;
+  auto by = 1.f - 2.f * (b.y - viewPortPos.y) / viewPortSize.y;
+  auto clipFromWorld = rectangleClipMatrix(PM, std::min(ax, bx), std::min(ay, by), std::max(ax, bx), std::max(ay, by));
 
-        else {
-          logger(0, "Degenerate");
-        }
-      }
+  pruneMeshData(tmp, meshes);
+
+  struct Chunk
+  {
+    uint32_t object;
+    uint32_t begin;   // Range in MeshObjects::triangles.
+    uint32_t end;
+  };
+  struct StackItem
+  {
+    uint32_t node;
+    uint32_t mask;    // Planes the node's parent was not fully inside of.
+  };
+  Vector<uint32_t> masks;
+  Vector<StackItem> stack;
+  Vector<StackItem> leaves;
+  Vector<Chunk> chunks;
+  Vector<uint8_t> chunkHits;
+  for (uint32_t j = 0; j < meshes.size32(); j++) {
+    auto * m = meshes[j];
+    uint32_t meshMask = 0x3f;
+    if (!isEmpty(m->bbox) && !insideFrustumPlaneMask(meshMask, m->bbox, clipFromWorld)) continue;
+
+    const auto & objects = getMeshObjects(tmp, logger, tasks, m);
+    const auto & bvh = objects.bvh;
+    uint32_t objectCount = objects.objectCount();
 
+    // Planes left to test for each object, zero when inside and ~0u when outside or empty.
+    masks.resize(objectCount);
+    for (auto & mask : masks) mask = ~0u;
+    leaves.resize(0);
+    if (!bvh.nodes.empty()) stack.pushBack(StackItem{ 0, meshMask });
+    while (!stack.empty()) {
+      auto item = stack.back();
+      stack.popBack();
+      const auto & node = bvh.nodes[item.node];
+      if (!insideFrustumPlaneMask(item.mask, node.bbox, clipFromWorld)) continue;
+      if (node.count) {
+        leaves.pushBack(item);
+      }
       else {
-        // Handle with clipping or do ray-intersection in world space.
-        logger(0, "Triangle intersecting near plane");
+        stack.pushBack(StackItem{ node.first + 0, item.mask });
+        stack.pushBack(StackItem{ node.first + 1, item.mask });
       }
     }
 
+    // Each object sits in exactly one leaf, so leaves write disjoint masks.
+    parallelFor(tasks, leaves.size32(), 64, [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t l = begin; l < end; l++) {
+        const auto & node = bvh.nodes[leaves[l].node];
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+          auto o = bvh.primitives[i];
+          uint32_t mask = leaves[l].mask;
+          if (insideFrustumPlaneMask(mask, objects.boxes[o], clipFromWorld)) masks[o] = mask;
+        }
+      }
+    });
+
+    chunks.resize(0);
+    for (uint32_t o = 0; o < objectCount; o++) {
+      if (masks[o] == 0 || masks[o] == ~0u) continue;
+      for (uint32_t i = objects.offsets[o]; i < objects.offsets[o + 1]; i += chunkTriangles) {
+        chunks.pushBack(Chunk{ o, i, std::min(objects.offsets[o + 1], i + chunkTriangles) });
+      }
+    }
+    chunkHits.resize(chunks.size());
+    parallelFor(tasks, chunks.size32(), 1, [&](uint32_t begin, uint32_t end)
+    {
+      const auto * ix = m->triVtxIx;
+      for (uint32_t c = begin; c < end; c++) {
+        const auto & chunk = chunks[c];
+        chunkHits[c] = 0;
+        for (uint32_t i = chunk.begin; i < chunk.end; i++) {
+          auto t = objects.triangles[i];
+          auto h0 = mul(clipFromWorld, Vec4f(m->vtx[ix[3 * t + 0]], 1.f));
+          auto h1 = mul(clipFromWorld, Vec4f(m->vtx[ix[3 * t + 1]], 1.f));
+          auto h2 = mul(clipFromWorld, Vec4f(m->vtx[ix[3 * t + 2]], 1.f));
+          if (triangleInsideFrustum(h0, h1, h2, masks[chunk.object])) {
+            chunkHits[c] = 1;
+            break;
+          }
+        }
+      }
+    });
+    for (uint32_t c = 0; c < chunks.size32(); c++) {
+      if (chunkHits[c]) masks[chunks[c].object] = 0;
+    }
 
+    for (uint32_t o = 0; o < objectCount; o++) {
+      if (masks[o] == 0) hits.pushBack(ObjectHit{ j, o });
+    }
   }
-  return nearestZ < FLT_MAX;
-}
\ No newline at end of file
+}
@@ -1,6 +1,10 @@
 #pragma once
 #include "Common.h"
 #include "LinAlg.h"
+#include "BVH.h"
+#include "MeshObjects.h"
+
+class Tasks;
 
 
 struct Hit
@@ -8,17 +12,40 @@ struct Hit
   uint32_t mesh;
   uint32_t triangle;
   float depth;
+  float u;  // Barycentric weight of the triangle's second vertex.
+  float v;  // Barycentric weight of the triangle's third vertex.
 };
 
+// Per-mesh triangle BVHs and object groupings, built on first use and rebuilt when the mesh geometry changes.
 struct HitTmp
 {
-  MemBuffer<uint8_t> vertexMasks;
+  struct MeshData
+  {
+    const Mesh* mesh = nullptr;
+    uint32_t geometryGeneration = 0;  // Generation of bvh.
+    BVH bvh;
+
+    MeshObjects objects;
+  };
+  Vector<MeshData*> meshData;
+
+  HitTmp() = default;
+  HitTmp(const HitTmp&) = delete;
+  HitTmp& operator=(const HitTmp&) = delete;
+  ~HitTmp();
+};
+
+struct ObjectHit
+{
+  uint32_t mesh;
+  uint32_t object;  // Index into Mesh::obj, zero for meshes without objects.
 };
 
 
 bool nearestHit(Hit& hit,
                 HitTmp& tmp,
                 Logger logger,
+                Tasks* tasks,
                 const Vector<Mesh*>& meshes,
                 const Mat4f& PM,
                 const Mat4f& PMinv,
@@ -26,3 +53,20 @@ bool nearestHit(Hit& hit,
                 const Vec2f& viewPortSize,
                 const Vec2f& screenPos);
 
+// Object grouping of a mesh, built on first use and shared with picking.
+const MeshObjects& getMeshObjects(HitTmp& tmp, Logger logger, Tasks* tasks, const Mesh* mesh);
+
+// Objects with some part inside the screen rectangle spanned by the corners a and b, sorted
+// by mesh and object. Meshes, subtrees of the object BVH and objects are rejected or accepted
+// whole by their bounds where possible, the triangles of objects that straddle the rectangle
+// are tested in parallel.
+void objectsInRectangle(Vector<ObjectHit>& hits,
+                        HitTmp& tmp,
+                        Logger logger,
+                        Tasks* tasks,
+                        const Vector<Mesh*>& meshes,
+                        const Mat4f& PM,
+                        const Vec2f& viewPortPos,
+                        const Vec2f& viewPortSize,
+                        const Vec2f& a,
+                        const Vec2f& b);
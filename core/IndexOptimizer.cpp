@@ -0,0 +1,269 @@
+#include <cassert>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+#include "IndexOptimizer.h"
+#include "VertexCache.h"
+#include "LinAlgOps.h"
+
+namespace {
+
+  inline Vec3f getPosition(const float* P, size_t stride, uint32_t ix)
+  {
+    return Vec3f((float*)((const char*)P + stride * ix));
+  }
+
+  struct Cluster
+  {
+    uint32_t begin;
+    uint32_t end;
+    Vec3f centroid;
+    Vec3f normal;
+    float area;
+    float score;
+  };
+
+}
+
+const char* getIndexOptimizerName(IndexOptimizer strategy)
+{
+  switch (strategy) {
+  case IndexOptimizer::None: return "None";
+  case IndexOptimizer::Forsyth: return "Forsyth";
+  case IndexOptimizer::ForsythPartitioned: return "Forsyth partitioned";
+  case IndexOptimizer::Tipsify: return "Tipsify";
+  case IndexOptimizer::TipsifyOverdraw: return "Tipsify + overdraw";
+  default: return "?";
+  }
+}
+
+void optimizeIndices(Logger logger, Tasks* tasks, uint32_t* output, const uint32_t* input, const uint32_t N,
+                     const float* P, size_t stride, IndexOptimizer strategy, uint32_t cacheSize)
+{
+  switch (strategy) {
+  case IndexOptimizer::None:
+    std::memcpy(output, input, sizeof(uint32_t) * N);
+    break;
+  case IndexOptimizer::Forsyth:
+    linearSpeedVertexCacheOptimisation(logger, output, input, N);
+    break;
+  case IndexOptimizer::ForsythPartitioned:
+    assert(P);
+    linearSpeedVertexCacheOptimisationPartitioned(logger, tasks, output, input, N, P, stride);
+    break;
+  case IndexOptimizer::Tipsify:
+    tipsify(logger, output, input, N, cacheSize);
+    break;
+  case IndexOptimizer::TipsifyOverdraw: {
+    assert(P);
+    Vector<uint32_t> tipsified(N);
+    Vector<uint32_t> clusterStarts;
+    tipsify(logger, tipsified.data(), input, N, cacheSize, &clusterStarts);
+    overdrawClusterSort(logger, output, tipsified.data(), N, P, stride, clusterStarts, cacheSize);
+    break;
+  }
+  default:
+    assert(false && "Unhandled index optimizer");
+  }
+}
+
+void getTriangleOrigins(Vector<uint32_t>& origins, const uint32_t* output, const uint32_t* input, const uint32_t N)
+{
+  const uint32_t Nt = N / 3;
+  origins.resize(Nt);
+
+  // Input triangles bucketed by their first corner.
+  uint32_t vertexCount = 0;
+  for (uint32_t i = 0; i < N; i++) vertexCount = std::max(vertexCount, input[i] + 1);
+  Vector<uint32_t> offsets(vertexCount + 1, 0);
+  for (uint32_t t = 0; t < Nt; t++) offsets[input[3 * t] + 1]++;
+  for (uint32_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+  Vector<uint32_t> fill(offsets);
+  Vector<uint32_t> triangles(Nt);
+  for (uint32_t t = 0; t < Nt; t++) triangles[fill[input[3 * t]]++] = t;
+
+  // A matched triangle is swapped to the front of its bucket, fill[v] is the first unmatched.
+  for (uint32_t v = 0; v < vertexCount; v++) fill[v] = offsets[v];
+  for (uint32_t t = 0; t < Nt; t++) {
+    auto a = output[3 * t + 0];
+    auto b = output[3 * t + 1];
+    auto c = output[3 * t + 2];
+    assert(a < vertexCount);
+    bool found = false;
+    for (uint32_t i = fill[a]; i < offsets[a + 1]; i++) {
+      auto s = triangles[i];
+      if (input[3 * s + 1] == b && input[3 * s + 2] == c) {
+        std::swap(triangles[i], triangles[fill[a]]);
+        origins[t] = triangles[fill[a]++];
+        found = true;
+        break;
+      }
+    }
+    assert(found && "Output is not a reordering of the input triangles");
+    (void)found;
+  }
+}
+
+void overdrawClusterSort(Logger logger, uint32_t* output, const uint32_t* input, const uint32_t N,
+                         const float* P, size_t stride, const Vector<uint32_t>& clusterStarts, uint32_t cacheSize, float threshold)
+{
+  const uint32_t Nt = N / 3;
+  if (Nt == 0) return;
+
+  uint32_t Nv = 0;
+  for (uint32_t i = 0; i < N; i++) Nv = Nv < input[i] + 1 ? input[i] + 1 : Nv;
+
+  // Split at the hard boundaries and where the cluster ACMR in a FIFO cache
+  // drops below the threshold.
+  Vector<Cluster> clusters;
+  Vector<uint32_t> stamp(Nv);
+  for (auto & s : stamp) s = 0;
+  uint32_t time = 0;
+  uint32_t misses = 0;
+  uint32_t begin = 0;
+  uint32_t hard = 0;
+  for (uint32_t t = 0; t < Nt; t++) {
+    bool cut = false;
+    if (hard < clusterStarts.size32() && clusterStarts[hard] == t) {
+      hard++;
+      cut = true;
+    }
+    else if (t != begin && float(misses) < threshold * float(t - begin)) {
+      cut = true;
+    }
+    if (cut && t != begin) {
+      clusters.pushBack(Cluster{ begin, t });
+      begin = t;
+      misses = 0;
+      time += cacheSize + 1;  // Flush.
+    }
+    for (uint32_t k = 0; k < 3; k++) {
+      auto v = input[3 * t + k];
+      if (stamp[v] == 0 || cacheSize <= time - stamp[v]) {
+        stamp[v] = ++time;
+        misses++;
+      }
+    }
+  }
+  clusters.pushBack(Cluster{ begin, Nt });
+
+  // Occlusion potential: how far the area-weighted cluster centroid lies out
+  // along the cluster's average normal, relative to the mesh centroid.
+  Vec3f meshCentroid(0.f);
+  float meshArea = 0.f;
+  for (auto & cluster : clusters) {
+    cluster.centroid = Vec3f(0.f);
+    cluster.normal = Vec3f(0.f);
+    cluster.area = 0.f;
+    for (uint32_t t = cluster.begin; t < cluster.end; t++) {
+      auto p0 = getPosition(P, stride, input[3 * t + 0]);
+      auto p1 = getPosition(P, stride, input[3 * t + 1]);
+      auto p2 = getPosition(P, stride, input[3 * t + 2]);
+      auto n = cross(p1 - p0, p2 - p0);
+      auto a = length(n);
+      cluster.centroid = cluster.centroid + (a / 3.f) * (p0 + p1 + p2);
+      cluster.normal = cluster.normal + n;
+      cluster.area += a;
+    }
+    meshCentroid = meshCentroid + cluster.centroid;
+    meshArea += cluster.area;
+  }
+  if (0.f < meshArea) meshCentroid = (1.f / meshArea) * meshCentroid;
+
+  for (auto & cluster : clusters) {
+    auto l = length(cluster.normal);
+    if (0.f < cluster.area && 0.f < l) {
+      cluster.score = dot((1.f / cluster.area) * cluster.centroid - meshCentroid, (1.f / l) * cluster.normal);
+    }
+    else {
+      cluster.score = -FLT_MAX;
+    }
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.score > b.score; });
+
+  uint32_t o = 0;
+  for (auto & cluster : clusters) {
+    for (uint32_t i = 3 * cluster.begin; i < 3 * cluster.end; i++) output[o++] = input[i];
+  }
+  assert(o == N);
+  logger(0, "overdrawClusterSort: Nt=%d in %d clusters.", Nt, clusters.size32());
+}
+
+float estimateOverdraw(const uint32_t* indices, const uint32_t N, const float* P, size_t stride, uint32_t resolution)
+{
+  const uint32_t Nt = N / 3;
+  if (Nt == 0) return 1.f;
+
+  auto bbox = createEmptyBBox3f();
+  for (uint32_t i = 0; i < N; i++) engulf(bbox, getPosition(P, stride, indices[i]));
+  auto center = 0.5f * (bbox.min + bbox.max);
+  auto radius = 0.5f * diagonal(bbox);
+  if (radius <= 0.f) return 1.f;
+  auto scale = 0.5f * resolution / radius;
+
+  // The six axis directions and the eight cube diagonals.
+  Vec3f dirs[14];
+  uint32_t d = 0;
+  for (uint32_t a = 0; a < 3; a++) {
+    for (float s : { -1.f, 1.f }) {
+      Vec3f v(0.f);
+      v[a] = s;
+      dirs[d++] = v;
+    }
+  }
+  for (uint32_t i = 0; i < 8; i++) {
+    dirs[d++] = normalize(Vec3f((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f));
+  }
+
+  Vector<float> depth(size_t(resolution) * resolution);
+  Vector<Vec3f> projected(N);
+  uint64_t shaded = 0;
+  uint64_t covered = 0;
+  for (auto & dir : dirs) {
+    // Right-handed screen basis (u, v, dir), the viewer is at +dir looking down -dir.
+    auto u = normalize(std::abs(dir.x) < 0.9f ? cross(Vec3f(1.f, 0.f, 0.f), dir) : cross(Vec3f(0.f, 1.f, 0.f), dir));
+    auto v = cross(dir, u);
+
+    for (auto & z : depth) z = FLT_MAX;
+    for (uint32_t i = 0; i < N; i++) {
+      auto p = getPosition(P, stride, indices[i]) - center;
+      projected[i] = Vec3f(scale * dot(p, u) + 0.5f * resolution,
+                           scale * dot(p, v) + 0.5f * resolution,
+                           -dot(p, dir));
+    }
+
+    for (uint32_t t = 0; t < Nt; t++) {
+      auto & a = projected[3 * t + 0];
+      auto & b = projected[3 * t + 1];
+      auto & c = projected[3 * t + 2];
+      auto area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+      if (area <= 0.f) continue;  // Back-facing or degenerate.
+
+      auto x0 = std::max(0, int(std::floor(std::min(a.x, std::min(b.x, c.x)))));
+      auto x1 = std::min(int(resolution) - 1, int(std::ceil(std::max(a.x, std::max(b.x, c.x)))));
+      auto y0 = std::max(0, int(std::floor(std::min(a.y, std::min(b.y, c.y)))));
+      auto y1 = std::min(int(resolution) - 1, int(std::ceil(std::max(a.y, std::max(b.y, c.y)))));
+      auto rcpArea = 1.f / area;
+      for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+          auto px = x + 0.5f;
+          auto py = y + 0.5f;
+          auto w0 = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+          auto w1 = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+          auto w2 = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+          if (w0 < 0.f || w1 < 0.f || w2 < 0.f) continue;
+          auto z = rcpArea * (w0 * a.z + w1 * b.z + w2 * c.z);
+          auto & Z = depth[size_t(resolution) * y + x];
+          if (z < Z) {
+            Z = z;
+            shaded++;
+          }
+        }
+      }
+    }
+    for (auto z : depth) covered += z != FLT_MAX ? 1 : 0;
+  }
+  return covered ? float(double(shaded) / double(covered)) : 1.f;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "Common.h"
+
+class Tasks;
+
+enum struct IndexOptimizer
+{
+  None,                 // Keep input order.
+  Forsyth,              // linearSpeedVertexCacheOptimisation.
+  ForsythPartitioned,   // linearSpeedVertexCacheOptimisationPartitioned, needs positions.
+  Tipsify,              // tipsify, faster than Forsyth at a slightly higher ACMR.
+  TipsifyOverdraw       // tipsify followed by sorting clusters for less overdraw, needs positions.
+};
+
+const char* getIndexOptimizerName(IndexOptimizer strategy);
+
+// Reorder the triangles of an index buffer using the given strategy. P points
+// to the position of vertex 0, with stride bytes between consecutive vertices,
+// and may be null for strategies that do not need positions.
+void optimizeIndices(Logger logger, Tasks* tasks, uint32_t* output, const uint32_t* input, const uint32_t N,
+                     const float* P, size_t stride, IndexOptimizer strategy, uint32_t cacheSize = 16);
+
+// For each triangle of output, a reordering of the triangles of input like optimizeIndices
+// produces, the input triangle it stems from. Corners must keep their order within a
+// triangle, and identical triangles are matched one to one.
+void getTriangleOrigins(Vector<uint32_t>& origins, const uint32_t* output, const uint32_t* input, const uint32_t N);
+
+// Split a cache-optimized index buffer into clusters at the given boundaries
+// and where the cache miss ratio of a cluster has dropped below threshold,
+// then order clusters so that those facing away from the mesh centroid are
+// drawn first, which makes them likely to occlude the rest.
+void overdrawClusterSort(Logger logger, uint32_t* output, const uint32_t* input, const uint32_t N,
+                         const float* P, size_t stride, const Vector<uint32_t>& clusterStarts, uint32_t cacheSize, float threshold = 0.75f);
+
+// Render the triangles orthographically from a set of directions around the
+// mesh with back-face culling and a depth test, and return the number of
+// shaded pixels divided by the number of covered pixels.
+float estimateOverdraw(const uint32_t* indices, const uint32_t N, const float* P, size_t stride, uint32_t resolution = 256);
@@ -93,6 +93,14 @@ struct BBox3f
   };
 };
 
+// Oriented box, center + sum of +/- halfSize[i] * axis[i].
+struct OBB3f
+{
+  Vec3f center = Vec3f(0.f);
+  Vec3f axis[3] = { Vec3f(1.f, 0.f, 0.f), Vec3f(0.f, 1.f, 0.f), Vec3f(0.f, 0.f, 1.f) };  // Orthonormal.
+  Vec3f halfSize = Vec3f(-1.f);  // Negative when empty.
+};
+
 struct Mat3f
 {
   Mat3f() = default;
@@ -124,6 +124,14 @@ inline Vec3f mul(const Mat3x4f& A, const Vec3f& x)
   return r;
 }
 
+// Vec4f
+
+inline Vec4f operator+(const Vec4f& a, const Vec4f& b) { return Vec4f(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+
+inline Vec4f operator-(const Vec4f& a, const Vec4f& b) { return Vec4f(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
+
+inline Vec4f operator*(const float a, const Vec4f& b) { return Vec4f(a*b.x, a*b.y, a*b.z, a*b.w); }
+
 // Mat4f
 
 Mat4f mul(const Mat4f& A, const Mat4f& B);
@@ -169,6 +177,19 @@ inline bool isEmpty(const BBox3f& b) { return b.max.x < b.min.x; }
 
 inline bool isNotEmpty(const BBox3f& b) { return b.min.x <= b.max.x; }
 
+// OBB3f
+
+inline bool isEmpty(const OBB3f& b) { return b.halfSize.x < 0.f; }
+
+inline Vec3f corner(const OBB3f& b, unsigned i)
+{
+  return b.center + (i & 1 ? -b.halfSize.x : b.halfSize.x) * b.axis[0]
+                  + (i & 2 ? -b.halfSize.y : b.halfSize.y) * b.axis[1]
+                  + (i & 4 ? -b.halfSize.z : b.halfSize.z) * b.axis[2];
+}
+
+inline float volume(const OBB3f& b) { return 8.f * b.halfSize.x * b.halfSize.y * b.halfSize.z; }
+
 inline float maxSideLength(const BBox3f& b)
 {
   auto l = b.max - b.min;
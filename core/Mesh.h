@@ -1,7 +1,21 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include "LinAlg.h"
 #include "Common.h"
+#include "Selection.h"
+
+struct MeshLodLevel
+{
+  uint32_t* triVtxIx = nullptr;
+  uint32_t* triNrmIx = nullptr;
+  uint32_t* triTexIx = nullptr;
+  uint32_t* triSource = nullptr;  // Triangle in the full mesh that each triangle stems from, nullptr for the full mesh.
+  uint32_t triCount = 0;
+  float error = 0.f;              // Geometric error in model units, accumulated along the chain.
+
+  uint32_t sourceTriangle(uint32_t t) const { return triSource ? triSource[t] : t; }
+};
 
 struct Mesh
 {
@@ -12,6 +26,7 @@ struct Mesh
   uint32_t colorGeneration = 1;     // is never zero
 
   BBox3f bbox;
+  OBB3f obb;
   Vec3f* vtx = nullptr;
   uint32_t vtxCount = 0;
 
@@ -33,15 +48,17 @@ struct Mesh
   uint32_t* lineColor = nullptr;
   uint32_t lineCount = 0;
 
+  MeshLodLevel* lodLevels = nullptr;  // Level 0 is the full mesh, see buildMeshLods.
+  std::atomic<uint32_t> lodLevelCount{ 0 };  // Stored after lodLevels, as levels may arrive while the mesh is in use.
+
   const char** obj = nullptr;
   uint32_t obj_n = 0;
 
   // move to mesh app state or something.
-  uint32_t* currentColor = nullptr;  // Current triangle color, one uint32_t per triangle;
-  bool * selected = nullptr;
+  Selection selection;               // Selected objects, one bit per object.
 
   const char* name = nullptr;
 
-  void touchColor() { geometryGeneration++; if (!geometryGeneration) geometryGeneration++; }
+  void touchColor() { colorGeneration++; if (!colorGeneration) colorGeneration++; }
   void touchGeometry() { geometryGeneration++; if (!geometryGeneration) geometryGeneration++; touchColor(); }
 };
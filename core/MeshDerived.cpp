@@ -0,0 +1,230 @@
+#include <cassert>
+#include <cstring>
+#include "Common.h"
+#include "Tasks.h"
+#include "Mesh.h"
+#include "MeshLod.h"
+#include "MeshIndexing.h"
+#include "VertexCache.h"
+#include "LinAlgOps.h"
+#include "MeshDerived.h"
+
+namespace {
+
+  // One derived item, computed once under compute by the first request.
+  template<typename T>
+  struct Slot
+  {
+    uint64_t key = 0;
+    std::mutex compute;
+    std::shared_ptr<const T> value;
+  };
+
+  template<typename T>
+  using Slots = Vector<std::shared_ptr<Slot<T>>>;
+
+}
+
+struct MeshDerivedCache::MeshData
+{
+  const Mesh* mesh = nullptr;
+  uint32_t geometryGeneration = 0;  // Generation the slots were made for.
+
+  Slots<Vector<Vec3f>> faceNormals;         // Keyed by level.
+  Slots<MeshVertexIndexing> indexings;      // Keyed by optimizer and level.
+  Slots<Vector<uint32_t>> edges;            // Keyed by class mask and crease angle.
+  Slots<MeshTangents> tangents;
+};
+
+namespace {
+
+  // Finds or adds the slot of key, after dropping everything if the geometry has changed and
+  // the slots that keep returns false for.
+  template<typename T, typename Keep>
+  std::shared_ptr<Slot<T>> getSlot(MeshDerivedCache& cache, const Mesh* mesh, Slots<T> MeshDerivedCache::MeshData::* slots, uint64_t key, Keep keep)
+  {
+    std::lock_guard<std::mutex> guard(cache.lock);
+
+    MeshDerivedCache::MeshData* entry = nullptr;
+    for (auto * e : cache.meshData) {
+      if (e->mesh == mesh) {
+        entry = e;
+        break;
+      }
+    }
+    if (entry == nullptr) {
+      entry = new MeshDerivedCache::MeshData();
+      entry->mesh = mesh;
+      cache.meshData.pushBack(entry);
+    }
+    if (entry->geometryGeneration != mesh->geometryGeneration) {
+      entry->geometryGeneration = mesh->geometryGeneration;
+      entry->faceNormals.clear();
+      entry->indexings.clear();
+      entry->edges.clear();
+      entry->tangents.clear();
+    }
+
+    auto & list = entry->*slots;
+    for (auto & slot : list) {
+      if (slot->key == key) return slot;
+    }
+    for (uint32_t i = 0; i < list.size32(); ) {
+      if (keep(list[i]->key)) {
+        i++;
+      }
+      else {
+        list[i].swap(list.back());
+        list.popBack();
+      }
+    }
+    list.pushBack(std::make_shared<Slot<T>>());
+    list.back()->key = key;
+    return list.back();
+  }
+
+  // Returns the value of the slot, computing it if this is the first request.
+  template<typename T, typename Compute>
+  std::shared_ptr<const T> getValue(Slot<T>& slot, Compute compute)
+  {
+    std::lock_guard<std::mutex> guard(slot.compute);
+    if (!slot.value) {
+      auto value = std::make_shared<T>();
+      compute(*value);
+      slot.value = value;
+    }
+    return slot.value;
+  }
+
+  void computeFaceNormals(Tasks* tasks, Vector<Vec3f>& normals, const Mesh* mesh, uint32_t level)
+  {
+    auto lod = getLodLevel(mesh, level);
+    normals.resize(lod.triCount);
+    parallelFor(tasks, lod.triCount, 1 << 14, [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t t = begin; t < end; t++) {
+        Vec3f p[3];
+        for (unsigned k = 0; k < 3; k++) p[k] = mesh->vtx[lod.triVtxIx[3 * t + k]];
+        normals[t] = cross(p[1] - p[0], p[2] - p[0]);
+      }
+    });
+  }
+
+  void computeVertexIndexing(Logger logger, Tasks* tasks, MeshVertexIndexing& indexing, const Mesh* mesh, uint32_t level, IndexOptimizer optimizer)
+  {
+    auto lod = getLodLevel(mesh, level);
+    auto N = 3 * lod.triCount;
+
+    Vector<uint32_t> indices;
+    Vector<uint32_t> vertices;
+    if (mesh->nrmCount) {
+      const uint32_t* streams[3] = { lod.triVtxIx, lod.triNrmIx, lod.triTexIx };
+      uint32_t streamCount = mesh->texCount ? 3 : 2;
+      uniqueIndices(logger, tasks, indices, vertices, streams, streamCount, N);
+    }
+    else {
+      indices.resize(N);
+      vertices.resize(N);
+      for (uint32_t i = 0; i < N; i++) indices[i] = vertices[i] = i;
+    }
+
+    Vector<Vec3f> positions(vertices.size());
+    for (uint32_t i = 0; i < vertices.size32(); i++) positions[i] = mesh->vtx[lod.triVtxIx[vertices[i]]];
+
+    float fifo4, fifo8, fifo16, fifo32;
+    getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, indices.data(), N);
+    logger(0, "IN  AMCR FIFO4=%.2f, FIFO8=%.2f, FIFO16=%.2f, FIFO32=%.2f", fifo4, fifo8, fifo16, fifo32);
+
+    indexing.indices.resize(N);
+    optimizeIndices(logger, tasks, indexing.indices.data(), indices.data(), N, positions.any() ? positions[0].data : nullptr, sizeof(Vec3f), optimizer);
+    getTriangleOrigins(indexing.triangles, indexing.indices.data(), indices.data(), N);
+
+    // Renumber vertices in first-use order so fetches walk the vertex buffer forwards.
+    Vector<uint32_t> order;
+    optimizeVertexFetch(logger, order, indexing.indices.data(), N, vertices.size32());
+    indexing.corners.resize(order.size());
+    for (uint32_t i = 0; i < order.size32(); i++) indexing.corners[i] = vertices[order[i]];
+
+    getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, indexing.indices.data(), N);
+    logger(0, "OPT AMCR FIFO4=%.2f, FIFO8=%.2f, FIFO16=%.2f, FIFO32=%.2f", fifo4, fifo8, fifo16, fifo32);
+  }
+
+  // Face normals are only used if the mesh has no normals.
+  void computeTangents(Tasks* tasks, MeshTangents& tangents, const Vec3f* faceNormals, const Mesh* mesh)
+  {
+    tangents.tangents.resize(3 * size_t(mesh->triCount));
+    tangents.binormals.resize(3 * size_t(mesh->triCount));
+    parallelFor(tasks, mesh->triCount, 1 << 14, [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t i = begin; i < end; i++) {
+        Vec3f p[3];
+        Vec2f t[3];
+        for (unsigned k = 0; k < 3; k++) {
+          p[k] = mesh->vtx[mesh->triVtxIx[3 * i + k]];
+          t[k] = mesh->tex[mesh->triTexIx[3 * i + k]];
+        }
+        Vec3f u, v;
+        tangentSpaceBasis(u, v, p[0], p[1], p[2], t[0], t[1], t[2]);
+        for (unsigned k = 0; k < 3; k++) {
+          auto n = normalize(mesh->nrm ? mesh->nrm[mesh->triNrmIx[3 * i + k]] : faceNormals[i]);
+          tangents.tangents[3 * i + k] = normalize(u - dot(u, n)*n);
+          tangents.binormals[3 * i + k] = normalize(v - dot(v, n)*n);
+        }
+      }
+    });
+  }
+
+}
+
+MeshDerivedCache::~MeshDerivedCache()
+{
+  for (auto * e : meshData) delete e;
+}
+
+std::shared_ptr<const Vector<Vec3f>> getFaceNormals(MeshDerivedCache& cache, Logger logger, Tasks* tasks, const Mesh* mesh, uint32_t level)
+{
+  auto slot = getSlot(cache, mesh, &MeshDerivedCache::MeshData::faceNormals, level, [](uint64_t) { return true; });
+  return getValue(*slot, [&](Vector<Vec3f>& normals)
+  {
+    computeFaceNormals(tasks, normals, mesh, level);
+    logger(0, "MeshDerived: Face normals of level %u.", level);
+  });
+}
+
+std::shared_ptr<const MeshVertexIndexing> getVertexIndexing(MeshDerivedCache& cache, Logger logger, Tasks* tasks, const Mesh* mesh, uint32_t level, IndexOptimizer optimizer)
+{
+  uint64_t key = (uint64_t(optimizer) << 32) | level;
+  auto slot = getSlot(cache, mesh, &MeshDerivedCache::MeshData::indexings, key, [optimizer](uint64_t k) { return (k >> 32) == uint64_t(optimizer); });
+  return getValue(*slot, [&](MeshVertexIndexing& indexing)
+  {
+    computeVertexIndexing(logger, tasks, indexing, mesh, level, optimizer);
+    logger(0, "MeshDerived: %u vertices of level %u with %s.", indexing.corners.size32(), level, getIndexOptimizerName(optimizer));
+  });
+}
+
+std::shared_ptr<const Vector<uint32_t>> getClassifiedEdges(MeshDerivedCache& cache, Logger logger, Tasks* tasks, const Mesh* mesh, uint32_t classMask, float creaseAngle)
+{
+  uint32_t angleBits;
+  std::memcpy(&angleBits, &creaseAngle, sizeof(angleBits));
+  uint64_t key = (uint64_t(classMask) << 32) | angleBits;
+  auto slot = getSlot(cache, mesh, &MeshDerivedCache::MeshData::edges, key, [](uint64_t) { return false; });
+  return getValue(*slot, [&](Vector<uint32_t>& edges)
+  {
+    Vector<uint32_t> classes;
+    getClassifiedEdges(logger, tasks, edges, classes, mesh, classMask, creaseAngle);
+    logger(0, "MeshDerived: %u classified edges.", edges.size32() / 2);
+  });
+}
+
+std::shared_ptr<const MeshTangents> getTangents(MeshDerivedCache& cache, Logger logger, Tasks* tasks, const Mesh* mesh)
+{
+  assert(mesh->tex);
+  auto slot = getSlot(cache, mesh, &MeshDerivedCache::MeshData::tangents, 0, [](uint64_t) { return false; });
+  return getValue(*slot, [&](MeshTangents& tangents)
+  {
+    std::shared_ptr<const Vector<Vec3f>> faceNormals;
+    if (!mesh->nrm) faceNormals = getFaceNormals(cache, logger, tasks, mesh, 0);
+    computeTangents(tasks, tangents, faceNormals ? faceNormals->data() : nullptr, mesh);
+    logger(0, "MeshDerived: Tangents of %u corners.", tangents.tangents.size32());
+  });
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include "Common.h"
+#include "LinAlg.h"
+#include "IndexOptimizer.h"
+
+class Tasks;
+struct Mesh;
+
+// Vertices of a level of detail that are unique on position, normal and texture coordinate,
+// with triangles reordered by an index optimizer and vertices numbered in first-use order.
+// Without mesh normals each corner is a vertex of its own, as flat shading needs.
+struct MeshVertexIndexing
+{
+  Vector<uint32_t> corners;     // Corner in the triangle list of the level that each vertex is taken from.
+  Vector<uint32_t> indices;     // Three vertices per triangle.
+  Vector<uint32_t> triangles;   // Triangle of the level that each triangle of indices stems from.
+};
+
+// Tangent and binormal of each triangle corner of the full mesh, made orthogonal to the corner
+// normal, or to the face normal for meshes without normals.
+struct MeshTangents
+{
+  Vector<Vec3f> tangents;
+  Vector<Vec3f> binormals;
+};
+
+// Data derived from mesh geometry that several renderers use, computed on first request and
+// dropped when the geometry generation changes. Requests may come from several tasks at once,
+// and concurrent requests for the same data wait for a single computation. Results are
+// immutable, so holders can keep using them after the cache has dropped them.
+struct MeshDerivedCache
+{
+  struct MeshData;
+  Vector<MeshData*> meshData;
+  std::mutex lock;
+
+  MeshDerivedCache() = default;
+  MeshDerivedCache(const MeshDerivedCache&) = delete;
+  MeshDerivedCache& operator=(const MeshDerivedCache&) = delete;
+  ~MeshDerivedCache();
+};
+
+// Face normals cross(p1 - p0, p2 - p0) of the triangles of a level, not normalized.
+std::shared_ptr<const Vector<Vec3f>> getFaceNormals(MeshDerivedCache& cache, Logger logger, Tasks* tasks, const Mesh* mesh, uint32_t level);
+
+// Indexing of a level, only the most recently requested optimizer is kept.
+std::shared_ptr<const MeshVertexIndexing> getVertexIndexing(MeshDerivedCache& cache, Logger logger, Tasks* tasks, const Mesh* mesh, uint32_t level, IndexOptimizer optimizer);
+
+// Vertex pairs of the edges getClassifiedEdges returns for classMask and creaseAngle in radians,
+// only the most recently requested classification is kept.
+std::shared_ptr<const Vector<uint32_t>> getClassifiedEdges(MeshDerivedCache& cache, Logger logger, Tasks* tasks, const Mesh* mesh, uint32_t classMask, float creaseAngle);
+
+// Tangent frames of a mesh with texture coordinates.
+std::shared_ptr<const MeshTangents> getTangents(MeshDerivedCache& cache, Logger logger, Tasks* tasks, const Mesh* mesh);
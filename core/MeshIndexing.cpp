@@ -1,47 +1,282 @@
+#include <chrono>
+#include <algorithm>
 #include "MeshIndexing.h"
+#include "Mesh.h"
+#include "LinAlgOps.h"
+#include "RadixSort.h"
+#include "Tasks.h"
 
 
 void getEdges(Logger logger, Vector<uint32_t>& edgeIndices, const uint32_t* triVtxIx, const uint32_t triCount)
 {
-  edgeIndices.clear();
-
-  Map known;
-  for (uint32_t j = 0; j < 3 * triCount; j += 3) {
-    for (uint32_t i = 0; i < 3; i++) {
-      auto a = triVtxIx[j + i];
-      auto b = triVtxIx[j + i + (i < 2 ? 1 : -2)];
-      if (b < a) {
-        auto t = a;
-        a = b;
-        b = t;
+  getEdges(logger, nullptr, edgeIndices, nullptr, triVtxIx, triCount);
+}
+
+namespace {
+
+  const uint32_t edgeChunkSize = 0x10000;
+
+  // Emits a (min,max) key per half-edge and sorts them, optionally along with
+  // the half-edge indices. The two vertex indices are packed with just enough
+  // bits each, so the radix sort runs as few passes as possible. Returns the
+  // number of bits used by the max index.
+  uint32_t sortEdgeKeys(Tasks* tasks, Vector<uint64_t>& keys, Vector<uint32_t>* halfEdges, const uint32_t* triVtxIx, const uint32_t triCount)
+  {
+    const uint32_t N = 3 * triCount;
+    const uint32_t chunkCount = (N + edgeChunkSize - 1) / edgeChunkSize;
+    Vector<uint32_t> chunkMax(chunkCount);
+    parallelFor(tasks, chunkCount, 1, [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t c = begin; c < end; c++) {
+        auto chunkEnd = std::min(N, (c + 1) * edgeChunkSize);
+        uint32_t m = 0;
+        for (uint32_t i = c * edgeChunkSize; i < chunkEnd; i++) m = std::max(m, triVtxIx[i]);
+        chunkMax[c] = m;
       }
-      auto key = (uint64_t(a) << 32u) | uint64_t(b + 1);
-      if (known.get(key) == 0) {
-        edgeIndices.pushBack(a);
-        edgeIndices.pushBack(b);
-        known.insert(key, 1);
+    });
+    uint32_t maxIndex = 0;
+    for (auto m : chunkMax) maxIndex = std::max(maxIndex, m);
+    uint32_t shift = 1;
+    while (shift < 32 && (maxIndex >> shift)) shift++;
+
+    keys.resize(N);
+    if (halfEdges) halfEdges->resize(N);
+    parallelFor(tasks, triCount, 0x4000, [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t j = 3 * begin; j < 3 * end; j += 3) {
+        for (uint32_t i = 0; i < 3; i++) {
+          uint64_t a = triVtxIx[j + i];
+          uint64_t b = triVtxIx[j + (i < 2 ? i + 1 : 0)];
+          keys[j + i] = a < b ? (a << shift) | b : (b << shift) | a;
+          if (halfEdges) (*halfEdges)[j + i] = j + i;
+        }
       }
-    }
+    });
+    radixSort(tasks, keys.data(), halfEdges ? halfEdges->data() : nullptr, N);
+    return shift;
+  }
+
+  // Runs func(runBegin, runEnd) for every run of equal sorted keys, in
+  // parallel chunks. A run is handled by the chunk where it begins.
+  template<typename F>
+  void forEachEdgeRun(Tasks* tasks, const Vector<uint64_t>& keys, F func)
+  {
+    const uint32_t N = keys.size32();
+    const uint32_t chunkCount = (N + edgeChunkSize - 1) / edgeChunkSize;
+    parallelFor(tasks, chunkCount, 1, [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t c = begin; c < end; c++) {
+        auto i = c * edgeChunkSize;
+        auto chunkEnd = std::min(N, (c + 1) * edgeChunkSize);
+        while (0 < i && i < chunkEnd && keys[i - 1] == keys[i]) i++;
+        while (i < chunkEnd) {
+          auto j = i + 1;
+          for (; j < N && keys[j] == keys[i]; j++);
+          func(c, i, j);
+          i = j;
+        }
+      }
+    });
   }
-  logger(0, "getEdges: %d triangles with %d edges.", triCount, edgeIndices.size()/2);
+
+}
+
+void getEdges(Logger logger, Tasks* tasks, Vector<uint32_t>& edgeIndices, Vector<uint32_t>* faceCounts, const uint32_t* triVtxIx, const uint32_t triCount)
+{
+  auto time0 = std::chrono::high_resolution_clock::now();
+
+  // Sort half-edge keys and take runs of equal keys.
+  Vector<uint64_t> keys;
+  const auto shift = sortEdgeKeys(tasks, keys, nullptr, triVtxIx, triCount);
+  const uint64_t mask = (uint64_t(1) << shift) - 1;
+
+  // Count runs per chunk, then write each chunk's runs at its offset.
+  const uint32_t chunkCount = (keys.size32() + edgeChunkSize - 1) / edgeChunkSize;
+  Vector<uint32_t> offsets(chunkCount + 1);
+  for (auto & o : offsets) o = 0;
+  forEachEdgeRun(tasks, keys, [&](uint32_t chunk, uint32_t, uint32_t) { offsets[chunk + 1]++; });
+  for (uint32_t c = 0; c < chunkCount; c++) offsets[c + 1] += offsets[c];
+
+  const uint32_t edgeCount = offsets[chunkCount];
+  edgeIndices.resize(2 * size_t(edgeCount));
+  if (faceCounts) faceCounts->resize(edgeCount);
+  forEachEdgeRun(tasks, keys, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+  {
+    auto o = offsets[chunk]++;
+    edgeIndices[2 * o + 0] = uint32_t(keys[begin] >> shift);
+    edgeIndices[2 * o + 1] = uint32_t(keys[begin] & mask);
+    if (faceCounts) (*faceCounts)[o] = end - begin;
+  });
+
+  auto time1 = std::chrono::high_resolution_clock::now();
+  logger(0, "getEdges: %d triangles with %d edges, %lldms.", triCount, edgeCount,
+         std::chrono::duration_cast<std::chrono::milliseconds>(time1 - time0).count());
+}
+
+void getClassifiedEdges(Logger logger, Tasks* tasks, Vector<uint32_t>& edgeIndices, Vector<uint32_t>& edgeClasses, const Mesh* mesh, uint32_t classMask, float creaseAngle)
+{
+  auto time0 = std::chrono::high_resolution_clock::now();
+
+  Vector<uint64_t> keys;
+  Vector<uint32_t> halfEdges;
+  const auto shift = sortEdgeKeys(tasks, keys, &halfEdges, mesh->triVtxIx, mesh->triCount);
+  const uint64_t mask = (uint64_t(1) << shift) - 1;
+  const float cosCrease = std::cos(creaseAngle);
+
+  auto faceNormal = [mesh](uint32_t f)
+  {
+    auto & p0 = mesh->vtx[mesh->triVtxIx[3 * f + 0]];
+    auto & p1 = mesh->vtx[mesh->triVtxIx[3 * f + 1]];
+    auto & p2 = mesh->vtx[mesh->triVtxIx[3 * f + 2]];
+    return cross(p1 - p0, p2 - p0);
+  };
+
+  auto classify = [&](uint32_t begin, uint32_t end)
+  {
+    auto count = end - begin;
+    if (count == 1) return uint32_t(EdgeBoundary);
+
+    uint32_t c = count == 2 ? 0 : uint32_t(EdgeNonManifold);
+    auto f0 = halfEdges[begin] / 3;
+    for (uint32_t k = begin + 1; k < end; k++) {
+      auto f1 = halfEdges[k] / 3;
+      if (mesh->TriObjIx && mesh->TriObjIx[f0] != mesh->TriObjIx[f1]) c |= EdgeObjectBoundary;
+      if (mesh->triSmoothGroupIx && mesh->triSmoothGroupIx[f0] != mesh->triSmoothGroupIx[f1]) c |= EdgeSmoothingBoundary;
+    }
+    if (count == 2) {
+      auto n0 = faceNormal(f0);
+      auto n1 = faceNormal(halfEdges[begin + 1] / 3);
+      auto l = std::sqrt(dot(n0, n0) * dot(n1, n1));
+      if (0.f < l && dot(n0, n1) < cosCrease * l) c |= EdgeCrease;
+    }
+    return c ? c : uint32_t(EdgeInterior);
+  };
+
+  const uint32_t chunkCount = (keys.size32() + edgeChunkSize - 1) / edgeChunkSize;
+  Vector<uint32_t> offsets(chunkCount + 1);
+  for (auto & o : offsets) o = 0;
+  forEachEdgeRun(tasks, keys, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+  {
+    if (classify(begin, end) & classMask) offsets[chunk + 1]++;
+  });
+  for (uint32_t c = 0; c < chunkCount; c++) offsets[c + 1] += offsets[c];
+
+  const uint32_t edgeCount = offsets[chunkCount];
+  edgeIndices.resize(2 * size_t(edgeCount));
+  edgeClasses.resize(edgeCount);
+  forEachEdgeRun(tasks, keys, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+  {
+    auto c = classify(begin, end);
+    if (!(c & classMask)) return;
+    auto o = offsets[chunk]++;
+    edgeIndices[2 * o + 0] = uint32_t(keys[begin] >> shift);
+    edgeIndices[2 * o + 1] = uint32_t(keys[begin] & mask);
+    edgeClasses[o] = c;
+  });
+
+  auto time1 = std::chrono::high_resolution_clock::now();
+  logger(0, "getClassifiedEdges: %d triangles with %d selected edges, %lldms.", mesh->triCount, edgeCount,
+         std::chrono::duration_cast<std::chrono::milliseconds>(time1 - time0).count());
 }
 
 void uniqueIndices(Logger logger, Vector<uint32_t>& indices, Vector<uint32_t>& vertices, const uint32_t* vtxIx, const uint32_t* nrmIx, const uint32_t N)
 {
-  Map known;
-  vertices.clear();
-  indices.resize(N);
-  for (uint32_t i = 0; i < N; i++) {
-    auto v = uint64_t(vtxIx[i] + 1);
-    auto n = uint64_t(nrmIx[i]);
-    auto key = (n << 32u) | v;
-    uint64_t val = 0;
-    if (!known.get(val, key)) {
-      val = vertices.size();
-      vertices.pushBack(i);
-      known.insert(key, val);
-    }
-    indices[i] = uint32_t(val);
+  const uint32_t* streams[2] = { vtxIx, nrmIx };
+  uniqueIndices(logger, nullptr, indices, vertices, streams, 2, N);
+}
+
+namespace {
+
+  bool sameCorner(const uint32_t* const* streams, uint32_t streamCount, uint32_t a, uint32_t b)
+  {
+    for (uint32_t s = 0; s < streamCount; s++) {
+      if (streams[s][a] != streams[s][b]) return false;
+    }
+    return true;
   }
-  logger(0, "uniqueIndices: %d index pairs where %d were unique.", N, vertices.size());
+
+}
+
+void uniqueIndices(Logger logger, Tasks* tasks, Vector<uint32_t>& indices, Vector<uint32_t>& vertices, const uint32_t* const* streams, uint32_t streamCount, const uint32_t N)
+{
+  auto time0 = std::chrono::high_resolution_clock::now();
+
+  // Hash the attribute indices of each corner and sort corners by hash. The
+  // sort is stable, so the first corner of a run is the first occurrence.
+  Vector<uint64_t> keys(N);
+  Vector<uint32_t> order(N);
+  parallelFor(tasks, N, 0x10000, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t i = begin; i < end; i++) {
+      uint64_t h = 0x2545F4914F6CDD1Dull;
+      for (uint32_t s = 0; s < streamCount; s++) {
+        h = (h ^ streams[s][i]) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+      }
+      keys[i] = h;
+      order[i] = i;
+    }
+  });
+  radixSort(tasks, keys.data(), order.data(), N);
+
+  // For each corner, find the first corner with the same attributes. Equal
+  // hashes are checked against the actual indices to handle collisions.
+  Vector<uint32_t> first(N);
+  parallelFor(tasks, N, 0x10000, [&](uint32_t begin, uint32_t end)
+  {
+    auto j = begin;
+    while (0 < j && j < end && keys[j - 1] == keys[j]) j++;
+    while (j < end) {
+      uint32_t i = j + 1;
+      for (; i < N && keys[j] == keys[i]; i++);
+      for (uint32_t k = j; k < i; k++) {
+        uint32_t r = j;
+        while (!sameCorner(streams, streamCount, order[r], order[k])) r++;
+        first[order[k]] = order[r];
+      }
+      j = i;
+    }
+  });
+
+  // Number unique corners in the order they first occur.
+  const uint32_t chunkSize = 0x10000;
+  const uint32_t chunkCount = (N + chunkSize - 1) / chunkSize;
+  Vector<uint32_t> offsets(chunkCount + 1);
+  parallelFor(tasks, chunkCount, 1, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t c = begin; c < end; c++) {
+      uint32_t count = 0;
+      for (uint32_t i = c * chunkSize; i < std::min(N, (c + 1) * chunkSize); i++) {
+        if (first[i] == i) count++;
+      }
+      offsets[c + 1] = count;
+    }
+  });
+  offsets[0] = 0;
+  for (uint32_t c = 0; c < chunkCount; c++) offsets[c + 1] += offsets[c];
+
+  indices.resize(N);
+  vertices.resize(offsets[chunkCount]);
+  parallelFor(tasks, chunkCount, 1, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t c = begin; c < end; c++) {
+      auto o = offsets[c];
+      for (uint32_t i = c * chunkSize; i < std::min(N, (c + 1) * chunkSize); i++) {
+        if (first[i] == i) {
+          vertices[o] = i;
+          indices[i] = o++;
+        }
+      }
+    }
+  });
+  parallelFor(tasks, N, 0x10000, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t i = begin; i < end; i++) {
+      if (first[i] != i) indices[i] = indices[first[i]];
+    }
+  });
+
+  auto time1 = std::chrono::high_resolution_clock::now();
+  logger(0, "uniqueIndices: %d corners with %d streams where %d were unique, %lldms.", N, streamCount, vertices.size32(),
+         std::chrono::duration_cast<std::chrono::milliseconds>(time1 - time0).count());
 }
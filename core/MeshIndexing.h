@@ -1,6 +1,43 @@
 #pragma once
 #include "Common.h"
 
+class Tasks;
+struct Mesh;
+
 void getEdges(Logger, Vector<uint32_t>& edgeIndices, const uint32_t* triVtxIx, const uint32_t triCount);
 
+// Finds the unique edges of a triangle mesh by sorting packed (min,max)
+// vertex pairs, in parallel when tasks is non-null. Edges come out sorted
+// with the smaller vertex index first. If faceCounts is non-null, it
+// receives the number of triangles using each edge: 1 is a boundary edge,
+// 2 an interior edge and more a non-manifold edge.
+// FIXME: At 20M triangles this is only 1.6x faster than the map it replaced on
+// one core, far from the 10x asked for. The 48-bit keys take six radix passes,
+// which are about 85% of the time.
+void getEdges(Logger, Tasks* tasks, Vector<uint32_t>& edgeIndices, Vector<uint32_t>* faceCounts, const uint32_t* triVtxIx, const uint32_t triCount);
+
+enum EdgeClass : uint32_t
+{
+  EdgeInterior          = 1 << 0, // Two faces and none of the below.
+  EdgeBoundary          = 1 << 1, // One face.
+  EdgeNonManifold       = 1 << 2, // More than two faces.
+  EdgeCrease            = 1 << 3, // Two faces meeting at more than the crease angle.
+  EdgeObjectBoundary    = 1 << 4, // Faces belong to different objects.
+  EdgeSmoothingBoundary = 1 << 5, // Faces belong to different smoothing groups.
+  EdgeAll               = (1 << 6) - 1
+};
+
+// Like getEdges, but classifies each edge and only returns those where
+// some class bit is in classMask. edgeClasses receives the class bits of
+// each returned edge. creaseAngle is the dihedral angle in radians above
+// which an edge is a crease.
+void getClassifiedEdges(Logger logger, Tasks* tasks, Vector<uint32_t>& edgeIndices, Vector<uint32_t>& edgeClasses, const Mesh* mesh, uint32_t classMask, float creaseAngle);
+
 void uniqueIndices(Logger logger, Vector<uint32_t>& indices, Vector<uint32_t>& vertices, const uint32_t* vtxIx, const uint32_t* nrmIx, const uint32_t N);
+
+// Finds the unique combinations of streamCount index streams of N corners
+// each, like vertex, normal and texture coordinate indices. indices[i]
+// receives the unique vertex of corner i, and vertices[v] the first corner
+// of unique vertex v. Vertices are numbered in the order they first occur,
+// regardless of the number of threads.
+void uniqueIndices(Logger logger, Tasks* tasks, Vector<uint32_t>& indices, Vector<uint32_t>& vertices, const uint32_t* const* streams, uint32_t streamCount, const uint32_t N);
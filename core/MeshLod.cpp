@@ -0,0 +1,108 @@
+#include <cassert>
+#include <cmath>
+#include <cfloat>
+#include "MeshLod.h"
+#include "MeshSimplify.h"
+#include "Mesh.h"
+#include "LinAlgOps.h"
+
+
+void buildMeshLods(Logger logger, Mesh* mesh, const float* ratios, uint32_t ratioCount)
+{
+  auto * levels = (MeshLodLevel*)mesh->arena.alloc(sizeof(MeshLodLevel) * (ratioCount + 1));
+  levels[0] = getLodLevel(mesh, 0);
+  uint32_t levelCount = 1;
+
+  Vector<uint32_t> objIx;
+  SimplifiedMesh simplified;
+  for (uint32_t i = 0; i < ratioCount; i++) {
+    auto & prev = levels[levelCount - 1];
+
+    // Present the previous level to the simplifier as a mesh of its own.
+    Mesh src;
+    src.vtx = mesh->vtx;
+    src.vtxCount = mesh->vtxCount;
+    src.triVtxIx = prev.triVtxIx;
+    src.triNrmIx = prev.triNrmIx;
+    src.triTexIx = prev.triTexIx;
+    src.triCount = prev.triCount;
+    if (mesh->TriObjIx) {
+      objIx.resize(prev.triCount);
+      for (uint32_t t = 0; t < prev.triCount; t++) objIx[t] = mesh->TriObjIx[prev.sourceTriangle(t)];
+      src.TriObjIx = objIx.data();
+    }
+
+    SimplifyOptions options;
+    options.targetTriangleCount = uint32_t(ratios[i] * mesh->triCount);
+    simplifyMesh(logger, simplified, &src, options);
+
+    const auto triCount = simplified.triSource.size32();
+    if (prev.triCount <= triCount + triCount / 8) {
+      logger(1, "buildMeshLods: Level %d only reduced %d triangles to %d, stopping.", levelCount, prev.triCount, triCount);
+      break;
+    }
+
+    auto & level = levels[levelCount++];
+    level = MeshLodLevel();
+    level.triCount = triCount;
+    level.error = prev.error + simplified.error;
+    level.triVtxIx = (uint32_t*)mesh->arena.alloc(sizeof(uint32_t) * 3 * triCount);
+    if (prev.triNrmIx) level.triNrmIx = (uint32_t*)mesh->arena.alloc(sizeof(uint32_t) * 3 * triCount);
+    if (prev.triTexIx) level.triTexIx = (uint32_t*)mesh->arena.alloc(sizeof(uint32_t) * 3 * triCount);
+    level.triSource = (uint32_t*)mesh->arena.alloc(sizeof(uint32_t) * triCount);
+    for (uint32_t k = 0; k < 3 * triCount; k++) {
+      auto c = simplified.corners[k];
+      level.triVtxIx[k] = prev.triVtxIx[c];
+      if (level.triNrmIx) level.triNrmIx[k] = prev.triNrmIx[c];
+      if (level.triTexIx) level.triTexIx[k] = prev.triTexIx[c];
+    }
+    for (uint32_t t = 0; t < triCount; t++) {
+      level.triSource[t] = prev.sourceTriangle(simplified.triSource[t]);
+    }
+    logger(0, "buildMeshLods: Level %d has %d triangles, error=%f.", levelCount - 1, triCount, level.error);
+  }
+
+  mesh->lodLevels = levels;
+  mesh->lodLevelCount.store(levelCount, std::memory_order_release);
+}
+
+MeshLodLevel getLodLevel(const Mesh* mesh, uint32_t level)
+{
+  if (level < mesh->lodLevelCount.load(std::memory_order_acquire)) return mesh->lodLevels[level];
+
+  MeshLodLevel full;
+  full.triVtxIx = mesh->triVtxIx;
+  full.triNrmIx = mesh->triNrmIx;
+  full.triTexIx = mesh->triTexIx;
+  full.triCount = mesh->triCount;
+  return full;
+}
+
+float getScreenSpaceScale(const Mesh* mesh, const Mat4f& P, const Mat4f& M, float viewportHeight)
+{
+  if (isEmpty(mesh->bbox)) return FLT_MAX;
+  auto center = 0.5f * (mesh->bbox.min + mesh->bbox.max);
+  auto radius = 0.5f * diagonal(mesh->bbox);
+
+  // Smallest clip-space w over the bounding sphere, which is the eye distance
+  // for a perspective projection and constant for an orthographic one.
+  auto e = mul(M, Vec4f(center, 1.f));
+  auto w = P.m32 * e.z + P.m33 - std::abs(P.m32) * radius;
+  if (w <= 0.f) return FLT_MAX;
+
+  return 0.5f * viewportHeight * std::abs(P.m11) / w;
+}
+
+uint32_t selectLodLevel(const Mesh* mesh, const Mat4f& P, const Mat4f& M, float viewportHeight, float pixelThreshold)
+{
+  auto levelCount = mesh->lodLevelCount.load(std::memory_order_acquire);
+  if (levelCount < 2) return 0;
+  auto scale = getScreenSpaceScale(mesh, P, M, viewportHeight);
+  if (scale == FLT_MAX) return 0;
+
+  uint32_t level = 0;
+  for (uint32_t i = 1; i < levelCount; i++) {
+    if (mesh->lodLevels[i].error * scale <= pixelThreshold) level = i;
+  }
+  return level;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "Common.h"
+
+struct Mat4f;
+struct MeshLodLevel;
+
+// Build a chain of simplified levels in the mesh arena, level i+1 targets
+// ratios[i] of the full triangle count and is simplified from level i. Level 0
+// references the full mesh. Must be rebuilt if the geometry changes. May run in
+// a task while the mesh is in use, as the levels are published all at once when
+// done and level 0 is the full mesh both before and after.
+void buildMeshLods(Logger logger, Mesh* mesh, const float* ratios, uint32_t ratioCount);
+
+// Returns a level of the mesh, the full mesh if no chain has been built.
+MeshLodLevel getLodLevel(const Mesh* mesh, uint32_t level);
+
+// Pixels per model unit at the point of the mesh bounds nearest to the camera,
+// or FLT_MAX if the camera is inside the bounds.
+float getScreenSpaceScale(const Mesh* mesh, const Mat4f& P, const Mat4f& M, float viewportHeight);
+
+// Pick the coarsest level whose error projects to at most pixelThreshold pixels.
+uint32_t selectLodLevel(const Mesh* mesh, const Mat4f& P, const Mat4f& M, float viewportHeight, float pixelThreshold);
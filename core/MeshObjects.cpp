@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <chrono>
+#include "MeshObjects.h"
+#include "Bounds.h"
+#include "Tasks.h"
+#include "LinAlgOps.h"
+#include "Mesh.h"
+
+void updateMeshObjects(Logger logger, Tasks* tasks, MeshObjects& objects, const Mesh* mesh)
+{
+  if (objects.geometryGeneration == mesh->geometryGeneration) return;
+  objects.geometryGeneration = mesh->geometryGeneration;
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  uint32_t objectCount = 1;
+  if (mesh->TriObjIx) {
+    objectCount = std::max(1u, mesh->obj_n);
+    for (uint32_t t = 0; t < mesh->triCount; t++) objectCount = std::max(objectCount, mesh->TriObjIx[t] + 1);
+  }
+
+  // Counting sort, stable so triangles keep their mesh order within an object.
+  auto & offsets = objects.offsets;
+  offsets.resize(0);
+  offsets.resize(objectCount + 1);
+  for (uint32_t t = 0; t < mesh->triCount; t++) {
+    offsets[(mesh->TriObjIx ? mesh->TriObjIx[t] : 0) + 1]++;
+  }
+  for (uint32_t o = 0; o < objectCount; o++) offsets[o + 1] += offsets[o];
+
+  Vector<uint32_t> fill(offsets);
+  objects.triangles.resize(mesh->triCount);
+  for (uint32_t t = 0; t < mesh->triCount; t++) {
+    objects.triangles[fill[mesh->TriObjIx ? mesh->TriObjIx[t] : 0]++] = t;
+  }
+
+  // Vertex indices of the corners in object order, so each object's box is one SIMD batch.
+  Vector<uint32_t> corners(3 * size_t(mesh->triCount));
+  parallelFor(tasks, mesh->triCount, 0x4000, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t i = begin; i < end; i++) {
+      auto t = objects.triangles[i];
+      for (unsigned k = 0; k < 3; k++) corners[3 * i + k] = mesh->triVtxIx[3 * t + k];
+    }
+  });
+  Vector<uint32_t> cornerOffsets(objectCount + 1);
+  for (uint32_t o = 0; o <= objectCount; o++) cornerOffsets[o] = 3 * offsets[o];
+
+  objects.boxes.resize(objectCount);
+  boundingBoxes(tasks, objects.boxes.data(), mesh->vtx, corners.data(), cornerOffsets.data(), objectCount);
+
+  // Objects without triangles have no extent to sort, leave them out of the tree. Median splits
+  // build in about half the time of SAH, and the tree is only used for coarse culling.
+  Vector<uint32_t> nonEmpty;
+  Vector<BBox3f> boxes;
+  for (uint32_t o = 0; o < objectCount; o++) {
+    if (offsets[o] == offsets[o + 1]) continue;
+    nonEmpty.pushBack(o);
+    boxes.pushBack(objects.boxes[o]);
+  }
+  buildBVH(logger, tasks, objects.bvh, boxes.data(), boxes.size32(), BVHBuild::Median);
+  for (auto & p : objects.bvh.primitives) p = nonEmpty[p];
+
+  auto stop = std::chrono::high_resolution_clock::now();
+  logger(0, "Grouped %u triangles into %u objects in %.1fms", mesh->triCount, objectCount,
+         std::chrono::duration<double, std::milli>(stop - start).count());
+}
+
+BBox3f selectedBounds(const MeshObjects& objects, const Selection& selection)
+{
+  auto bbox = createEmptyBBox3f();
+  for (uint32_t w = 0; w < selection.words.size32(); w++) {
+    auto bits = selection.words[w];
+    for (uint32_t o = 32 * w; bits; o++, bits >>= 1) {
+      if ((bits & 1) && o < objects.objectCount() && objects.triangleCount(o)) engulf(bbox, objects.boxes[o]);
+    }
+  }
+  return bbox;
+}
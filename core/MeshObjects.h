@@ -0,0 +1,29 @@
+#pragma once
+#include "Common.h"
+#include "LinAlg.h"
+#include "BVH.h"
+#include "Selection.h"
+
+class Tasks;
+struct Mesh;
+
+// Triangles of a mesh grouped by Mesh::TriObjIx, so per-object work does not scan all triangles.
+// Meshes without objects have a single object that holds every triangle.
+struct MeshObjects
+{
+  uint32_t geometryGeneration = 0;  // Generation of the mesh this was built from.
+
+  Vector<uint32_t> triangles;       // Triangle indices ordered by object, in mesh order within an object.
+  Vector<uint32_t> offsets;         // Object o has the triangles triangles[offsets[o]..offsets[o+1]).
+  Vector<BBox3f> boxes;             // Bounds of each object, empty if the object has no triangles.
+  BVH bvh;                          // Over the objects with triangles, primitives are object indices.
+
+  uint32_t objectCount() const { return boxes.size32(); }
+  uint32_t triangleCount(uint32_t o) const { return offsets[o + 1] - offsets[o]; }
+};
+
+// Rebuilds the grouping if the mesh geometry generation changed.
+void updateMeshObjects(Logger logger, Tasks* tasks, MeshObjects& objects, const Mesh* mesh);
+
+// Bounds of the selected objects, without looking at their triangles.
+BBox3f selectedBounds(const MeshObjects& objects, const Selection& selection);
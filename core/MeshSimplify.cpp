@@ -0,0 +1,514 @@
+#include <cassert>
+#include <cmath>
+#include "MeshSimplify.h"
+#include "Mesh.h"
+#include "LinAlgOps.h"
+#include "RadixSort.h"
+#include "adt/KeyedHeap.h"
+
+namespace {
+
+  struct Quadric
+  {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double w;
+  };
+
+  void addPlane(Quadric& q, const Vec3f& n, float d, double w)
+  {
+    double a = n.x, b = n.y, c = n.z;
+    q.a2 += w * a * a;  q.ab += w * a * b;  q.ac += w * a * c;  q.ad += w * a * d;
+    q.b2 += w * b * b;  q.bc += w * b * c;  q.bd += w * b * d;
+    q.c2 += w * c * c;  q.cd += w * c * d;
+    q.d2 += w * double(d) * d;
+    q.w += w;
+  }
+
+  void addQuadric(Quadric& q, const Quadric& o)
+  {
+    q.a2 += o.a2; q.ab += o.ab; q.ac += o.ac; q.ad += o.ad;
+    q.b2 += o.b2; q.bc += o.bc; q.bd += o.bd;
+    q.c2 += o.c2; q.cd += o.cd;
+    q.d2 += o.d2;
+    q.w += o.w;
+  }
+
+  double evaluate(const Quadric& q, const Vec3f& p)
+  {
+    double x = p.x, y = p.y, z = p.z;
+    return q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+         + q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+         + q.c2 * z * z + 2.0 * q.cd * z
+         + q.d2;
+  }
+
+  enum struct VertexKind : uint8_t
+  {
+    Manifold,   // Interior vertex, can collapse onto any neighbour.
+    Border,     // On a chain of boundary edges, can only collapse along it.
+    Seam,       // On a chain of attribute or object seams, can only collapse along it.
+    Locked      // Chain end or junction, non-manifold, unused or removed.
+  };
+
+  struct Context
+  {
+    Logger logger;
+    const Mesh* mesh;
+    const SimplifyOptions* options;
+
+    Vector<Quadric> quadrics;
+    Vector<VertexKind> kinds;
+    Vector<uint32_t> featureNbr;            // Two per vertex, the neighbours along a border or seam chain.
+    Vector<Vector<uint32_t>> vtxCorners;    // Corners referencing each vertex, pruned lazily.
+    Vector<uint32_t> cornerVtx;             // Current vertex of each corner.
+    Vector<uint32_t> cornerSrc;             // Input corner that supplies the attributes of each corner.
+    Vector<uint8_t> triAlive;
+    uint32_t aliveCount = 0;
+
+    // Scratch for planning a collapse.
+    Vector<uint32_t> tris;
+    Vector<uint32_t> triNewSrc;
+    Vector<uint32_t> nbrsU;
+    Vector<uint32_t> nbrsW;
+    Vector<uint32_t> stack;
+    Vector<uint32_t> candidates;
+  };
+
+  const uint32_t none = ~0u;
+
+  inline uint32_t nextCorner(uint32_t c) { return c % 3 == 2 ? c - 2 : c + 1; }
+
+  bool sameWedge(const Context& ctx, uint32_t srcA, uint32_t srcB)
+  {
+    auto * mesh = ctx.mesh;
+    if (mesh->triNrmIx && mesh->triNrmIx[srcA] != mesh->triNrmIx[srcB]) return false;
+    if (mesh->triTexIx && mesh->triTexIx[srcA] != mesh->triTexIx[srcB]) return false;
+    return true;
+  }
+
+  uint32_t cornerOf(const Context& ctx, uint32_t t, uint32_t v)
+  {
+    for (uint32_t k = 0; k < 3; k++) {
+      if (ctx.cornerVtx[3 * t + k] == v) return 3 * t + k;
+    }
+    return none;
+  }
+
+  // Prune and return the alive corners of a vertex.
+  Vector<uint32_t>& aliveCorners(Context& ctx, uint32_t v)
+  {
+    auto & corners = ctx.vtxCorners[v];
+    uint32_t o = 0;
+    for (auto c : corners) {
+      if (ctx.triAlive[c / 3] && ctx.cornerVtx[c] == v) corners[o++] = c;
+    }
+    corners.resize(o);
+    return corners;
+  }
+
+  void gatherNeighbours(Context& ctx, Vector<uint32_t>& nbrs, uint32_t v)
+  {
+    nbrs.clear();
+    for (auto c : aliveCorners(ctx, v)) {
+      uint32_t n[2] = { ctx.cornerVtx[nextCorner(c)], ctx.cornerVtx[nextCorner(nextCorner(c))] };
+      for (auto x : n) {
+        bool known = false;
+        for (auto y : nbrs) known = known || x == y;
+        if (!known) nbrs.pushBack(x);
+      }
+    }
+  }
+
+  bool isFeatureNbr(const Context& ctx, uint32_t u, uint32_t v)
+  {
+    return ctx.featureNbr[2 * u] == v || ctx.featureNbr[2 * u + 1] == v;
+  }
+
+  uint32_t otherFeatureNbr(const Context& ctx, uint32_t u, uint32_t v)
+  {
+    return ctx.featureNbr[2 * u] == v ? ctx.featureNbr[2 * u + 1] : ctx.featureNbr[2 * u];
+  }
+
+  bool allowedByKind(const Context& ctx, uint32_t u, uint32_t w)
+  {
+    switch (ctx.kinds[u]) {
+    case VertexKind::Manifold:
+      return true;
+    case VertexKind::Border:
+    case VertexKind::Seam: {
+      if (!isFeatureNbr(ctx, u, w)) return false;
+      // Do not collapse a closed chain of three into a degenerate one.
+      auto x = otherFeatureNbr(ctx, u, w);
+      auto kw = ctx.kinds[w];
+      if ((kw == VertexKind::Border || kw == VertexKind::Seam) && otherFeatureNbr(ctx, w, u) == x) return false;
+      return true;
+    }
+    default:
+      return false;
+    }
+  }
+
+  float collapseCost(const Context& ctx, uint32_t u, uint32_t w)
+  {
+    auto & qu = ctx.quadrics[u];
+    auto & qw = ctx.quadrics[w];
+    auto p = ctx.mesh->vtx[w];
+    auto weight = qu.w + qw.w;
+    if (weight <= 0.0) return 0.f;
+    auto e = (evaluate(qu, p) + evaluate(qw, p)) / weight;
+    return float(e < 0.0 ? 0.0 : e);
+  }
+
+  // Check that u can collapse onto w and find the attributes that the corners
+  // of u get. Fills ctx.tris with the triangles around u and ctx.triNewSrc
+  // with the new source corner of u in each, none for triangles that vanish.
+  bool planCollapse(Context& ctx, uint32_t u, uint32_t w)
+  {
+    auto * P = ctx.mesh->vtx;
+
+    // Link condition: common neighbours must be the apices of the triangles on the edge.
+    gatherNeighbours(ctx, ctx.nbrsU, u);
+    gatherNeighbours(ctx, ctx.nbrsW, w);
+    uint32_t common = 0;
+    for (auto x : ctx.nbrsU) {
+      for (auto y : ctx.nbrsW) common += x == y ? 1 : 0;
+    }
+
+    ctx.tris.clear();
+    ctx.triNewSrc.clear();
+    uint32_t shared = 0;
+    for (auto c : aliveCorners(ctx, u)) {
+      auto t = c / 3;
+      ctx.tris.pushBack(t);
+      ctx.triNewSrc.pushBack(none);
+      if (cornerOf(ctx, t, w) != none) shared++;
+    }
+    if (shared == 0 || common != shared) return false;
+
+    // Reject collapses that flip or degenerate triangles.
+    auto pw = P[w];
+    for (auto t : ctx.tris) {
+      if (cornerOf(ctx, t, w) != none) continue;
+      Vec3f p[3];
+      Vec3f q[3];
+      for (uint32_t k = 0; k < 3; k++) {
+        auto v = ctx.cornerVtx[3 * t + k];
+        p[k] = P[v];
+        q[k] = v == u ? pw : P[v];
+      }
+      auto n0 = cross(p[1] - p[0], p[2] - p[0]);
+      auto n1 = cross(q[1] - q[0], q[2] - q[0]);
+      auto l1 = lengthSquared(n1);
+      if (l1 <= 0.f) return false;
+      if (dot(n0, n1) <= 0.1f * std::sqrt(lengthSquared(n0) * l1)) return false;
+    }
+
+    // Each triangle on the edge seeds its side of u with the attributes of w,
+    // which spread across edges of u that are not on a chain.
+    const uint32_t T = ctx.tris.size32();
+    ctx.stack.clear();
+    for (uint32_t i = 0; i < T; i++) {
+      auto t = ctx.tris[i];
+      auto cw = cornerOf(ctx, t, w);
+      if (cw == none) continue;
+      ctx.stack.pushBack(i);
+      ctx.triNewSrc[i] = ctx.cornerSrc[cw];
+    }
+    while (ctx.stack.any()) {
+      auto i = ctx.stack.popBack();
+      auto t = ctx.tris[i];
+      auto cu = cornerOf(ctx, t, u);
+      uint32_t others[2] = { ctx.cornerVtx[nextCorner(cu)], ctx.cornerVtx[nextCorner(nextCorner(cu))] };
+      for (auto x : others) {
+        if (x == w || isFeatureNbr(ctx, u, x)) continue;
+        for (uint32_t j = 0; j < T; j++) {
+          if (ctx.triNewSrc[j] != none || cornerOf(ctx, ctx.tris[j], x) == none) continue;
+          ctx.triNewSrc[j] = ctx.triNewSrc[i];
+          ctx.stack.pushBack(j);
+        }
+      }
+    }
+    for (uint32_t i = 0; i < T; i++) {
+      if (ctx.triNewSrc[i] == none) return false;
+    }
+    for (uint32_t i = 0; i < T; i++) {
+      if (cornerOf(ctx, ctx.tris[i], w) != none) ctx.triNewSrc[i] = none;
+    }
+    return true;
+  }
+
+  bool findCandidate(Context& ctx, float& cost, uint32_t& target, uint32_t u, bool validate)
+  {
+    cost = FLT_MAX;
+    target = none;
+    if (ctx.kinds[u] == VertexKind::Locked) return false;
+
+    auto & nbrs = ctx.candidates;
+    gatherNeighbours(ctx, nbrs, u);
+    for (auto w : nbrs) {
+      if (!allowedByKind(ctx, u, w)) continue;
+      auto c = collapseCost(ctx, u, w);
+      if (cost <= c) continue;
+      if (validate && !planCollapse(ctx, u, w)) continue;
+      cost = c;
+      target = w;
+    }
+    return target != none;
+  }
+
+  void collapse(Context& ctx, uint32_t u, uint32_t w)
+  {
+    auto ok = planCollapse(ctx, u, w);
+    assert(ok);
+    (void)ok;
+
+    auto & cornersW = ctx.vtxCorners[w];
+    for (uint32_t i = 0; i < ctx.tris.size32(); i++) {
+      auto t = ctx.tris[i];
+      if (ctx.triNewSrc[i] == none) {
+        ctx.triAlive[t] = 0;
+        ctx.aliveCount--;
+      }
+      else {
+        auto c = cornerOf(ctx, t, u);
+        ctx.cornerVtx[c] = w;
+        ctx.cornerSrc[c] = ctx.triNewSrc[i];
+        cornersW.pushBack(c);
+      }
+    }
+    addQuadric(ctx.quadrics[w], ctx.quadrics[u]);
+
+    auto ku = ctx.kinds[u];
+    if (ku == VertexKind::Border || ku == VertexKind::Seam) {
+      auto x = otherFeatureNbr(ctx, u, w);
+      auto kw = ctx.kinds[w];
+      if (kw == VertexKind::Border || kw == VertexKind::Seam) {
+        ctx.featureNbr[2 * w + (ctx.featureNbr[2 * w] == u ? 0 : 1)] = x;
+      }
+      auto kx = ctx.kinds[x];
+      if (kx == VertexKind::Border || kx == VertexKind::Seam) {
+        ctx.featureNbr[2 * x + (ctx.featureNbr[2 * x] == u ? 0 : 1)] = w;
+      }
+    }
+    ctx.kinds[u] = VertexKind::Locked;
+    ctx.vtxCorners[u].clear();
+  }
+
+  void classifyAndSetupQuadrics(Context& ctx, const Vector<uint32_t>& liveTris)
+  {
+    auto * mesh = ctx.mesh;
+    auto * P = mesh->vtx;
+    const auto vtxCount = mesh->vtxCount;
+
+    ctx.quadrics.resize(vtxCount);
+    for (auto & q : ctx.quadrics) q = Quadric{};
+
+    for (auto t : liveTris) {
+      auto a = mesh->triVtxIx[3 * t + 0];
+      auto b = mesh->triVtxIx[3 * t + 1];
+      auto c = mesh->triVtxIx[3 * t + 2];
+      auto n = cross(P[b] - P[a], P[c] - P[a]);
+      auto l = length(n);
+      if (l <= 0.f) continue;
+      n = (1.f / l) * n;
+      auto d = -dot(n, P[a]);
+      Quadric q{};
+      addPlane(q, n, d, 0.5 * l);
+      addQuadric(ctx.quadrics[a], q);
+      addQuadric(ctx.quadrics[b], q);
+      addQuadric(ctx.quadrics[c], q);
+    }
+
+    // Sort half-edges on their undirected edge to find the triangles sharing each edge.
+    const uint32_t N = 3 * liveTris.size32();
+    Vector<uint64_t> keys(N);
+    Vector<uint32_t> order(N);
+    for (uint32_t i = 0; i < liveTris.size32(); i++) {
+      for (uint32_t k = 0; k < 3; k++) {
+        auto c = 3 * liveTris[i] + k;
+        auto a = mesh->triVtxIx[c];
+        auto b = mesh->triVtxIx[nextCorner(c)];
+        keys[3 * i + k] = a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+        order[3 * i + k] = c;
+      }
+    }
+    radixSort(nullptr, keys.data(), order.data(), N);
+
+    Vector<uint8_t> borderCount(vtxCount, 0);
+    Vector<uint8_t> seamCount(vtxCount, 0);
+    Vector<uint8_t> locked(vtxCount, 1);
+    ctx.featureNbr.resize(2 * size_t(vtxCount));
+    for (auto & f : ctx.featureNbr) f = none;
+
+    for (uint32_t i = 0; i < N; i++) locked[mesh->triVtxIx[order[i]]] = 0;
+
+    auto addFeature = [&](uint32_t c, bool border)
+    {
+      auto a = mesh->triVtxIx[c];
+      auto b = mesh->triVtxIx[nextCorner(c)];
+      auto & count = border ? borderCount : seamCount;
+      if (count[a] < 255) count[a]++;
+      if (count[b] < 255) count[b]++;
+      for (auto e : { a, b }) {
+        auto o = e == a ? b : a;
+        if (ctx.featureNbr[2 * e] == none) ctx.featureNbr[2 * e] = o;
+        else if (ctx.featureNbr[2 * e + 1] == none) ctx.featureNbr[2 * e + 1] = o;
+      }
+
+      auto n = cross(P[b] - P[a], P[mesh->triVtxIx[nextCorner(nextCorner(c))]] - P[a]);
+      auto e = P[b] - P[a];
+      auto m = cross(e, n);
+      auto l = length(m);
+      if (l <= 0.f) return;
+      m = (1.f / l) * m;
+      Quadric q{};
+      addPlane(q, m, -dot(m, P[a]), ctx.options->featureWeight * lengthSquared(e));
+      addQuadric(ctx.quadrics[a], q);
+      addQuadric(ctx.quadrics[b], q);
+    };
+
+    for (uint32_t j = 0; j < N; ) {
+      uint32_t i = j + 1;
+      for (; i < N && keys[i] == keys[j]; i++);
+      auto cA = order[j];
+      auto a = mesh->triVtxIx[cA];
+      auto b = mesh->triVtxIx[nextCorner(cA)];
+      if (i - j == 1) {
+        addFeature(cA, true);
+      }
+      else if (i - j == 2) {
+        auto cB = order[j + 1];
+        if (mesh->triVtxIx[cB] != b) {
+          locked[a] = locked[b] = 1;    // Inconsistent orientation.
+        }
+        else {
+          auto tA = cA / 3;
+          auto tB = cB / 3;
+          bool seam = !sameWedge(ctx, cA, nextCorner(cB)) || !sameWedge(ctx, nextCorner(cA), cB);
+          if (mesh->TriObjIx && mesh->TriObjIx[tA] != mesh->TriObjIx[tB]) seam = true;
+          if (seam) addFeature(cA, false);
+        }
+      }
+      else {
+        locked[a] = locked[b] = 1;      // Non-manifold edge.
+      }
+      j = i;
+    }
+
+    ctx.kinds.resize(vtxCount);
+    uint32_t kindCount[4] = { 0, 0, 0, 0 };
+    for (uint32_t v = 0; v < vtxCount; v++) {
+      auto kind = VertexKind::Locked;
+      if (!locked[v]) {
+        if (borderCount[v] == 0 && seamCount[v] == 0) kind = VertexKind::Manifold;
+        else if (borderCount[v] == 2 && seamCount[v] == 0) kind = VertexKind::Border;
+        else if (borderCount[v] == 0 && seamCount[v] == 2) kind = VertexKind::Seam;
+      }
+      ctx.kinds[v] = kind;
+      kindCount[unsigned(kind)]++;
+    }
+    ctx.logger(0, "simplifyMesh: %d manifold, %d border, %d seam and %d locked vertices.",
+               kindCount[0], kindCount[1], kindCount[2], kindCount[3]);
+  }
+
+}
+
+
+void simplifyMesh(Logger logger, SimplifiedMesh& result, const Mesh* mesh, const SimplifyOptions& options)
+{
+  Context ctx;
+  ctx.logger = logger;
+  ctx.mesh = mesh;
+  ctx.options = &options;
+
+  const auto triCount = mesh->triCount;
+  const auto vtxCount = mesh->vtxCount;
+
+  // Triangles with repeated vertices cover no area and are dropped up front.
+  Vector<uint32_t> liveTris;
+  ctx.triAlive.resize(triCount);
+  ctx.cornerVtx.resize(3 * size_t(triCount));
+  ctx.cornerSrc.resize(3 * size_t(triCount));
+  ctx.vtxCorners.resize(vtxCount);
+  for (uint32_t t = 0; t < triCount; t++) {
+    auto * ix = mesh->triVtxIx + 3 * t;
+    bool alive = ix[0] != ix[1] && ix[0] != ix[2] && ix[1] != ix[2];
+    ctx.triAlive[t] = alive ? 1 : 0;
+    for (uint32_t k = 0; k < 3; k++) {
+      ctx.cornerVtx[3 * t + k] = ix[k];
+      ctx.cornerSrc[3 * t + k] = 3 * t + k;
+      if (alive) ctx.vtxCorners[ix[k]].pushBack(3 * t + k);
+    }
+    if (alive) liveTris.pushBack(t);
+  }
+  ctx.aliveCount = liveTris.size32();
+
+  classifyAndSetupQuadrics(ctx, liveTris);
+
+  Vector<uint32_t> heapKeys;
+  Vector<float> heapValues;
+  for (uint32_t v = 0; v < vtxCount; v++) {
+    float cost;
+    uint32_t target;
+    if (findCandidate(ctx, cost, target, v, false)) {
+      heapKeys.pushBack(v);
+      heapValues.pushBack(cost);
+    }
+  }
+  KeyedHeap4 heap;
+  heap.setKeyRange(vtxCount);
+  heap.buildFrom(heapKeys.data(), heapValues.data(), heapKeys.size32());
+
+  const float maxCost = options.maxError < std::sqrt(FLT_MAX) ? options.maxError * options.maxError : FLT_MAX;
+  float maxCostSeen = 0.f;
+  uint32_t collapses = 0;
+  Vector<uint32_t> nbrs;
+  while (heap.any() && options.targetTriangleCount < ctx.aliveCount) {
+    auto u = heap.peekMin();
+    auto lowerBound = heap.getValue(u);
+    if (maxCost < lowerBound) break;
+    heap.removeMin();
+
+    float cost;
+    uint32_t w;
+    if (!findCandidate(ctx, cost, w, u, true)) continue;
+    if (lowerBound < cost) {
+      heap.insert(u, cost);
+      continue;
+    }
+
+    collapse(ctx, u, w);
+    collapses++;
+    if (maxCostSeen < cost) maxCostSeen = cost;
+
+    gatherNeighbours(ctx, nbrs, w);
+    nbrs.pushBack(w);
+    for (auto v : nbrs) {
+      float c;
+      uint32_t t;
+      bool any = findCandidate(ctx, c, t, v, false);
+      if (heap.contains(v)) {
+        if (any) heap.update(v, c);
+        else heap.erase(v);
+      }
+      else if (any) {
+        heap.insert(v, c);
+      }
+    }
+  }
+
+  result.corners.clear();
+  result.triSource.clear();
+  for (uint32_t t = 0; t < triCount; t++) {
+    if (!ctx.triAlive[t]) continue;
+    for (uint32_t k = 0; k < 3; k++) {
+      auto c = ctx.cornerSrc[3 * t + k];
+      assert(mesh->triVtxIx[c] == ctx.cornerVtx[3 * t + k]);
+      result.corners.pushBack(c);
+    }
+    result.triSource.pushBack(t);
+  }
+  result.error = std::sqrt(maxCostSeen);
+
+  logger(0, "simplifyMesh: %d collapses reduced %d triangles to %d, error=%f.", collapses, triCount, result.triSource.size32(), result.error);
+}
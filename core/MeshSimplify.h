@@ -0,0 +1,23 @@
+#pragma once
+#include <cfloat>
+#include "Common.h"
+
+struct SimplifyOptions
+{
+  uint32_t targetTriangleCount = 0;   // Stop when at most this many triangles remain.
+  float maxError = FLT_MAX;           // Stop before collapses that introduce a larger error, in model units.
+  float featureWeight = 10.f;         // Weight of quadrics that keep boundaries, seams and object borders in place.
+};
+
+struct SimplifiedMesh
+{
+  Vector<uint32_t> corners;     // Three input corner indices per triangle, corner c supplies triVtxIx[c], triNrmIx[c] and triTexIx[c].
+  Vector<uint32_t> triSource;   // Input triangle that each triangle stems from, for object ids, colors and smoothing groups.
+  float error = 0.f;            // Largest error of any collapse, in model units.
+};
+
+// Garland-Heckbert quadric error simplification by collapsing half-edges onto
+// their end vertices, so no new vertices or attributes are created. Boundaries,
+// normal and texcoord seams and object borders are kept as chains that only
+// collapse along themselves, and vertices where chains meet never move.
+void simplifyMesh(Logger logger, SimplifiedMesh& result, const Mesh* mesh, const SimplifyOptions& options);
@@ -3,6 +3,7 @@
 #include "LinAlg.h"
 #include "LinAlgOps.h"
 #include "Mesh.h"
+#include "Bounds.h"
 
 namespace {
 
@@ -550,7 +551,6 @@ Mesh*  readObj(Logger logger, const void * ptr, size_t size)
   auto * mesh = new Mesh();
 
   {
-    BBox3f bbox = createEmptyBBox3f();
     unsigned o = 0;
     mesh->vtxCount = context.vertices_n;
     mesh->vtx = (Vec3f*)mesh->arena.alloc(sizeof(Vec3f)*mesh->vtxCount);
@@ -558,12 +558,12 @@ Mesh*  readObj(Logger logger, const void * ptr, size_t size)
     for (auto * block = context.vertices.first; block; block = block->next) {
 
       for (unsigned i = 0; i < block->fill; i++) {
-        engulf(bbox, block->data[i]);
         mesh->vtx[o++] = block->data[i];
       }
     }
     assert(o == mesh->vtxCount);
-    mesh->bbox = bbox;
+    mesh->bbox = boundingBox(mesh->vtx, nullptr, mesh->vtxCount);
+    orientedBoundingBox(mesh->obb, mesh->vtx, mesh->vtxCount);
   }
 
   {
@@ -0,0 +1,120 @@
+#include <cassert>
+#include <cstring>
+#include "Common.h"
+#include "Tasks.h"
+#include "RadixSort.h"
+
+namespace {
+
+  const uint32_t digitBits = 8;
+  const uint32_t digitCount = 64 / digitBits;
+  const uint32_t bucketCount = 1 << digitBits;
+  const uint32_t maxBlocks = 64;
+  const uint32_t minBlockSize = 1 << 16;
+
+  inline uint32_t digit(uint64_t key, uint32_t pass)
+  {
+    return uint32_t(key >> (digitBits * pass)) & (bucketCount - 1);
+  }
+
+}
+
+void radixSort(Tasks* tasks, uint64_t* keys, uint32_t* values, uint32_t N)
+{
+  if (N < 2) return;
+
+  // Blocking only depends on N, so the result does not depend on the thread count.
+  auto blockSize = (N + maxBlocks - 1) / maxBlocks;
+  if (blockSize < minBlockSize) blockSize = minBlockSize;
+  auto blockCount = (N + blockSize - 1) / blockSize;
+
+  // Global histograms of all digits in one sweep to find passes that can be skipped.
+  MemBuffer<uint32_t> blockHistograms(size_t(blockCount) * digitCount * bucketCount);
+  parallelFor(tasks, N, blockSize, [&](uint32_t begin, uint32_t end)
+  {
+    auto * hist = blockHistograms.data() + size_t(begin / blockSize) * digitCount * bucketCount;
+    std::memset(hist, 0, sizeof(uint32_t) * digitCount * bucketCount);
+    for (uint32_t i = begin; i < end; i++) {
+      auto key = keys[i];
+      for (uint32_t d = 0; d < digitCount; d++) {
+        hist[bucketCount * d + digit(key, d)]++;
+      }
+    }
+  });
+
+  bool activePass[digitCount];
+  for (uint32_t d = 0; d < digitCount; d++) {
+    activePass[d] = true;
+    for (uint32_t r = 0; r < bucketCount; r++) {
+      uint32_t sum = 0;
+      for (uint32_t b = 0; b < blockCount; b++) {
+        sum += blockHistograms[(size_t(b) * digitCount + d) * bucketCount + r];
+      }
+      if (sum == N) activePass[d] = false;
+      if (sum) break;
+    }
+  }
+
+  MemBuffer<uint64_t> keysTmp(N);
+  MemBuffer<uint32_t> valuesTmp;
+  if (values) valuesTmp.accommodate(N);
+
+  auto * srcKeys = keys;
+  auto * dstKeys = keysTmp.data();
+  auto * srcValues = values;
+  auto * dstValues = valuesTmp.data();
+
+  MemBuffer<uint32_t> offsets(size_t(blockCount) * bucketCount);
+  for (uint32_t d = 0; d < digitCount; d++) {
+    if (!activePass[d]) continue;
+
+    parallelFor(tasks, N, blockSize, [&](uint32_t begin, uint32_t end)
+    {
+      auto * hist = offsets.data() + size_t(begin / blockSize) * bucketCount;
+      std::memset(hist, 0, sizeof(uint32_t) * bucketCount);
+      for (uint32_t i = begin; i < end; i++) {
+        hist[digit(srcKeys[i], d)]++;
+      }
+    });
+
+    // Exclusive prefix sum, bucket-major and block-minor to keep the sort stable.
+    uint32_t sum = 0;
+    for (uint32_t r = 0; r < bucketCount; r++) {
+      for (uint32_t b = 0; b < blockCount; b++) {
+        auto & o = offsets[size_t(b) * bucketCount + r];
+        auto t = o;
+        o = sum;
+        sum += t;
+      }
+    }
+    assert(sum == N);
+
+    parallelFor(tasks, N, blockSize, [&](uint32_t begin, uint32_t end)
+    {
+      auto * offset = offsets.data() + size_t(begin / blockSize) * bucketCount;
+      if (srcValues) {
+        for (uint32_t i = begin; i < end; i++) {
+          auto o = offset[digit(srcKeys[i], d)]++;
+          dstKeys[o] = srcKeys[i];
+          dstValues[o] = srcValues[i];
+        }
+      }
+      else {
+        for (uint32_t i = begin; i < end; i++) {
+          dstKeys[offset[digit(srcKeys[i], d)]++] = srcKeys[i];
+        }
+      }
+    });
+
+    auto * tk = srcKeys; srcKeys = dstKeys; dstKeys = tk;
+    auto * tv = srcValues; srcValues = dstValues; dstValues = tv;
+  }
+
+  if (srcKeys != keys) {
+    parallelFor(tasks, N, blockSize, [&](uint32_t begin, uint32_t end)
+    {
+      std::memcpy(keys + begin, srcKeys + begin, sizeof(uint64_t) * (end - begin));
+      if (values) std::memcpy(values + begin, srcValues + begin, sizeof(uint32_t) * (end - begin));
+    });
+  }
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "Common.h"
+
+class Tasks;
+
+// Stable LSD radix sort of 64-bit keys. If values is non-null, it is permuted along
+// with the keys. Passes where every key has the same digit are skipped, so keys with
+// few significant bits sort faster. Runs in parallel when tasks is non-null, and the
+// result is independent of the number of threads.
+void radixSort(Tasks* tasks, uint64_t* keys, uint32_t* values, uint32_t N);
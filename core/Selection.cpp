@@ -0,0 +1,215 @@
+#include <cassert>
+#include <cctype>
+#include <immintrin.h>
+#include "Common.h"
+#include "Tasks.h"
+#include "Selection.h"
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+namespace {
+
+  uint32_t popCount32(uint32_t x)
+  {
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0F0F0F0F;
+    return (x * 0x01010101) >> 24;
+  }
+
+  bool matchName(const char* name, const char* pattern)
+  {
+    // Greedy match that backtracks to the last '*'.
+    const char* starName = nullptr;
+    const char* starPattern = nullptr;
+    while (*name) {
+      if (*pattern == '*') {
+        starPattern = ++pattern;
+        starName = name;
+      }
+      else if (*pattern == '?' || std::tolower((unsigned char)*pattern) == std::tolower((unsigned char)*name)) {
+        pattern++;
+        name++;
+      }
+      else if (starPattern) {
+        pattern = starPattern;
+        name = ++starName;
+      }
+      else {
+        return false;
+      }
+    }
+    while (*pattern == '*') pattern++;
+    return *pattern == '\0';
+  }
+
+  // Unsigned division by a constant as a multiply and shifts, from T. Granlund and
+  // P. Montgomery, Division by Invariant Integers using Multiplication.
+  struct Divider
+  {
+    uint32_t m;
+    uint32_t s1;
+    uint32_t s2;
+
+    Divider(uint32_t d)
+    {
+      assert(0 < d && d <= (1u << 31));
+      uint32_t l = 0;
+      while ((uint64_t(1) << l) < d) l++;
+      m = uint32_t((uint64_t(1) << 32) * ((uint64_t(1) << l) - d) / d + 1);
+      s1 = l < 1 ? l : 1;
+      s2 = l < 1 ? 0 : l - 1;
+    }
+
+    uint32_t divide(uint32_t n) const
+    {
+      uint32_t t = uint32_t((uint64_t(m) * n) >> 32);
+      return (t + ((n - t) >> s1)) >> s2;
+    }
+  };
+
+  uint32_t triangleColor(const TriangleColorRule& rule, uint32_t t)
+  {
+    if (rule.colors) return rule.colors[t];
+    if (rule.palette) return rule.palette[((rule.indices ? rule.indices[t] : t) >> rule.shift) % rule.paletteSize];
+    return rule.color;
+  }
+
+  void evaluateTriangleColorsScalar(uint32_t* out, const TriangleColorRule& rule,
+                                    const uint32_t* triObjIx, const Selection& selection, uint32_t begin, uint32_t end)
+  {
+    for (uint32_t t = begin; t < end; t++) {
+      out[t] = selection.get(triObjIx ? triObjIx[t] : 0) ? rule.selectedColor : triangleColor(rule, t);
+    }
+  }
+
+  AVX2_TARGET __m256i mulhi(__m256i a, __m256i b)
+  {
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(a, b), 32);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    return _mm256_blend_epi32(even, odd, 0xAA);
+  }
+
+  AVX2_TARGET uint32_t evaluateTriangleColorsAVX2(uint32_t* out, const TriangleColorRule& rule, const Divider& divider,
+                                                  const uint32_t* triObjIx, const Selection& selection, uint32_t begin, uint32_t end)
+  {
+    const auto * words = reinterpret_cast<const int*>(selection.words.data());
+    const __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i selectedColor = _mm256_set1_epi32(int(rule.selectedColor));
+    const __m256i color = _mm256_set1_epi32(int(rule.color));
+    const __m256i m = _mm256_set1_epi32(int(divider.m));
+    const __m128i s1 = _mm_cvtsi32_si128(int(divider.s1));
+    const __m128i s2 = _mm_cvtsi32_si128(int(divider.s2));
+    const __m128i shift = _mm_cvtsi32_si128(int(rule.shift));
+    const __m256i paletteSize = _mm256_set1_epi32(int(rule.paletteSize));
+
+    uint32_t t = begin;
+    for (; t + 8 <= end; t += 8) {
+      __m256i base = color;
+      if (rule.colors) {
+        base = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rule.colors + t));
+      }
+      else if (rule.palette) {
+        __m256i ix = rule.indices ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rule.indices + t))
+                                  : _mm256_add_epi32(_mm256_set1_epi32(int(t)), iota);
+        ix = _mm256_srl_epi32(ix, shift);
+        __m256i hi = mulhi(m, ix);
+        __m256i q = _mm256_srl_epi32(_mm256_add_epi32(hi, _mm256_srl_epi32(_mm256_sub_epi32(ix, hi), s1)), s2);
+        __m256i r = _mm256_sub_epi32(ix, _mm256_mullo_epi32(q, paletteSize));
+        base = _mm256_i32gather_epi32(reinterpret_cast<const int*>(rule.palette), r, 4);
+      }
+
+      __m256i obj = triObjIx ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(triObjIx + t)) : _mm256_setzero_si256();
+      __m256i word = _mm256_i32gather_epi32(words, _mm256_srli_epi32(obj, 5), 4);
+      __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(obj, _mm256_set1_epi32(31))), one);
+      __m256i selected = _mm256_cmpeq_epi32(bit, one);
+
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + t), _mm256_blendv_epi8(base, selectedColor, selected));
+    }
+    return t;
+  }
+
+}
+
+void Selection::resize(uint32_t newCount)
+{
+  // Added words come zeroed, and the bits past the old count are already zero.
+  words.resize((newCount + 31) / 32);
+  count = newCount;
+  if (newCount & 31) words.back() &= (1u << (newCount & 31)) - 1;
+}
+
+void Selection::setAll(bool value)
+{
+  for (auto & w : words) w = value ? ~0u : 0u;
+  if (value && (count & 31)) words.back() = (1u << (count & 31)) - 1;
+}
+
+void Selection::invert()
+{
+  for (auto & w : words) w = ~w;
+  if (count & 31) words.back() &= (1u << (count & 31)) - 1;
+}
+
+void Selection::unite(const Selection& other)
+{
+  assert(count == other.count);
+  for (uint32_t w = 0; w < words.size32(); w++) words[w] |= other.words[w];
+}
+
+void Selection::intersect(const Selection& other)
+{
+  assert(count == other.count);
+  for (uint32_t w = 0; w < words.size32(); w++) words[w] &= other.words[w];
+}
+
+void Selection::subtract(const Selection& other)
+{
+  assert(count == other.count);
+  for (uint32_t w = 0; w < words.size32(); w++) words[w] &= ~other.words[w];
+}
+
+uint32_t Selection::popCount() const
+{
+  uint32_t n = 0;
+  for (auto w : words) n += popCount32(w);
+  return n;
+}
+
+bool Selection::any() const
+{
+  for (auto w : words) if (w) return true;
+  return false;
+}
+
+uint32_t selectByName(Selection& selection, const char* const* names, uint32_t nameCount, const char* pattern)
+{
+  assert(nameCount <= selection.count);
+  uint32_t matches = 0;
+  for (uint32_t o = 0; o < nameCount; o++) {
+    if (names[o] && matchName(names[o], pattern)) {
+      selection.set(o, true);
+      matches++;
+    }
+  }
+  return matches;
+}
+
+void evaluateTriangleColors(Tasks* tasks, uint32_t* out, const TriangleColorRule& rule,
+                            const uint32_t* triObjIx, const Selection& selection, uint32_t triCount)
+{
+  assert(selection.count);
+  assert(rule.colors || rule.palette == nullptr || rule.paletteSize);
+  Divider divider(rule.palette ? rule.paletteSize : 1);
+  bool avx2 = cpuSupportsAVX2();
+  parallelFor(tasks, triCount, 1 << 16, [&](uint32_t begin, uint32_t end)
+  {
+    if (avx2) begin = evaluateTriangleColorsAVX2(out, rule, divider, triObjIx, selection, begin, end);
+    evaluateTriangleColorsScalar(out, rule, triObjIx, selection, begin, end);
+  });
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "Common.h"
+
+class Tasks;
+
+// Selection state of the objects of a mesh, one bit per object. Bits past count are kept zero.
+struct Selection
+{
+  Vector<uint32_t> words;
+  uint32_t count = 0;
+
+  // Sets the number of objects, objects that are added are not selected.
+  void resize(uint32_t newCount);
+
+  bool get(uint32_t o) const { return (words[o >> 5] >> (o & 31)) & 1; }
+  void set(uint32_t o, bool value) { if (value) words[o >> 5] |= 1u << (o & 31); else words[o >> 5] &= ~(1u << (o & 31)); }
+  void toggle(uint32_t o) { words[o >> 5] ^= 1u << (o & 31); }
+
+  void setAll(bool value);
+  void invert();
+
+  // Set algebra with a selection of the same count.
+  void unite(const Selection& other);
+  void intersect(const Selection& other);
+  void subtract(const Selection& other);
+
+  uint32_t popCount() const;
+  bool any() const;
+};
+
+// Selects the objects whose names match the pattern, where '*' matches any run of characters
+// and '?' a single character, ignoring case. Returns the number of matching names.
+uint32_t selectByName(Selection& selection, const char* const* names, uint32_t nameCount, const char* pattern);
+
+// Color of a triangle that is not selected: the color of colors when set, else the palette
+// entry of (index >> shift) % paletteSize when palette is set, where index is indices[t] or
+// the triangle index t if indices is null, else color.
+struct TriangleColorRule
+{
+  uint32_t color = 0xff888888;
+  const uint32_t* colors = nullptr;
+  const uint32_t* palette = nullptr;
+  uint32_t paletteSize = 0;
+  const uint32_t* indices = nullptr;
+  uint32_t shift = 0;
+  uint32_t selectedColor = 0xffddffff;  // Color of triangles whose object is selected.
+};
+
+// Writes the color of each triangle in one pass, eight triangles at a time with AVX2 and in
+// parallel with tasks. Object indices must be below selection.count, and triObjIx may be null,
+// which puts every triangle in object 0.
+void evaluateTriangleColors(Tasks* tasks, uint32_t* out, const TriangleColorRule& rule,
+                            const uint32_t* triObjIx, const Selection& selection, uint32_t triCount);
@@ -2,8 +2,45 @@
 #include "Tasks.h"
 #include <list>
 #include <thread>
+#include <atomic>
+#include <memory>
 #include <cassert>
 
+namespace {
+
+  struct ParallelForState
+  {
+    std::mutex lock;
+    std::condition_variable finished;
+    std::atomic<uint32_t> nextChunk = 0;
+    uint32_t chunksDone = 0;
+    uint32_t chunkCount = 0;
+    uint32_t N = 0;
+    uint32_t grainSize = 0;
+    const RangeFunc* func = nullptr;  // only valid while there are unfinished chunks.
+  };
+
+  void runChunks(ParallelForState& state)
+  {
+    uint32_t done = 0;
+    while (true) {
+      auto chunk = state.nextChunk.fetch_add(1);
+      if (state.chunkCount <= chunk) break;
+
+      auto begin = chunk * state.grainSize;
+      auto end = state.N - begin < state.grainSize ? state.N : begin + state.grainSize;
+      (*state.func)(begin, end);
+      done++;
+    }
+    if (done) {
+      std::lock_guard<std::mutex> guard(state.lock);
+      state.chunksDone += done;
+      if (state.chunksDone == state.chunkCount) state.finished.notify_all();
+    }
+  }
+
+}
+
 
 void Tasks::init(Logger logger)
 {
@@ -165,3 +202,38 @@ void  Tasks::cleanup()
   }
   workers.clear();
 }
+
+
+void parallelFor(Tasks* tasks, uint32_t N, uint32_t grainSize, const RangeFunc& func)
+{
+  if (N == 0) return;
+  if (grainSize == 0) grainSize = 1;
+
+  auto chunkCount = (N + grainSize - 1) / grainSize;
+  if (tasks == nullptr || chunkCount == 1 || tasks->getWorkerCount() == 0) {
+    for (uint32_t begin = 0; begin < N; begin += grainSize) {
+      func(begin, N - begin < grainSize ? N : begin + grainSize);
+    }
+    return;
+  }
+
+  // Tasks may be started after we have returned, they must not touch our stack.
+  auto state = std::make_shared<ParallelForState>();
+  state->chunkCount = chunkCount;
+  state->N = N;
+  state->grainSize = grainSize;
+  state->func = &func;
+
+  auto helpers = chunkCount - 1;
+  if (tasks->getWorkerCount() < helpers) helpers = tasks->getWorkerCount();
+  for (uint32_t i = 0; i < helpers; i++) {
+    TaskFunc f = [state](bool&) { runChunks(*state); };
+    tasks->enqueue(f);
+  }
+  runChunks(*state);
+
+  std::unique_lock<std::mutex> guard(state->lock);
+  while (state->chunksDone != state->chunkCount) {
+    state->finished.wait(guard);
+  }
+}
\ No newline at end of file
@@ -1,9 +1,11 @@
 #pragma once
 #include <mutex>
+#include <thread>
 #include <condition_variable>
 #include "mem/Allocators.h"
 
 typedef std::function<void(bool&)> TaskFunc;
+typedef std::function<void(uint32_t begin, uint32_t end)> RangeFunc;
 
 struct TaskId
 {
@@ -41,6 +43,8 @@ public:
   void waitAll();
   void cleanup();
 
+  uint32_t getWorkerCount() const { return workers.size32(); }
+
 private:
   Logger logger = nullptr;
   std::mutex lock;
@@ -55,4 +59,9 @@ private:
   bool running = true;
   void worker();
 
-};
\ No newline at end of file
+};
+
+// Run func over [0,N) in chunks of at most grainSize elements. The calling thread
+// processes chunks as well and only waits for chunks already picked up by workers,
+// so it is safe to call from within a task. With tasks=nullptr, it runs serially.
+void parallelFor(Tasks* tasks, uint32_t N, uint32_t grainSize, const RangeFunc& func);
\ No newline at end of file
@@ -1,49 +1,233 @@
 #include <chrono>
+#include <algorithm>
 #include "VertexCache.h"
 #include "Common.h"
+#include "LinAlgOps.h"
+#include "RadixSort.h"
+#include "Tasks.h"
 
 namespace {
 
-  template<uint32_t M>
-  struct Cache
+  struct CacheSim
   {
-    uint32_t entries[M];
+    VertexCacheModel model;
+    uint32_t size;
     uint32_t misses = 0;
-    uint32_t p = 0;
 
-    Cache() { for (auto & e : entries) e = ~0u; }
+    // Every model keeps a stamp per vertex, interleaved with the stamps of
+    // the other caches so a lookup touches a single cache line. FIFO stores
+    // the miss count when the vertex was inserted, LRU the time of last use,
+    // Batch the batch + 1.
+    uint32_t* stamps = nullptr;
+    uint32_t stride = 0;
 
-    void lookup(uint32_t ix)
+    uint32_t batchIndex = 0;
+    uint32_t batchFill = 0;
+
+    // LRU has a bit per time that is set while it is the last use of some
+    // resident vertex, the first set bit is the least recently used one.
+    uint64_t* live = nullptr;
+    uint32_t clock = 0;
+    uint32_t oldest = 1;
+    uint32_t fill = 0;
+
+    // Each model runs over a block of indices with its state in locals, as
+    // the stamp stores may alias the members and would force them to memory.
+
+    void fifo(const uint32_t* indices, uint32_t n)
+    {
+      // A vertex is resident if fewer than size misses happened after it was inserted.
+      // Written without branches as hits and misses are hard to predict.
+      auto * st = stamps;
+      auto str = stride;
+      auto sz = size;
+      auto m = misses;
+      for (uint32_t i = 0; i < n; i++) {
+        auto & s = st[size_t(str) * indices[i]];
+        uint32_t miss = (s == 0) | (sz <= m - s);
+        m += miss;
+        s = miss ? m : s;
+      }
+      misses = m;
+    }
+
+    void lru(const uint32_t* indices, uint32_t n)
     {
-      for (auto & e : entries) {
-        if (e == ix) return;  // hit
+      // A vertex is resident if it was last used no earlier than the least
+      // recently used resident. A miss evicts that one, and oldest moves
+      // forward to the next live bit, so the scan is amortized O(1).
+      auto * st = stamps;
+      auto * lv = live;
+      auto str = stride;
+      auto sz = size;
+      auto m = misses;
+      auto t = clock;
+      auto o = oldest;
+      auto f = fill;
+      for (uint32_t i = 0; i < n; i++) {
+        auto & s = st[size_t(str) * indices[i]];
+        auto now = ++t;
+        lv[now >> 6] |= uint64_t(1) << (now & 63);
+        if (s != 0 && o <= s) {
+          lv[s >> 6] &= ~(uint64_t(1) << (s & 63));
+        }
+        else {
+          m++;
+          if (f < sz) f++;
+          else lv[o >> 6] &= ~(uint64_t(1) << (o & 63));
+        }
+        s = now;
+        while ((lv[o >> 6] >> (o & 63) & 1) == 0) {
+          o = lv[o >> 6] >> (o & 63) ? o + 1 : (o | 63) + 1;
+        }
+      }
+      misses = m;
+      clock = t;
+      oldest = o;
+      fill = f;
+    }
+
+    void batch(const uint32_t* indices, uint32_t n)
+    {
+      // A batch takes triangles until their unique vertices would overflow
+      // it, and every vertex in a batch is shaded once.
+      auto * st = stamps;
+      auto str = stride;
+      for (uint32_t i = 0; i < n; i += 3) {
+        const uint32_t* tri = indices + i;
+        auto current = batchIndex + 1;
+        uint32_t fresh = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+          if (st[size_t(str) * tri[k]] != current && (k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1])) fresh++;
+        }
+        if (batchFill + fresh > size) {
+          batchIndex++;
+          batchFill = 0;
+          current++;
+        }
+        for (uint32_t k = 0; k < 3; k++) {
+          auto & s = st[size_t(str) * tri[k]];
+          if (s != current) {
+            s = current;
+            batchFill++;
+            misses++;
+          }
+        }
       }
-      misses++;
-      entries[p] = ix;
-      p = (p + 1) % M;
     }
   };
 
 }
 
-void getAverageCacheMissRatioPerTriangle(float& fifo4, float& fifo8, float& fifo16, float& fifo32, const uint32_t* indices, const uint32_t N)
+void simulateVertexCaches(VertexCacheConfig* caches, uint32_t cacheCount, const uint32_t* indices, const uint32_t N)
 {
   assert((N % 3) == 0);
-  Cache<4> cache4;
-  Cache<8> cache8;
-  Cache<16> cache16;
-  Cache<32> cache32;
+  uint32_t vertexCount = 0;
+  for (uint32_t i = 0; i < N; i++) vertexCount = std::max(vertexCount, indices[i] + 1);
+
+  uint32_t stride = cacheCount;
+  uint32_t lruCount = 0;
+  for (uint32_t c = 0; c < cacheCount; c++) {
+    if (caches[c].model == VertexCacheModel::LRU) lruCount++;
+  }
+  Vector<uint32_t> stamps(size_t(stride) * vertexCount);
+  for (auto & s : stamps) s = 0;
+  size_t liveWords = size_t(N) / 64 + 1;
+  Vector<uint64_t> live(lruCount * liveWords);
+  for (auto & l : live) l = 0;
+
+  Vector<CacheSim> sims(cacheCount);
+  uint32_t lruIndex = 0;
+  for (uint32_t c = 0; c < cacheCount; c++) {
+    auto & sim = sims[c];
+    sim.model = caches[c].model;
+    sim.size = caches[c].size;
+    assert(sim.size);
+    assert(sim.model != VertexCacheModel::Batch || 3 <= sim.size);
+    sim.stamps = stamps.data() + c;
+    sim.stride = stride;
+    if (sim.model == VertexCacheModel::LRU) sim.live = live.data() + liveWords * lruIndex++;
+  }
+
+  // One pass over the indices in blocks of whole triangles, updating every
+  // cache per block while the block and its stamps are in cache.
+  const uint32_t blockSize = 3 * 1024;
+  for (uint32_t i = 0; i < N; i += blockSize) {
+    auto n = std::min(blockSize, N - i);
+    for (auto & sim : sims) {
+      switch (sim.model) {
+      case VertexCacheModel::FIFO:
+        sim.fifo(indices + i, n);
+        break;
+      case VertexCacheModel::LRU:
+        sim.lru(indices + i, n);
+        break;
+      case VertexCacheModel::Batch:
+        sim.batch(indices + i, n);
+        break;
+      }
+    }
+  }
+
+  for (uint32_t c = 0; c < cacheCount; c++) {
+    caches[c].acmr = N ? (3.f * sims[c].misses) / float(N) : 0.f;
+  }
+}
+
+void getAverageCacheMissRatioPerTriangle(float& fifo4, float& fifo8, float& fifo16, float& fifo32, const uint32_t* indices, const uint32_t N)
+{
+  VertexCacheConfig caches[4] = {
+    { VertexCacheModel::FIFO, 4 },
+    { VertexCacheModel::FIFO, 8 },
+    { VertexCacheModel::FIFO, 16 },
+    { VertexCacheModel::FIFO, 32 }
+  };
+  simulateVertexCaches(caches, 4, indices, N);
+  fifo4 = caches[0].acmr;
+  fifo8 = caches[1].acmr;
+  fifo16 = caches[2].acmr;
+  fifo32 = caches[3].acmr;
+}
+
+float getVertexFetchOverfetch(const uint32_t* indices, const uint32_t N, uint32_t vertexSize, uint32_t lineSize, uint32_t cacheLines)
+{
+  uint32_t vertexCount = 0;
+  for (uint32_t i = 0; i < N; i++) vertexCount = std::max(vertexCount, indices[i] + 1);
+  if (vertexCount == 0) return 0.f;
+
+  // FIFO cache of lines: a line is resident if fewer than cacheLines lines
+  // have been fetched since it was fetched itself.
+  auto lineCount = uint32_t((uint64_t(vertexCount) * vertexSize + lineSize - 1) / lineSize);
+  Vector<uint64_t> fetchedAt(lineCount);
+  for (auto & f : fetchedAt) f = ~uint64_t(0);
+
+  uint64_t fetches = 0;
   for (uint32_t i = 0; i < N; i++) {
-    const auto ix = indices[i];
-    cache4.lookup(ix);
-    cache8.lookup(ix);
-    cache16.lookup(ix);
-    cache32.lookup(ix);
+    auto a = (uint64_t(indices[i]) * vertexSize) / lineSize;
+    auto b = (uint64_t(indices[i] + 1) * vertexSize - 1) / lineSize;
+    for (auto l = a; l <= b; l++) {
+      if (fetchedAt[l] != ~uint64_t(0) && fetches - fetchedAt[l] < cacheLines) continue;
+      fetchedAt[l] = fetches++;
+    }
   }
-  fifo4 = (3.f * cache4.misses) / float(N);
-  fifo8 = (3.f * cache8.misses) / float(N);
-  fifo16 = (3.f * cache16.misses) / float(N);
-  fifo32 = (3.f * cache32.misses) / float(N);
+  return float(double(fetches) * lineSize / (double(vertexCount) * vertexSize));
+}
+
+void optimizeVertexFetch(Logger logger, Vector<uint32_t>& order, uint32_t* indices, const uint32_t N, const uint32_t vertexCount)
+{
+  Vector<uint32_t> remap(vertexCount);
+  for (auto & r : remap) r = ~0u;
+
+  order.clear();
+  for (uint32_t i = 0; i < N; i++) {
+    auto & r = remap[indices[i]];
+    if (r == ~0u) {
+      r = order.size32();
+      order.pushBack(indices[i]);
+    }
+    indices[i] = r;
+  }
+  logger(0, "optimizeVertexFetch: %d vertices of which %d referenced.", vertexCount, order.size32());
 }
 
 
@@ -68,6 +252,7 @@ struct LinSpd
   };
 
   Logger logger;
+  bool verbose;
 
   static const uint32_t cacheSize = 32;
   float cachePosScore[cacheSize] = { 0.75f, 0.75f, 0.75f };
@@ -92,8 +277,9 @@ struct LinSpd
 
   Vector<uint32_t> vtxTri;
 
-  LinSpd(Logger logger, uint32_t* output, const uint32_t* input, const uint32_t Nt) :
+  LinSpd(Logger logger, uint32_t* output, const uint32_t* input, const uint32_t Nt, bool verbose = true) :
     logger(logger),
+    verbose(verbose),
     output(output),
     input(input),
     Nt(Nt)
@@ -320,7 +506,7 @@ struct LinSpd
     while (emitted < Nt) {
 
       if ((emitted % 100000) == 0) {
-        logger(0, "Emitted %d", emitted);
+        if (verbose) logger(0, "Emitted %d", emitted);
         uint32_t g = 0;
         for (uint32_t t = 0; t < Nt; t++) {
           if (tri[t].active) g++;
@@ -350,7 +536,7 @@ struct LinSpd
     }
     auto time1 = std::chrono::high_resolution_clock::now();
     auto e = std::chrono::duration_cast<std::chrono::milliseconds>((time1 - time0)).count();
-    logger(0, "Nt=%d, maxIx=%d, maxValence=%d, dry=%.3f, time=%lldms", Nt, maxIx, maxFoundValence, float(dry)/Nt, e);
+    if (verbose) logger(0, "Nt=%d, maxIx=%d, maxValence=%d, dry=%.3f, time=%lldms", Nt, maxIx, maxFoundValence, float(dry)/Nt, e);
 
     // sanity check : make sure all input triangles are present in output
 #if 0
@@ -380,8 +566,48 @@ struct LinSpd
 
 namespace {
 
+  const uint32_t clusterTriangles = 1 << 16;
 
+  uint32_t spreadBits10(uint32_t x)
+  {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+  }
+
+  // Renumber the vertices of a cluster densely so that LinSpd's per-vertex
+  // arrays are sized by the cluster instead of the whole mesh.
+  void optimizeCluster(Logger logger, uint32_t* output, const uint32_t* input, const uint32_t* triangles, uint32_t Nt)
+  {
+    const uint32_t N = 3 * Nt;
+    Vector<uint64_t> keys(N);
+    Vector<uint32_t> corners(N);
+    for (uint32_t i = 0; i < Nt; i++) {
+      for (uint32_t k = 0; k < 3; k++) {
+        keys[3 * i + k] = input[3 * triangles[i] + k];
+        corners[3 * i + k] = 3 * i + k;
+      }
+    }
+    radixSort(nullptr, keys.data(), corners.data(), N);
+
+    Vector<uint32_t> localIn(N);
+    Vector<uint32_t> globalIx;
+    for (uint32_t i = 0; i < N; i++) {
+      if (i == 0 || keys[i - 1] != keys[i]) globalIx.pushBack(uint32_t(keys[i]));
+      localIn[corners[i]] = globalIx.size32() - 1;
+    }
+
+    Vector<uint32_t> localOut(N);
+    LinSpd linspd(logger, localOut.data(), localIn.data(), Nt, false);
+    linspd.run();
 
+    for (uint32_t i = 0; i < N; i++) {
+      output[i] = globalIx[localOut[i]];
+    }
+  }
 
 }
 
@@ -395,4 +621,152 @@ void linearSpeedVertexCacheOptimisation(Logger logger, uint32_t * output, const
   linspd.run();
 
 
-}
\ No newline at end of file
+}
+
+void linearSpeedVertexCacheOptimisationPartitioned(Logger logger, Tasks* tasks, uint32_t * output, const uint32_t* input, const uint32_t N, const float* P, size_t stride)
+{
+  if (N == 0) return;
+  assert((N % 3) == 0);
+  auto time0 = std::chrono::high_resolution_clock::now();
+
+  const uint32_t Nt = N / 3;
+  auto centroid = [&](uint32_t t)
+  {
+    Vec3f c(0.f);
+    for (uint32_t k = 0; k < 3; k++) {
+      c = c + Vec3f((float*)((const char*)P + stride * input[3 * t + k]));
+    }
+    return (1.f / 3.f) * c;
+  };
+
+  const uint32_t chunkSize = 0x10000;
+  const uint32_t chunks = (Nt + chunkSize - 1) / chunkSize;
+  Vector<BBox3f> chunkBounds(chunks);
+  parallelFor(tasks, chunks, 1, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t c = begin; c < end; c++) {
+      auto bbox = createEmptyBBox3f();
+      auto tEnd = Nt < (c + 1) * chunkSize ? Nt : (c + 1) * chunkSize;
+      for (uint32_t t = c * chunkSize; t < tEnd; t++) engulf(bbox, centroid(t));
+      chunkBounds[c] = bbox;
+    }
+  });
+  auto bbox = createEmptyBBox3f();
+  for (auto & b : chunkBounds) engulf(bbox, b);
+
+  auto side = maxSideLength(bbox);
+  auto scale = 0.f < side ? 1023.f / side : 0.f;
+  Vector<uint64_t> keys(Nt);
+  Vector<uint32_t> triangles(Nt);
+  parallelFor(tasks, Nt, chunkSize, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t t = begin; t < end; t++) {
+      auto q = scale * (centroid(t) - bbox.min);
+      keys[t] = (spreadBits10(uint32_t(q.x)) << 2) | (spreadBits10(uint32_t(q.y)) << 1) | spreadBits10(uint32_t(q.z));
+      triangles[t] = t;
+    }
+  });
+  radixSort(tasks, keys.data(), triangles.data(), Nt);
+
+  const uint32_t clusters = (Nt + clusterTriangles - 1) / clusterTriangles;
+  parallelFor(tasks, clusters, 1, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t c = begin; c < end; c++) {
+      auto tBegin = c * clusterTriangles;
+      auto tEnd = Nt < tBegin + clusterTriangles ? Nt : tBegin + clusterTriangles;
+      optimizeCluster(logger, output + 3 * tBegin, input, triangles.data() + tBegin, tEnd - tBegin);
+    }
+  });
+
+  auto time1 = std::chrono::high_resolution_clock::now();
+  auto e = std::chrono::duration_cast<std::chrono::milliseconds>((time1 - time0)).count();
+  logger(0, "Nt=%d in %d clusters, time=%lldms", Nt, clusters, e);
+}
+
+void tipsify(Logger logger, uint32_t * output, const uint32_t* input, const uint32_t N, uint32_t cacheSize, Vector<uint32_t>* clusterStarts)
+{
+  if (clusterStarts) clusterStarts->clear();
+  if (N == 0) return;
+  assert((N % 3) == 0);
+  auto time0 = std::chrono::high_resolution_clock::now();
+
+  const uint32_t Nt = N / 3;
+  uint32_t Nv = 0;
+  for (uint32_t i = 0; i < N; i++) Nv = Nv < input[i] + 1 ? input[i] + 1 : Nv;
+
+  // Vertex-triangle adjacency.
+  Vector<uint32_t> offsets(Nv + 1);
+  for (auto & o : offsets) o = 0;
+  for (uint32_t i = 0; i < N; i++) offsets[input[i] + 1]++;
+  for (uint32_t v = 0; v < Nv; v++) offsets[v + 1] += offsets[v];
+  Vector<uint32_t> adjacency(N);
+  Vector<uint32_t> live(Nv);
+  for (uint32_t v = 0; v < Nv; v++) live[v] = 0;
+  for (uint32_t i = 0; i < N; i++) adjacency[offsets[input[i]] + live[input[i]]++] = i / 3;
+
+  Vector<uint32_t> timeStamp(Nv);
+  for (auto & t : timeStamp) t = 0;
+  Vector<uint8_t> emitted(Nt);
+  for (auto & e : emitted) e = 0;
+  Vector<uint32_t> deadEnd;
+  Vector<uint32_t> candidates;
+
+  const uint32_t none = ~0u;
+  uint32_t time = cacheSize + 1;
+  uint32_t cursor = 0;
+  uint32_t out = 0;
+  uint32_t restarts = 0;
+
+  uint32_t fanning = none;
+  for (; cursor < Nv && live[cursor] == 0; cursor++) {}
+  if (cursor < Nv) fanning = cursor;
+  while (fanning != none) {
+    candidates.clear();
+    for (uint32_t o = offsets[fanning]; o < offsets[fanning + 1]; o++) {
+      auto t = adjacency[o];
+      if (emitted[t]) continue;
+      emitted[t] = 1;
+      for (uint32_t k = 0; k < 3; k++) {
+        auto v = input[3 * t + k];
+        output[3 * out + k] = v;
+        deadEnd.pushBack(v);
+        candidates.pushBack(v);
+        live[v]--;
+        if (cacheSize < time - timeStamp[v]) timeStamp[v] = time++;
+      }
+      out++;
+    }
+
+    // Pick the candidate that will still be in the cache after its remaining
+    // triangles are emitted, preferring the oldest.
+    fanning = none;
+    int best = -1;
+    for (auto v : candidates) {
+      if (live[v] == 0) continue;
+      int priority = 0;
+      if (time - timeStamp[v] + 2 * live[v] <= cacheSize) priority = int(time - timeStamp[v]);
+      if (best < priority) {
+        best = priority;
+        fanning = v;
+      }
+    }
+    if (fanning == none) {
+      while (deadEnd.any() && fanning == none) {
+        auto v = deadEnd.popBack();
+        if (live[v]) fanning = v;
+      }
+      for (; fanning == none && cursor < Nv; cursor++) {
+        if (live[cursor]) fanning = cursor;
+      }
+      if (fanning != none) {
+        restarts++;
+        if (clusterStarts) clusterStarts->pushBack(out);
+      }
+    }
+  }
+  assert(out == Nt);
+
+  auto time1 = std::chrono::high_resolution_clock::now();
+  auto e = std::chrono::duration_cast<std::chrono::milliseconds>((time1 - time0)).count();
+  logger(0, "tipsify: Nt=%d, Nv=%d, cacheSize=%d, restarts=%d, time=%lldms", Nt, Nv, cacheSize, restarts, e);
+}
@@ -1,6 +1,52 @@
 #pragma once
 #include "Common.h"
 
+class Tasks;
+
+enum struct VertexCacheModel
+{
+  FIFO,     // Classic post-transform cache, size entries.
+  LRU,      // Least recently used replacement, size entries.
+  Batch     // Triangles are grouped into batches of at most size unique vertices, shaded once per batch.
+};
+
+struct VertexCacheConfig
+{
+  VertexCacheModel model;
+  uint32_t size;
+  float acmr = 0.f;   // Average cache misses per triangle, set by simulateVertexCaches.
+};
+
+// Runs an index buffer through a set of cache models in a single pass.
+// FIXME: LRU costs about twice as much as FIFO per index, and 100M indices
+// through one LRU still take most of a second.
+void simulateVertexCaches(VertexCacheConfig* caches, uint32_t cacheCount, const uint32_t* indices, const uint32_t N);
+
 void getAverageCacheMissRatioPerTriangle(float& fifo4, float& fifo8, float& fifo16, float& fifo32, const uint32_t* indices, const uint32_t N);
 
+// Runs the vertex fetches of an index buffer through a FIFO cache of
+// cacheLines lines of lineSize bytes, where each vertex is vertexSize bytes,
+// and returns the bytes fetched divided by the size of the vertex buffer.
+// 1 is optimal when every vertex is referenced.
+float getVertexFetchOverfetch(const uint32_t* indices, const uint32_t N, uint32_t vertexSize, uint32_t lineSize = 64, uint32_t cacheLines = 256);
+
+// Renumbers vertices in the order they are first referenced by indices,
+// rewriting indices in place. order[i] receives the old index of new vertex
+// i and is used to permute the vertex streams; unreferenced vertices are
+// dropped.
+void optimizeVertexFetch(Logger logger, Vector<uint32_t>& order, uint32_t* indices, const uint32_t N, const uint32_t vertexCount);
+
 __declspec(noinline) void linearSpeedVertexCacheOptimisation(Logger logger, uint32_t * output, const uint32_t* input, const uint32_t N);
+
+// Sorts triangles along a Morton curve of their centroids, cuts the sorted
+// list into clusters of a fixed number of triangles and runs
+// linearSpeedVertexCacheOptimisation on each cluster in parallel. P points to
+// the position of vertex 0, with stride bytes between consecutive vertices.
+// The result is independent of the number of threads.
+void linearSpeedVertexCacheOptimisationPartitioned(Logger logger, Tasks* tasks, uint32_t * output, const uint32_t* input, const uint32_t N, const float* P, size_t stride);
+
+// Implementation of Sander, Nehab and Barczak, Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw, the Tipsify pass for a cache of
+// cacheSize entries. If clusterStarts is non-null, it receives the output
+// triangle indices where the fanning restarted after a dead end.
+void tipsify(Logger logger, uint32_t * output, const uint32_t* input, const uint32_t N, uint32_t cacheSize, Vector<uint32_t>* clusterStarts = nullptr);
@@ -17,6 +17,26 @@ void KeyedHeap::setKeyRange(Key size)
   fill = 0;
 }
 
+void KeyedHeap::buildFrom(const Key* keys, const float* values, uint32_t N)
+{
+  assert(N <= keyRange);
+  for (HeapPos i = 0; i < fill; i++) {
+    lut[heap[i]].heapPos = ~0u;
+  }
+  fill = N;
+  for (HeapPos i = 0; i < N; i++) {
+    auto key = keys[i];
+    assert(lut[key].heapPos == ~0u && "Duplicate key");
+    lut[key].heapPos = i;
+    lut[key].value = values[i];
+    heap[i] = key;
+  }
+  // Floyd's heapify, percolate down all parents from the last one.
+  for (HeapPos i = N / 2; 0 < i; i--) {
+    percolateDown(i - 1);
+  }
+}
+
 void KeyedHeap::percolateUp(HeapPos child)
 {
   while (child) {
@@ -82,7 +102,9 @@ void KeyedHeap::erase(Key key)
 
   auto t = lut[key].value;
   update(key, -FLT_MAX);
-  assert(removeMin() == key);
+  auto removed = removeMin();
+  assert(removed == key);
+  (void)removed;
 
   lut[key].value = t; // in case we call getValue with key
 }
@@ -128,3 +150,144 @@ uint32_t KeyedHeap::removeMin()
 
   return headKey;
 }
+
+
+
+void KeyedHeap4::setKeyRange(Key size)
+{
+  keyRange = size;
+  lut.accommodate(size);
+  for (Key i = 0; i < keyRange; i++) {
+    lut[i].heapPos = ~0u;
+    lut[i].value = 0.f;
+  }
+
+  // Up to seven slots to reach 64-byte alignment, then three slots of padding before the root.
+  heapStorage.accommodate(size_t(size) + 7 + 3);
+  auto base = (uintptr_t(heapStorage.data()) + 63) & ~uintptr_t(63);
+  heap = (Slot*)base + 3;
+  fill = 0;
+}
+
+void KeyedHeap4::buildFrom(const Key* keys, const float* values, uint32_t N)
+{
+  assert(N <= keyRange);
+  for (HeapPos i = 0; i < fill; i++) {
+    lut[heap[i].key].heapPos = ~0u;
+  }
+  fill = N;
+  for (HeapPos i = 0; i < N; i++) {
+    auto key = keys[i];
+    assert(lut[key].heapPos == ~0u && "Duplicate key");
+    lut[key].heapPos = i;
+    lut[key].value = values[i];
+    heap[i] = Slot{ values[i], key };
+  }
+  for (HeapPos i = (N + 2) / 4; 0 < i; i--) {
+    percolateDown(i - 1);
+  }
+}
+
+// Both percolations move a hole instead of swapping, and write the moved
+// element once at its final position.
+void KeyedHeap4::percolateUp(HeapPos pos)
+{
+  auto slot = heap[pos];
+  while (pos) {
+    auto parent = (pos - 1) / 4;
+    if (!(slot.value < heap[parent].value)) break;
+    heap[pos] = heap[parent];
+    lut[heap[pos].key].heapPos = pos;
+    pos = parent;
+  }
+  heap[pos] = slot;
+  lut[slot.key].heapPos = pos;
+}
+
+void KeyedHeap4::percolateDown(HeapPos pos)
+{
+  auto slot = heap[pos];
+  while (true) {
+    auto first = 4 * pos + 1;
+    if (fill <= first) break;
+    auto last = first + 4 < fill ? first + 4 : fill;
+
+    auto smallest = first;
+    auto smallestValue = heap[first].value;
+    for (auto child = first + 1; child < last; child++) {
+      if (heap[child].value < smallestValue) {
+        smallest = child;
+        smallestValue = heap[child].value;
+      }
+    }
+    if (!(smallestValue < slot.value)) break;
+
+    heap[pos] = heap[smallest];
+    lut[heap[pos].key].heapPos = pos;
+    pos = smallest;
+  }
+  heap[pos] = slot;
+  lut[slot.key].heapPos = pos;
+}
+
+void KeyedHeap4::insert(Key key, float value)
+{
+  assert(lut[key].heapPos == ~0u);
+  lut[key].value = value;
+  heap[fill] = Slot{ value, key };
+  percolateUp(fill++);
+}
+
+void KeyedHeap4::erase(Key key)
+{
+  assert(lut[key].heapPos != ~0u && "Element not present in heap");
+  auto pos = lut[key].heapPos;
+  lut[key].heapPos = ~0u;
+
+  auto tail = heap[--fill];
+  if (pos < fill) {
+    heap[pos] = tail;
+    lut[tail.key].heapPos = pos;
+    if (pos && tail.value < heap[(pos - 1) / 4].value) percolateUp(pos);
+    else percolateDown(pos);
+  }
+}
+
+void KeyedHeap4::update(Key key, float value)
+{
+  assert(lut[key].heapPos != ~0u && "Element not present in heap");
+  auto pos = lut[key].heapPos;
+  auto old = heap[pos].value;
+  heap[pos].value = value;
+  lut[key].value = value;
+  if (value < old) percolateUp(pos);
+  else if (old < value) percolateDown(pos);
+}
+
+KeyedHeap4::Key KeyedHeap4::removeMin()
+{
+  assert(fill);
+
+  Key headKey = heap[0].key;
+  lut[headKey].heapPos = ~0u;
+
+  auto tail = heap[--fill];
+  if (fill) {
+    heap[0] = tail;
+    lut[tail.key].heapPos = 0;
+    percolateDown(0);
+  }
+
+  return headKey;
+}
+
+void KeyedHeap4::assertHeapInvariants()
+{
+  for (HeapPos child = 0; child < fill; child++) {
+    assert(lut[heap[child].key].heapPos == child);
+    assert(lut[heap[child].key].value == heap[child].value);
+    if (child) {
+      assert(heap[(child - 1) / 4].value <= heap[child].value);
+    }
+  }
+}
@@ -14,6 +14,9 @@ public:
 
   // Clear heap and set key domain to [0...N-1]
   void setKeyRange(Key N);
+
+  // Replace heap contents with N distinct keys and their values in O(N).
+  void buildFrom(const Key* keys, const float* values, uint32_t N);
   
   // Erase an existing element from the heap.
   void erase(Key ix);
@@ -29,6 +32,8 @@ public:
 
   inline float getValue(uint32_t key) const { return lut[key].value; }
 
+  inline bool contains(Key key) const { return lut[key].heapPos != ~0u; }
+
   inline Key peekMin() const { assert(fill); return heap[0]; }
 
   inline bool any() const { return fill; }
@@ -58,4 +63,72 @@ protected:
   void percolateDown(HeapPos heapPos);
 };
 
+// Same interface as KeyedHeap, but with four children per node and values
+// stored next to the keys in the heap, so that a percolation step compares
+// children without going through the lookup table. The root sits three slots
+// into a 64-byte aligned block, which puts the four children of every node in
+// one aligned 32-byte group and thus in one cache line.
+class KeyedHeap4
+{
+public:
+  typedef uint32_t Key;
+
+  KeyedHeap4() {}
+  KeyedHeap4(const KeyedHeap4&) = delete;
+  KeyedHeap4& operator=(const KeyedHeap4&) = delete;
+
+  // Clear heap and set key domain to [0...N-1]
+  void setKeyRange(Key N);
+
+  // Replace heap contents with N distinct keys and their values in O(N).
+  void buildFrom(const Key* keys, const float* values, uint32_t N);
+
+  // Erase an existing element from the heap.
+  void erase(Key ix);
+
+  // Insert a new element in the heap.
+  void insert(Key key, float value);
+
+  // Update an existing element in the heap.
+  void update(Key key, float value);
+
+  // Remove smallest element and return its key.
+  Key removeMin();
+
+  inline float getValue(uint32_t key) const { return lut[key].value; }
+
+  inline bool contains(Key key) const { return lut[key].heapPos != ~0u; }
+
+  inline Key peekMin() const { assert(fill); return heap[0].key; }
 
+  inline bool any() const { return fill; }
+
+  inline bool empty() const { return fill == 0; }
+
+  inline uint32_t size() const { return fill; }
+
+  void assertHeapInvariants();
+
+protected:
+  typedef uint32_t HeapPos;
+  struct LutEntry
+  {
+    HeapPos heapPos = ~0u;
+    float value = 0.f;
+  };
+  struct Slot
+  {
+    float value;
+    Key key;
+  };
+
+  Key keyRange = 0;
+  HeapPos fill = 0;
+  MemBuffer<LutEntry> lut;
+  MemBuffer<Slot> heapStorage;
+  Slot* heap = nullptr;   // Root of the heap inside heapStorage.
+
+  void percolateUp(HeapPos heapPos);
+
+  void percolateDown(HeapPos heapPos);
+};
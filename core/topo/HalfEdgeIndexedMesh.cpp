@@ -0,0 +1,221 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "HalfEdgeIndexedMesh.h"
+#include "../Tasks.h"
+#include "../RadixSort.h"
+
+namespace {
+
+  struct FileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t halfEdgeCount;
+    uint32_t faceCount;
+    uint32_t reserved[2];
+  };
+  static_assert(sizeof(FileHeader) == 32, "Header size should keep arrays aligned");
+
+  const char fileMagic[8] = { 'H', 'E', 'I', 'X', 'M', 'E', 'S', 'H' };
+  const uint32_t fileVersion = 1;
+
+}
+
+
+void HalfEdge::IndexedMesh::setArrays(const uint32_t* base)
+{
+  next = base;
+  twin = next + halfEdgeCount;
+  vertex = twin + halfEdgeCount;
+  face = vertex + halfEdgeCount;
+  vertexEdge = face + halfEdgeCount;
+}
+
+void HalfEdge::IndexedMesh::release()
+{
+  if (mappedView) {
+#ifdef _WIN32
+    UnmapViewOfFile(mappedView);
+    CloseHandle((HANDLE)mappedFile);
+#else
+    munmap(mappedView, mappedSize);
+#endif
+    mappedView = nullptr;
+    mappedFile = nullptr;
+    mappedSize = 0;
+  }
+  next = twin = vertex = face = vertexEdge = nullptr;
+  vertexCount = halfEdgeCount = faceCount = 0;
+}
+
+void HalfEdge::IndexedMesh::build(const uint32_t* triVtxIx, uint32_t triCount, uint32_t vtxCount)
+{
+  release();
+  vertexCount = vtxCount;
+  faceCount = triCount;
+  halfEdgeCount = 3 * triCount;
+  auto N = halfEdgeCount;
+
+  storage.accommodate(4 * size_t(N) + vertexCount);
+  setArrays(storage.data());
+  auto * nextW = storage.data();
+  auto * twinW = nextW + N;
+  auto * vertexW = twinW + N;
+  auto * faceW = vertexW + N;
+  auto * vertexEdgeW = faceW + N;
+
+  Vector<uint64_t> keys(N);
+  Vector<uint32_t> order(N);
+  parallelFor(tasks, triCount, 0x4000, [&](uint32_t begin, uint32_t end)
+  {
+    for (uint32_t f = begin; f < end; f++) {
+      for (uint32_t k = 0; k < 3; k++) {
+        auto he = 3 * f + k;
+        auto a = triVtxIx[he];
+        auto b = triVtxIx[3 * f + (k == 2 ? 0 : k + 1)];
+        assert(a < vtxCount && b < vtxCount);
+        nextW[he] = k == 2 ? 3 * f : he + 1;
+        vertexW[he] = a;
+        faceW[he] = f;
+        keys[he] = a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+        order[he] = he;
+      }
+    }
+  });
+  radixSort(tasks, keys.data(), order.data(), N);
+
+  // Same twin semantics as the pointer-based mesh: a circular list of the
+  // half-edges sharing an edge, in creation order.
+  parallelFor(tasks, N, 0x10000, [&](uint32_t begin, uint32_t end)
+  {
+    auto j = begin;
+    while (0 < j && j < end && keys[j - 1] == keys[j]) j++;
+    while (j < end) {
+      uint32_t i = j + 1;
+      for (; i < N && keys[j] == keys[i]; i++);
+      for (uint32_t k = j; k + 1 < i; k++) {
+        twinW[order[k]] = order[k + 1];
+      }
+      twinW[order[i - 1]] = order[j];
+      j = i;
+    }
+  });
+
+  // Prefer an outgoing boundary half-edge so that vertex iteration covers the
+  // whole fan; otherwise the lowest outgoing half-edge.
+  for (uint32_t v = 0; v < vertexCount; v++) vertexEdgeW[v] = none;
+  for (uint32_t he = N; 0 < he; ) {
+    he--;
+    auto v = vertexW[he];
+    auto & e = vertexEdgeW[v];
+    if (e == none || twinW[he] == he || twinW[e] != e) e = he;
+  }
+}
+
+bool HalfEdge::IndexedMesh::save(const char* path) const
+{
+  FileHeader header = {};
+  memcpy(header.magic, fileMagic, sizeof(fileMagic));
+  header.version = fileVersion;
+  header.vertexCount = vertexCount;
+  header.halfEdgeCount = halfEdgeCount;
+  header.faceCount = faceCount;
+
+  FILE* fp = fopen(path, "wb");
+  if (fp == nullptr) {
+    logger(2, "Failed to open %s for writing", path);
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  const uint32_t* arrays[4] = { next, twin, vertex, face };
+  for (auto * a : arrays) {
+    ok = ok && fwrite(a, sizeof(uint32_t), halfEdgeCount, fp) == halfEdgeCount;
+  }
+  ok = ok && fwrite(vertexEdge, sizeof(uint32_t), vertexCount, fp) == vertexCount;
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) logger(2, "Failed to write %s", path);
+  return ok;
+}
+
+bool HalfEdge::IndexedMesh::map(const char* path)
+{
+  release();
+
+  size_t fileSize = 0;
+  void* ptr = nullptr;
+#ifdef _WIN32
+  HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (h == INVALID_HANDLE_VALUE) {
+    logger(2, "Failed to open file %s: %d", path, GetLastError());
+    return false;
+  }
+  DWORD hiSize;
+  DWORD loSize = GetFileSize(h, &hiSize);
+  fileSize = (size_t(hiSize) << 32u) + loSize;
+  HANDLE m = CreateFileMappingA(h, 0, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(h);
+  if (m == NULL) {
+    logger(2, "Failed to map file %s: %d", path, GetLastError());
+    return false;
+  }
+  ptr = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+  if (ptr == nullptr) {
+    logger(2, "Failed to map view of file %s: %d", path, GetLastError());
+    CloseHandle(m);
+    return false;
+  }
+  mappedFile = (void*)m;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    logger(2, "Failed to open file %s", path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    logger(2, "Failed to get size of file %s", path);
+    close(fd);
+    return false;
+  }
+  fileSize = size_t(st.st_size);
+  ptr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    logger(2, "Failed to map file %s", path);
+    return false;
+  }
+#endif
+  mappedView = ptr;
+  mappedSize = fileSize;
+
+  auto * header = (const FileHeader*)ptr;
+  if (fileSize < sizeof(FileHeader) || memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0 || header->version != fileVersion) {
+    logger(2, "%s is not a half-edge mesh file", path);
+    release();
+    return false;
+  }
+  if (fileSize != sizeof(FileHeader) + sizeof(uint32_t) * (4 * size_t(header->halfEdgeCount) + header->vertexCount) ||
+      header->halfEdgeCount != 3 * header->faceCount)
+  {
+    logger(2, "%s has inconsistent size", path);
+    release();
+    return false;
+  }
+  vertexCount = header->vertexCount;
+  halfEdgeCount = header->halfEdgeCount;
+  faceCount = header->faceCount;
+  setArrays((const uint32_t*)(header + 1));
+  return true;
+}
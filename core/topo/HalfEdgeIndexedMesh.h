@@ -0,0 +1,108 @@
+#pragma once
+#include "../Common.h"
+
+class Tasks;
+
+namespace HalfEdge
+{
+
+  // Compact triangle-only half-edge structure using 32-bit indices in separate
+  // arrays. Half-edge 3*f+k runs from corner k to corner k+1 of triangle f.
+  // Either built in bulk from a triangle index list, or a read-only memory
+  // mapping of a file written by save.
+  class IndexedMesh : NonCopyable
+  {
+  public:
+    static const uint32_t none = ~0u;
+
+    IndexedMesh(Logger logger, Tasks* tasks = nullptr) : logger(logger), tasks(tasks) {}
+    ~IndexedMesh() { release(); }
+
+    void build(const uint32_t* triVtxIx, uint32_t triCount, uint32_t vtxCount);
+
+    bool save(const char* path) const;
+    bool map(const char* path);
+    void release();
+
+    uint32_t getVertexCount() const { return vertexCount; }
+    uint32_t getHalfEdgeCount() const { return halfEdgeCount; }
+    uint32_t getFaceCount() const { return faceCount; }
+    size_t getByteSize() const { return sizeof(uint32_t) * (4 * size_t(halfEdgeCount) + vertexCount); }
+
+    uint32_t getNext(uint32_t he) const { return next[he]; }
+    uint32_t getPrev(uint32_t he) const { return next[next[he]]; }
+    uint32_t getTwin(uint32_t he) const { return twin[he]; }                // Circular list of half-edges sharing the edge, itself on boundaries.
+    uint32_t getSrcVertex(uint32_t he) const { return vertex[he]; }
+    uint32_t getDstVertex(uint32_t he) const { return vertex[next[he]]; }
+    uint32_t getFace(uint32_t he) const { return face[he]; }
+    uint32_t getVertexEdge(uint32_t v) const { return vertexEdge[v]; }     // Outgoing half-edge, on the boundary if v is, none if unused.
+    bool isBoundary(uint32_t he) const { return twin[he] == he; }
+
+    // Iterates over the half-edges of a face.
+    struct FaceEdges
+    {
+      struct Iterator
+      {
+        const IndexedMesh* mesh;
+        uint32_t he;
+        uint32_t left;
+        uint32_t operator*() const { return he; }
+        Iterator& operator++() { he = mesh->next[he]; left--; return *this; }
+        bool operator!=(const Iterator& other) const { return left != other.left; }
+      };
+      const IndexedMesh* mesh;
+      uint32_t face;
+      Iterator begin() const { return Iterator{ mesh, 3 * face, 3 }; }
+      Iterator end() const { return Iterator{ mesh, none, 0 }; }
+    };
+    FaceEdges faceEdges(uint32_t f) const { return FaceEdges{ this, f }; }
+
+    // Iterates over the outgoing half-edges of a vertex by rotating across twins.
+    // Stops at a boundary, covers the complete fan of manifold vertices.
+    struct VertexEdges
+    {
+      struct Iterator
+      {
+        const IndexedMesh* mesh;
+        uint32_t first;
+        uint32_t he;
+        uint32_t operator*() const { return he; }
+        Iterator& operator++()
+        {
+          auto in = mesh->getPrev(he);
+          auto out = mesh->twin[in];
+          he = (out == in || out == first || mesh->vertex[out] != mesh->vertex[first]) ? none : out;
+          return *this;
+        }
+        bool operator!=(const Iterator& other) const { return he != other.he; }
+      };
+      const IndexedMesh* mesh;
+      uint32_t vertex;
+      Iterator begin() const { auto he = mesh->vertexEdge[vertex]; return Iterator{ mesh, he, he }; }
+      Iterator end() const { return Iterator{ mesh, none, none }; }
+    };
+    VertexEdges vertexEdges(uint32_t v) const { return VertexEdges{ this, v }; }
+
+  private:
+    Logger logger = nullptr;
+    Tasks* tasks = nullptr;
+
+    uint32_t vertexCount = 0;
+    uint32_t halfEdgeCount = 0;
+    uint32_t faceCount = 0;
+
+    const uint32_t* next = nullptr;
+    const uint32_t* twin = nullptr;
+    const uint32_t* vertex = nullptr;
+    const uint32_t* face = nullptr;
+    const uint32_t* vertexEdge = nullptr;
+
+    MemBuffer<uint32_t> storage;
+    void* mappedFile = nullptr;
+    void* mappedView = nullptr;
+    size_t mappedSize = 0;
+
+    void setArrays(const uint32_t* base);
+  };
+
+}
@@ -1,5 +1,8 @@
+#include <atomic>
+#include <cassert>
 #include "HalfEdgeMesh.h"
-#include <algorithm>
+#include "../Tasks.h"
+#include "../RadixSort.h"
 
 
 HalfEdge::Vertex* HalfEdge::Mesh::createVertex(HalfEdge* leading)
@@ -46,6 +49,7 @@ void HalfEdge::Mesh::insert(uint32_t vtxCount, uint32_t* indices, uint32_t* offs
 
   auto mark = halfEdges.size32();
 
+  Vector<uint64_t> keys(offsets[faceCount] - offsets[0]);
   Vector<HalfEdge*> loop;
   for (uint32_t f = 0; f < faceCount; f++) {
     auto * face = createFace();
@@ -61,70 +65,63 @@ void HalfEdge::Mesh::insert(uint32_t vtxCount, uint32_t* indices, uint32_t* offs
       if (0 < i) {
         loop[i - 1]->nextInFace = loop[i];
       }
+
+      uint64_t a = vtxMark + ix;
+      uint64_t b = vtxMark + indices[offsets[f] + (i + 1 < N ? i + 1 : 0)];
+      keys[offsets[f] - offsets[0] + i] = a < b ? (a << 32) | b : (b << 32) | a;
     }
     loop[N - 1]->nextInFace = loop[0];
   }
 
-  stitchRange(mark, halfEdges.size32());
+  stitchRange(mark, halfEdges.size32(), keys);
 }
 
-namespace {
-
-  struct SortHelper
-  {
-    HalfEdge::HalfEdge* he;
-    HalfEdge::Vertex* maj;
-    HalfEdge::Vertex* min;
-  };
-
-
-}
-
-void HalfEdge::Mesh::stitchRange(uint32_t heA, uint32_t heB)
+void HalfEdge::Mesh::stitchRange(uint32_t heA, uint32_t heB, Vector<uint64_t>& keys)
 {
   auto N = heB - heA;
-  Vector<SortHelper> helper(N);
-  for (uint32_t i = 0; i < N; i++) {
-    auto & item = helper[i];
-    item.he = halfEdges[heA + i];
-    item.maj = item.he->srcVtx;
-    item.min = item.he->nextInFace->srcVtx;
-    if (item.maj < item.min) {
-      auto t = item.maj;
-      item.maj = item.min;
-      item.min = t;
-    }
-  }
-  // A bit lazy, but will wait until it is a problem to do something more clever.
-  std::sort(helper.begin(), helper.end(), [](auto& a, auto& b)
+  assert(keys.size32() == N);
+
+  // Sorting on vertex indices instead of pointers makes the result deterministic,
+  // half-edges of an edge end up in the order they were created.
+  Vector<uint32_t> order(N);
+  for (uint32_t i = 0; i < N; i++) order[i] = heA + i;
+  radixSort(tasks, keys.data(), order.data(), N);
+
+  std::atomic<uint32_t> boundary = 0;
+  std::atomic<uint32_t> manifold = 0;
+  std::atomic<uint32_t> nonManifold = 0;
+  parallelFor(tasks, N, 0x10000, [&](uint32_t begin, uint32_t end)
   {
-    if (a.maj == b.maj) {
-      return a.min < b.min;
-    }
-    return a.maj < b.maj;
-  });
-
-  for (uint32_t j = 0; j < N; ) {
+    // A chunk handles the runs of equal keys that start inside it.
+    auto j = begin;
+    while (0 < j && j < end && keys[j - 1] == keys[j]) j++;
+
+    uint32_t boundaryN = 0;
+    uint32_t manifoldN = 0;
+    uint32_t nonManifoldN = 0;
+    while (j < end) {
+      uint32_t i = j + 1;
+      for (; i < N && keys[j] == keys[i]; i++);
+
+      for (uint32_t k = j; k + 1 < i; k++) {
+        halfEdges[order[k]]->nextInEdge = halfEdges[order[k + 1]];
+      }
+      halfEdges[order[i - 1]]->nextInEdge = halfEdges[order[j]];
 
-    uint32_t i=j+1;
-    for (; i < N && helper[j].maj == helper[i].maj && helper[j].min == helper[i].min; i++) ;
+      auto abutting = i - j;
+      if (abutting == 1) boundaryN++;
+      else if (abutting == 2) manifoldN++;
+      else nonManifoldN++;
 
-    auto abutting = i - j;
-    if (abutting == 1) {
-      boundaryEdges++;
-      // stitch
-    }
-    else if (abutting == 2) {
-      manifoldEdges++;
-      // stitch
+      j = i;
     }
-    else {
-      nonManifoldEdges++;
-      // stitch
-    }
-
-    j = i;
-  }
+    boundary += boundaryN;
+    manifold += manifoldN;
+    nonManifold += nonManifoldN;
+  });
+  boundaryEdges += boundary;
+  manifoldEdges += manifold;
+  nonManifoldEdges += nonManifold;
 
   logger(0, "Found %d boundary edges, %d manifold edges and %d non-manifold edges", boundaryEdges, manifoldEdges, nonManifoldEdges);
 }
@@ -3,6 +3,8 @@
 #include "../Common.h"
 #include "../LinAlg.h"
 
+class Tasks;
+
 namespace HalfEdge
 {
   struct HalfEdge;
@@ -16,7 +18,7 @@ namespace HalfEdge
   struct HalfEdge {
     Vertex* srcVtx = nullptr;
     HalfEdge* nextInFace = nullptr;
-    HalfEdge* nextInEdge = nullptr;
+    HalfEdge* nextInEdge = nullptr;   // Circular list of half-edges sharing the edge, points to itself on boundaries.
     Face* face = nullptr;
   };
 
@@ -53,7 +55,9 @@ namespace HalfEdge
   protected:
     Logger logger = nullptr;
 
-    Mesh(IStore* store, Logger logger) : store(store), logger(logger) {}
+    Tasks* tasks = nullptr;
+
+    Mesh(IStore* store, Logger logger, Tasks* tasks) : store(store), logger(logger), tasks(tasks) {}
 
     Vertex* createVertex(HalfEdge* leading = nullptr);
     HalfEdge* createHalfEdge(Vertex* srcVtx=nullptr, HalfEdge* nextInFace=nullptr, HalfEdge* nextInEdge=nullptr, Face* face = nullptr);
@@ -67,7 +71,8 @@ namespace HalfEdge
     uint32_t manifoldEdges = 0;
     uint32_t nonManifoldEdges = 0;
 
-    void stitchRange(uint32_t heA, uint32_t heB);
+    // Link nextInEdge of half-edges [heA,heB), keys holds the (min,max) vertex index pair of each half-edge.
+    void stitchRange(uint32_t heA, uint32_t heB, Vector<uint64_t>& keys);
   };
 
 
@@ -82,7 +87,7 @@ namespace HalfEdge
   {
   public:
 
-    R3Mesh(Logger logger) : Mesh(this, logger) {}
+    R3Mesh(Logger logger, Tasks* tasks = nullptr) : Mesh(this, logger, tasks) {}
 
     void insert(const Vec3f* vtx, uint32_t vtxCount, uint32_t* indices, uint32_t* offsets, uint32_t faceCount);
 
@@ -0,0 +1,26 @@
+#version 450
+#pragma shader_stage(fragment)
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// As triangleColor.frag, for devices without gl_PrimitiveID in fragment shaders. The triangle
+// comes from vanilla.vert, which requires drawing three vertices per triangle without indices.
+layout(binding = 3) readonly buffer TriangleColors
+{
+  uint triangleColors[];
+};
+
+layout(location = 0) in vec4 albedo;
+layout(location = 1) in vec3 normal;
+layout(location = 3) flat in uint triangleId;
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+  uint c = triangleColors[triangleId];
+  vec3 color = (1.0/255.0)*vec3((c >> 16) & 0xff, (c >> 8) & 0xff, c & 0xff);
+
+  float diffuse = max(0.2, dot(normalize(normal),
+                               normalize(vec3(1, 1, 1))));
+
+  fragColor = vec4(diffuse * color, 1);
+}
@@ -0,0 +1,27 @@
+#version 450
+#pragma shader_stage(fragment)
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout(binding = 2) uniform sampler2D texSampler;
+
+// Color per triangle in draw order, 0xRRGGBB, see triangleColor.frag.
+layout(binding = 3) readonly buffer TriangleColors
+{
+  uint triangleColors[];
+};
+
+layout(location = 0) in vec4 albedo;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+  uint c = triangleColors[gl_PrimitiveID];
+  vec3 color = (1.0/255.0)*vec3((c >> 16) & 0xff, (c >> 8) & 0xff, c & 0xff);
+
+  float diffuse = max(0.2, dot(normalize(normal),
+                               normalize(vec3(1, 1, 1))));
+
+  fragColor = vec4(diffuse * color * texture(texSampler, texCoord).rgb, 1);
+}
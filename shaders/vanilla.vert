@@ -21,6 +21,7 @@ layout(binding=1) readonly buffer Vertices
 layout(location = 0) out vec4 albedo;
 layout(location = 1) out vec3 normal;
 layout(location = 2) out vec2 texCoord;
+layout(location = 3) flat out uint triangleId;   // Only meaningful when drawn without indices.
 
 void main() {
   vec3 pos = vec3(vertices[gl_VertexIndex].px,
@@ -39,5 +40,6 @@ void main() {
   normal = normalize(N * nrm);
   albedo = col;
   texCoord = tex;
+  triangleId = gl_VertexIndex / 3;
   gl_Position = MP * vec4(pos, 1);
 }
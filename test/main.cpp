@@ -5,21 +5,42 @@
 #include <atomic>
 #include <cctype>
 #include <cstdio>
+#include <cstring>
 #include <chrono>
 #include <mutex>
 #include <cassert>
 #include <vector>
 #include <list>
+#include <map>
+#include <tuple>
+#include <array>
 #include <algorithm>
 #include <limits>
+#include <cfloat>
+#include <random>
 
 #include "Common.h"
 #include "Tasks.h"
+#include "RadixSort.h"
 #include "Half.h"
 #include "Mesh.h"
+#include "MeshSimplify.h"
+#include "MeshLod.h"
+#include "MeshIndexing.h"
+#include "Bounds.h"
+#include "BVH.h"
+#include "CpuRaycaster.h"
+#include "HandlePicking.h"
+#include "VertexCache.h"
+#include "IndexOptimizer.h"
+#include "Selection.h"
+#include "AsyncPackage.h"
+#include "MeshDerived.h"
 #include "LinAlgOps.h"
+#include "Viewer.h"
 #include "adt/KeyedHeap.h"
 #include "topo/HalfEdgeMesh.h"
+#include "topo/HalfEdgeIndexedMesh.h"
 #include "spatial/R3PointKdTree.h"
 
 namespace {
@@ -72,6 +93,26 @@ namespace {
     0, 4, 8, 12, 16, 20, 24
   };
 
+  // The same cube as triangles, where the top face is a separate object.
+  uint32_t cubeTris[12 * 3] = {
+    0, 2, 1, 1, 2, 3,   4, 5, 6, 5, 7, 6,   0, 1, 4, 1, 5, 4,
+    2, 6, 3, 3, 6, 7,   0, 4, 2, 2, 4, 6,   1, 3, 5, 3, 7, 5
+  };
+
+  uint32_t cubeObj[12] = {
+    0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0
+  };
+
+  void initCubeMesh(Mesh& cube)
+  {
+    cube.vtx = cubeVtx;
+    cube.vtxCount = 8;
+    cube.texCount = 0;
+    cube.triVtxIx = cubeTris;
+    cube.TriObjIx = cubeObj;
+    cube.triCount = 12;
+  }
+
   void runObjReader(Logger logger, std::string path)
   {
     auto time0 = std::chrono::high_resolution_clock::now();
@@ -128,6 +169,135 @@ namespace {
     float value;
   };
 
+  template<typename Heap>
+  void checkKeyedHeap(bool bulk)
+  {
+    srand(42);
+    uint32_t N = 100;
+
+    Heap heap;
+    heap.setKeyRange(N);
+ 
+    std::list<HeapItem> items;
+    for (uint32_t i = 0; i < N; i++) {
+      HeapItem item{ i, float(rand()) };
+      items.push_back(item);
+      if (!bulk) {
+        heap.insert(item.key, item.value);
+        heap.assertHeapInvariants();
+      }
+    }
+    if (bulk) {
+      Vector<uint32_t> keys;
+      Vector<float> values;
+      for (auto & item : items) {
+        keys.pushBack(item.key);
+        values.pushBack(item.value);
+      }
+      heap.buildFrom(keys.data(), values.data(), N);
+      heap.assertHeapInvariants();
+    }
+
+    items.sort([](const HeapItem & a, const HeapItem &  b) { return a.value < b.value; });
+
+    // regular delmin on the first half
+    auto Na = N / 2;
+    for (uint32_t i = 0; i < Na; i++) {
+      auto item = items.front();
+      items.pop_front();
+
+      auto key = heap.removeMin();
+      auto b = heap.getValue(key);
+
+      assert(item.key == key);
+      assert(item.value == b);
+      heap.assertHeapInvariants();
+    }
+
+    assert(!items.empty());
+    unsigned m = 0;
+    for (auto it = items.begin(); it != items.end();) {
+      // change value
+      if (m == 1) {
+        it->value = float(rand());
+        heap.update(it->key, it->value);
+        it++;
+      }
+      // erase
+      else if (m == 2) {
+        heap.erase(it->key);
+        it = items.erase(it);
+      }
+      // keep
+      else {
+        it++;
+      }
+      m = (m + 1) % 3;
+    }
+    items.sort([](const HeapItem & a, const HeapItem &  b) { return a.value < b.value; });
+
+    for (auto & item : items) {
+      auto key = heap.removeMin();
+      auto b = heap.getValue(key);
+
+      assert(item.key == key);
+      assert(item.value == b);
+      heap.assertHeapInvariants();
+    }
+  }
+
+  // Simplification-style heap workload: fill with N costs, then repeatedly
+  // remove the cheapest and update the costs of a few other keys.
+  template<typename Heap>
+  double benchmarkKeyedHeap(uint64_t& checksum, uint32_t N, bool bulk)
+  {
+    uint32_t state = 1234567;
+    auto next = [&state]() { state = 1664525u * state + 1013904223u; return state >> 8; };
+
+    // Values are distinct integers below 2^24, wrapping around, so no two heap elements tie
+    // and every heap variant pops the same sequence. At most N + 3N updates are ever marked.
+    const uint32_t valueMask = (1u << 24) - 1;
+    assert(4 * N < valueMask);
+    Vector<uint8_t> used(size_t(valueMask) + 1);
+    for (auto & u : used) u = 0;
+    auto unique = [&used, valueMask](uint32_t v)
+    {
+      v &= valueMask;
+      while (used[v]) v = (v + 1) & valueMask;
+      used[v] = 1;
+      return float(v);
+    };
+
+    Vector<uint32_t> keys(N);
+    Vector<float> values(N);
+    for (uint32_t i = 0; i < N; i++) {
+      keys[i] = i;
+      values[i] = unique(next() & 0x7fffff);
+    }
+
+    auto time0 = std::chrono::high_resolution_clock::now();
+    Heap heap;
+    heap.setKeyRange(N);
+    if (bulk) {
+      heap.buildFrom(keys.data(), values.data(), N);
+    }
+    else {
+      for (uint32_t i = 0; i < N; i++) heap.insert(keys[i], values[i]);
+    }
+    checksum = 0;
+    while (N / 4 < heap.size()) {
+      auto key = heap.removeMin();
+      checksum = 31 * checksum + key;
+      for (uint32_t k = 0; k < 4; k++) {
+        auto j = next() % N;
+        auto delta = next() & 0xffff;
+        if (heap.contains(j)) heap.update(j, unique(uint32_t(heap.getValue(j)) + delta));
+      }
+    }
+    auto time1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(time1 - time0).count();
+  }
+
   // mean zero, variance one, exactly zero outside +/- 6*variance
   float normalDistRand()
   {
@@ -209,6 +379,38 @@ int main(int argc, char** argv)
       auto h = halfFromFloat(value.f);
       assert(h == value.h);
     }
+
+    // Batch conversion matches the table, also when the values land in SIMD blocks.
+    Vector<float> floats;
+    for (unsigned k = 0; k < 3; k++) {
+      for (auto & value : values) floats.pushBack(value.f);
+    }
+    Vector<uint16_t> halves(floats.size());
+    halvesFromFloats(halves.data(), floats.data(), floats.size());
+    for (uint32_t i = 0; i < halves.size32(); i++) {
+      assert(halves[i] == values[i % (sizeof(values) / sizeof(values[0]))].h);
+    }
+
+    // Every half both ways, batch and scalar bit-exact, plus random float bit patterns.
+    halves.resize(0x10000);
+    for (uint32_t i = 0; i < halves.size32(); i++) halves[i] = uint16_t(i);
+    floats.resize(halves.size());
+    floatsFromHalves(floats.data(), halves.data(), halves.size());
+    for (uint32_t i = 0; i < halves.size32(); i++) {
+      float f = floatFromHalf(halves[i]);
+      assert(std::memcmp(&f, &floats[i], sizeof(float)) == 0);
+      assert((halves[i] & 0x7FFF) > 0x7C00 || halfFromFloat(f) == halves[i]);
+    }
+    srand(7);
+    for (uint32_t i = 0; i < 0x8000; i++) {
+      uint32_t bits = (uint32_t(rand()) << 17) ^ (uint32_t(rand()) << 5) ^ uint32_t(rand());
+      std::memcpy(&floats[i], &bits, sizeof(float));
+    }
+    Vector<uint16_t> converted(floats.size());
+    halvesFromFloats(converted.data(), floats.data(), floats.size());
+    for (uint32_t i = 0; i < floats.size32(); i++) {
+      assert(converted[i] == halfFromFloat(floats[i]));
+    }
     logger(0, "half conversions passed.");
   }
 
@@ -235,6 +437,20 @@ int main(int argc, char** argv)
     }
   }
 
+  {
+    logger(0, "Vector move checks...");
+    Vector<Vector<uint32_t>> outer;
+    Vector<uint32_t> inner(1000);
+    auto * innerData = inner.data();
+    outer.pushBack(std::move(inner));
+    assert(inner.empty());
+    assert(outer[0].size() == 1000 && outer[0].data() == innerData);
+    auto popped = outer.popBack();
+    assert(outer.empty());
+    assert(popped.size() == 1000 && popped.data() == innerData);
+    logger(0, "Vector move checks... OK");
+  }
+
   {
     logger(0, "Pool checks...");
     Pool<Vec3f> pool;
@@ -281,68 +497,244 @@ int main(int argc, char** argv)
   if(true) {
     logger(0, "Keyed heap checks...");
 
-    srand(42);
-    uint32_t N = 100;
+    checkKeyedHeap<KeyedHeap>(false);
+    checkKeyedHeap<KeyedHeap>(true);
+    checkKeyedHeap<KeyedHeap4>(false);
+    checkKeyedHeap<KeyedHeap4>(true);
 
-    KeyedHeap heap;
-    heap.setKeyRange(N);
- 
-    std::list<HeapItem> items;
-    for (uint32_t i = 0; i < N; i++) {
-      HeapItem item{ i, float(rand()) };
-      items.push_back(item);
-      heap.insert(item.key, item.value);
-      heap.assertHeapInvariants();
+    logger(0, "Keyed heap checks... OK");
+  }
+
+  {
+#ifdef NDEBUG
+    uint32_t N = 1000000;
+#else
+    uint32_t N = 100000;
+#endif
+    uint64_t checksum[4];
+    double ms[4] = {
+      benchmarkKeyedHeap<KeyedHeap>(checksum[0], N, false),
+      benchmarkKeyedHeap<KeyedHeap>(checksum[1], N, true),
+      benchmarkKeyedHeap<KeyedHeap4>(checksum[2], N, false),
+      benchmarkKeyedHeap<KeyedHeap4>(checksum[3], N, true)
+    };
+    logger(0, "Keyed heap N=%d: binary insert %.1fms, binary buildFrom %.1fms, 4-ary insert %.1fms, 4-ary buildFrom %.1fms",
+           N, ms[0], ms[1], ms[2], ms[3]);
+    // Not an assert, the comparison matters most in release builds.
+    for (unsigned i = 1; i < 4; i++) {
+      if (checksum[i] != checksum[0]) {
+        logger(2, "Keyed heap benchmark %d popped a different sequence", i);
+        return -1;
+      }
     }
+  }
 
-    items.sort([](const HeapItem & a, const HeapItem &  b) { return a.value < b.value; });
+  {
+    logger(0, "Radix sort checks...");
+    Tasks tasks;
+    tasks.init(logger);
 
-    // regular delmin on the first half
-    auto Na = N / 2;
-    for (uint32_t i = 0; i < Na; i++) {
-      auto item = items.front();
-      items.pop_front();
+    srand(42);
+    for (uint32_t N : { 0u, 1u, 1000u, 300000u }) {
+      for (uint32_t shift : { 0u, 40u }) {
+        Vector<uint64_t> keys(N);
+        Vector<uint32_t> values(N);
+        std::vector<std::pair<uint64_t, uint32_t>> ref(N);
+        for (uint32_t i = 0; i < N; i++) {
+          keys[i] = ((uint64_t(rand()) << 32) | (uint64_t(rand()) << 16) | uint64_t(rand() & 0xff)) >> shift;
+          values[i] = i;
+          ref[i] = std::make_pair(keys[i], i);
+        }
+        std::stable_sort(ref.begin(), ref.end(), [](auto&a, auto&b) { return a.first < b.first; });
+
+        auto keys2 = keys;
+        radixSort(&tasks, keys.data(), values.data(), N);
+        radixSort(nullptr, keys2.data(), nullptr, N);
+        for (uint32_t i = 0; i < N; i++) {
+          assert(keys[i] == ref[i].first);
+          assert(values[i] == ref[i].second);
+          assert(keys2[i] == ref[i].first);
+        }
+      }
+    }
+    logger(0, "Radix sort checks... OK");
+  }
 
-      auto key = heap.removeMin();
-      auto b = heap.getValue(key);
+  {
+    logger(0, "Edge extraction checks...");
+    Tasks tasks;
+    tasks.init(logger);
 
-      assert(item.key == key);
-      assert(item.value == b);
-      heap.assertHeapInvariants();
+    // Grid of n x n quads with a fin on the first quad, giving boundary,
+    // interior and non-manifold edges.
+#ifdef NDEBUG
+    const uint32_t n = 1000;
+#else
+    const uint32_t n = 100;
+#endif
+    Vector<uint32_t> tris;
+    for (uint32_t j = 0; j < n; j++) {
+      for (uint32_t i = 0; i < n; i++) {
+        auto a = (n + 1) * j + i;
+        auto b = a + n + 1;
+        uint32_t t[6] = { a, a + 1, b, a + 1, b + 1, b };
+        for (auto ix : t) tris.pushBack(ix);
+      }
     }
+    uint32_t fin[3] = { 1, n + 1, (n + 1) * (n + 1) };
+    for (auto ix : fin) tris.pushBack(ix);
+    const uint32_t triCount = tris.size32() / 3;
 
-    assert(!items.empty());
-    unsigned m = 0;
-    for (auto it = items.begin(); it != items.end();) {
-      // change value
-      if (m == 1) {
-        it->value = float(rand());
-        heap.update(it->key, it->value);
-        it++;
+    // Reference with a map from edge to face count, as getEdges used to do.
+    auto time0 = std::chrono::high_resolution_clock::now();
+    Map known;
+    for (uint32_t j = 0; j < 3 * triCount; j += 3) {
+      for (uint32_t i = 0; i < 3; i++) {
+        auto a = tris[j + i];
+        auto b = tris[j + (i < 2 ? i + 1 : 0)];
+        auto key = (uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b) + 1);
+        known.insert(key, known.get(key) + 1);
       }
-      // erase
-      else if (m == 2) {
-        heap.erase(it->key);
-        it = items.erase(it);
+    }
+    auto time1 = std::chrono::high_resolution_clock::now();
+    Vector<uint32_t> edges;
+    Vector<uint32_t> faceCounts;
+    getEdges(logger, &tasks, edges, &faceCounts, tris.data(), triCount);
+    auto time2 = std::chrono::high_resolution_clock::now();
+    logger(0, "Edges of %d triangles: map %lldms, sorted %lldms", triCount,
+           std::chrono::duration_cast<std::chrono::milliseconds>(time1 - time0).count(),
+           std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1).count());
+
+    Vector<uint32_t> serialEdges;
+    getEdges(logger, serialEdges, tris.data(), triCount);
+    assert(serialEdges.size32() == edges.size32());
+    for (uint32_t i = 0; i < edges.size32(); i++) assert(serialEdges[i] == edges[i]);
+
+    const uint32_t edgeCount = 3 * n * n + 2 * n + 2;
+    assert(edges.size32() == 2 * edgeCount && faceCounts.size32() == edgeCount);
+    uint32_t counts[4] = { 0, 0, 0, 0 };
+    for (uint32_t e = 0; e < edgeCount; e++) {
+      auto a = edges[2 * e + 0];
+      auto b = edges[2 * e + 1];
+      assert(a < b);
+      assert(e == 0 || (uint64_t(edges[2 * e - 2]) << 32 | edges[2 * e - 1]) < (uint64_t(a) << 32 | b));
+      assert(known.get((uint64_t(a) << 32) | uint64_t(b + 1)) == faceCounts[e]);
+      counts[std::min(3u, faceCounts[e])]++;
+    }
+    assert(counts[1] == 4 * n + 2);
+    assert(counts[2] == edgeCount - 4 * n - 3);
+    assert(counts[3] == 1);
+
+    // Cube where the top face is a separate object: the twelve cube edges
+    // are creases, the face diagonals are interior, and the top rim also
+    // separates objects.
+    Mesh cube;
+    initCubeMesh(cube);
+
+    Vector<uint32_t> classes;
+    getClassifiedEdges(logger, &tasks, edges, classes, &cube, EdgeAll, 0.5f);
+    assert(edges.size32() == 2 * 18);
+    uint32_t creases = 0, interior = 0, objectRim = 0;
+    for (uint32_t e = 0; e < classes.size32(); e++) {
+      if (classes[e] & EdgeCrease) creases++;
+      if (classes[e] == EdgeInterior) interior++;
+      if (classes[e] & EdgeObjectBoundary) {
+        assert((edges[2 * e] & 4) && (edges[2 * e + 1] & 4));
+        objectRim++;
       }
-      // keep
-      else {
-        it++;
+      assert(!(classes[e] & (EdgeBoundary | EdgeNonManifold | EdgeSmoothingBoundary)));
+    }
+    assert(creases == 12 && interior == 6 && objectRim == 4);
+
+    getClassifiedEdges(logger, &tasks, edges, classes, &cube, EdgeObjectBoundary, 0.5f);
+    assert(edges.size32() == 2 * 4);
+    getClassifiedEdges(logger, &tasks, edges, classes, &cube, EdgeCrease, 2.f);
+    assert(edges.size32() == 0);
+
+#ifdef NDEBUG
+    // Timing at 20M triangles, the size the speedup target is stated for,
+    // with the map, serially and on the task pool.
+    {
+      const uint32_t m = 3163;
+      Vector<uint32_t> big(6 * m * m);
+      for (uint32_t j = 0; j < m; j++) {
+        for (uint32_t i = 0; i < m; i++) {
+          auto a = (m + 1) * j + i;
+          auto b = a + m + 1;
+          uint32_t t[6] = { a, a + 1, b, a + 1, b + 1, b };
+          for (uint32_t k = 0; k < 6; k++) big[6 * (m * j + i) + k] = t[k];
+        }
       }
-      m = (m + 1) % 3;
+      const uint32_t bigCount = big.size32() / 3;
+
+      auto start = std::chrono::high_resolution_clock::now();
+      Map bigKnown;
+      for (uint32_t j = 0; j < 3 * bigCount; j += 3) {
+        for (uint32_t i = 0; i < 3; i++) {
+          auto a = big[j + i];
+          auto b = big[j + (i < 2 ? i + 1 : 0)];
+          auto key = (uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b) + 1);
+          bigKnown.insert(key, bigKnown.get(key) + 1);
+        }
+      }
+      auto mapped = std::chrono::high_resolution_clock::now();
+      getEdges(logger, nullptr, edges, &faceCounts, big.data(), bigCount);
+      auto serial = std::chrono::high_resolution_clock::now();
+      getEdges(logger, &tasks, edges, &faceCounts, big.data(), bigCount);
+      auto parallel = std::chrono::high_resolution_clock::now();
+      assert(edges.size32() == 2 * (3 * m * m + 2 * m));
+      logger(0, "Edges of %d triangles: map %lldms, sorted %lldms serial, %lldms on %d workers", bigCount,
+             std::chrono::duration_cast<std::chrono::milliseconds>(mapped - start).count(),
+             std::chrono::duration_cast<std::chrono::milliseconds>(serial - mapped).count(),
+             std::chrono::duration_cast<std::chrono::milliseconds>(parallel - serial).count(),
+             tasks.getWorkerCount());
     }
-    items.sort([](const HeapItem & a, const HeapItem &  b) { return a.value < b.value; });
+#endif
 
-    for (auto & item : items) {
-      auto key = heap.removeMin();
-      auto b = heap.getValue(key);
+    logger(0, "Edge extraction checks... OK");
+  }
 
-      assert(item.key == key);
-      assert(item.value == b);
-      heap.assertHeapInvariants();
+  {
+    logger(0, "Unique indices checks...");
+    Tasks tasks;
+    tasks.init(logger);
+
+    // Streams with few distinct values so combinations repeat a lot.
+    const uint32_t N = 3 * 100000;
+    Vector<uint32_t> a(N), b(N), c(N);
+    srand(1);
+    for (uint32_t i = 0; i < N; i++) {
+      a[i] = rand() % 3000;
+      b[i] = a[i] % 7 + (rand() % 4 == 0 ? 1 : 0);
+      c[i] = (rand() % 8 == 0) ? 0xffffffff : 0xdddddd;
     }
+    const uint32_t* streams[3] = { a.data(), b.data(), c.data() };
 
-    logger(0, "Keyed heap checks... OK");
+    Vector<uint32_t> indices, vertices;
+    uniqueIndices(logger, &tasks, indices, vertices, streams, 3, N);
+
+    // Reference numbering in order of first occurrence.
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> known;
+    for (uint32_t i = 0; i < N; i++) {
+      auto it = known.emplace(std::make_tuple(a[i], b[i], c[i]), uint32_t(known.size())).first;
+      assert(indices[i] == it->second);
+    }
+    assert(vertices.size32() == known.size());
+    for (uint32_t v = 0; v < vertices.size32(); v++) assert(indices[vertices[v]] == v);
+
+    Vector<uint32_t> serialIndices, serialVertices;
+    uniqueIndices(logger, nullptr, serialIndices, serialVertices, streams, 3, N);
+    for (uint32_t i = 0; i < N; i++) assert(serialIndices[i] == indices[i]);
+
+    // Two-stream version keeps its behaviour.
+    uniqueIndices(logger, serialIndices, serialVertices, a.data(), b.data(), N);
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> pairs;
+    for (uint32_t i = 0; i < N; i++) {
+      auto it = pairs.emplace(std::make_pair(a[i], b[i]), uint32_t(pairs.size())).first;
+      assert(serialIndices[i] == it->second);
+    }
+
+    logger(0, "Unique indices checks... OK");
   }
 
   {
@@ -355,10 +747,1540 @@ int main(int argc, char** argv)
     assert(hemesh.getManifoldEdgeCount() == 12);
     assert(hemesh.getNonManifoldEdgeCount() == 0);
 
+    for (auto * he : hemesh.halfEdges) {
+      auto * twin = he->nextInEdge;
+      assert(twin != he);
+      assert(twin->nextInEdge == he);
+      assert(twin->srcVtx == he->nextInFace->srcVtx);
+      assert(twin->nextInFace->srcVtx == he->srcVtx);
+    }
 
     logger(0, "Half-edge cube checks... OK");
   }
 
+  {
+    logger(0, "Half-edge boundary and non-manifold checks...");
+
+    // Three triangles sharing the edge 0-1, giving 6 boundary edges and 1 non-manifold edge.
+    uint32_t finIdx[3 * 3] = {
+      0, 1, 2,
+      1, 0, 3,
+      0, 1, 4
+    };
+    uint32_t finOff[4] = { 0, 3, 6, 9 };
+
+    HalfEdge::R3Mesh hemesh(logger);
+    hemesh.insert(cubeVtx, 5, finIdx, finOff, 3);
+
+    assert(hemesh.getBoundaryEdgeCount() == 6);
+    assert(hemesh.getManifoldEdgeCount() == 0);
+    assert(hemesh.getNonManifoldEdgeCount() == 1);
+
+    for (auto * he : hemesh.halfEdges) {
+      auto a = he->srcVtx;
+      auto b = he->nextInFace->srcVtx;
+      bool shared = (a == hemesh.vertices[0] && b == hemesh.vertices[1]) || (a == hemesh.vertices[1] && b == hemesh.vertices[0]);
+
+      uint32_t n = 1;
+      for (auto * it = he->nextInEdge; it != he; it = it->nextInEdge) {
+        assert((it->srcVtx == a && it->nextInFace->srcVtx == b) || (it->srcVtx == b && it->nextInFace->srcVtx == a));
+        n++;
+      }
+      assert(n == (shared ? 3 : 1));
+    }
+
+    logger(0, "Half-edge boundary and non-manifold checks... OK");
+  }
+
+  {
+    logger(0, "Indexed half-edge checks...");
+
+    Tasks tasks;
+    tasks.init(logger);
+
+    uint32_t cubeTri[6 * 2 * 3];
+    for (uint32_t f = 0; f < 6; f++) {
+      auto * q = cubeIdx + cubeOff[f];
+      uint32_t tri[6] = { q[0], q[1], q[2], q[0], q[2], q[3] };
+      for (uint32_t k = 0; k < 6; k++) cubeTri[6 * f + k] = tri[k];
+    }
+
+    HalfEdge::IndexedMesh cube(logger, &tasks);
+    cube.build(cubeTri, 12, 8);
+    assert(cube.getHalfEdgeCount() == 36);
+    uint32_t ringSum = 0;
+    for (uint32_t v = 0; v < 8; v++) {
+      for (auto he : cube.vertexEdges(v)) {
+        assert(cube.getSrcVertex(he) == v);
+        ringSum++;
+      }
+    }
+    assert(ringSum == 36);
+    for (uint32_t he = 0; he < 36; he++) {
+      auto twin = cube.getTwin(he);
+      assert(twin != he && cube.getTwin(twin) == he);
+      assert(cube.getSrcVertex(twin) == cube.getDstVertex(he));
+      assert(cube.getFace(he) == he / 3);
+      uint32_t n = 0;
+      for (auto e : cube.faceEdges(cube.getFace(he))) { assert(cube.getFace(e) == cube.getFace(he)); n++; }
+      assert(n == 3);
+    }
+
+    uint32_t finIdx[3 * 3] = {
+      0, 1, 2,
+      1, 0, 3,
+      0, 1, 4
+    };
+    HalfEdge::IndexedMesh fin(logger, &tasks);
+    fin.build(finIdx, 3, 5);
+    for (uint32_t he = 0; he < 9; he++) {
+      uint32_t n = 1;
+      for (auto it = fin.getTwin(he); it != he; it = fin.getTwin(it)) n++;
+      assert(n == (he % 3 == 0 ? 3 : 1));
+    }
+    for (uint32_t v = 2; v < 5; v++) assert(fin.isBoundary(fin.getVertexEdge(v)));
+
+    // Compare against the pointer-based mesh on the loaded model.
+    Vector<uint32_t> offsets(mesh->triCount + 1);
+    for (uint32_t i = 0; i <= mesh->triCount; i++) offsets[i] = 3 * i;
+
+    auto time0 = std::chrono::high_resolution_clock::now();
+    HalfEdge::R3Mesh pmesh(logger, &tasks);
+    pmesh.insert(mesh->vtx, mesh->vtxCount, mesh->triVtxIx, offsets.data(), mesh->triCount);
+    auto time1 = std::chrono::high_resolution_clock::now();
+    HalfEdge::IndexedMesh imesh(logger, &tasks);
+    imesh.build(mesh->triVtxIx, mesh->triCount, mesh->vtxCount);
+    auto time2 = std::chrono::high_resolution_clock::now();
+
+    for (uint32_t he = 0; he < imesh.getHalfEdgeCount(); he++) {
+      assert(imesh.isBoundary(he) == (pmesh.halfEdges[he]->nextInEdge == pmesh.halfEdges[he]));
+      assert(imesh.getSrcVertex(he) == mesh->triVtxIx[he]);
+    }
+
+    auto time3 = std::chrono::high_resolution_clock::now();
+    uint64_t pSum = 0;
+    for (auto * v : pmesh.vertices) {
+      auto * first = v->leadingEdge;
+      for (auto * he = first; he; ) {
+        pSum += ((HalfEdge::R3Vertex*)he->nextInFace->srcVtx)->pos.x != 0.f;
+        auto * in = he->nextInFace->nextInFace;
+        auto * out = in->nextInEdge;
+        he = (out == in || out == first || out->srcVtx != v) ? nullptr : out;
+      }
+    }
+    auto time4 = std::chrono::high_resolution_clock::now();
+    uint64_t iSum = 0;
+    for (uint32_t v = 0; v < imesh.getVertexCount(); v++) {
+      for (auto he : imesh.vertexEdges(v)) {
+        iSum += mesh->vtx[imesh.getDstVertex(he)].x != 0.f;
+      }
+    }
+    auto time5 = std::chrono::high_resolution_clock::now();
+
+    auto pBytes = pmesh.halfEdges.size() * (sizeof(HalfEdge::HalfEdge) + sizeof(void*)) +
+                  pmesh.vertices.size() * (sizeof(HalfEdge::R3Vertex) + sizeof(void*)) +
+                  pmesh.faces.size() * (sizeof(HalfEdge::Face) + sizeof(void*));
+    logger(0, "Pointer half-edge: build %lldms, one-ring sweep %lldus (%llu), %zu bytes",
+           std::chrono::duration_cast<std::chrono::milliseconds>(time1 - time0).count(),
+           std::chrono::duration_cast<std::chrono::microseconds>(time4 - time3).count(), pSum, pBytes);
+    logger(0, "Indexed half-edge: build %lldms, one-ring sweep %lldus (%llu), %zu bytes",
+           std::chrono::duration_cast<std::chrono::milliseconds>(time2 - time1).count(),
+           std::chrono::duration_cast<std::chrono::microseconds>(time5 - time4).count(), iSum, imesh.getByteSize());
+
+    const char* path = "indexed_halfedge_test.bin";
+    bool saved = imesh.save(path);
+    assert(saved);
+    {
+      HalfEdge::IndexedMesh mapped(logger);
+      bool isMapped = mapped.map(path);
+      assert(isMapped);
+      assert(mapped.getVertexCount() == imesh.getVertexCount());
+      assert(mapped.getHalfEdgeCount() == imesh.getHalfEdgeCount());
+      for (uint32_t he = 0; he < imesh.getHalfEdgeCount(); he++) {
+        assert(mapped.getNext(he) == imesh.getNext(he));
+        assert(mapped.getTwin(he) == imesh.getTwin(he));
+        assert(mapped.getSrcVertex(he) == imesh.getSrcVertex(he));
+        assert(mapped.getFace(he) == imesh.getFace(he));
+      }
+      for (uint32_t v = 0; v < imesh.getVertexCount(); v++) {
+        assert(mapped.getVertexEdge(v) == imesh.getVertexEdge(v));
+      }
+    }
+    std::remove(path);
+
+    logger(0, "Indexed half-edge checks... OK");
+  }
+
+  {
+    logger(0, "Mesh simplification checks...");
+
+    // Planar grid, everything but the four corners should collapse without error.
+    const uint32_t n = 16;
+    Vector<Vec3f> gridVtx;
+    Vector<uint32_t> gridIdx;
+    for (uint32_t j = 0; j <= n; j++) {
+      for (uint32_t i = 0; i <= n; i++) gridVtx.pushBack(Vec3f(float(i), float(j), 0.f));
+    }
+    for (uint32_t j = 0; j < n; j++) {
+      for (uint32_t i = 0; i < n; i++) {
+        auto a = (n + 1) * j + i;
+        uint32_t quad[6] = { a, a + 1, a + n + 2, a, a + n + 2, a + n + 1 };
+        for (auto ix : quad) gridIdx.pushBack(ix);
+      }
+    }
+    Mesh grid;
+    grid.vtx = gridVtx.data();
+    grid.vtxCount = gridVtx.size32();
+    grid.triVtxIx = gridIdx.data();
+    grid.triCount = gridIdx.size32() / 3;
+
+    SimplifyOptions options;
+    options.maxError = 1e-4f;
+    SimplifiedMesh simplified;
+    simplifyMesh(logger, simplified, &grid, options);
+    assert(simplified.triSource.size32() == 2);
+    assert(simplified.error <= 1e-4f);
+    float area = 0.f;
+    for (uint32_t t = 0; t < simplified.triSource.size32(); t++) {
+      auto & p0 = gridVtx[gridIdx[simplified.corners[3 * t + 0]]];
+      auto & p1 = gridVtx[gridIdx[simplified.corners[3 * t + 1]]];
+      auto & p2 = gridVtx[gridIdx[simplified.corners[3 * t + 2]]];
+      area += 0.5f * cross(p1 - p0, p2 - p0).z;
+    }
+    assert(std::abs(area - float(n * n)) < 1e-3f);
+
+    // Closed sphere, halving the triangle count must keep it closed.
+    const uint32_t rings = 24;
+    const uint32_t segments = 48;
+    Vector<Vec3f> sphereVtx;
+    Vector<uint32_t> sphereIdx;
+    sphereVtx.pushBack(Vec3f(0.f, 0.f, 1.f));
+    for (uint32_t j = 1; j < rings; j++) {
+      auto theta = 3.14159265f * j / rings;
+      for (uint32_t i = 0; i < segments; i++) {
+        auto phi = 2.f * 3.14159265f * i / segments;
+        sphereVtx.pushBack(Vec3f(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)));
+      }
+    }
+    sphereVtx.pushBack(Vec3f(0.f, 0.f, -1.f));
+    auto south = sphereVtx.size32() - 1;
+    for (uint32_t i = 0; i < segments; i++) {
+      auto i1 = (i + 1) % segments;
+      uint32_t top[3] = { 0, 1 + i, 1 + i1 };
+      for (auto ix : top) sphereIdx.pushBack(ix);
+      for (uint32_t j = 1; j + 1 < rings; j++) {
+        auto a = 1 + segments * (j - 1);
+        auto b = a + segments;
+        uint32_t quad[6] = { a + i, b + i, b + i1, a + i, b + i1, a + i1 };
+        for (auto ix : quad) sphereIdx.pushBack(ix);
+      }
+      auto a = 1 + segments * (rings - 2);
+      uint32_t bottom[3] = { a + i, south, a + i1 };
+      for (auto ix : bottom) sphereIdx.pushBack(ix);
+    }
+    Mesh sphere;
+    sphere.vtx = sphereVtx.data();
+    sphere.vtxCount = sphereVtx.size32();
+    sphere.triVtxIx = sphereIdx.data();
+    sphere.triCount = sphereIdx.size32() / 3;
+
+    options = SimplifyOptions();
+    options.targetTriangleCount = sphere.triCount / 2;
+    simplifyMesh(logger, simplified, &sphere, options);
+    auto T = simplified.triSource.size32();
+    assert(T <= options.targetTriangleCount && options.targetTriangleCount - 2 <= T);
+    assert(simplified.error < 0.05f);
+    {
+      Map edges;
+      for (uint32_t t = 0; t < T; t++) {
+        for (uint32_t k = 0; k < 3; k++) {
+          auto a = sphereIdx[simplified.corners[3 * t + k]];
+          auto b = sphereIdx[simplified.corners[3 * t + (k + 1) % 3]];
+          assert(a != b);
+          auto key = (uint64_t(a) << 32) | (b + 1);
+          assert(edges.get(key) == 0);
+          edges.insert(key, 1);
+        }
+      }
+      for (uint32_t t = 0; t < T; t++) {
+        for (uint32_t k = 0; k < 3; k++) {
+          auto a = sphereIdx[simplified.corners[3 * t + k]];
+          auto b = sphereIdx[simplified.corners[3 * t + (k + 1) % 3]];
+          assert(edges.get((uint64_t(b) << 32) | (a + 1)) == 1);
+        }
+      }
+    }
+
+    // Loaded model with normal seams and several objects.
+    options = SimplifyOptions();
+    options.targetTriangleCount = mesh->triCount / 2;
+    simplifyMesh(logger, simplified, mesh, options);
+    for (uint32_t t = 0; t < simplified.triSource.size32(); t++) {
+      auto * c = simplified.corners.data() + 3 * t;
+      assert(mesh->triVtxIx[c[0]] != mesh->triVtxIx[c[1]] && mesh->triVtxIx[c[0]] != mesh->triVtxIx[c[2]] && mesh->triVtxIx[c[1]] != mesh->triVtxIx[c[2]]);
+    }
+
+    logger(0, "Mesh simplification checks... OK");
+  }
+
+  {
+    logger(0, "LOD checks...");
+
+    float ratios[] = { 0.5f, 0.25f, 0.125f };
+    buildMeshLods(logger, mesh, ratios, ARRAYSIZE(ratios));
+    assert(2 <= mesh->lodLevelCount);
+    assert(mesh->lodLevels[0].triCount == mesh->triCount && mesh->lodLevels[0].error == 0.f);
+    for (uint32_t l = 1; l < mesh->lodLevelCount; l++) {
+      auto & level = mesh->lodLevels[l];
+      assert(level.triCount < mesh->lodLevels[l - 1].triCount);
+      assert(mesh->lodLevels[l - 1].error <= level.error);
+      for (uint32_t t = 0; t < level.triCount; t++) assert(level.sourceTriangle(t) < mesh->triCount);
+    }
+
+    auto b = 1.f / std::tan(0.5f);
+    auto n = 0.01f;
+    auto f = 1000.f;
+    Mat4f P(b, 0.f, 0.f, 0.f,
+            0.f, b, 0.f, 0.f,
+            0.f, 0.f, (f + n) / (n - f), (2 * f * n) / (n - f),
+            0.f, 0.f, -1.f, 0.f);
+    auto center = 0.5f * (mesh->bbox.min + mesh->bbox.max);
+    auto radius = 0.5f * diagonal(mesh->bbox);
+
+    uint32_t prevLevel = 0;
+    for (float d = 0.5f * radius; d < 1e5f * radius; d *= 2.f) {
+      auto M = translationMatrix(Vec3f(-center.x, -center.y, -center.z - d));
+      auto level = selectLodLevel(mesh, P, M, 1000.f, 1.f);
+      assert(prevLevel <= level);
+      if (d < radius) assert(level == 0);
+      prevLevel = level;
+    }
+    assert(prevLevel == mesh->lodLevelCount - 1);
+
+    logger(0, "LOD checks... OK");
+  }
+
+  {
+    logger(0, "Bounding sphere checks...");
+
+    // Brute force minimal sphere over all candidate supports of a few points.
+    auto contains = [](const Vec3f& c, float r, const Vec3f* P, uint32_t N)
+    {
+      for (uint32_t i = 0; i < N; i++) if (r * (1.f + 1e-5f) + 1e-6f < distance(c, P[i])) return false;
+      return true;
+    };
+
+    // Circumcircle of p0, p1, p2, or the circumsphere when p3 is given, in double
+    // precision. False when the points are degenerate.
+    auto supportSphere = [](Vec3f& c, float& r, const Vec3f& p0, const Vec3f& p1, const Vec3f& p2, const Vec3f* p3)
+    {
+      auto sub = [](const Vec3f& a, const Vec3f& b) { return std::array<double, 3>{ double(a.x) - b.x, double(a.y) - b.y, double(a.z) - b.z }; };
+      auto crs = [](const std::array<double, 3>& a, const std::array<double, 3>& b) { return std::array<double, 3>{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] }; };
+      auto dt = [](const std::array<double, 3>& a, const std::array<double, 3>& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+      auto u = sub(p1, p0);
+      auto v = sub(p2, p0);
+      std::array<double, 3> o;
+      if (p3) {
+        auto t = sub(*p3, p0);
+        auto vt = crs(v, t), tu = crs(t, u), uv = crs(u, v);
+        auto det = 2.0 * dt(u, vt);
+        if (std::abs(det) < 1e-12) return false;
+        for (unsigned k = 0; k < 3; k++) o[k] = (dt(u, u) * vt[k] + dt(v, v) * tu[k] + dt(t, t) * uv[k]) / det;
+      }
+      else {
+        auto w = crs(u, v);
+        auto w2 = dt(w, w);
+        if (w2 < 1e-20) return false;
+        auto vw = crs(v, w), wu = crs(w, u);
+        for (unsigned k = 0; k < 3; k++) o[k] = (dt(u, u) * vw[k] + dt(v, v) * wu[k]) / (2.0 * w2);
+      }
+      c = Vec3f(float(p0.x + o[0]), float(p0.y + o[1]), float(p0.z + o[2]));
+      r = float(std::sqrt(dt(o, o)));
+      return true;
+    };
+
+    srand(5);
+    auto random = []() { return float(rand()) / RAND_MAX; };
+    for (uint32_t N : { 1u, 2u, 3u, 4u, 5u, 8u, 12u }) {
+      for (uint32_t iter = 0; iter < 20; iter++) {
+        Vector<Vec3f> P(N);
+        for (auto & p : P) p = Vec3f(random(), random(), 0.2f * random());
+        Vec3f c; float r;
+        boundingSphereExact(c, r, P.data(), N);
+        assert(contains(c, r, P.data(), N));
+
+        // No sphere with two, three or four of the points on its boundary that
+        // contains them all is smaller.
+        float best = FLT_MAX;
+        for (uint32_t a = 0; a < N; a++) {
+          for (uint32_t b = a; b < N; b++) {
+            Vec3f q[2] = { P[a], P[b] };
+            Vec3f cc; float rr;
+            boundingSphereExact(cc, rr, q, 2);
+            if (contains(cc, rr, P.data(), N)) best = std::min(best, rr);
+
+            for (uint32_t d = b + 1; a < b && d < N; d++) {
+              if (supportSphere(cc, rr, P[a], P[b], P[d], nullptr) && contains(cc, rr, P.data(), N)) best = std::min(best, rr);
+              for (uint32_t e = d + 1; e < N; e++) {
+                if (supportSphere(cc, rr, P[a], P[b], P[d], &P[e]) && contains(cc, rr, P.data(), N)) best = std::min(best, rr);
+              }
+            }
+          }
+        }
+        assert(r <= best * 1.0001f + 1e-6f);
+      }
+    }
+
+    // Cocircular and nearly coplanar points make the circumsphere degenerate,
+    // the result must still be a finite sphere around the circle.
+    for (uint32_t N : { 4u, 5u, 16u, 64u }) {
+      for (float jitter : { 0.f, 1e-7f, 1e-5f }) {
+        Vector<Vec3f> P(N);
+        for (uint32_t i = 0; i < N; i++) {
+          auto t = 6.2831853f * float(i) / float(N);
+          P[i] = Vec3f(1.f + 3.f * std::cos(t), -2.f + 3.f * std::sin(t), 0.5f + jitter * (random() - 0.5f));
+        }
+        Vec3f c; float r;
+        boundingSphereExact(c, r, P.data(), N);
+        assert(std::isfinite(r) && std::isfinite(c.x) && std::isfinite(c.y) && std::isfinite(c.z));
+        assert(contains(c, r, P.data(), N));
+        assert(r <= 3.f * 1.0001f + jitter);
+      }
+    }
+
+    // Meshlet-sized and large clouds: exact <= Ritter, AVX2 matches Ritter.
+#ifdef NDEBUG
+    const uint32_t rounds = 10000;
+#else
+    const uint32_t rounds = 100;
+#endif
+    for (uint32_t N : { 64u, 100000u }) {
+      Vector<Vec3f> P(N);
+      float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+      double ms[4] = { 0.0, 0.0, 0.0, 0.0 };
+      auto R = N < 1000 ? rounds : 10;
+      for (uint32_t round = 0; round < R; round++) {
+        for (auto & p : P) {
+          // Points on an ellipsoid surface.
+          Vec3f d(random() - 0.5f, random() - 0.5f, random() - 0.5f);
+          d = (1.f / std::max(1e-6f, length(d))) * d;
+          p = Vec3f(2.f * d.x, d.y, 0.5f * d.z);
+        }
+        Vec3f c[4]; float r[4];
+        auto time = [&](uint32_t k, void(*func)(Vec3f&, float&, const Vec3f*, size_t))
+        {
+          auto start = std::chrono::high_resolution_clock::now();
+          func(c[k], r[k], P.data(), N);
+          auto stop = std::chrono::high_resolution_clock::now();
+          ms[k] += std::chrono::duration<double, std::milli>(stop - start).count();
+          sum[k] += r[k];
+          assert(contains(c[k], r[k], P.data(), N));
+        };
+        time(0, boundingSphereNaive);
+        time(1, boundingSphere);
+        time(2, boundingSphereExact);
+        if (cpuSupportsAVX2()) {
+          time(3, boundingSphereAVX2);
+          assert(std::abs(r[3] - r[1]) <= 1e-5f * r[1]);
+        }
+        assert(r[2] <= r[1] * 1.0001f && r[2] <= r[0] * 1.0001f);
+      }
+      logger(0, "N=%d x %d: naive r=%.3f %.2fms, Ritter r=%.3f %.2fms, exact r=%.3f %.2fms, Ritter AVX2 r=%.3f %.2fms",
+             N, R, sum[0] / R, ms[0], sum[1] / R, ms[1], sum[2] / R, ms[2], sum[3] / R, ms[3]);
+    }
+
+    logger(0, "Bounding sphere checks... OK");
+  }
+
+  {
+    logger(0, "Bounding box checks...");
+    Tasks tasks;
+
+    srand(6);
+    auto random = []() { return float(rand()) / RAND_MAX; };
+
+    // SIMD boxes match engulf, directly and through indices, alone and in batches.
+    Vector<Vec3f> P(1000);
+    for (auto & p : P) p = Vec3f(random() - 0.3f, 2.f * random(), -random());
+    Vector<uint32_t> indices(3000);
+    for (auto & ix : indices) ix = rand() % P.size32();
+    Vector<uint32_t> offsets;
+    for (uint32_t o : { 0u, 0u, 1u, 2u, 5u, 64u, 999u, 1000u }) offsets.pushBack(o);
+    Vector<BBox3f> direct(offsets.size32() - 1);
+    Vector<BBox3f> indexed(offsets.size32() - 1);
+    boundingBoxes(&tasks, direct.data(), P.data(), nullptr, offsets.data(), direct.size32());
+    boundingBoxes(&tasks, indexed.data(), P.data(), indices.data(), offsets.data(), indexed.size32());
+    for (uint32_t i = 0; i + 1 < offsets.size32(); i++) {
+      BBox3f a = createEmptyBBox3f();
+      BBox3f b = createEmptyBBox3f();
+      for (uint32_t k = offsets[i]; k < offsets[i + 1]; k++) {
+        engulf(a, P[k]);
+        engulf(b, P[indices[k]]);
+      }
+      assert(lengthSquared(direct[i].min - a.min) == 0.f && lengthSquared(direct[i].max - a.max) == 0.f);
+      assert(lengthSquared(indexed[i].min - b.min) == 0.f && lengthSquared(indexed[i].max - b.max) == 0.f);
+    }
+    assert(isEmpty(boundingBox(P.data(), nullptr, 0)));
+
+    auto contains = [](const OBB3f& box, const Vec3f* P, uint32_t N)
+    {
+      float tol = 1e-4f * (1.f + length(box.halfSize));
+      for (unsigned k = 0; k < 3; k++) {
+        for (unsigned l = 0; l < 3; l++) {
+          if (1e-4f < std::abs(dot(box.axis[k], box.axis[l]) - (k == l ? 1.f : 0.f))) return false;
+        }
+      }
+      for (uint32_t i = 0; i < N; i++) {
+        auto d = P[i] - box.center;
+        if (box.halfSize.x + tol < std::abs(dot(d, box.axis[0])) ||
+            box.halfSize.y + tol < std::abs(dot(d, box.axis[1])) ||
+            box.halfSize.z + tol < std::abs(dot(d, box.axis[2]))) return false;
+      }
+      return true;
+    };
+
+    // Points inside a rotated box including its corners: DiTO should recover it.
+    for (uint32_t iter = 0; iter < 20; iter++) {
+      Vec3f u = normalize(Vec3f(random() - 0.5f, random() - 0.5f, random() - 0.5f));
+      Vec3f v = normalize(cross(u, Vec3f(random() - 0.5f, random() - 0.5f, random() - 0.5f)));
+      Vec3f w = cross(u, v);
+      Vec3f h(4.f, 1.f, 0.25f);
+      Vec3f t(10.f * random(), 10.f * random(), 10.f * random());
+      Vector<Vec3f> Q(500);
+      for (uint32_t i = 0; i < Q.size32(); i++) {
+        Vec3f r = i < 8 ? Vec3f(i & 1 ? -1.f : 1.f, i & 2 ? -1.f : 1.f, i & 4 ? -1.f : 1.f)
+                        : Vec3f(2.f * random() - 1.f, 2.f * random() - 1.f, 2.f * random() - 1.f);
+        Q[i] = t + (h.x * r.x) * u + (h.y * r.y) * v + (h.z * r.z) * w;
+      }
+      OBB3f dito;
+      orientedBoundingBox(dito, Q.data(), Q.size());
+      assert(contains(dito, Q.data(), Q.size32()));
+      assert(volume(dito) <= 1.05f * 8.f * h.x * h.y * h.z);
+
+      auto aabb = boundingBox(Q.data(), nullptr, Q.size());
+      auto e = aabb.max - aabb.min;
+      assert(volume(dito) <= 1.0001f * e.x * e.y * e.z);
+    }
+
+    // Degenerate input: a point, a line and a plane.
+    for (uint32_t N : { 1u, 5u, 50u }) {
+      for (unsigned dim = 0; dim < 3; dim++) {
+        Vector<Vec3f> Q(N);
+        for (auto & q : Q) {
+          float a = random(), b = random();
+          q = Vec3f(1.f, 2.f, 3.f) + (dim > 0 ? a : 0.f) * Vec3f(1.f, 1.f, 0.f) + (dim > 1 ? b : 0.f) * Vec3f(0.f, -1.f, 1.f);
+        }
+        OBB3f dito;
+        orientedBoundingBox(dito, Q.data(), N);
+        assert(!isEmpty(dito) && contains(dito, Q.data(), N));
+      }
+    }
+    OBB3f empty;
+    orientedBoundingBox(empty, P.data(), 0);
+    assert(isEmpty(empty));
+
+    logger(0, "Bounding box checks... OK");
+  }
+
+  {
+    logger(0, "BVH picking checks...");
+
+    srand(8);
+    auto random = []() { return float(rand()) / RAND_MAX; };
+
+    // Small random triangles in [-0.5,0.5]^3.
+    const uint32_t triCount = 2000;
+    Vector<Vec3f> vtx(3 * triCount);
+    Vector<uint32_t> triVtxIx(3 * triCount);
+    for (uint32_t i = 0; i < triCount; i++) {
+      Vec3f c(random() - 0.5f, random() - 0.5f, random() - 0.5f);
+      for (unsigned k = 0; k < 3; k++) {
+        vtx[3 * i + k] = c + Vec3f(0.1f * random() - 0.05f, 0.1f * random() - 0.05f, 0.1f * random() - 0.05f);
+        triVtxIx[3 * i + k] = 3 * i + k;
+      }
+    }
+
+    BVH bvh;
+    buildTriangleBVH(logger, nullptr, bvh, vtx.data(), triVtxIx.data(), triCount);
+    for (auto & node : bvh.nodes) {
+      if (node.count == 0) continue;
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        for (unsigned k = 0; k < 3; k++) {
+          auto & p = vtx[triVtxIx[3 * bvh.primitives[i] + k]];
+          assert(node.bbox.min.x <= p.x && node.bbox.min.y <= p.y && node.bbox.min.z <= p.z);
+          assert(p.x <= node.bbox.max.x && p.y <= node.bbox.max.y && p.z <= node.bbox.max.z);
+        }
+      }
+    }
+
+    // Nearest hit matches brute force.
+    uint32_t hits = 0;
+    for (uint32_t iter = 0; iter < 1000; iter++) {
+      Vec3f origin(2.f * random() - 1.f, 2.f * random() - 1.f, 2.f * random() - 1.f);
+      Vec3f direction = Vec3f(random() - 0.5f, random() - 0.5f, random() - 0.5f) - origin;
+      float tMax = iter & 1 ? 1.f : FLT_MAX;
+
+      float bestT = tMax;
+      bool bestFound = false;
+      for (uint32_t i = 0; i < triCount; i++) {
+        float t, u, v;
+        if (intersectTriangle(t, u, v, origin, direction, vtx[3 * i + 0], vtx[3 * i + 1], vtx[3 * i + 2]) && 0.f <= t && t <= bestT) {
+          bestT = t;
+          bestFound = true;
+        }
+      }
+      RayHit hit;
+      bool found = intersectTriangles(hit, bvh, vtx.data(), triVtxIx.data(), origin, direction, tMax);
+      assert(found == bestFound);
+      if (found) {
+        assert(hit.t == bestT);
+        auto & p0 = vtx[3 * hit.triangle + 0];
+        auto & p1 = vtx[3 * hit.triangle + 1];
+        auto & p2 = vtx[3 * hit.triangle + 2];
+        auto p = p0 + hit.u * (p1 - p0) + hit.v * (p2 - p0);
+        assert(distance(p, origin + hit.t * direction) < 1e-4f);
+        hits++;
+      }
+    }
+    assert(hits);
+
+    // Picking through an identity projection hits the nearest triangle under the cursor, and
+    // the BVH is rebuilt after the geometry changes.
+    Vec3f quad[4] = { Vec3f(-1.f, -1.f, 0.5f), Vec3f(1.f, -1.f, 0.5f), Vec3f(1.f, 1.f, 0.5f), Vec3f(-1.f, 1.f, 0.5f) };
+    uint32_t quadIx[12] = { 0, 1, 2, 0, 2, 3, 0, 1, 2, 0, 2, 3 };
+    Vec3f quadVtx[8];
+    for (unsigned k = 0; k < 4; k++) {
+      quadVtx[k] = quad[k];
+      quadVtx[4 + k] = quad[k] - Vec3f(0.f, 0.f, 1.f);
+    }
+    for (unsigned k = 6; k < 12; k++) quadIx[k] += 4;
+
+    Mesh mesh;
+    mesh.vtx = quadVtx;
+    mesh.vtxCount = 8;
+    mesh.triVtxIx = quadIx;
+    mesh.triCount = 4;
+    mesh.bbox = boundingBox(quadVtx, nullptr, 8);
+    orientedBoundingBox(mesh.obb, quadVtx, 8);
+    Vector<Mesh*> meshes;
+    meshes.pushBack(&mesh);
+
+    HitTmp tmp;
+    Hit hit;
+    auto I = createIdentityMat4f();
+    Vec2f viewPortPos(0.f);
+    Vec2f viewPortSize(100.f);
+    bool found = nearestHit(hit, tmp, logger, nullptr, meshes, I, I, viewPortPos, viewPortSize, Vec2f(75.f, 25.f));
+    assert(found && hit.mesh == 0 && 2 <= hit.triangle && std::abs(hit.depth + 0.5f) < 1e-5f);
+    assert(!nearestHit(hit, tmp, logger, nullptr, meshes, I, I, viewPortPos, viewPortSize, Vec2f(-10.f, 50.f)));
+
+    for (unsigned k = 4; k < 8; k++) quadVtx[k].z += 2.f;
+    mesh.bbox = boundingBox(quadVtx, nullptr, 8);
+    orientedBoundingBox(mesh.obb, quadVtx, 8);
+    mesh.touchGeometry();
+    found = nearestHit(hit, tmp, logger, nullptr, meshes, I, I, viewPortPos, viewPortSize, Vec2f(75.f, 25.f));
+    assert(found && hit.triangle < 2 && std::abs(hit.depth - 0.5f) < 1e-5f);
+
+    // A triangle crossing the near and far planes is hit where the ray is between them.
+    Vec3f slanted[3] = { Vec3f(0.f, 0.f, -2.5f), Vec3f(2.f, 0.f, 1.5f), Vec3f(0.f, 2.f, 1.5f) };
+    uint32_t slantedIx[3] = { 0, 1, 2 };
+    mesh.vtx = slanted;
+    mesh.vtxCount = 3;
+    mesh.triVtxIx = slantedIx;
+    mesh.triCount = 1;
+    mesh.bbox = boundingBox(slanted, nullptr, 3);
+    orientedBoundingBox(mesh.obb, slanted, 3);
+    mesh.touchGeometry();
+    found = nearestHit(hit, tmp, logger, nullptr, meshes, I, I, viewPortPos, viewPortSize, Vec2f(75.f, 25.f));
+    assert(found && hit.triangle == 0 && std::abs(hit.depth + 0.5f) < 1e-5f);
+
+    // Rays from inside a closed box surface, aimed at the shared vertices of its grid, never slip
+    // through, neither in the BVH traversal nor in the single triangle test. The box sits away
+    // from the origin. Moller-Trumbore misses about one ray in twelve here.
+    const uint32_t S = 4;
+    const float offset = 1000.f;
+    auto gridPoint = [&](uint32_t face, uint32_t i, uint32_t j)
+    {
+      float a = -1.f + 2.f * i / S;
+      float b = -1.f + 2.f * j / S;
+      Vec3f p;
+      switch (face) {
+      case 0: p = Vec3f(1.f, a, b); break;
+      case 1: p = Vec3f(-1.f, b, a); break;
+      case 2: p = Vec3f(b, 1.f, a); break;
+      case 3: p = Vec3f(a, -1.f, b); break;
+      case 4: p = Vec3f(a, b, 1.f); break;
+      default: p = Vec3f(b, a, -1.f); break;
+      }
+      return Vec3f(offset, offset, offset) + 0.37f * p;
+    };
+    Vector<Vec3f> boxVtx;
+    Vector<uint32_t> boxIx;
+    for (uint32_t face = 0; face < 6; face++) {
+      for (uint32_t j = 0; j < S; j++) {
+        for (uint32_t i = 0; i < S; i++) {
+          Vec3f quad[6] = { gridPoint(face, i, j), gridPoint(face, i + 1, j), gridPoint(face, i + 1, j + 1),
+                            gridPoint(face, i, j), gridPoint(face, i + 1, j + 1), gridPoint(face, i, j + 1) };
+          for (auto & p : quad) {
+            boxIx.pushBack(boxVtx.size32());
+            boxVtx.pushBack(p);
+          }
+        }
+      }
+    }
+    uint32_t boxTriCount = boxIx.size32() / 3;
+    BVH boxBVH;
+    buildTriangleBVH(logger, nullptr, boxBVH, boxVtx.data(), boxIx.data(), boxTriCount);
+    for (uint32_t iter = 0; iter < 2000; iter++) {
+      Vec3f origin = Vec3f(offset, offset, offset) + Vec3f(0.01f * (random() - 0.5f), 0.01f * (random() - 0.5f), 0.f);
+      Vec3f direction = gridPoint(rand() % 6, rand() % (S + 1), rand() % (S + 1)) - origin;
+      RayHit rayHit;
+      assert(intersectTriangles(rayHit, boxBVH, boxVtx.data(), boxIx.data(), origin, direction));
+
+      bool anyHit = false;
+      for (uint32_t t = 0; t < boxTriCount && !anyHit; t++) {
+        float tt, u, v;
+        anyHit = intersectTriangle(tt, u, v, origin, direction, boxVtx[boxIx[3 * t + 0]], boxVtx[boxIx[3 * t + 1]], boxVtx[boxIx[3 * t + 2]]) && 0.f <= tt;
+      }
+      assert(anyHit);
+    }
+
+    logger(0, "BVH picking checks... OK");
+  }
+
+  {
+    logger(0, "Rectangle selection checks...");
+    Tasks tasks;
+    tasks.init(logger);
+
+    // A grid of small quads in the z=0 plane, one object each, seen through an identity projection
+    // so that normalized device coordinates are world coordinates. The two triangles of a quad
+    // are far apart in triangle order.
+#ifdef NDEBUG
+    const uint32_t G = 400;
+#else
+    const uint32_t G = 60;
+#endif
+    const float cell = 2.f / G;
+    Vector<Vec3f> vtx;
+    Vector<uint32_t> triVtxIx;
+    Vector<uint32_t> triObjIx;
+    for (unsigned half = 0; half < 2; half++) {
+      for (uint32_t j = 0; j < G; j++) {
+        for (uint32_t i = 0; i < G; i++) {
+          float x0 = -1.f + cell * (i + 0.1f);
+          float y0 = -1.f + cell * (j + 0.1f);
+          float x1 = x0 + 0.8f * cell;
+          float y1 = y0 + 0.8f * cell;
+          auto o = vtx.size32();
+          if (half == 0) {
+            vtx.pushBack(Vec3f(x0, y0, 0.f)); vtx.pushBack(Vec3f(x1, y0, 0.f)); vtx.pushBack(Vec3f(x1, y1, 0.f));
+          }
+          else {
+            vtx.pushBack(Vec3f(x0, y0, 0.f)); vtx.pushBack(Vec3f(x1, y1, 0.f)); vtx.pushBack(Vec3f(x0, y1, 0.f));
+          }
+          for (unsigned k = 0; k < 3; k++) triVtxIx.pushBack(o + k);
+          triObjIx.pushBack(G * j + i);
+        }
+      }
+    }
+    // Two large triangles whose boxes overlap the selection, the first misses it by its diagonal.
+    Vec3f diagonals[6] = { Vec3f(-0.9f, 0.3f, 0.f), Vec3f(-0.3f, 0.9f, 0.f), Vec3f(-0.9f, 0.9f, 0.f),
+                           Vec3f(-0.9f, 0.0f, 0.f), Vec3f(-0.0f, 0.9f, 0.f), Vec3f(-0.9f, 0.9f, 0.f) };
+    for (unsigned k = 0; k < 6; k++) {
+      triVtxIx.pushBack(vtx.size32());
+      vtx.pushBack(diagonals[k]);
+    }
+    triObjIx.pushBack(G * G);
+    triObjIx.pushBack(G * G + 1);
+
+    Mesh mesh;
+    mesh.vtx = vtx.data();
+    mesh.vtxCount = vtx.size32();
+    mesh.triVtxIx = triVtxIx.data();
+    mesh.TriObjIx = triObjIx.data();
+    mesh.triCount = triObjIx.size32();
+    mesh.obj_n = G * G + 2;
+    mesh.bbox = boundingBox(mesh.vtx, nullptr, mesh.vtxCount);
+    Vector<Mesh*> meshes;
+    meshes.pushBack(&mesh);
+
+    // Screen rectangle from (25,25) to (50,50) is x in [-0.5,0] and y in [0,0.5].
+    auto I = createIdentityMat4f();
+    Vec2f viewPortPos(0.f);
+    Vec2f viewPortSize(100.f);
+    HitTmp tmp;
+    Vector<ObjectHit> hits;
+    auto start = std::chrono::high_resolution_clock::now();
+    objectsInRectangle(hits, tmp, logger, &tasks, meshes, I, viewPortPos, viewPortSize, Vec2f(50.f, 25.f), Vec2f(25.f, 50.f));
+    auto stop = std::chrono::high_resolution_clock::now();
+    logger(0, "Selected %u of %u objects in %.1fms", hits.size32(), mesh.obj_n,
+           std::chrono::duration<double, std::milli>(stop - start).count());
+
+    Vector<uint8_t> expected(mesh.obj_n, 0);
+    for (uint32_t j = 0; j < G; j++) {
+      for (uint32_t i = 0; i < G; i++) {
+        float x0 = -1.f + cell * (i + 0.1f);
+        float y0 = -1.f + cell * (j + 0.1f);
+        float x1 = x0 + 0.8f * cell;
+        float y1 = y0 + 0.8f * cell;
+        expected[G * j + i] = (x0 <= 0.f && -0.5f <= x1 && y0 <= 0.5f && 0.f <= y1) ? 1 : 0;
+      }
+    }
+    expected[G * G + 1] = 1;
+    uint32_t expectedCount = 0;
+    for (auto e : expected) expectedCount += e;
+    assert(hits.size32() == expectedCount);
+    for (auto & hit : hits) assert(hit.mesh == 0 && expected[hit.object]);
+
+    // Object grouping is a stable permutation of the triangles, and selection bounds come from object bounds.
+    const auto & objects = getMeshObjects(tmp, logger, &tasks, &mesh);
+    assert(objects.objectCount() == mesh.obj_n && objects.triangles.size32() == mesh.triCount);
+    for (uint32_t o = 0; o < objects.objectCount(); o++) {
+      for (uint32_t i = objects.offsets[o]; i < objects.offsets[o + 1]; i++) {
+        assert(mesh.TriObjIx[objects.triangles[i]] == o);
+        assert(i == objects.offsets[o] || objects.triangles[i - 1] < objects.triangles[i]);
+      }
+    }
+    Selection selected;
+    selected.resize(mesh.obj_n);
+    selected.set(0, true);
+    selected.set(G * G + 1, true);
+    auto selectionBox = selectedBounds(objects, selected);
+    auto expectedBox = boundingBox(mesh.vtx, nullptr, 3);
+    engulf(expectedBox, boundingBox(mesh.vtx + 3 * G * G, nullptr, 3));
+    engulf(expectedBox, boundingBox(mesh.vtx + vtx.size() - 3, nullptr, 3));
+    for (unsigned k = 0; k < 3; k++) assert(selectionBox.min[k] == expectedBox.min[k] && selectionBox.max[k] == expectedBox.max[k]);
+
+    Vector<ObjectHit> serialHits;
+    objectsInRectangle(serialHits, tmp, logger, nullptr, meshes, I, viewPortPos, viewPortSize, Vec2f(25.f, 25.f), Vec2f(50.f, 50.f));
+    assert(serialHits.size32() == hits.size32());
+    for (uint32_t i = 0; i < hits.size32(); i++) assert(serialHits[i].object == hits[i].object);
+
+    // Everything inside, and nothing outside.
+    objectsInRectangle(hits, tmp, logger, &tasks, meshes, I, viewPortPos, viewPortSize, Vec2f(-1.f), Vec2f(101.f));
+    assert(hits.size32() == mesh.obj_n);
+    objectsInRectangle(hits, tmp, logger, &tasks, meshes, I, viewPortPos, viewPortSize, Vec2f(101.f), Vec2f(120.f));
+    assert(hits.empty());
+
+    // Moved geometry is picked up.
+    for (auto & p : vtx) p.z += 5.f;
+    mesh.bbox = boundingBox(mesh.vtx, nullptr, mesh.vtxCount);
+    mesh.touchGeometry();
+    objectsInRectangle(hits, tmp, logger, &tasks, meshes, I, viewPortPos, viewPortSize, Vec2f(-1.f), Vec2f(101.f));
+    assert(hits.empty());
+
+    logger(0, "Rectangle selection checks... OK");
+  }
+
+  {
+    logger(0, "BVH build checks...");
+    Tasks tasks;
+    tasks.init(logger);
+
+    srand(9);
+    auto random = []() { return float(rand()) / RAND_MAX; };
+
+    // Triangles on a few noisy spheres of different sizes, which gives SAH something to do.
+#ifdef NDEBUG
+    const uint32_t triCount = 1000000;
+#else
+    const uint32_t triCount = 50000;
+#endif
+    Vector<Vec3f> vtx(3 * triCount);
+    Vector<uint32_t> triVtxIx(3 * triCount);
+    for (uint32_t i = 0; i < triCount; i++) {
+      float radius = 0.05f + 0.3f * float(i % 5);
+      Vec3f center(float(i % 5), 0.f, 0.f);
+      Vec3f d = normalize(Vec3f(random() - 0.5f, random() - 0.5f, random() - 0.5f) + Vec3f(1e-6f));
+      float size = 0.05f * radius;
+      for (unsigned k = 0; k < 3; k++) {
+        vtx[3 * i + k] = center + radius * d + Vec3f(size * random(), size * random(), size * random());
+        triVtxIx[3 * i + k] = 3 * i + k;
+      }
+    }
+
+    // Every triangle in exactly one leaf, and every box inside its parent.
+    auto validate = [&](const BVH& bvh)
+    {
+      Vector<uint32_t> seen(triCount, 0);
+      uint32_t leaves = 0;
+      for (auto & node : bvh.nodes) {
+        if (node.count) {
+          leaves++;
+          for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            assert(seen[bvh.primitives[i]]++ == 0);
+            for (unsigned k = 0; k < 3; k++) {
+              auto & p = vtx[triVtxIx[3 * bvh.primitives[i] + k]];
+              assert(node.bbox.min.x <= p.x && node.bbox.min.y <= p.y && node.bbox.min.z <= p.z);
+              assert(p.x <= node.bbox.max.x && p.y <= node.bbox.max.y && p.z <= node.bbox.max.z);
+            }
+          }
+        }
+        else {
+          for (unsigned c = 0; c < 2; c++) {
+            auto & child = bvh.nodes[node.first + c].bbox;
+            assert(node.bbox.min.x <= child.min.x && node.bbox.min.y <= child.min.y && node.bbox.min.z <= child.min.z);
+            assert(child.max.x <= node.bbox.max.x && child.max.y <= node.bbox.max.y && child.max.z <= node.bbox.max.z);
+          }
+        }
+      }
+      for (auto n : seen) assert(n == 1);
+      assert(2 * leaves == bvh.nodes.size32() + 1);
+    };
+
+    BVH median, sah, sahParallel;
+    buildTriangleBVH(logger, nullptr, median, vtx.data(), triVtxIx.data(), triCount, BVHBuild::Median);
+    buildTriangleBVH(logger, nullptr, sah, vtx.data(), triVtxIx.data(), triCount);
+    buildTriangleBVH(logger, &tasks, sahParallel, vtx.data(), triVtxIx.data(), triCount);
+    validate(median);
+    validate(sah);
+    validate(sahParallel);
+    assert(getSAHCost(sah) < getSAHCost(median));
+    assert(std::abs(getSAHCost(sah) - getSAHCost(sahParallel)) <= 1e-3f * getSAHCost(sah));
+
+    // Binary, 4-wide and 8-wide traversal agree with each other.
+    BVH4 sah4;
+    BVH8 sah8;
+    collapseBVH(sah4, sahParallel);
+    collapseBVH(sah8, sahParallel);
+    logger(0, "Collapsed %u binary nodes into %u 4-wide and %u 8-wide nodes",
+           sahParallel.nodes.size32(), sah4.nodes.size32(), sah8.nodes.size32());
+
+    const uint32_t rayCount = 10000;
+    Vector<Vec3f> origins(rayCount);
+    Vector<Vec3f> directions(rayCount);
+    for (uint32_t i = 0; i < rayCount; i++) {
+      origins[i] = Vec3f(6.f * random() - 1.f, 3.f * random() - 1.5f, 3.f * random() - 1.5f);
+      directions[i] = Vec3f(6.f * random() - 1.f, 2.f * random() - 1.f, 2.f * random() - 1.f) - origins[i];
+      if (i % 7 == 0) directions[i].y = 0.f;
+    }
+    uint32_t hits[4] = { 0, 0, 0, 0 };
+    double ms[4] = { 0.0, 0.0, 0.0, 0.0 };
+    Vector<RayHit> reference(rayCount);
+    Vector<uint8_t> referenceFound(rayCount);
+    for (unsigned k = 0; k < 4; k++) {
+      auto start = std::chrono::high_resolution_clock::now();
+      for (uint32_t i = 0; i < rayCount; i++) {
+        RayHit hit;
+        bool found = false;
+        switch (k) {
+        case 0: found = intersectTriangles(hit, median, vtx.data(), triVtxIx.data(), origins[i], directions[i]); break;
+        case 1: found = intersectTriangles(hit, sahParallel, vtx.data(), triVtxIx.data(), origins[i], directions[i]); break;
+        case 2: found = intersectTriangles(hit, sah4, vtx.data(), triVtxIx.data(), origins[i], directions[i]); break;
+        case 3: found = intersectTriangles(hit, sah8, vtx.data(), triVtxIx.data(), origins[i], directions[i]); break;
+        }
+        if (k == 0) {
+          reference[i] = hit;
+          referenceFound[i] = found ? 1 : 0;
+        }
+        else {
+          assert(found == (referenceFound[i] != 0));
+          assert(!found || hit.t == reference[i].t);
+        }
+        hits[k] += found ? 1 : 0;
+      }
+      auto stop = std::chrono::high_resolution_clock::now();
+      ms[k] = std::chrono::duration<double, std::milli>(stop - start).count();
+    }
+    logger(0, "%u rays, %u hits: median %.1fms, SAH %.1fms, SAH 4-wide %.1fms, SAH 8-wide %.1fms",
+           rayCount, hits[0], ms[0], ms[1], ms[2], ms[3]);
+
+    // Four-ray packets agree with single rays, including packets with inactive lanes.
+    for (uint32_t i = 0; i + 4 <= rayCount; i += 4) {
+      float tMax[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+      if (i % 20 == 0) tMax[2] = -1.f;
+      RayHit packetHits[4];
+      unsigned mask = intersectTriangles4(packetHits, sahParallel, vtx.data(), triVtxIx.data(), origins.data() + i, directions.data() + i, tMax);
+      for (unsigned k = 0; k < 4; k++) {
+        bool found = (mask & (1 << k)) != 0;
+        assert(found == (tMax[k] < 0.f ? false : referenceFound[i + k] != 0));
+        assert(!found || std::abs(packetHits[k].t - reference[i + k].t) <= 1e-5f * reference[i + k].t);
+      }
+    }
+
+    logger(0, "BVH build checks... OK");
+  }
+
+  {
+    logger(0, "CPU raycaster checks...");
+    Tasks tasks;
+    tasks.init(logger);
+
+    srand(10);
+    auto random = []() { return float(rand()) / RAND_MAX; };
+
+    const uint32_t triCount = 500;
+    Vector<Vec3f> vtx(3 * triCount);
+    Vector<uint32_t> triVtxIx(3 * triCount);
+    for (uint32_t i = 0; i < triCount; i++) {
+      Vec3f c(2.f * random() - 1.f, 2.f * random() - 1.f, 2.f * random() - 1.f);
+      for (unsigned k = 0; k < 3; k++) {
+        vtx[3 * i + k] = c + Vec3f(0.3f * random() - 0.15f, 0.3f * random() - 0.15f, 0.3f * random() - 0.15f);
+        triVtxIx[3 * i + k] = 3 * i + k;
+      }
+    }
+    Mesh mesh;
+    mesh.vtx = vtx.data();
+    mesh.vtxCount = vtx.size32();
+    mesh.triVtxIx = triVtxIx.data();
+    mesh.triCount = triCount;
+    mesh.bbox = boundingBox(mesh.vtx, nullptr, mesh.vtxCount);
+    orientedBoundingBox(mesh.obb, mesh.vtx, mesh.vtxCount);
+    Vector<Mesh*> meshes;
+    meshes.pushBack(&mesh);
+
+    // Odd size so that tiles and packets stick out of the image.
+    const uint32_t w = 67;
+    const uint32_t h = 45;
+    Viewer viewer;
+    viewer.resize(Vec2f(0.f), Vec2f(float(w), float(h)));
+    viewer.setViewVolume(mesh.bbox);
+    viewer.viewAll();
+    viewer.update();
+    const auto & PM = viewer.getProjectionViewMatrix();
+    const auto & PMinv = viewer.getProjectionViewInverseMatrix();
+    Mat3f Ninv(viewer.getViewInverseMatrix());
+
+    // Triangle indices match picking through the same pixels.
+    CpuRaycaster raycaster(logger, &tasks);
+    raycaster.update(meshes);
+    raycaster.shading = CpuRaycaster::Shading::TriangleIndex;
+    Vector<uint32_t> image(w * h);
+    raycaster.draw(image.data(), w, h, Ninv, PMinv);
+
+    HitTmp tmp;
+    uint32_t hits = 0;
+    uint32_t mismatches = 0;
+    for (uint32_t y = 0; y < h; y++) {
+      for (uint32_t x = 0; x < w; x++) {
+        auto pixel = image[w * y + x];
+        Hit hit;
+        if (nearestHit(hit, tmp, logger, nullptr, meshes, PM, PMinv, Vec2f(0.f), Vec2f(float(w), float(h)), Vec2f(float(x), float(y)))) {
+          hits++;
+          uint32_t triangle = ((pixel & 0xff) << 16) | (pixel & 0xff00) | ((pixel >> 16) & 0xff);
+          if ((pixel >> 24) != 0xff || triangle != hit.triangle) mismatches++;
+        }
+        else if (pixel != 0) mismatches++;
+      }
+    }
+    assert(hits && mismatches <= w * h / 200);
+
+    // Path tracing gives the same image serially and on tasks, and the sky shows around the mesh.
+    CpuRaycaster serial(logger, nullptr);
+    serial.update(meshes);
+    serial.samples = raycaster.samples = 4;
+    raycaster.shading = CpuRaycaster::Shading::PathTraced;
+    Vector<uint32_t> traced(w * h);
+    Vector<uint32_t> tracedSerial(w * h);
+    auto start = std::chrono::high_resolution_clock::now();
+    raycaster.draw(traced.data(), w, h, Ninv, PMinv);
+    auto stop = std::chrono::high_resolution_clock::now();
+    serial.draw(tracedSerial.data(), w, h, Ninv, PMinv);
+    logger(0, "Path traced %ux%u pixels with %u samples in %.1fms", w, h, raycaster.samples,
+           std::chrono::duration<double, std::milli>(stop - start).count());
+    for (uint32_t i = 0; i < w * h; i++) {
+      assert(traced[i] == tracedSerial[i]);
+      if (image[i] == 0) assert(traced[i] & 0xff0000);
+    }
+
+    // Moved geometry is picked up by update.
+    for (auto & p : vtx) p.x += 100.f;
+    mesh.touchGeometry();
+    raycaster.update(meshes);
+    raycaster.shading = CpuRaycaster::Shading::TriangleIndex;
+    raycaster.draw(image.data(), w, h, Ninv, PMinv);
+    for (auto pixel : image) assert(pixel == 0);
+
+    logger(0, "CPU raycaster checks... OK");
+  }
+
+  {
+    logger(0, "Vertex cache simulator checks...");
+
+    // Straightforward reference caches.
+    auto referenceFifo = [](const Vector<uint32_t>& indices, uint32_t size)
+    {
+      std::list<uint32_t> cache;
+      uint32_t misses = 0;
+      for (auto ix : indices) {
+        if (std::find(cache.begin(), cache.end(), ix) != cache.end()) continue;
+        misses++;
+        cache.push_front(ix);
+        if (size < cache.size()) cache.pop_back();
+      }
+      return (3.f * misses) / indices.size();
+    };
+    auto referenceLru = [](const Vector<uint32_t>& indices, uint32_t size)
+    {
+      std::list<uint32_t> cache;
+      uint32_t misses = 0;
+      for (auto ix : indices) {
+        auto it = std::find(cache.begin(), cache.end(), ix);
+        if (it != cache.end()) cache.erase(it);
+        else misses++;
+        cache.push_front(ix);
+        if (size < cache.size()) cache.pop_back();
+      }
+      return (3.f * misses) / indices.size();
+    };
+
+    std::mt19937 g(7);
+    Vector<uint32_t> indices;
+    for (uint32_t i = 0; i < 3 * 20000; i++) {
+      // Mostly local references with some jumps.
+      indices.pushBack((i / 2 + (g() % 24) + ((g() % 16) == 0 ? g() % 5000 : 0)) % 40000);
+    }
+    VertexCacheConfig caches[] = {
+      { VertexCacheModel::FIFO, 16 },
+      { VertexCacheModel::FIFO, 32 },
+      { VertexCacheModel::LRU, 7 },
+      { VertexCacheModel::LRU, 32 },
+      { VertexCacheModel::Batch, 32 }
+    };
+    simulateVertexCaches(caches, 5, indices.data(), indices.size32());
+    assert(caches[0].acmr == referenceFifo(indices, 16));
+    assert(caches[1].acmr == referenceFifo(indices, 32));
+    assert(caches[2].acmr == referenceLru(indices, 7));
+    assert(caches[3].acmr == referenceLru(indices, 32));
+    logger(0, "FIFO16=%.3f FIFO32=%.3f LRU7=%.3f LRU32=%.3f BATCH32=%.3f",
+           caches[0].acmr, caches[1].acmr, caches[2].acmr, caches[3].acmr, caches[4].acmr);
+
+    // LRU cost is independent of size, so large caches work too.
+    VertexCacheConfig lru[] = { { VertexCacheModel::LRU, 1 }, { VertexCacheModel::LRU, 300 } };
+    simulateVertexCaches(lru, 2, indices.data(), indices.size32());
+    assert(lru[0].acmr == referenceLru(indices, 1));
+    assert(lru[1].acmr == referenceLru(indices, 300));
+
+    // Batches: a strip of quads shares two vertices between consecutive
+    // triangles, so a batch of 32 vertices holds 30 triangles and shades each
+    // pair of shared vertices twice per batch boundary.
+    Vector<uint32_t> strip;
+    for (uint32_t i = 0; i < 300; i++) {
+      strip.pushBack(i); strip.pushBack(i + 1); strip.pushBack(i + 2);
+    }
+    VertexCacheConfig batch = { VertexCacheModel::Batch, 32 };
+    simulateVertexCaches(&batch, 1, strip.data(), strip.size32());
+    assert(batch.acmr == (3.f * (302 + 2 * 9)) / strip.size32());
+
+#ifdef NDEBUG
+    const uint32_t N = 3 * 33333333;
+#else
+    const uint32_t N = 3 * 333333;
+#endif
+    Vector<uint32_t> large(N);
+    for (uint32_t i = 0; i < N; i++) large[i] = (i / 2 + (i * 2654435761u >> 28)) & 0xFFFFFF;
+    auto start = std::chrono::high_resolution_clock::now();
+    simulateVertexCaches(caches, 5, large.data(), N);
+    auto stop = std::chrono::high_resolution_clock::now();
+    logger(0, "Simulated %d indices through 5 caches in %lldms",
+           N, std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
+
+    logger(0, "Vertex cache simulator checks... OK");
+  }
+
+  {
+    logger(0, "Partitioned vertex cache optimisation checks...");
+
+    Tasks tasks;
+    tasks.init(logger);
+
+    // Grid with shuffled triangles, large enough to span several clusters.
+    const uint32_t n = 300;
+    Vector<Vec3f> P;
+    for (uint32_t j = 0; j <= n; j++) {
+      for (uint32_t i = 0; i <= n; i++) P.pushBack(Vec3f(float(i), float(j), 0.f));
+    }
+    Vector<uint32_t> triangles;
+    for (uint32_t j = 0; j < n; j++) {
+      for (uint32_t i = 0; i < n; i++) {
+        auto a = (n + 1) * j + i;
+        uint32_t quad[6] = { a, a + 1, a + n + 2, a, a + n + 2, a + n + 1 };
+        for (auto ix : quad) triangles.pushBack(ix);
+      }
+    }
+    const uint32_t N = triangles.size32();
+    srand(42);
+    for (uint32_t t = N / 3 - 1; 0 < t; t--) {
+      auto s = uint32_t((uint64_t(rand()) * RAND_MAX + rand()) % (t + 1));
+      for (uint32_t k = 0; k < 3; k++) std::swap(triangles[3 * t + k], triangles[3 * s + k]);
+    }
+
+    Vector<uint32_t> serial(N);
+    Vector<uint32_t> partitioned(N);
+    linearSpeedVertexCacheOptimisation(logger, serial.data(), triangles.data(), N);
+    linearSpeedVertexCacheOptimisationPartitioned(logger, &tasks, partitioned.data(), triangles.data(), N, P[0].data, sizeof(Vec3f));
+
+    float fifo4, fifo8, fifo16, fifo32;
+    getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, triangles.data(), N);
+    logger(0, "Shuffled     AMCR FIFO4=%.3f, FIFO8=%.3f, FIFO16=%.3f, FIFO32=%.3f", fifo4, fifo8, fifo16, fifo32);
+    getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, serial.data(), N);
+    logger(0, "Serial       AMCR FIFO4=%.3f, FIFO8=%.3f, FIFO16=%.3f, FIFO32=%.3f", fifo4, fifo8, fifo16, fifo32);
+    auto serial32 = fifo32;
+    getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, partitioned.data(), N);
+    logger(0, "Partitioned  AMCR FIFO4=%.3f, FIFO8=%.3f, FIFO16=%.3f, FIFO32=%.3f", fifo4, fifo8, fifo16, fifo32);
+    assert(fifo32 < 1.05f * serial32);
+
+    // Same triangles, possibly in another order.
+    auto sortTriangles = [](Vector<uint32_t>& tris)
+    {
+      std::vector<uint64_t> keys;
+      for (uint32_t t = 0; t < tris.size32(); t += 3) {
+        auto * v = tris.data() + t;
+        auto m = std::min_element(v, v + 3) - v;
+        keys.push_back((uint64_t(v[m]) << 40) | (uint64_t(v[(m + 1) % 3]) << 20) | v[(m + 2) % 3]);
+      }
+      std::sort(keys.begin(), keys.end());
+      return keys;
+    };
+    assert(sortTriangles(triangles) == sortTriangles(partitioned));
+
+    logger(0, "Partitioned vertex cache optimisation checks... OK");
+  }
+
+  {
+    logger(0, "Index optimizer checks...");
+
+    // Three concentric spheres with the innermost first, the worst order for overdraw.
+    Vector<Vec3f> P;
+    Vector<uint32_t> triangles;
+    const uint32_t rings = 32;
+    const uint32_t segments = 64;
+    for (float r : { 0.6f, 0.8f, 1.f }) {
+      auto o = P.size32();
+      for (uint32_t j = 0; j <= rings; j++) {
+        auto theta = 3.14159265f * j / rings;
+        for (uint32_t i = 0; i <= segments; i++) {
+          auto phi = 2.f * 3.14159265f * i / segments;
+          P.pushBack(r * Vec3f(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)));
+        }
+      }
+      for (uint32_t j = 0; j < rings; j++) {
+        for (uint32_t i = 0; i < segments; i++) {
+          auto a = o + (segments + 1) * j + i;
+          auto b = a + segments + 1;
+          if (j != 0) { uint32_t t[3] = { a, b, a + 1 }; for (auto ix : t) triangles.pushBack(ix); }
+          if (j + 1 != rings) { uint32_t t[3] = { a + 1, b, b + 1 }; for (auto ix : t) triangles.pushBack(ix); }
+        }
+      }
+    }
+    const uint32_t N = triangles.size32();
+
+    auto sortTriangles = [](const uint32_t* tris, uint32_t N)
+    {
+      std::vector<uint64_t> keys;
+      for (uint32_t t = 0; t < N; t += 3) {
+        auto * v = tris + t;
+        auto m = std::min_element(v, v + 3) - v;
+        keys.push_back((uint64_t(v[m]) << 40) | (uint64_t(v[(m + 1) % 3]) << 20) | v[(m + 2) % 3]);
+      }
+      std::sort(keys.begin(), keys.end());
+      return keys;
+    };
+    auto reference = sortTriangles(triangles.data(), N);
+
+    auto inOverdraw = estimateOverdraw(triangles.data(), N, P[0].data, sizeof(Vec3f));
+    IndexOptimizer strategies[] = {
+      IndexOptimizer::None,
+      IndexOptimizer::Forsyth,
+      IndexOptimizer::ForsythPartitioned,
+      IndexOptimizer::Tipsify,
+      IndexOptimizer::TipsifyOverdraw
+    };
+    Vector<uint32_t> optimized(N);
+    for (auto strategy : strategies) {
+      optimizeIndices(logger, nullptr, optimized.data(), triangles.data(), N, P[0].data, sizeof(Vec3f), strategy);
+      assert(sortTriangles(optimized.data(), N) == reference);
+
+      Vector<uint32_t> origins;
+      Vector<uint8_t> used(N / 3, 0);
+      getTriangleOrigins(origins, optimized.data(), triangles.data(), N);
+      for (uint32_t t = 0; t < N / 3; t++) {
+        auto s = origins[t];
+        assert(!used[s]);
+        used[s] = 1;
+        for (unsigned k = 0; k < 3; k++) assert(optimized[3 * t + k] == triangles[3 * s + k]);
+      }
+
+      float fifo4, fifo8, fifo16, fifo32;
+      getAverageCacheMissRatioPerTriangle(fifo4, fifo8, fifo16, fifo32, optimized.data(), N);
+      auto overdraw = estimateOverdraw(optimized.data(), N, P[0].data, sizeof(Vec3f));
+      logger(0, "%-20s ACMR FIFO16=%.3f, overdraw=%.3f", getIndexOptimizerName(strategy), fifo16, overdraw);
+      if (strategy == IndexOptimizer::Tipsify) assert(fifo16 < 1.f);
+      if (strategy == IndexOptimizer::TipsifyOverdraw) assert(overdraw < inOverdraw);
+    }
+
+    // Scramble the vertex numbering and check that first-use renumbering
+    // restores locality without changing the triangles.
+    Vector<uint32_t> scramble(P.size());
+    for (uint32_t i = 0; i < P.size32(); i++) scramble[i] = i;
+    std::mt19937 g(42);
+    std::shuffle(scramble.begin(), scramble.end(), g);
+    Vector<Vec3f> scrambledP(P.size());
+    for (uint32_t i = 0; i < P.size32(); i++) scrambledP[scramble[i]] = P[i];
+    for (uint32_t i = 0; i < N; i++) optimized[i] = scramble[triangles[i]];
+
+    Vector<uint32_t> order;
+    Vector<uint32_t> fetchOptimized(N);
+    tipsify(logger, fetchOptimized.data(), optimized.data(), N, 16);
+    auto inOverfetch = getVertexFetchOverfetch(fetchOptimized.data(), N, 24);
+    optimizeVertexFetch(logger, order, fetchOptimized.data(), N, P.size32());
+    auto outOverfetch = getVertexFetchOverfetch(fetchOptimized.data(), N, 24);
+    logger(0, "Overfetch scrambled=%.2f, first-use=%.2f", inOverfetch, outOverfetch);
+    assert(order.size32() <= P.size32());
+    assert(outOverfetch < inOverfetch && outOverfetch < 1.5f);
+
+    Vector<uint32_t> unscramble(P.size());
+    for (uint32_t i = 0; i < P.size32(); i++) unscramble[scramble[i]] = i;
+    for (uint32_t i = 0; i < N; i++) fetchOptimized[i] = unscramble[order[fetchOptimized[i]]];
+    assert(sortTriangles(fetchOptimized.data(), N) == reference);
+
+    logger(0, "Index optimizer checks... OK");
+  }
+
+  {
+    logger(0, "Selection checks...");
+    Tasks tasks;
+    tasks.init(logger);
+
+    Selection a;
+    a.resize(70);
+    assert(a.words.size32() == 3 && !a.any());
+    a.setAll(true);
+    assert(a.popCount() == 70);
+    a.invert();
+    assert(!a.any());
+    for (uint32_t o = 0; o < 70; o += 3) a.set(o, true);
+    Selection b;
+    b.resize(70);
+    for (uint32_t o = 0; o < 70; o += 2) b.toggle(o);
+    Selection u(a);
+    u.unite(b);
+    assert(u.popCount() == 24 + 35 - 12);
+    Selection i(a);
+    i.intersect(b);
+    assert(i.popCount() == 12);
+    Selection c(a);
+    c.subtract(b);
+    assert(c.popCount() == 12 && c.get(3) && !c.get(6));
+    c.invert();
+    assert(c.popCount() == 58 && (c.words.back() >> 6) == 0);
+    c.resize(40);
+    assert(c.popCount() == 40 - 7 && (c.words.back() >> 8) == 0);
+    c.resize(100);
+    assert(c.popCount() == 40 - 7 && !c.get(40) && !c.get(99));
+
+    const char* names[] = { "Wall_north", "wall_south", "Door", "WINDOW_01", "window_02", nullptr };
+    Selection byName;
+    byName.resize(6);
+    assert(selectByName(byName, names, 6, "wall*") == 2 && byName.get(0) && byName.get(1));
+    assert(selectByName(byName, names, 6, "*_0?") == 2 && byName.get(3) && byName.get(4));
+    assert(selectByName(byName, names, 6, "*o*r*") == 2 && byName.get(2));
+    assert(selectByName(byName, names, 6, "door") == 1 && byName.popCount() == 5);
+    assert(selectByName(byName, names, 6, "*x") == 0);
+
+    // Every rule against a plain per-triangle evaluation, with a count that is not a multiple of eight.
+    const uint32_t triCount = 100003;
+    const uint32_t objectCount = 1001;
+    std::mt19937 g(7);
+    Vector<uint32_t> triObjIx(triCount);
+    Vector<uint32_t> triColors(triCount);
+    Vector<uint32_t> groups(triCount);
+    for (uint32_t t = 0; t < triCount; t++) {
+      triObjIx[t] = g() % objectCount;
+      triColors[t] = g();
+      groups[t] = t < 16 ? ~0u - t : g();
+    }
+    Selection selection;
+    selection.resize(objectCount);
+    for (uint32_t o = 0; o < objectCount; o++) selection.set(o, g() % 5 == 0);
+    uint32_t palette[48];
+    for (auto & p : palette) p = g();
+
+    TriangleColorRule rules[6];
+    rules[1].colors = triColors.data();
+    rules[2].palette = palette; rules[2].paletteSize = 48; rules[2].indices = triObjIx.data();
+    rules[3].palette = palette; rules[3].paletteSize = 48; rules[3].indices = groups.data();
+    rules[4].palette = palette; rules[4].paletteSize = 48; rules[4].shift = 8;
+    rules[5].palette = palette; rules[5].paletteSize = 37; rules[5].indices = groups.data(); rules[5].shift = 3;
+    Vector<uint32_t> out(triCount);
+    for (auto & rule : rules) {
+      auto start = std::chrono::high_resolution_clock::now();
+      evaluateTriangleColors(&tasks, out.data(), rule, triObjIx.data(), selection, triCount);
+      auto stop = std::chrono::high_resolution_clock::now();
+      for (uint32_t t = 0; t < triCount; t++) {
+        uint32_t expected = rule.color;
+        if (rule.colors) expected = rule.colors[t];
+        else if (rule.palette) expected = rule.palette[((rule.indices ? rule.indices[t] : t) >> rule.shift) % rule.paletteSize];
+        if (selection.get(triObjIx[t])) expected = rule.selectedColor;
+        assert(out[t] == expected);
+      }
+      logger(0, "Evaluated %u triangle colors in %.2fms", triCount, std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+
+    Selection single;
+    single.resize(1);
+    single.set(0, true);
+    evaluateTriangleColors(nullptr, out.data(), rules[0], nullptr, single, 13);
+    for (uint32_t t = 0; t < 13; t++) assert(out[t] == rules[0].selectedColor);
+
+    logger(0, "Selection checks... OK");
+  }
+
+  {
+    logger(0, "Async package checks...");
+    Tasks tasks;
+    tasks.init(logger);
+
+    AsyncPackage<uint32_t, Vector<uint32_t>> package;
+    assert(!package.pending());
+    uint32_t key = 0;
+    Vector<uint32_t> values;
+    assert(!package.take(key, values));
+
+    auto fill = [](Vector<uint32_t>& values, const uint32_t& key)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      values.resize(1000);
+      for (uint32_t i = 0; i < values.size32(); i++) values[i] = key * i;
+    };
+    package.start(&tasks, 3, fill);
+    assert(package.pending() && package.pendingKey() == 3);
+    while (!package.take(key, values)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    assert(!package.pending() && key == 3 && values.size32() == 1000 && values[999] == 3 * 999);
+
+    // A replaced job still runs to completion, only the newest package is handed out.
+    std::atomic<uint32_t> runs = 0;
+    auto count = [&runs, fill](Vector<uint32_t>& values, const uint32_t& key) { fill(values, key); runs++; };
+    package.start(&tasks, 4, count);
+    package.start(&tasks, 5, count);
+    while (!package.take(key, values)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    assert(key == 5 && values[1] == 5);
+
+    // Dropping a pending package leaves the job to finish on its own.
+    {
+      AsyncPackage<uint32_t, Vector<uint32_t>> dropped;
+      dropped.start(&tasks, 6, count);
+    }
+    tasks.waitAll();
+    assert(runs.load() == 3);
+
+    logger(0, "Async package checks... OK");
+  }
+
+  {
+    logger(0, "Mesh derived data checks...");
+    Tasks tasks;
+    tasks.init(logger);
+
+    // Grid of n x n quads in the xy-plane with a single normal and texture coordinates equal to positions.
+    const uint32_t n = 40;
+    Vector<Vec3f> gridVtx((n + 1) * (n + 1));
+    Vector<Vec2f> gridTex(gridVtx.size());
+    for (uint32_t j = 0; j <= n; j++) {
+      for (uint32_t i = 0; i <= n; i++) {
+        gridVtx[(n + 1) * j + i] = Vec3f(float(i), float(j), 0.f);
+        gridTex[(n + 1) * j + i] = Vec2f(float(i), float(j));
+      }
+    }
+    Vector<uint32_t> gridTris;
+    for (uint32_t j = 0; j < n; j++) {
+      for (uint32_t i = 0; i < n; i++) {
+        uint32_t a = (n + 1) * j + i;
+        uint32_t quad[6] = { a, a + 1, a + n + 2, a, a + n + 2, a + n + 1 };
+        for (auto q : quad) gridTris.pushBack(q);
+      }
+    }
+    Vector<uint32_t> gridNrmIx(gridTris.size(), 0);
+    Vec3f gridNrm(0.f, 0.f, 1.f);
+    Mesh grid;
+    grid.vtx = gridVtx.data();
+    grid.vtxCount = gridVtx.size32();
+    grid.nrm = &gridNrm;
+    grid.nrmCount = 1;
+    grid.tex = gridTex.data();
+    grid.texCount = gridTex.size32();
+    grid.triVtxIx = gridTris.data();
+    grid.triNrmIx = gridNrmIx.data();
+    grid.triTexIx = gridTris.data();
+    grid.triCount = gridTris.size32() / 3;
+
+    // Each optimized triangle has the corners of the triangle it stems from, and vertices come in first-use order.
+    auto checkIndexing = [](const MeshVertexIndexing& indexing, const Mesh& mesh)
+    {
+      assert(indexing.indices.size32() == 3 * mesh.triCount && indexing.triangles.size32() == mesh.triCount);
+      uint32_t next = 0;
+      for (uint32_t t = 0; t < mesh.triCount; t++) {
+        for (unsigned k = 0; k < 3; k++) {
+          auto v = indexing.indices[3 * t + k];
+          assert(v <= next);
+          if (v == next) next++;
+          auto corner = indexing.corners[v];
+          assert(mesh.triVtxIx[corner] == mesh.triVtxIx[3 * indexing.triangles[t] + k]);
+        }
+      }
+      assert(next == indexing.corners.size32());
+    };
+
+    MeshDerivedCache cache;
+    auto indexing = getVertexIndexing(cache, logger, &tasks, &grid, 0, IndexOptimizer::Forsyth);
+    assert(indexing->corners.size32() == gridVtx.size32());
+    checkIndexing(*indexing, grid);
+    assert(getVertexIndexing(cache, logger, &tasks, &grid, 0, IndexOptimizer::Forsyth) == indexing);
+
+    // Concurrent requests share one computation, and another optimizer replaces the old indexing.
+    Vector<const MeshVertexIndexing*> seen(64);
+    parallelFor(&tasks, seen.size32(), 1, [&](uint32_t begin, uint32_t end)
+    {
+      for (uint32_t i = begin; i < end; i++) seen[i] = getVertexIndexing(cache, logger, &tasks, &grid, 0, IndexOptimizer::Tipsify).get();
+    });
+    for (auto * p : seen) assert(p == seen[0] && p != indexing.get());
+    checkIndexing(*seen[0], grid);
+    assert(getVertexIndexing(cache, logger, &tasks, &grid, 0, IndexOptimizer::Forsyth) != indexing);
+    checkIndexing(*indexing, grid);
+
+    auto tangents = getTangents(cache, logger, &tasks, &grid);
+    assert(tangents->tangents.size32() == 3 * grid.triCount);
+    for (uint32_t i = 0; i < tangents->tangents.size32(); i++) {
+      assert(distanceSquared(tangents->tangents[i], Vec3f(1.f, 0.f, 0.f)) < 1e-6f);
+      assert(distanceSquared(tangents->binormals[i], Vec3f(0.f, 1.f, 0.f)) < 1e-6f);
+    }
+
+    // Without normals, every corner is a vertex.
+    Mesh cube;
+    initCubeMesh(cube);
+
+    auto cubeIndexing = getVertexIndexing(cache, logger, &tasks, &cube, 0, IndexOptimizer::Forsyth);
+    assert(cubeIndexing->corners.size32() == 36);
+    checkIndexing(*cubeIndexing, cube);
+
+    auto normals = getFaceNormals(cache, logger, &tasks, &cube, 0);
+    assert(normals->size32() == cube.triCount);
+    for (uint32_t t = 0; t < cube.triCount; t++) {
+      const auto & p0 = cubeVtx[cubeTris[3 * t + 0]];
+      const auto & p1 = cubeVtx[cubeTris[3 * t + 1]];
+      const auto & p2 = cubeVtx[cubeTris[3 * t + 2]];
+      assert(distanceSquared((*normals)[t], cross(p1 - p0, p2 - p0)) == 0.f);
+    }
+
+    Vector<uint32_t> edges, classes;
+    getClassifiedEdges(logger, &tasks, edges, classes, &cube, EdgeCrease | EdgeObjectBoundary, 0.5f);
+    auto cached = getClassifiedEdges(cache, logger, &tasks, &cube, EdgeCrease | EdgeObjectBoundary, 0.5f);
+    assert(cached->size32() == edges.size32());
+    for (uint32_t i = 0; i < edges.size32(); i++) assert((*cached)[i] == edges[i]);
+    assert(getClassifiedEdges(cache, logger, &tasks, &cube, EdgeCrease | EdgeObjectBoundary, 0.5f) == cached);
+    assert(getClassifiedEdges(cache, logger, &tasks, &cube, EdgeAll, 0.5f)->size32() == 2 * 18);
+
+    // A geometry change drops everything, results already handed out stay valid.
+    cube.touchGeometry();
+    assert(getFaceNormals(cache, logger, &tasks, &cube, 0) != normals);
+    assert(getVertexIndexing(cache, logger, &tasks, &cube, 0, IndexOptimizer::Forsyth) != cubeIndexing);
+    checkIndexing(*cubeIndexing, cube);
+    assert(getVertexIndexing(cache, logger, &tasks, &grid, 0, IndexOptimizer::Forsyth) == getVertexIndexing(cache, logger, &tasks, &grid, 0, IndexOptimizer::Forsyth));
+
+    logger(0, "Mesh derived data checks... OK");
+  }
+
   {
     logger(0, "KD-tree checks...");
 